@@ -0,0 +1,68 @@
+#include "ApiReply.h"
+
+void formatApiEtag(uint32_t bootId, uint32_t generation, char* out, size_t size) {
+    snprintf(out, size, "\"%08lx-%lu\"", (unsigned long)bootId, (unsigned long)generation);
+}
+
+bool parseApiSince(const char* text, uint32_t bootId, uint32_t& since) {
+    char* end;
+    unsigned long value = strtoul(text, &end, 16);
+    if (*end == '-') {
+        if (end == text || value != bootId) {
+            return false;
+        }
+        text = end + 1;
+    }
+    since = strtoul(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+// The header is a comma separated list of tags, each possibly weak (W/"...")
+bool apiEtagMatches(const char* ifNoneMatch, const char* etag) {
+    if (ifNoneMatch == nullptr) {
+        return false;
+    }
+    size_t etagLength = strlen(etag);
+    const char* p = ifNoneMatch;
+    while (*p) {
+        while (*p == ' ' || *p == ',') p++;
+        if (*p == '*') {
+            return true;
+        }
+        if (p[0] == 'W' && p[1] == '/') {
+            p += 2;
+        }
+        const char* end = p;
+        if (*end == '"') {
+            end = strchr(end + 1, '"');
+            end = end ? end + 1 : p + strlen(p);
+        } else {
+            while (*end && *end != ',' && *end != ' ') end++;
+        }
+        if ((size_t)(end - p) == etagLength && strncmp(p, etag, etagLength) == 0) {
+            return true;
+        }
+        p = end;
+        while (*p && *p != ',') p++;
+    }
+    return false;
+}
+
+ApiReply decideApiReply(uint32_t bootId, uint32_t generation, const char* ifNoneMatch, const char* since,
+                        uint8_t openLongPolls) {
+    if (since == nullptr) {
+        char etag[API_ETAG_SIZE];
+        formatApiEtag(bootId, generation, etag, sizeof(etag));
+        return apiEtagMatches(ifNoneMatch, etag) ? ApiReply::NOT_MODIFIED : ApiReply::NOW;
+    }
+    // A client that is already behind, or saw another boot, is answered straight away
+    uint32_t seen;
+    if (!parseApiSince(since, bootId, seen) || seen != generation) {
+        return ApiReply::NOW;
+    }
+    return openLongPolls >= API_LONG_POLL_MAX ? ApiReply::BUSY : ApiReply::WAIT;
+}
+
+bool apiLongPollWaiting(uint32_t generation, uint32_t since, unsigned long elapsed) {
+    return generation == since && elapsed < API_LONG_POLL_TIMEOUT;
+}
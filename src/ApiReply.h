@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Longest a ?since= request is held open waiting for a change
+#ifndef API_LONG_POLL_TIMEOUT
+#define API_LONG_POLL_TIMEOUT 25000
+#endif
+
+// Long-poll requests held open at once; more are answered with 503
+#ifndef API_LONG_POLL_MAX
+#define API_LONG_POLL_MAX 4
+#endif
+
+// Room for a quoted "<boot>-<generation>" ETag
+#define API_ETAG_SIZE 24
+
+// How a state API request is answered. Kept apart from the web server so
+// the conditional and long-poll rules can be tested on the host.
+enum class ApiReply : uint8_t {
+    NOT_MODIFIED, // 304 with the ETag and no body
+    NOW,          // 200 with the current state
+    WAIT,         // Held until the state changes or API_LONG_POLL_TIMEOUT
+    BUSY          // 503, too many long-polls open
+};
+
+// Writes the quoted ETag for a generation. Generations restart at every
+// boot, so the tag also carries a per-boot id and an old tag never matches.
+void formatApiEtag(uint32_t bootId, uint32_t generation, char* out, size_t size);
+
+// Reads ?since= as "<generation>" or "<boot>-<generation>", the ETag without
+// quotes. Returns false if it names another boot or is not a number.
+bool parseApiSince(const char* text, uint32_t bootId, uint32_t& since);
+
+// True if an If-None-Match value names etag, or is "*"
+bool apiEtagMatches(const char* ifNoneMatch, const char* etag);
+
+// since is the ?since= text, null for a plain request; ifNoneMatch may be
+// null. Long-polls ignore If-None-Match: ?since= already says what the
+// client has.
+ApiReply decideApiReply(uint32_t bootId, uint32_t generation, const char* ifNoneMatch, const char* since,
+                        uint8_t openLongPolls);
+
+// Whether a held request keeps waiting after elapsed ms
+bool apiLongPollWaiting(uint32_t generation, uint32_t since, unsigned long elapsed);
@@ -0,0 +1,169 @@
+#include "CommandDispatcher.h"
+#include "Config.h"
+
+// =================================================================
+// Command Table
+// =================================================================
+
+using CommandFunction = void (*)(ParadoxHandler& panel, uint8_t partition, const CommandRequest& request);
+
+struct PanelCommand {
+    const char* name;
+    CommandFunction run;
+};
+
+static void cmdArm(ParadoxHandler& panel, uint8_t partition, const CommandRequest& request) {
+    panel.arm(partition, 0x04, request);
+}
+static void cmdDisarm(ParadoxHandler& panel, uint8_t partition, const CommandRequest& request) {
+    panel.disarm(partition, 0x05, request);
+}
+static void cmdStay(ParadoxHandler& panel, uint8_t partition, const CommandRequest& request) {
+    panel.arm(partition, 0x01, request);
+}
+static void cmdSleep(ParadoxHandler& panel, uint8_t partition, const CommandRequest& request) {
+    panel.arm(partition, 0x03, request);
+}
+static void cmdStatus(ParadoxHandler& panel, uint8_t, const CommandRequest& request) {
+    panel.requestStatus(request);
+}
+static void cmdZoneStatus(ParadoxHandler& panel, uint8_t, const CommandRequest& request) {
+    panel.requestZoneStatus(request);
+}
+static void cmdPartitionStatus(ParadoxHandler& panel, uint8_t, const CommandRequest& request) {
+    panel.requestPartitionStatus(request);
+}
+static void cmdDisconnect(ParadoxHandler& panel, uint8_t, const CommandRequest& request) {
+    panel.disconnect(request);
+}
+static void cmdRefreshLabels(ParadoxHandler& panel, uint8_t, const CommandRequest& request) {
+    panel.refreshLabels(request);
+}
+
+static constexpr PanelCommand CMD_ARM = {"arm", cmdArm};
+static constexpr PanelCommand CMD_DISARM = {"disarm", cmdDisarm};
+static constexpr PanelCommand CMD_STAY = {"stay", cmdStay};
+static constexpr PanelCommand CMD_SLEEP = {"sleep", cmdSleep};
+static constexpr PanelCommand CMD_STATUS = {"status", cmdStatus};
+static constexpr PanelCommand CMD_ZONE_STATUS = {"status-getzones", cmdZoneStatus};
+static constexpr PanelCommand CMD_PARTITION_STATUS = {"status-getarmstatus", cmdPartitionStatus};
+static constexpr PanelCommand CMD_DISCONNECT = {"disconnect", cmdDisconnect};
+static constexpr PanelCommand CMD_REFRESH_LABELS = {"refresh-labels", cmdRefreshLabels};
+
+// The case labels are evaluated at compile time, and duplicate labels do not
+// compile, so a hash collision between two command names is caught at build time
+static const PanelCommand* findCommand(const char* name) {
+    const PanelCommand* command = nullptr;
+    switch (hashName(name)) {
+        case hashName(CMD_ARM.name): command = &CMD_ARM; break;
+        case hashName(CMD_DISARM.name): command = &CMD_DISARM; break;
+        case hashName(CMD_STAY.name): command = &CMD_STAY; break;
+        case hashName(CMD_SLEEP.name): command = &CMD_SLEEP; break;
+        case hashName(CMD_STATUS.name): command = &CMD_STATUS; break;
+        case hashName(CMD_ZONE_STATUS.name): command = &CMD_ZONE_STATUS; break;
+        case hashName(CMD_PARTITION_STATUS.name): command = &CMD_PARTITION_STATUS; break;
+        case hashName(CMD_DISCONNECT.name): command = &CMD_DISCONNECT; break;
+        case hashName(CMD_REFRESH_LABELS.name): command = &CMD_REFRESH_LABELS; break;
+        default: return nullptr;
+    }
+    // Reject unknown names that happen to share a hash
+    return strcasecmp(name, command->name) == 0 ? command : nullptr;
+}
+
+// =================================================================
+// Dispatcher
+// =================================================================
+
+CommandDispatcher::CommandDispatcher(MqttHandler& mqttHandler) : _mqttHandler(mqttHandler) {}
+
+bool CommandDispatcher::addRoute(const String& topic, TopicHandler handler) {
+    if (_routeCount >= COMMAND_MAX_ROUTES) {
+        DEBUG_PRINTF("[MQTT] Too many routes, ignoring %s\n", topic.c_str());
+        return false;
+    }
+    Route& route = _routes[_routeCount++];
+    route.hash = hashName(topic.c_str());
+    route.topic = topic;
+    route.handler = handler;
+    return true;
+}
+
+bool CommandDispatcher::addPanel(ParadoxHandler& panel) {
+    ParadoxHandler* target = &panel;
+    return addRoute(panel.getTopicPrefix() + "/commands", [this, target](char* payload, size_t length) {
+        handleCommandPayload(*target, payload, length);
+    });
+}
+
+bool CommandDispatcher::dispatch(const char* topic, byte* payload, unsigned int length) {
+    uint32_t hash = hashName(topic);
+    for (int i = 0; i < _routeCount; i++) {
+        if (_routes[i].hash == hash && strcmp(_routes[i].topic.c_str(), topic) == 0) {
+            _routes[i].handler((char*)payload, length);
+            return true;
+        }
+    }
+    return false;
+}
+
+void CommandDispatcher::handleCommandPayload(ParadoxHandler& panel, char* payload, size_t length) {
+    // A mutable char* input puts ArduinoJson in zero-copy mode: strings are
+    // terminated inside the payload buffer instead of being copied
+    StaticJsonDocument<COMMAND_JSON_CAPACITY> doc;
+    DeserializationError error = deserializeJson(doc, payload, length);
+
+    if (error) {
+        DEBUG_PRINTF("[MQTT] deserializeJson() failed: %s\n", error.c_str());
+        return;
+    }
+
+    // A batch is an array of command objects, handled in order
+    if (doc.is<JsonArray>()) {
+        for (JsonVariant item : doc.as<JsonArray>()) {
+            handleCommand(panel, item.as<JsonObjectConst>());
+        }
+    } else {
+        handleCommand(panel, doc.as<JsonObjectConst>());
+    }
+}
+
+void CommandDispatcher::handleCommand(ParadoxHandler& panel, JsonObjectConst command) {
+    if (command.containsKey("password")) {
+        const char* password = command["password"];
+        panel.setPassword(password);
+        DEBUG_PRINTLN("[MQTT] Password updated from payload.");
+    }
+
+    uint8_t partition = command["partition"] | 0;
+
+    if (command.containsKey("encoding")) {
+        PayloadEncoding encoding;
+        if (parsePayloadEncoding(command["encoding"], encoding)) {
+            _mqttHandler.setPayloadEncoding(encoding);
+        } else {
+            DEBUG_PRINTLN("[MQTT] Unknown payload encoding in payload.");
+        }
+    }
+
+    const char* name = command["command"];
+    if (name == nullptr) {
+        return;
+    }
+
+    // Ids may be strings or numbers; either way they are echoed back as a string
+    char idBuffer[PARADOX_COMMAND_ID_SIZE];
+    const char* id = command["id"];
+    if (id == nullptr && command["id"].is<long>()) {
+        snprintf(idBuffer, sizeof(idBuffer), "%ld", command["id"].as<long>());
+        id = idBuffer;
+    }
+
+    DEBUG_PRINTF("[MQTT] Processing command for panel %u: %s\n", panel.getPanelId(), name);
+    const PanelCommand* entry = findCommand(name);
+    if (entry) {
+        entry->run(panel, partition, CommandRequest(id, entry->name, command["force"] | false));
+    } else {
+        DEBUG_PRINTF("[MQTT] Unknown command: %s\n", name);
+        panel.rejectCommand(CommandRequest(id, name));
+    }
+}
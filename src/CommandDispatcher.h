@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include "ParadoxHandler.h"
+#include "MqttHandler.h"
+
+#ifndef COMMAND_MAX_ROUTES
+#define COMMAND_MAX_ROUTES 8
+#endif
+
+// Capacity of the per-message JSON document. Strings are parsed in place, so
+// this only has to hold the object/array slots of a batch.
+#ifndef COMMAND_JSON_CAPACITY
+#define COMMAND_JSON_CAPACITY 512
+#endif
+
+constexpr char toLowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+// Case-insensitive FNV-1a. constexpr so command names are hashed at compile time.
+constexpr uint32_t hashName(const char* s, uint32_t hash = 2166136261u) {
+    return *s == '\0' ? hash : hashName(s + 1, (hash ^ (uint8_t)toLowerAscii(*s)) * 16777619u);
+}
+
+// Handles one received payload. The payload is not null-terminated and may be
+// modified in place.
+using TopicHandler = std::function<void(char* payload, size_t length)>;
+
+class CommandDispatcher {
+public:
+    explicit CommandDispatcher(MqttHandler& mqttHandler);
+
+    // Routes are matched by precomputed topic hash, then confirmed with strcmp
+    bool addRoute(const String& topic, TopicHandler handler);
+
+    // Routes <panel topic prefix>/commands to the command table
+    bool addPanel(ParadoxHandler& panel);
+
+    // Returns false if no route matches the topic
+    bool dispatch(const char* topic, byte* payload, unsigned int length);
+
+private:
+    struct Route {
+        uint32_t hash;
+        String topic;
+        TopicHandler handler;
+    };
+
+    MqttHandler& _mqttHandler;
+    Route _routes[COMMAND_MAX_ROUTES];
+    int _routeCount = 0;
+
+    void handleCommandPayload(ParadoxHandler& panel, char* payload, size_t length);
+    void handleCommand(ParadoxHandler& panel, JsonObjectConst command);
+};
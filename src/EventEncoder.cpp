@@ -0,0 +1,91 @@
+#include "EventEncoder.h"
+
+static void writeUint32BE(uint8_t* out, uint32_t value) {
+    out[0] = (value >> 24) & 0xFF;
+    out[1] = (value >> 16) & 0xFF;
+    out[2] = (value >> 8) & 0xFF;
+    out[3] = value & 0xFF;
+}
+
+// Writes a CBOR unsigned integer (major type 0) using the shortest form
+static size_t writeCborUint(uint8_t* out, uint32_t value) {
+    if (value < 24) {
+        out[0] = value;
+        return 1;
+    }
+    if (value <= 0xFF) {
+        out[0] = 0x18;
+        out[1] = value;
+        return 2;
+    }
+    if (value <= 0xFFFF) {
+        out[0] = 0x19;
+        out[1] = value >> 8;
+        out[2] = value & 0xFF;
+        return 3;
+    }
+    out[0] = 0x1A;
+    writeUint32BE(&out[1], value);
+    return 5;
+}
+
+size_t encodeEvent(PayloadEncoding encoding, const ParadoxEvent& event, uint8_t* out, size_t outLen,
+                   const char* label) {
+    switch (encoding) {
+        case PayloadEncoding::BINARY: {
+            // [event][sub_event][partition][timestamp:4][sequence:4]
+            if (outLen < EVENT_BINARY_RECORD_SIZE) return 0;
+            out[0] = event.event;
+            out[1] = event.subEvent;
+            out[2] = event.partition;
+            writeUint32BE(&out[3], event.timestamp);
+            writeUint32BE(&out[7], event.sequence);
+            return EVENT_BINARY_RECORD_SIZE;
+        }
+        case PayloadEncoding::CBOR: {
+            // Worst case: array header + 3 x 2-byte + 2 x 5-byte items
+            if (outLen < 1 + 3 * 2 + 2 * 5) return 0;
+            size_t len = 0;
+            out[len++] = 0x85; // Array of 5 items
+            len += writeCborUint(&out[len], event.event);
+            len += writeCborUint(&out[len], event.subEvent);
+            len += writeCborUint(&out[len], event.partition);
+            len += writeCborUint(&out[len], event.timestamp);
+            len += writeCborUint(&out[len], event.sequence);
+            return len;
+        }
+        case PayloadEncoding::JSON:
+        default: {
+            // "value" stays a string for existing Home Assistant templates
+            int len = snprintf((char*)out, outLen, "{\"value\":\"%u\",\"seq\":%lu%s%s%s%s}",
+                               event.subEvent, (unsigned long)event.sequence,
+                               label ? ",\"label\":\"" : "", label ? label : "", label ? "\"" : "",
+                               event.historical ? ",\"historical\":true" : "");
+            if (len < 0 || (size_t)len >= outLen) return 0;
+            return len;
+        }
+    }
+}
+
+const char* getPayloadEncodingName(PayloadEncoding encoding) {
+    switch (encoding) {
+        case PayloadEncoding::BINARY: return "binary";
+        case PayloadEncoding::CBOR:   return "cbor";
+        case PayloadEncoding::JSON:
+        default:                      return "json";
+    }
+}
+
+bool parsePayloadEncoding(const char* name, PayloadEncoding& encoding) {
+    if (name == nullptr) return false;
+    if (strcasecmp(name, "json") == 0) {
+        encoding = PayloadEncoding::JSON;
+    } else if (strcasecmp(name, "binary") == 0) {
+        encoding = PayloadEncoding::BINARY;
+    } else if (strcasecmp(name, "cbor") == 0) {
+        encoding = PayloadEncoding::CBOR;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ParadoxEvents.h"
+
+// Bumped whenever the layout of any encoding below changes.
+// Published in paradox/__status__ so consumers can pick a decoder.
+#define EVENT_ENCODING_VERSION 2
+
+// Default encoding for paradox/events/<n> payloads
+#ifndef MQTT_PAYLOAD_ENCODING
+#define MQTT_PAYLOAD_ENCODING PayloadEncoding::JSON
+#endif
+
+// Size of the fixed binary record, see encodeEvent()
+#define EVENT_BINARY_RECORD_SIZE 11
+
+// Large enough for any encoding of a single event, label included
+#define EVENT_PAYLOAD_MAX_SIZE 96
+
+enum class PayloadEncoding : uint8_t {
+    JSON,   // Legacy {"value":"<sub_event>","seq":<sequence>}, plus "label" when known
+            // and "historical":true for events read back from the panel log
+    BINARY, // Fixed 11-byte big-endian record
+    CBOR    // CBOR array [event, sub_event, partition, timestamp, sequence]
+};
+
+// Encodes the event into out and returns the number of bytes written,
+// or 0 if the buffer is too small. JSON output is null-terminated. label is
+// the panel's name for the zone, partition or user, added to JSON only; it
+// must not need escaping.
+size_t encodeEvent(PayloadEncoding encoding, const ParadoxEvent& event, uint8_t* out, size_t outLen,
+                   const char* label = nullptr);
+
+const char* getPayloadEncodingName(PayloadEncoding encoding);
+bool parsePayloadEncoding(const char* name, PayloadEncoding& encoding);
@@ -0,0 +1,80 @@
+#include "EventJournal.h"
+#include "Config.h"
+#include <Preferences.h>
+
+#define JOURNAL_RTC_MAGIC 0x5EC0E7A1
+
+// RTC slow memory survives soft resets (OTA, crash, ESP.restart()), so the
+// sequence continues without a gap. After a power cut we fall back to the
+// batch bound in NVS, which skips ahead but never reuses a number.
+RTC_NOINIT_ATTR static uint32_t rtcMagic;
+RTC_NOINIT_ATTR static uint32_t rtcNextSequence;
+RTC_NOINIT_ATTR static uint32_t rtcReservedUntil;
+
+void EventJournal::setup() {
+    if (rtcMagic == JOURNAL_RTC_MAGIC && rtcNextSequence <= rtcReservedUntil) {
+        _nextSequence = rtcNextSequence;
+        _reservedUntil = rtcReservedUntil;
+        DEBUG_PRINTF("[Journal] Resuming sequence at %u from RTC memory.\n", _nextSequence);
+    } else {
+        Preferences prefs;
+        prefs.begin("journal", true);
+        _nextSequence = prefs.getUInt("seq", 1);
+        prefs.end();
+        _reservedUntil = _nextSequence;
+        DEBUG_PRINTF("[Journal] Resuming sequence at %u from NVS.\n", _nextSequence);
+    }
+
+    if (_nextSequence >= _reservedUntil) {
+        reserveSequenceBatch();
+    }
+    rtcMagic = JOURNAL_RTC_MAGIC;
+    rtcNextSequence = _nextSequence;
+    rtcReservedUntil = _reservedUntil;
+}
+
+void EventJournal::reserveSequenceBatch() {
+    _reservedUntil = _nextSequence + JOURNAL_SEQUENCE_BATCH;
+    Preferences prefs;
+    prefs.begin("journal", false);
+    prefs.putUInt("seq", _reservedUntil);
+    prefs.end();
+    rtcReservedUntil = _reservedUntil;
+    DEBUG_PRINTF("[Journal] Reserved sequence numbers up to %u.\n", _reservedUntil);
+}
+
+void EventJournal::record(ParadoxEvent& event) {
+    if (_nextSequence >= _reservedUntil) {
+        reserveSequenceBatch();
+    }
+    event.sequence = _nextSequence++;
+    rtcNextSequence = _nextSequence;
+
+    _ring[_head] = event;
+    _head = (_head + 1) % JOURNAL_RING_SIZE;
+    if (_count < JOURNAL_RING_SIZE) {
+        _count++;
+    }
+}
+
+uint32_t EventJournal::getOldestSequence() const {
+    if (_count == 0) return _nextSequence;
+    size_t tail = (_head + JOURNAL_RING_SIZE - _count) % JOURNAL_RING_SIZE;
+    return _ring[tail].sequence;
+}
+
+bool EventJournal::clampRange(uint32_t& from, uint32_t& to) const {
+    if (_count == 0 || from > to) return false;
+
+    uint32_t oldest = getOldestSequence();
+    uint32_t newest = _nextSequence - 1;
+    if (from < oldest) from = oldest;
+    if (to > newest) to = newest;
+    return from <= to;
+}
+
+// The ring holds consecutive sequence numbers, so the slot is a direct offset
+const ParadoxEvent& EventJournal::at(uint32_t sequence) const {
+    size_t tail = (_head + JOURNAL_RING_SIZE - _count) % JOURNAL_RING_SIZE;
+    return _ring[(tail + (sequence - getOldestSequence())) % JOURNAL_RING_SIZE];
+}
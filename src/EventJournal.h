@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ParadoxEvents.h"
+
+// Number of recent events kept in RAM for replay requests
+#ifndef JOURNAL_RING_SIZE
+#define JOURNAL_RING_SIZE 128
+#endif
+
+// Sequence numbers are reserved in NVS this many at a time, so flash is
+// written once per batch rather than once per event
+#ifndef JOURNAL_SEQUENCE_BATCH
+#define JOURNAL_SEQUENCE_BATCH 1000
+#endif
+
+class EventJournal {
+public:
+    void setup();
+
+    // Assigns the next sequence number to the event and stores it in the ring
+    void record(ParadoxEvent& event);
+
+    // Replays stored events with from <= sequence <= to, oldest first.
+    // Returns the number of events handed to the callback. Any callable is
+    // taken as is, so a capturing lambda costs no heap allocation per pass.
+    template <typename Callback>
+    size_t replay(uint32_t from, uint32_t to, Callback callback) const {
+        if (!clampRange(from, to)) return 0;
+        for (uint32_t seq = from; seq <= to; seq++) {
+            callback(at(seq));
+        }
+        return to - from + 1;
+    }
+
+    uint32_t getLastSequence() const { return _nextSequence - 1; }
+    uint32_t getOldestSequence() const;
+
+private:
+    ParadoxEvent _ring[JOURNAL_RING_SIZE];
+    size_t _head = 0;  // Next slot to write
+    size_t _count = 0;
+    uint32_t _nextSequence = 1;
+    uint32_t _reservedUntil = 0; // First sequence number not yet reserved in NVS
+
+    void reserveSequenceBatch();
+    // Narrows [from, to] to the stored events; false when none are left
+    bool clampRange(uint32_t& from, uint32_t& to) const;
+    const ParadoxEvent& at(uint32_t sequence) const;
+};
@@ -0,0 +1,72 @@
+#include "FrameDecoder.h"
+
+bool FrameDecoder::push(uint8_t value) {
+    _window[(_start + _count) % PARADOX_FRAME_SIZE] = value;
+    _count++;
+    _sum += value;
+    if (_count < PARADOX_FRAME_SIZE) {
+        return false;
+    }
+
+    // Window is full and the newest byte is the candidate checksum over the rest
+    uint8_t first = _window[_start];
+    if ((uint8_t)(_sum - value) == value && isPlausibleFrame()) {
+        for (int i = 0; i < PARADOX_FRAME_SIZE; i++) {
+            _frame[i] = _window[(_start + i) % PARADOX_FRAME_SIZE];
+        }
+        _start = 0;
+        _count = 0;
+        _sum = 0;
+        _inSync = true;
+        _framesDecoded++;
+        return true;
+    }
+
+    // Not a frame boundary: drop the oldest byte and try again on the next one
+    if (_inSync) {
+        _inSync = false;
+        _resyncs++;
+    }
+    _sum -= first;
+    _start = (_start + 1) % PARADOX_FRAME_SIZE;
+    _count--;
+    _bytesDiscarded++;
+    return false;
+}
+
+void FrameDecoder::reset() {
+    _start = 0;
+    _count = 0;
+    _sum = 0;
+    _inSync = true;
+}
+
+// Message types the panel sends: login replies (0x0X, 0x10), command replies
+// (0x4X, 0x5X), disconnect (0x70) and events (0xEX). Replies only count while
+// one is expected; events are checked field by field since they can arrive at
+// any time.
+bool FrameDecoder::isPlausibleFrame() const {
+    uint8_t first = at(0);
+    switch (first & 0xF0) {
+        case 0x00:
+        case 0x10:
+        case 0x40:
+        case 0x50:
+            return _repliesExpected;
+        case 0x70:
+            // Disconnect carries a reason code in byte 2; the rest up to the source id is padding
+            if (first != 0x70) return false;
+            for (uint8_t i = 3; i < 32; i++) {
+                if (at(i) != 0) return false;
+            }
+            return true;
+        case 0xE0:
+            // Date the panel stamped the event with, then the event group and partition
+            return at(1) >= 20 && at(1) <= 21 && at(2) <= 99 &&
+                   at(3) >= 1 && at(3) <= 12 && at(4) >= 1 && at(4) <= 31 &&
+                   at(5) <= 23 && at(6) <= 59 &&
+                   at(7) <= PARADOX_MAX_EVENT_GROUP && at(9) <= PARADOX_MAX_PARTITION;
+        default:
+            return false;
+    }
+}
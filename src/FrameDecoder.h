@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PARADOX_FRAME_SIZE 37
+
+// Highest event group and partition number an event frame can carry
+#define PARADOX_MAX_EVENT_GROUP 64
+#define PARADOX_MAX_PARTITION 8
+
+// Splits the panel's byte stream into checksummed 37-byte frames. Bytes sit
+// in a sliding window with a running sum, so after corruption the decoder
+// resyncs on the next valid frame at constant cost per byte. A one-byte
+// checksum alone matches one window in 256 of line noise, so a window is only
+// taken as a frame when its contents are plausible too: event frames need a
+// valid date and event group, and replies are only accepted while the
+// handler is waiting for one.
+// Free of Arduino dependencies so it can be exercised on a host.
+class FrameDecoder {
+public:
+    // Returns true when the byte completes a valid frame, then read frame()
+    bool push(uint8_t value);
+    const uint8_t* frame() const { return _frame; }
+    // Bytes held towards the next frame, always less than a full frame
+    size_t size() const { return _count; }
+    void reset();
+    // Set while a command, login step or memory read is waiting for the panel
+    void setRepliesExpected(bool expected) { _repliesExpected = expected; }
+
+    uint32_t getFramesDecoded() const { return _framesDecoded; }
+    uint32_t getResyncs() const { return _resyncs; }
+    uint32_t getBytesDiscarded() const { return _bytesDiscarded; }
+
+private:
+    uint8_t _window[PARADOX_FRAME_SIZE];
+    uint8_t _frame[PARADOX_FRAME_SIZE];
+    uint8_t _start = 0; // Oldest byte in _window
+    uint8_t _count = 0;
+    uint32_t _sum = 0;  // Sum of the bytes in _window
+    bool _inSync = true;
+    bool _repliesExpected = false;
+
+    uint32_t _framesDecoded = 0;
+    uint32_t _resyncs = 0;
+    uint32_t _bytesDiscarded = 0;
+
+    uint8_t at(uint8_t index) const { return _window[(_start + index) % PARADOX_FRAME_SIZE]; }
+    bool isPlausibleFrame() const;
+};
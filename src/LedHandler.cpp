@@ -1,72 +1,146 @@
 #include "LedHandler.h"
 #include "Config.h"
 
-#define BLINK_INTERVAL_FAST 250
-#define BLINK_INTERVAL_SLOW 1000
-#define FLICKER_DURATION 50
+// Indexed by LedMode. FLICKER is an overlay on the current pattern, see flicker().
+static constexpr LedPattern LED_PATTERNS[] = {
+    /* OFF */             {0, false, {}},
+    /* ON */              {0, true, {}},
+    /* BLINK_SLOW */      {2, false, {1000, 1000}},
+    /* BLINK_FAST */      {2, false, {250, 250}},
+    /* FLICKER */         {0, false, {}},
+    /* ALARM */           {6, false, {100, 100, 100, 100, 100, 700}},
+    /* PANEL_LINK_DOWN */ {4, false, {100, 200, 100, 1600}},
+    /* JOURNAL_BACKLOG */ {2, false, {50, 950}},
+};
+
+static_assert(sizeof(LED_PATTERNS) / sizeof(LED_PATTERNS[0]) == static_cast<size_t>(LedMode::JOURNAL_BACKLOG) + 1,
+              "LED_PATTERNS must have an entry for every LedMode");
+
+const LedPattern& getLedPattern(LedMode mode) {
+    return LED_PATTERNS[static_cast<uint8_t>(mode)];
+}
+
+LedMode selectLedMode(const LedStatus& status) {
+    if (status.resetInProgress) return LedMode::BLINK_FAST;
+    if (status.alarmActive) return LedMode::ALARM;
+    if (status.panelLinkDown) return LedMode::PANEL_LINK_DOWN;
+    if (!status.wifiConnected) return LedMode::BLINK_FAST;
+    if (status.journalBacklog) return LedMode::JOURNAL_BACKLOG;
+    if (!status.mqttConnected) return LedMode::BLINK_SLOW;
+    return LedMode::ON;
+}
+
+// =================================================================
+// LedSequencer
+// =================================================================
+
+void LedSequencer::start(const LedPattern& pattern) {
+    _pattern = &pattern;
+    _step = 0;
+}
+
+bool LedSequencer::level() const {
+    if (_pattern == nullptr) return false;
+    if (_pattern->stepCount == 0) return _pattern->level;
+    return (_step % 2) == 0; // Even steps are ON
+}
+
+uint16_t LedSequencer::duration() const {
+    if (_pattern == nullptr || _pattern->stepCount == 0) return 0;
+    return _pattern->steps[_step];
+}
+
+void LedSequencer::advance() {
+    if (_pattern == nullptr || _pattern->stepCount == 0) return;
+    _step = (_step + 1) % _pattern->stepCount;
+}
+
+// =================================================================
+// LedHandler
+// =================================================================
 
 LedHandler::LedHandler(uint8_t pin) : _pin(pin) {}
 
 void LedHandler::setup() {
     pinMode(_pin, OUTPUT);
     digitalWrite(_pin, LOW);
+    _sequencer.start(getLedPattern(LedMode::OFF));
+
+    esp_timer_create_args_t args = {};
+    args.callback = &LedHandler::onTimer;
+    args.arg = this;
+    args.name = "led";
+    esp_timer_create(&args, &_timer);
+    args.callback = &LedHandler::onFlickerTimer;
+    args.name = "led-flicker";
+    esp_timer_create(&args, &_flickerTimer);
     DEBUG_PRINTLN("[LED] Handler initialized.");
 }
 
 void LedHandler::setMode(LedMode newMode) {
-    if (_currentMode == newMode) return;
-
-    // Don't interrupt a flicker with a new mode unless it's another flicker
-    if (_currentMode == LedMode::FLICKER && newMode != LedMode::FLICKER) {
-        _previousMode = newMode; // Store the intended mode for after the flicker
+    if (newMode == LedMode::FLICKER) {
+        flicker();
         return;
     }
+    if (_currentMode == newMode) return;
 
-    _previousMode = _currentMode;
+    // DEBUG_PRINTF("[LED] New mode set: %d\n", static_cast<int>(newMode));
+
+    esp_timer_stop(_timer);
+    esp_timer_stop(_flickerTimer);
+    portENTER_CRITICAL(&_mux);
     _currentMode = newMode;
-    _lastToggleTime = millis(); // Reset timer on mode change
+    _flickering = false;
+    _sequencer.start(getLedPattern(newMode));
+    portEXIT_CRITICAL(&_mux);
+    startStep();
+}
 
-    // DEBUG_PRINTF("[LED] New mode set: %d\n", static_cast<int>(newMode));
+// Inverts the LED briefly on its own timer, so the pattern keeps its step
+// timing. A flicker already showing is left to finish rather than extended,
+// so a steady stream of events cannot hold the LED inverted.
+void LedHandler::flicker() {
+    portENTER_CRITICAL(&_mux);
+    bool started = !_flickering;
+    _flickering = true;
+    portEXIT_CRITICAL(&_mux);
+    if (!started) return;
 
-    switch (_currentMode) {
-        case LedMode::ON:
-            digitalWrite(_pin, HIGH);
-            break;
-        case LedMode::OFF:
-            digitalWrite(_pin, LOW);
-            break;
-        case LedMode::FLICKER:
-            digitalWrite(_pin, !digitalRead(_pin)); // Invert current state for flicker effect
-            _flickerEndTime = millis() + FLICKER_DURATION;
-            break;
-        case LedMode::BLINK_SLOW:
-        case LedMode::BLINK_FAST:
-            // Handled in loop
-            break;
-    }
+    writeLevel();
+    esp_timer_start_once(_flickerTimer, FLICKER_DURATION * 1000ULL);
 }
 
-void LedHandler::loop() {
-    if (_currentMode == LedMode::FLICKER) {
-        if (millis() >= _flickerEndTime) {
-            // Revert to previous mode after flicker is done
-            LedMode modeToRestore = _previousMode;
-            _currentMode = LedMode::OFF; // Prevent recursive setMode calls
-            setMode(modeToRestore);
-        }
-        return;
-    }
+void LedHandler::startStep() {
+    portENTER_CRITICAL(&_mux);
+    uint16_t duration = _sequencer.duration();
+    portEXIT_CRITICAL(&_mux);
 
-    if (_currentMode == LedMode::BLINK_FAST || _currentMode == LedMode::BLINK_SLOW) {
-        handleBlinking();
+    writeLevel();
+    if (duration > 0) {
+        esp_timer_start_once(_timer, duration * 1000ULL);
     }
 }
 
-void LedHandler::handleBlinking() {
-    unsigned long interval = (_currentMode == LedMode::BLINK_FAST) ? BLINK_INTERVAL_FAST : BLINK_INTERVAL_SLOW;
-    if (millis() - _lastToggleTime >= interval) {
-        digitalWrite(_pin, !digitalRead(_pin));
-        _lastToggleTime = millis();
-    }
+void LedHandler::writeLevel() {
+    portENTER_CRITICAL(&_mux);
+    bool level = _sequencer.level() != _flickering;
+    portEXIT_CRITICAL(&_mux);
+    digitalWrite(_pin, level ? HIGH : LOW);
 }
 
+// Both timers run in the esp_timer task
+void LedHandler::onTimer(void* arg) {
+    LedHandler* self = static_cast<LedHandler*>(arg);
+    portENTER_CRITICAL(&self->_mux);
+    self->_sequencer.advance();
+    portEXIT_CRITICAL(&self->_mux);
+    self->startStep();
+}
+
+void LedHandler::onFlickerTimer(void* arg) {
+    LedHandler* self = static_cast<LedHandler*>(arg);
+    portENTER_CRITICAL(&self->_mux);
+    self->_flickering = false;
+    portEXIT_CRITICAL(&self->_mux);
+    self->writeLevel();
+}
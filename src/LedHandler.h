@@ -1,28 +1,85 @@
 #pragma once
 #include <Arduino.h>
+#include <esp_timer.h>
 
-enum class LedMode {
+enum class LedMode : uint8_t {
     OFF,
     ON,
     BLINK_SLOW,
     BLINK_FAST,
-    FLICKER
+    FLICKER,
+    ALARM,
+    PANEL_LINK_DOWN,
+    JOURNAL_BACKLOG
 };
 
+#define LED_PATTERN_MAX_STEPS 6
+
+// How long a FLICKER inverts the LED, in ms
+#ifndef FLICKER_DURATION
+#define FLICKER_DURATION 50
+#endif
+
+// A repeating on/off sequence. Steps alternate starting with ON; a pattern
+// with no steps holds `level` steadily.
+struct LedPattern {
+    uint8_t stepCount;
+    bool level;
+    uint16_t steps[LED_PATTERN_MAX_STEPS]; // Duration of each step in ms
+};
+
+// Walks a pattern step by step. Has no hardware dependencies, so pattern
+// timing can be checked off-target.
+class LedSequencer {
+public:
+    void start(const LedPattern& pattern);
+    // Level to drive for the current step
+    bool level() const;
+    // Duration of the current step in ms, 0 for a steady pattern
+    uint16_t duration() const;
+    // Moves to the next step, wrapping at the end of the pattern
+    void advance();
+
+private:
+    const LedPattern* _pattern = nullptr;
+    uint8_t _step = 0;
+};
+
+const LedPattern& getLedPattern(LedMode mode);
+
+// What the status LED reports, most urgent first in selectLedMode()
+struct LedStatus {
+    bool resetInProgress = false;
+    bool alarmActive = false;
+    bool panelLinkDown = false;
+    bool wifiConnected = false;
+    bool journalBacklog = false;
+    bool mqttConnected = false;
+};
+
+LedMode selectLedMode(const LedStatus& status);
+
+// Drives the status LED from an esp_timer, so the main loop never has to
+// poll it. setMode() is cheap to call repeatedly with the same mode.
 class LedHandler {
 public:
     explicit LedHandler(uint8_t pin);
     void setup();
-    void loop();
     void setMode(LedMode mode);
+    LedMode getMode() const { return _currentMode; }
 
 private:
     uint8_t _pin;
     LedMode _currentMode = LedMode::OFF;
-    LedMode _previousMode = LedMode::OFF;
-    unsigned long _lastToggleTime = 0;
-    unsigned long _flickerEndTime = 0;
+    LedSequencer _sequencer;
+    bool _flickering = false; // Inverts whatever the pattern is driving
+    esp_timer_handle_t _timer = nullptr;
+    esp_timer_handle_t _flickerTimer = nullptr;
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
 
-    void handleBlinking();
+    void flicker();
+    void startStep();
+    void writeLevel();
+    static void onTimer(void* arg);
+    static void onFlickerTimer(void* arg);
 };
-
@@ -1,16 +1,97 @@
 #include "Log.h"
 #include "Logger.h"
+#include "LogFormat.h"
+#include <freertos/queue.h>
+#include <soc/soc_memory_layout.h>
+
+#define LOG_LINE_SIZE 256
+#define LOG_TASK_STACK_SIZE 4096
+#define LOG_TASK_PRIORITY 1
+
+static QueueHandle_t s_queue = nullptr;
+static LogStats s_stats = {};
+static portMUX_TYPE s_statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void writeLine(uint32_t timestamp, const char* line) {
+    Serial.print(line);
+    Logger::getInstance().add(timestamp, line);
+}
+
+static void drainTask(void*) {
+    LogRecord record;
+    char line[LOG_LINE_SIZE];
+    uint32_t reportedDropped = 0;
+    for (;;) {
+        if (xQueueReceive(s_queue, &record, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        formatLogRecord(record, line, sizeof(line));
+        writeLine(record.timestamp, line);
+
+        uint32_t dropped = s_stats.dropped;
+        if (dropped != reportedDropped) {
+            snprintf(line, sizeof(line), "[Log] %u lines dropped, queue full.\n", dropped - reportedDropped);
+            writeLine(millis(), line);
+            reportedDropped = dropped;
+        }
+    }
+}
+
+void setupLog() {
+    s_queue = xQueueCreate(LOG_QUEUE_DEPTH, sizeof(LogRecord));
+    // Core 0, away from loop(), so console writes never delay panel handling
+    xTaskCreatePinnedToCore(drainTask, "log", LOG_TASK_STACK_SIZE, nullptr, LOG_TASK_PRIORITY, nullptr, 0);
+}
+
+LogStats getLogStats() {
+    portENTER_CRITICAL(&s_statsMux);
+    LogStats stats = s_stats;
+    portEXIT_CRITICAL(&s_statsMux);
+    return stats;
+}
 
 void Log(const char* fmt, ...) {
-    char buf[256];
+    uint32_t start = micros();
     va_list args;
     va_start(args, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, args);
+
+    LogRecord record;
+    record.timestamp = millis();
+    if (s_queue && esp_ptr_in_drom(fmt)) {
+        record.fmt = fmt;
+        captureLogArgs(record, fmt, args);
+    } else {
+        // Before setupLog(), or a format string that will not outlive this
+        // call: format now
+        char line[LOG_LINE_SIZE];
+        vsnprintf(line, sizeof(line), fmt, args);
+        if (!s_queue) {
+            va_end(args);
+            writeLine(record.timestamp, line);
+            return;
+        }
+        record.fmt = "%s";
+        record.argLength = 0;
+        record.truncated = false;
+        size_t length = min(strlen(line), sizeof(record.args) - 1);
+        memcpy(record.args, line, length);
+        record.args[length] = '\0';
+        record.argLength = length + 1;
+    }
     va_end(args);
 
-    // Send to serial monitor
-    Serial.print(buf);
+    bool queued = xQueueSend(s_queue, &record, 0) == pdTRUE;
+    uint32_t elapsed = micros() - start;
 
-    // Send to in-memory logger
-    Logger::getInstance().add(buf);
+    portENTER_CRITICAL(&s_statsMux);
+    if (queued) {
+        s_stats.queued++;
+    } else {
+        s_stats.dropped++;
+    }
+    s_stats.enqueueMicrosTotal += elapsed;
+    if (elapsed > s_stats.enqueueMicrosMax) {
+        s_stats.enqueueMicrosMax = elapsed;
+    }
+    portEXIT_CRITICAL(&s_statsMux);
 }
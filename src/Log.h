@@ -2,4 +2,59 @@
 
 #include <Arduino.h>
 
-void Log(const char* fmt, ...);
+// Compile-time log levels. Call sites above LOG_LEVEL compile to nothing.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Subsystem tags. Clearing a tag's bit in LOG_TAGS_ENABLED removes its call sites.
+#define LOG_TAG_SYSTEM 0
+#define LOG_TAG_PANEL 1
+#define LOG_TAG_MQTT 2
+#define LOG_TAG_NET 3
+
+#ifndef LOG_TAGS_ENABLED
+#define LOG_TAGS_ENABLED 0xFFFFFFFFUL
+#endif
+
+// Records waiting for the drain task; further records are dropped, never waited on
+#ifndef LOG_QUEUE_DEPTH
+#define LOG_QUEUE_DEPTH 32
+#endif
+
+// Room for a record's captured arguments, including copies of %s strings
+#define LOG_RECORD_ARG_BYTES 116
+
+#define LOG_AT(level, tag, ...)                                                   \
+    do {                                                                          \
+        if ((level) <= LOG_LEVEL && (LOG_TAGS_ENABLED & (1UL << (tag))) != 0) {   \
+            Log(__VA_ARGS__);                                                     \
+        }                                                                         \
+    } while (0)
+
+#define LOG_E(tag, ...) LOG_AT(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#define LOG_W(tag, ...) LOG_AT(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#define LOG_I(tag, ...) LOG_AT(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#define LOG_D(tag, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+
+struct LogStats {
+    uint32_t queued;
+    uint32_t dropped;
+    uint32_t enqueueMicrosTotal;
+    uint32_t enqueueMicrosMax;
+};
+
+// Captures the format pointer and a copy of the arguments, then returns.
+// Formatting and the UART write happen later on a low-priority task.
+// Until setupLog() runs, lines are printed synchronously.
+void Log(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Starts the drain task; call once, early in setup()
+void setupLog();
+LogStats getLogStats();
@@ -0,0 +1,201 @@
+#include "LogFormat.h"
+
+enum class ArgKind : uint8_t { NONE, INT, LONG, LONG_LONG, SIZE, DOUBLE, POINTER, STRING, UNSUPPORTED };
+
+// One printf conversion, as found by parseSpec()
+struct FormatSpec {
+    const char* start;  // The '%'
+    const char* end;    // One past the conversion character
+    uint8_t stars;      // '*' width/precision arguments, each an int
+    bool starPrecision; // The last '*' argument is the precision
+    int precision;      // -1 when absent or given by '*'
+    ArgKind kind;
+};
+
+// Parses the conversion starting at percent. Handles the subset
+// of printf the firmware uses: flags, width, precision, h/l/ll/z and diuxXocsfegp.
+static FormatSpec parseSpec(const char* percent) {
+    FormatSpec spec = {percent, percent + 1, 0, false, -1, ArgKind::NONE};
+    const char* p = percent + 1;
+    while (*p && strchr("-+ #0", *p)) p++;
+    if (*p == '*') {
+        spec.stars++;
+        p++;
+    }
+    while (isdigit((unsigned char)*p)) p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec.stars++;
+            spec.starPrecision = true;
+            p++;
+        } else {
+            spec.precision = atoi(p);
+            while (isdigit((unsigned char)*p)) p++;
+        }
+    }
+    int longs = 0;
+    bool sizeT = false;
+    while (*p && strchr("hlzjt", *p)) {
+        if (*p == 'l') longs++;
+        if (*p == 'z') sizeT = true;
+        p++;
+    }
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            spec.kind = sizeT ? ArgKind::SIZE : longs >= 2 ? ArgKind::LONG_LONG : longs == 1 ? ArgKind::LONG : ArgKind::INT;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+            spec.kind = ArgKind::DOUBLE;
+            break;
+        case 'p': spec.kind = ArgKind::POINTER; break;
+        case 's': spec.kind = ArgKind::STRING; break;
+        case '%': spec.kind = ArgKind::NONE; break;
+        default:  spec.kind = ArgKind::UNSUPPORTED; break;
+    }
+    spec.end = *p ? p + 1 : p;
+    return spec;
+}
+
+// Bytes an argument takes in the record; strings take at least their terminator
+static size_t argSize(ArgKind kind) {
+    switch (kind) {
+        case ArgKind::INT:       return sizeof(int);
+        case ArgKind::LONG:      return sizeof(long);
+        case ArgKind::LONG_LONG: return sizeof(long long);
+        case ArgKind::SIZE:      return sizeof(size_t);
+        case ArgKind::DOUBLE:    return sizeof(double);
+        case ArgKind::POINTER:   return sizeof(void*);
+        case ArgKind::STRING:    return 1;
+        default:                 return 0;
+    }
+}
+
+template <typename T>
+static bool putArg(LogRecord& record, T value) {
+    if (record.argLength + sizeof(T) > sizeof(record.args)) return false;
+    memcpy(record.args + record.argLength, &value, sizeof(T));
+    record.argLength += sizeof(T);
+    return true;
+}
+
+template <typename T>
+static T takeArg(const LogRecord& record, size_t& offset) {
+    T value;
+    memcpy(&value, record.args + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+void captureLogArgs(LogRecord& record, const char* fmt, va_list args) {
+    record.argLength = 0;
+    record.truncated = false;
+    for (const char* p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+        FormatSpec spec = parseSpec(p);
+        p = spec.end;
+        int starValue = 0;
+        bool ok = true;
+        for (uint8_t i = 0; i < spec.stars && ok; i++) {
+            starValue = va_arg(args, int);
+            ok = putArg(record, starValue);
+        }
+        switch (spec.kind) {
+            case ArgKind::NONE: break;
+            case ArgKind::INT:       ok = ok && putArg(record, va_arg(args, int)); break;
+            case ArgKind::LONG:      ok = ok && putArg(record, va_arg(args, long)); break;
+            case ArgKind::LONG_LONG: ok = ok && putArg(record, va_arg(args, long long)); break;
+            case ArgKind::SIZE:      ok = ok && putArg(record, va_arg(args, size_t)); break;
+            case ArgKind::DOUBLE:    ok = ok && putArg(record, va_arg(args, double)); break;
+            case ArgKind::POINTER:   ok = ok && putArg(record, va_arg(args, void*)); break;
+            case ArgKind::STRING: {
+                const char* s = va_arg(args, const char*);
+                if (!s) s = "(null)";
+                // A precision bounds the read, as with "%.*s" on unterminated payloads
+                // "%.*s" has one star and "%*.*s" two; either way the precision is read last
+                int limit = spec.precision >= 0 ? spec.precision : (spec.starPrecision ? starValue : -1);
+                size_t length = limit >= 0 ? strnlen(s, limit) : strlen(s);
+                size_t room = ok ? sizeof(record.args) - record.argLength : 0;
+                if (room == 0) {
+                    ok = false;
+                    break;
+                }
+                if (length >= room) {
+                    length = room - 1;
+                    record.truncated = true;
+                }
+                memcpy(record.args + record.argLength, s, length);
+                record.args[record.argLength + length] = '\0';
+                record.argLength += length + 1;
+                break;
+            }
+            case ArgKind::UNSUPPORTED: ok = false; break;
+        }
+        if (!ok) {
+            record.truncated = true;
+            return;
+        }
+    }
+}
+
+template <typename T>
+static int formatArg(char* out, size_t size, const char* spec, uint8_t stars, const int* starValues, T value) {
+    switch (stars) {
+        case 0:  return snprintf(out, size, spec, value);
+        case 1:  return snprintf(out, size, spec, starValues[0], value);
+        default: return snprintf(out, size, spec, starValues[0], starValues[1], value);
+    }
+}
+
+void formatLogRecord(const LogRecord& record, char* out, size_t size) {
+    size_t used = 0;
+    size_t offset = 0;
+    const char* p = record.fmt;
+    while (*p && used + 1 < size) {
+        if (*p != '%') {
+            out[used++] = *p++;
+            continue;
+        }
+        FormatSpec spec = parseSpec(p);
+        p = spec.end;
+        if (spec.kind == ArgKind::NONE) {
+            out[used++] = '%';
+            continue;
+        }
+        // Stop at the first argument that was not captured
+        if (spec.kind == ArgKind::UNSUPPORTED || offset + spec.stars * sizeof(int) + argSize(spec.kind) > record.argLength) {
+            break;
+        }
+        int starValues[2] = {0, 0};
+        for (uint8_t i = 0; i < spec.stars; i++) {
+            starValues[i] = takeArg<int>(record, offset);
+        }
+        char specText[16];
+        size_t specLength = min((size_t)(spec.end - spec.start), sizeof(specText) - 1);
+        memcpy(specText, spec.start, specLength);
+        specText[specLength] = '\0';
+
+        char* dst = out + used;
+        size_t room = size - used;
+        int written = 0;
+        switch (spec.kind) {
+            case ArgKind::INT:       written = formatArg(dst, room, specText, spec.stars, starValues, takeArg<int>(record, offset)); break;
+            case ArgKind::LONG:      written = formatArg(dst, room, specText, spec.stars, starValues, takeArg<long>(record, offset)); break;
+            case ArgKind::LONG_LONG: written = formatArg(dst, room, specText, spec.stars, starValues, takeArg<long long>(record, offset)); break;
+            case ArgKind::SIZE:      written = formatArg(dst, room, specText, spec.stars, starValues, takeArg<size_t>(record, offset)); break;
+            case ArgKind::DOUBLE:    written = formatArg(dst, room, specText, spec.stars, starValues, takeArg<double>(record, offset)); break;
+            case ArgKind::POINTER:   written = formatArg(dst, room, specText, spec.stars, starValues, takeArg<void*>(record, offset)); break;
+            case ArgKind::STRING: {
+                const char* s = (const char*)record.args + offset;
+                offset += strlen(s) + 1;
+                written = formatArg(dst, room, specText, spec.stars, starValues, s);
+                break;
+            }
+            default: break;
+        }
+        used += written > 0 ? min((size_t)written, room - 1) : 0;
+    }
+    out[used] = '\0';
+    if (record.truncated && used + 16 < size) {
+        strcpy(out + used, " [truncated]\n");
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include "Log.h"
+
+// A log call as queued for the drain task: the format pointer and a copy of
+// its arguments
+struct LogRecord {
+    const char* fmt;
+    uint32_t timestamp;
+    uint8_t argLength;
+    bool truncated; // Arguments did not fit; the line is cut at that point
+    uint8_t args[LOG_RECORD_ARG_BYTES];
+};
+
+// Copies the arguments named by fmt out of the va_list, including the text of
+// %s strings, so the caller's buffers can go away before the line is formatted
+void captureLogArgs(LogRecord& record, const char* fmt, va_list args);
+
+// Replays the record's format against its captured arguments
+void formatLogRecord(const LogRecord& record, char* out, size_t size);
@@ -1,5 +1,8 @@
 #include "Logger.h"
 
+// Positions wrap at 2^32, which only lands on the same ring index if the size divides it
+static_assert((LOG_HISTORY_SIZE & (LOG_HISTORY_SIZE - 1)) == 0, "LOG_HISTORY_SIZE must be a power of two");
+
 Logger::Logger() {}
 
 Logger& Logger::getInstance() {
@@ -7,39 +10,65 @@ Logger& Logger::getInstance() {
     return instance;
 }
 
-void Logger::add(const char* fmt, ...) {
-    char buf[256];
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, args);
-    va_end(args);
-
-    // Prepend timestamp
-    String timestamp = "[" + String(millis()) + "] ";
-    _log_lines[_current_line] = timestamp + buf;
-
-    _current_line++;
-    if (_current_line >= LOG_BUFFER_SIZE) {
-        _current_line = 0;
-        _buffer_full = true;
-    }
-}
-
-String Logger::getHtml() {
-    String html = "<!DOCTYPE html><html><head><title>ESP32 Logs</title><meta http-equiv=\"refresh\" content=\"5\"></head><body><h1>ESP32 Logs</h1><pre>";
-    
-    int index;
-    int count = _buffer_full ? LOG_BUFFER_SIZE : _current_line;
+void Logger::add(unsigned long timestamp, const char* line) {
+    char stamp[16];
+    int stampLength = snprintf(stamp, sizeof(stamp), "[%lu] ", timestamp);
+    size_t length = strlen(line);
+    // A line never takes more than half the ring, so the newest ones always fit
+    length = min(length, (size_t)LOG_HISTORY_SIZE / 2);
+    bool terminated = length > 0 && line[length - 1] == '\n';
 
-    for (int i = 0; i < count; i++) {
-        index = _current_line - 1 - i;
-        if (index < 0) {
-            index += LOG_BUFFER_SIZE;
+    portENTER_CRITICAL(&_mux);
+    put(stamp, stampLength);
+    put(line, length);
+    if (!terminated) {
+        put("\n", 1);
+    }
+    // Drop whatever is left of the lines that were written over
+    if (_end - _start > LOG_HISTORY_SIZE) {
+        // The byte at _end - size is the oldest one not yet written over
+        _start = _end - LOG_HISTORY_SIZE;
+        while (_start != _end) {
+            if (_text[_start++ % LOG_HISTORY_SIZE] == '\n') {
+                break;
+            }
         }
-        html += _log_lines[index] + "\n";
     }
+    portEXIT_CRITICAL(&_mux);
+}
 
-    html += "</pre></body></html>";
-    return html;
+void Logger::put(const char* text, size_t length) {
+    size_t index = _end % LOG_HISTORY_SIZE;
+    size_t first = min(length, (size_t)LOG_HISTORY_SIZE - index);
+    memcpy(_text + index, text, first);
+    memcpy(_text, text + first, length - first);
+    _end += length;
 }
 
+uint32_t Logger::getEnd() const {
+    portENTER_CRITICAL(&_mux);
+    uint32_t end = _end;
+    portEXIT_CRITICAL(&_mux);
+    return end;
+}
+
+size_t Logger::readLineBefore(uint32_t& cursor, char* out, size_t size) const {
+    portENTER_CRITICAL(&_mux);
+    // Compared as distances back from _end, so positions may wrap
+    if (_end - cursor >= _end - _start) {
+        portEXIT_CRITICAL(&_mux);
+        return 0;
+    }
+    // Every stored line ends in '\n', so the one before the cursor starts after the previous '\n'
+    uint32_t lineStart = cursor - 1;
+    while (lineStart != _start && _text[(lineStart - 1) % LOG_HISTORY_SIZE] != '\n') {
+        lineStart--;
+    }
+    size_t length = min((size_t)(cursor - lineStart), size);
+    for (size_t i = 0; i < length; i++) {
+        out[i] = _text[(lineStart + i) % LOG_HISTORY_SIZE];
+    }
+    cursor = lineStart;
+    portEXIT_CRITICAL(&_mux);
+    return length;
+}
@@ -2,25 +2,37 @@
 
 #include <Arduino.h>
 
+// Bytes of recent log text kept for /logs, a power of two; the oldest lines
+// are overwritten
+#ifndef LOG_HISTORY_SIZE
+#define LOG_HISTORY_SIZE 16384
+#endif
+
+// Recent log lines in a fixed ring of characters. Written by the log drain
+// task and read by the web server task, so every access holds _mux.
 class Logger {
 public:
-    static const int LOG_BUFFER_SIZE = 500;
-
     static Logger& getInstance();
 
-    void add(const char* fmt, ...);
-    String getHtml();
+    // Stores a formatted line, stamped with the time it was logged
+    void add(unsigned long timestamp, const char* line);
 
-    // New methods for chunked transfer
-    const String* getLogLines() const { return _log_lines; }
-    int getCurrentLine() const { return _current_line; }
-    bool isBufferFull() const { return _buffer_full; }
+    // Position just past the newest line; reading backwards starts here
+    uint32_t getEnd() const;
+    // Copies the line that ends at cursor into out and moves cursor to its
+    // start. Returns the bytes copied, 0 once older lines have been overwritten
+    // or there are none. A line longer than size is cut short.
+    size_t readLineBefore(uint32_t& cursor, char* out, size_t size) const;
 
 private:
     Logger(); // Private constructor
-    String _log_lines[LOG_BUFFER_SIZE];
-    int _current_line = 0;
-    bool _buffer_full = false;
+    char _text[LOG_HISTORY_SIZE];
+    // Positions count every byte ever written; the ring index is position % size
+    uint32_t _start = 0; // First byte of the oldest whole line
+    uint32_t _end = 0;
+    mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+    void put(const char* text, size_t length);
 
     // Delete copy constructor and assignment operator
     Logger(const Logger&) = delete;
@@ -0,0 +1,106 @@
+#include "MemoryMonitor.h"
+#include "Config.h"
+
+// Tasks whose stack headroom is reported. Missing tasks are skipped.
+static const char* const WATCHED_TASKS[] = {"loopTask", "ota", "async_tcp", "esp_timer", "tiT"};
+
+static const char* const TAG_NAMES[] = {"untagged", "logger", "events", "mqtt", "panel", "other_tasks"};
+static_assert(sizeof(TAG_NAMES) / sizeof(TAG_NAMES[0]) == (size_t)AllocTag::COUNT, "TAG_NAMES must cover every AllocTag");
+
+// Shared with the malloc wrappers, which can run before any object is constructed
+static AllocCounter s_allocations[(size_t)AllocTag::COUNT];
+static TaskHandle_t s_trackedTask = nullptr;
+static AllocTag s_currentTag = AllocTag::UNTAGGED;
+
+AllocScope::AllocScope(AllocTag tag) : _previous(s_currentTag) {
+    _active = s_trackedTask && xTaskGetCurrentTaskHandle() == s_trackedTask;
+    if (_active) {
+        s_currentTag = tag;
+    }
+}
+
+AllocScope::~AllocScope() {
+    if (_active) {
+        s_currentTag = _previous;
+    }
+}
+
+// Counts from other tasks are not synchronised and may drift slightly
+void MemoryMonitor::countAllocation(size_t size) {
+    AllocTag tag = AllocTag::OTHER_TASKS;
+    if (s_trackedTask && xTaskGetCurrentTaskHandle() == s_trackedTask) {
+        tag = s_currentTag;
+    }
+    AllocCounter& counter = s_allocations[(size_t)tag];
+    counter.count++;
+    counter.bytes += size;
+}
+
+const AllocCounter& MemoryMonitor::getAllocations(AllocTag tag) {
+    return s_allocations[(size_t)tag];
+}
+
+void MemoryMonitor::setup() {
+    s_trackedTask = xTaskGetCurrentTaskHandle();
+    sample();
+}
+
+void MemoryMonitor::sample() {
+    _freeHeap = ESP.getFreeHeap();
+    _minFreeHeap = ESP.getMinFreeHeap();
+    _largestBlock = ESP.getMaxAllocHeap();
+    _fragmentation = _freeHeap > 0 ? 100 - (uint64_t)_largestBlock * 100 / _freeHeap : 0;
+
+    // Log once per crossing rather than on every sample
+    bool fragmented = _fragmentation >= MEMORY_FRAGMENTATION_WARN;
+    if (fragmented && !_fragmentationWarned) {
+        DEBUG_PRINTF("[Memory] Heap fragmented: %u%% (free %u, largest block %u)\n",
+                     _fragmentation, _freeHeap, _largestBlock);
+    }
+    _fragmentationWarned = fragmented;
+}
+
+void MemoryMonitor::toJson(JsonObject obj) {
+    obj["free"] = _freeHeap;
+    obj["min_free"] = _minFreeHeap;
+    obj["largest_block"] = _largestBlock;
+    obj["fragmentation_pct"] = _fragmentation;
+
+    // High-water marks are in bytes on the ESP32
+    JsonObject stacks = obj.createNestedObject("stack_free");
+    for (const char* name : WATCHED_TASKS) {
+        TaskHandle_t task = xTaskGetHandle(name);
+        if (task) {
+            stacks[name] = uxTaskGetStackHighWaterMark(task);
+        }
+    }
+
+    JsonObject allocations = obj.createNestedObject("allocations");
+    for (size_t i = 0; i < (size_t)AllocTag::COUNT; i++) {
+        JsonObject tag = allocations.createNestedObject(TAG_NAMES[i]);
+        tag["count"] = s_allocations[i].count;
+        tag["bytes"] = s_allocations[i].bytes;
+    }
+}
+
+// Linker wraps (-Wl,--wrap=malloc etc.): every heap allocation passes through here
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    MemoryMonitor::countAllocation(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    MemoryMonitor::countAllocation(count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    MemoryMonitor::countAllocation(size);
+    return __real_realloc(ptr, size);
+}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Warn when the largest free block is this small a share of free heap
+#ifndef MEMORY_FRAGMENTATION_WARN
+#define MEMORY_FRAGMENTATION_WARN 50 // percent
+#endif
+
+// Subsystems whose allocations are counted separately. Only allocations made
+// on the loop task are tagged; everything else lands in OTHER_TASKS.
+enum class AllocTag : uint8_t {
+    UNTAGGED,
+    LOGGER,
+    EVENTS,
+    MQTT,
+    PANEL,
+    OTHER_TASKS,
+    COUNT
+};
+
+struct AllocCounter {
+    uint32_t count;
+    uint32_t bytes;
+};
+
+// Attributes the loop task's allocations to a tag for the lifetime of the scope
+class AllocScope {
+public:
+    explicit AllocScope(AllocTag tag);
+    ~AllocScope();
+
+private:
+    AllocTag _previous;
+    bool _active;
+};
+
+// Samples heap usage, fragmentation and stack high-water marks, and counts
+// allocations by tag. Counting relies on the linker wrapping malloc, calloc
+// and realloc (see build_flags in platformio.ini).
+class MemoryMonitor {
+public:
+    // Call from setup(); the calling task is the one whose allocations are tagged
+    void setup();
+    // Refreshes the heap figures and logs when fragmentation crosses the threshold
+    void sample();
+    void toJson(JsonObject obj);
+
+    static const AllocCounter& getAllocations(AllocTag tag);
+    static void countAllocation(size_t size);
+
+private:
+    uint32_t _freeHeap = 0;
+    uint32_t _minFreeHeap = 0;
+    uint32_t _largestBlock = 0;
+    uint8_t _fragmentation = 0;
+    bool _fragmentationWarned = false;
+};
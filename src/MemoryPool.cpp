@@ -0,0 +1,70 @@
+#include "MemoryPool.h"
+
+FixedBlockPool::FixedBlockPool(void* storage, size_t blockSize, size_t blockCount)
+    : _blockSize(blockSize), _blockCount(blockCount) {
+    uint8_t* bytes = static_cast<uint8_t*>(storage);
+    for (size_t i = blockCount; i > 0; i--) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(bytes + (i - 1) * blockSize);
+        block->next = _free;
+        _free = block;
+    }
+}
+
+void* FixedBlockPool::allocate() {
+    portENTER_CRITICAL(&_mux);
+    FreeBlock* block = _free;
+    if (block) {
+        _free = block->next;
+        _inUse++;
+        if (_inUse > _peakInUse) {
+            _peakInUse = _inUse;
+        }
+    } else {
+        _failures++;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return block;
+}
+
+void FixedBlockPool::deallocate(void* block) {
+    if (!block) return;
+    portENTER_CRITICAL(&_mux);
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = _free;
+    _free = freed;
+    _inUse--;
+    portEXIT_CRITICAL(&_mux);
+}
+
+void FixedBlockPool::recordUsage(size_t bytes) {
+    portENTER_CRITICAL(&_mux);
+    if (bytes > _peakBytesUsed) {
+        _peakBytesUsed = bytes;
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+void FixedBlockPool::toJson(JsonObject obj) {
+    portENTER_CRITICAL(&_mux);
+    size_t inUse = _inUse;
+    size_t peakInUse = _peakInUse;
+    size_t peakBytesUsed = _peakBytesUsed;
+    uint32_t failures = _failures;
+    portEXIT_CRITICAL(&_mux);
+
+    obj["block_size"] = _blockSize;
+    obj["blocks"] = _blockCount;
+    obj["in_use"] = inUse;
+    obj["peak_in_use"] = peakInUse;
+    obj["peak_bytes_used"] = peakBytesUsed;
+    obj["failures"] = failures;
+}
+
+void* BumpArena::allocate(size_t size, size_t align) {
+    size_t start = (_used + align - 1) & ~(align - 1);
+    if (start + size > _size) {
+        return nullptr;
+    }
+    _used = start + size;
+    return _buffer + start;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Fixed number of equal-sized blocks carved from caller-owned storage. Blocks
+// are handed out from a free list, so allocate() and deallocate() are O(1)
+// and the pool never touches the heap. Safe to share between tasks.
+class FixedBlockPool {
+public:
+    FixedBlockPool(void* storage, size_t blockSize, size_t blockCount);
+
+    // Returns nullptr when every block is in use
+    void* allocate();
+    void deallocate(void* block);
+    // Records how much of a block a caller ended up needing, for sizing
+    void recordUsage(size_t bytes);
+
+    size_t getBlockSize() const { return _blockSize; }
+    void toJson(JsonObject obj);
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* _free = nullptr;
+    size_t _blockSize;
+    size_t _blockCount;
+    size_t _inUse = 0;
+    size_t _peakInUse = 0;
+    size_t _peakBytesUsed = 0;
+    uint32_t _failures = 0;
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+template <size_t BlockSize, size_t BlockCount>
+class StaticBlockPool : public FixedBlockPool {
+    static_assert(BlockSize % 4 == 0 && BlockSize >= sizeof(void*), "Blocks must hold a pointer and stay aligned");
+
+public:
+    StaticBlockPool() : FixedBlockPool(_storage, BlockSize, BlockCount) {}
+
+private:
+    alignas(4) uint8_t _storage[BlockSize * BlockCount];
+};
+
+// Bump allocator over one buffer, typically a pool block held for a single
+// request. Individual frees are no-ops; the whole arena is dropped at once.
+class BumpArena {
+public:
+    BumpArena(void* buffer, size_t size) : _buffer(static_cast<uint8_t*>(buffer)), _size(size) {}
+
+    // Returns nullptr when the arena is full
+    void* allocate(size_t size, size_t align = 4);
+    size_t getUsed() const { return _used; }
+
+private:
+    uint8_t* _buffer;
+    size_t _size;
+    size_t _used = 0;
+};
+
+// Lets BasicJsonDocument take its memory pool from a BumpArena
+class ArenaJsonAllocator {
+public:
+    explicit ArenaJsonAllocator(BumpArena& arena) : _arena(&arena) {}
+
+    void* allocate(size_t size) { return _arena->allocate(size); }
+    void deallocate(void*) {}
+    // Only shrinking is supported, which is all ArduinoJson asks of it
+    void* reallocate(void* ptr, size_t) { return ptr; }
+
+private:
+    BumpArena* _arena;
+};
@@ -1,30 +1,96 @@
 #include "MqttHandler.h"
-#include "ParadoxHandler.h"
 #include "Config.h"
-#include <ArduinoJson.h>
+#include "Log.h"
 
-MqttHandler::MqttHandler() : _mqttClient(_wifiClient) {
-    _statusMessageSent = false;
+MqttHandler::MqttHandler() {
 }
 
 void MqttHandler::setup(const char* server, int port, const char* user, const char* password, const String& commandTopic, MqttCallback callback) {
-    _server = server;
-    _port = port;
     _user = user;
     _password = password;
     _commandTopic = commandTopic;
+    _callback = callback;
+    addBroker(server, port);
+    DEBUG_PRINTF("[MQTT] Handler setup for server %s:%d\n", server, port);
+}
 
-    _mqttClient.setServer(_server.c_str(), _port);
-    _mqttClient.setCallback(callback);
-    DEBUG_PRINTF("[MQTT] Handler setup for server %s:%d\n", _server.c_str(), _port);
+void MqttHandler::addBroker(const char* server, int port) {
+    if (_brokerCount >= MQTT_MAX_BROKERS) {
+        DEBUG_PRINTF("[MQTT] Too many brokers, ignoring %s\n", server);
+        return;
+    }
+    Broker& broker = _brokers[_brokerCount++];
+    broker.server = server;
+    broker.port = port;
+    // PubSubClient keeps the pointer, so the String must not change afterwards
+    broker.client.setServer(broker.server.c_str(), broker.port);
+    broker.client.setCallback(_callback);
+    broker.client.setBufferSize(MQTT_BUFFER_SIZE);
+#if MQTT_TLS_ENABLED
+    broker.net.setSessionSlot(_brokerCount - 1);
+#endif
+}
+
+void MqttHandler::addBackupBrokers(const char* list) {
+    while (list && *list) {
+        const char* end = strchr(list, ',');
+        size_t len = end ? (size_t)(end - list) : strlen(list);
+        char entry[72];
+        if (len >= sizeof(entry)) {
+            len = sizeof(entry) - 1;
+        }
+        memcpy(entry, list, len);
+        entry[len] = '\0';
+
+        char* host = entry;
+        while (*host == ' ') host++;
+        char* tail = host + strlen(host);
+        while (tail > host && tail[-1] == ' ') *--tail = '\0';
+        int port = MQTT_DEFAULT_PORT;
+        char* colon = strchr(host, ':');
+        if (colon) {
+            *colon = '\0';
+            port = atoi(colon + 1);
+        }
+        if (*host && port > 0) {
+            addBroker(host, port);
+            DEBUG_PRINTF("[MQTT] Backup broker %s:%d\n", host, port);
+        }
+        list = end ? end + 1 : nullptr;
+    }
+}
+
+void MqttHandler::addSubscription(const String& topic) {
+    if (_extraTopicCount >= MAX_EXTRA_SUBSCRIPTIONS) {
+        DEBUG_PRINTF("[MQTT] Too many subscriptions, ignoring %s\n", topic.c_str());
+        return;
+    }
+    _extraTopics[_extraTopicCount++] = topic;
+    for (uint8_t i = 0; i < _brokerCount; i++) {
+        if (_brokers[i].wasConnected) {
+            _brokers[i].client.subscribe(topic.c_str());
+        }
+    }
 }
 
 bool MqttHandler::isConnected() {
-    return _mqttClient.connected();
+    for (uint8_t i = 0; i < _brokerCount; i++) {
+        if (isPublishTarget(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MqttHandler::isPublishTarget(uint8_t broker) {
+    if (broker >= _brokerCount || (!MQTT_FANOUT_ENABLED && broker != _active)) {
+        return false;
+    }
+    return _brokers[broker].client.connected();
 }
 
 const char* MqttHandler::getConnectionStatus() {
-    if (_mqttClient.connected()) {
+    if (isConnected()) {
         return "Connected";
     }
 
@@ -32,7 +98,7 @@ const char* MqttHandler::getConnectionStatus() {
         return "Disconnected";
     }
 
-    int state = _mqttClient.state();
+    int state = _brokers[_lostBroker >= 0 ? _lostBroker : 0].client.state();
     if (state == -4 || state == -3) { // MQTT_CONNECTION_TIMEOUT or MQTT_CONNECTION_LOST
         return "Connection Lost";
     }
@@ -41,54 +107,356 @@ const char* MqttHandler::getConnectionStatus() {
 }
 
 void MqttHandler::loop() {
-    if (!isConnected()) {
-        _statusMessageSent = false; // Reset on disconnect
-        unsigned long now = millis();
-        if (now - _lastReconnectAttempt > MQTT_RECONNECT_DELAY) {
-            _lastReconnectAttempt = now;
-            reconnect();
+    checkConnections();
+
+    unsigned long now = millis();
+    if (now - _lastRecovery >= MQTT_SCORE_RECOVERY_INTERVAL) {
+        _lastRecovery = now;
+        for (uint8_t i = 0; i < _brokerCount; i++) {
+            _brokers[i].score = min(_brokers[i].score + MQTT_SCORE_RECOVERY, MQTT_SCORE_MAX);
         }
-    } else {
-        _mqttClient.loop();
     }
+
+    // Nothing to reconnect over yet; WiFi may still be associating
+    if (!WiFi.isConnected()) {
+        return;
+    }
+#if MQTT_FANOUT_ENABLED
+    serviceFanout();
+#else
+    serviceFailover();
+#endif
 }
 
-void MqttHandler::reconnect() {
-    if (_server.length() == 0) {
+// Services live connections and notices the ones that dropped
+void MqttHandler::checkConnections() {
+    for (uint8_t i = 0; i < _brokerCount; i++) {
+        Broker& broker = _brokers[i];
+        if (broker.client.connected()) {
+            broker.client.loop();
+            continue;
+        }
+        if (!broker.wasConnected) {
+            continue;
+        }
+        broker.wasConnected = false;
+        broker.stats.disconnects++;
+        penalize(broker, MQTT_SCORE_CONNECTION_LOST);
+        DEBUG_PRINTF("[MQTT] Lost connection to %s:%d.\n", broker.server.c_str(), broker.port);
+        if (!MQTT_FANOUT_ENABLED && i == _active) {
+            _active = -1;
+            // Fail over now rather than after a reconnect delay
+            _reconnectNow = true;
+        }
+        if (!isConnected() && _lostAt == 0) {
+            _lostAt = millis();
+            _lostBroker = i;
+        }
+    }
+}
+
+// One broker at a time. A lost broker scores lower than the healthy ones,
+// so the next attempt goes to a backup; a later failback returns to the
+// higher-priority broker once it accepts connections again.
+void MqttHandler::serviceFailover() {
+    unsigned long now = millis();
+    // Polled every loop, not at the retry rate, so the broker is used as
+    // soon as its handshake completes
+    if (_pending >= 0) {
+        uint8_t index = _pending;
+        ConnectStep step = connect(index);
+        if (step != ConnectStep::WAITING) {
+            _pending = -1;
+        }
+        if (step == ConnectStep::DONE) {
+            promote(index);
+        }
         return;
     }
-    DEBUG_PRINT("[MQTT] Attempting to connect... ");
-    if (_mqttClient.connect(MQTT_CLIENT_ID, _user.c_str(), _password.c_str())) {
-        DEBUG_PRINTLN("connected!");
-        _mqttClient.subscribe(_commandTopic.c_str());
-        DEBUG_PRINTF("[MQTT] Subscribed to: %s\n", _commandTopic.c_str());
 
-        if (!_statusMessageSent) {
-            StaticJsonDocument<256> doc;
-            doc["firmware_version"] = FIRMWARE_VERSION;
-            doc["wifi_status"] = "Connected";
-            doc["mqtt_status"] = "Connected";
-            char payload[256];
-            serializeJson(doc, payload);
-            publish("paradox/__status__", payload);
-            _statusMessageSent = true;
+    if (_active < 0) {
+        if (!_reconnectNow && now - _lastReconnectAttempt <= MQTT_RECONNECT_DELAY) {
+            return;
+        }
+        _reconnectNow = false;
+        _lastReconnectAttempt = now;
+        int8_t index = pickBroker(_brokerCount);
+        if (index >= 0) {
+            attempt(index);
+        }
+        return;
+    }
 
-            // Request a full status update now that we are connected
-            DEBUG_PRINTLN("[MQTT] Requesting initial zone and partition status.");
-            paradoxHandler.requestZoneStatus();
-            delay(500); // Add a small delay between requests
-            paradoxHandler.requestPartitionStatus();
+    if (_active > 0 && now - _lastFailback >= MQTT_FAILBACK_INTERVAL) {
+        _lastFailback = now;
+        int8_t index = pickBroker(_active);
+        if (index >= 0) {
+            attempt(index);
         }
-    } else {
-        DEBUG_PRINTF("failed, rc=%d. Retrying in 5 seconds.\n", _mqttClient.state());
     }
 }
 
-bool MqttHandler::publish(const char* topic, const char* payload) {
-    if (isConnected()) {
-        DEBUG_PRINTF("[MQTT] Publishing. Topic: %s, Payload: %s\n", topic, payload);
-        return _mqttClient.publish(topic, payload, true); // Retain message
+void MqttHandler::attempt(uint8_t index) {
+    ConnectStep step = connect(index);
+    if (step == ConnectStep::WAITING) {
+        _pending = index;
+    } else if (step == ConnectStep::DONE) {
+        promote(index);
     }
-    DEBUG_PRINTLN("[MQTT] Cannot publish, not connected.");
-    return false;
-}
\ No newline at end of file
+}
+
+// Makes a newly connected broker the active one, closing the one it replaces
+void MqttHandler::promote(uint8_t index) {
+    if (_active < 0) {
+        _active = index;
+        _lastFailback = millis();
+        onConnected(index);
+        return;
+    }
+    uint8_t previous = _active;
+    _active = index;
+    // Closed on purpose, so not counted as lost
+    _brokers[previous].wasConnected = false;
+    _brokers[previous].client.disconnect();
+    DEBUG_PRINTF("[MQTT] Back on %s:%d.\n", _brokers[index].server.c_str(), _brokers[index].port);
+    onConnected(index);
+}
+
+// Every broker stays connected. Each is retried on its own schedule, one
+// new connect per call, so a dead broker never delays the others.
+// Handshakes already in flight are polled every call.
+void MqttHandler::serviceFanout() {
+    unsigned long now = millis();
+    bool started = false;
+    for (uint8_t i = 0; i < _brokerCount; i++) {
+        Broker& broker = _brokers[i];
+        if (broker.wasConnected) {
+            continue;
+        }
+        if (!isHandshaking(broker)) {
+            if (started || now - broker.lastAttempt <= MQTT_RECONNECT_DELAY) {
+                continue;
+            }
+            started = true;
+            _lastReconnectAttempt = now;
+        }
+        if (connect(i) == ConnectStep::DONE) {
+            onConnected(i);
+        }
+    }
+}
+
+bool MqttHandler::isHandshaking(const Broker& broker) const {
+#if MQTT_TLS_ENABLED
+    return broker.net.getState() != TlsClient::State::IDLE;
+#else
+    return broker.probe.getState() != TcpProbe::State::IDLE;
+#endif
+}
+
+// Healthiest of the first count brokers, earlier ones winning ties
+int8_t MqttHandler::pickBroker(uint8_t count) const {
+    int8_t best = -1;
+    for (uint8_t i = 0; i < count && i < _brokerCount; i++) {
+        if (best < 0 || _brokers[i].score > _brokers[best].score) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+MqttHandler::ConnectStep MqttHandler::connect(uint8_t index) {
+    Broker& broker = _brokers[index];
+    if (broker.server.length() == 0) {
+        return ConnectStep::FAILED;
+    }
+#if MQTT_TLS_ENABLED
+    switch (broker.net.getState()) {
+        case TlsClient::State::IDLE:
+            broker.lastAttempt = millis();
+            if (broker.net.startConnect(broker.server.c_str(), broker.port)) {
+                DEBUG_PRINTF("[MQTT] TLS handshake with %s:%d started.\n", broker.server.c_str(), broker.port);
+                return ConnectStep::WAITING;
+            }
+            DEBUG_PRINTF("[MQTT] Cannot start TLS to %s:%d.\n", broker.server.c_str(), broker.port);
+            broker.stats.connectFailures++;
+            penalize(broker, MQTT_SCORE_CONNECT_FAILED);
+            return ConnectStep::FAILED;
+        case TlsClient::State::CONNECTING:
+            return ConnectStep::WAITING;
+        case TlsClient::State::FAILED:
+            broker.net.stop();
+            broker.stats.connectFailures++;
+            penalize(broker, MQTT_SCORE_CONNECT_FAILED);
+            return ConnectStep::FAILED;
+        case TlsClient::State::READY:
+            break;
+    }
+#else
+    // PubSubClient's connect blocks on DNS and the TCP connect, for as long
+    // as their timeouts when the broker is down, so it only runs once the
+    // probe has reached the broker
+    switch (broker.probe.getState()) {
+        case TcpProbe::State::IDLE:
+            broker.lastAttempt = millis();
+            if (broker.probe.start(broker.server.c_str(), broker.port)) {
+                return ConnectStep::WAITING;
+            }
+            broker.stats.connectFailures++;
+            penalize(broker, MQTT_SCORE_CONNECT_FAILED);
+            return ConnectStep::FAILED;
+        case TcpProbe::State::RUNNING:
+            return ConnectStep::WAITING;
+        case TcpProbe::State::UNREACHABLE:
+            broker.probe.reset();
+            DEBUG_PRINTF("[MQTT] %s:%d is not reachable.\n", broker.server.c_str(), broker.port);
+            broker.stats.connectFailures++;
+            penalize(broker, MQTT_SCORE_CONNECT_FAILED);
+            return ConnectStep::FAILED;
+        case TcpProbe::State::REACHABLE:
+            broker.probe.reset();
+            break;
+    }
+#endif
+    DEBUG_PRINTF("[MQTT] Attempting to connect to %s:%d... ", broker.server.c_str(), broker.port);
+    if (!broker.client.connect(MQTT_CLIENT_ID, _user.c_str(), _password.c_str())) {
+        DEBUG_PRINTF("failed, rc=%d.\n", broker.client.state());
+        // Drops the TLS session too, so the next attempt starts afresh
+        broker.net.stop();
+        broker.stats.connectFailures++;
+        penalize(broker, MQTT_SCORE_CONNECT_FAILED);
+        return ConnectStep::FAILED;
+    }
+    DEBUG_PRINTLN("connected!");
+    broker.wasConnected = true;
+    broker.stats.connects++;
+    broker.client.subscribe(_commandTopic.c_str());
+    DEBUG_PRINTF("[MQTT] Subscribed to: %s\n", _commandTopic.c_str());
+    for (int i = 0; i < _extraTopicCount; i++) {
+        broker.client.subscribe(_extraTopics[i].c_str());
+        DEBUG_PRINTF("[MQTT] Subscribed to: %s\n", _extraTopics[i].c_str());
+    }
+    return ConnectStep::DONE;
+}
+
+void MqttHandler::onConnected(uint8_t index) {
+    if (_lostAt != 0) {
+        _lastFailoverMs = millis() - _lostAt;
+        if (index != _lostBroker) {
+            _failovers++;
+            DEBUG_PRINTF("[MQTT] Failed over to %s:%d in %lu ms.\n", _brokers[index].server.c_str(),
+                         _brokers[index].port, (unsigned long)_lastFailoverMs);
+        }
+        _lostAt = 0;
+    }
+    publishStatus(index);
+    if (_connectCallback) {
+        _connectCallback();
+    }
+}
+
+void MqttHandler::penalize(Broker& broker, int points) {
+    broker.score = max(broker.score - points, 0);
+}
+
+void MqttHandler::publishStatus(uint8_t index) {
+    StaticJsonDocument<256> doc;
+    doc["firmware_version"] = FIRMWARE_VERSION;
+    doc["wifi_status"] = "Connected";
+    doc["mqtt_status"] = "Connected";
+    doc["payload_encoding"] = getPayloadEncodingName(_payloadEncoding);
+    doc["encoding_version"] = EVENT_ENCODING_VERSION;
+    char payload[256];
+    size_t length = serializeJson(doc, payload);
+    publishTo(index, "paradox/__status__", (const uint8_t*)payload, length, true);
+}
+
+void MqttHandler::setPayloadEncoding(PayloadEncoding encoding) {
+    if (_payloadEncoding == encoding) return;
+    _payloadEncoding = encoding;
+    DEBUG_PRINTF("[MQTT] Event payload encoding set to %s.\n", getPayloadEncodingName(encoding));
+    // Let consumers switch decoders before the first event in the new format
+    for (uint8_t i = 0; i < _brokerCount; i++) {
+        if (isPublishTarget(i)) {
+            publishStatus(i);
+        }
+    }
+}
+
+bool MqttHandler::publishTo(uint8_t index, const char* topic, const uint8_t* payload, size_t length, bool retain) {
+    if (!isPublishTarget(index)) {
+        return false;
+    }
+    Broker& broker = _brokers[index];
+    uint32_t start = micros();
+    bool ok = broker.client.publish(topic, payload, length, retain);
+    uint32_t elapsed = micros() - start;
+    broker.stats.publishes++;
+    broker.stats.publishUsTotal += elapsed;
+    broker.stats.publishUsMax = max(broker.stats.publishUsMax, elapsed);
+    if (!ok) {
+        broker.stats.publishFailures++;
+        penalize(broker, MQTT_SCORE_PUBLISH_FAILED);
+    } else if (elapsed > MQTT_SLOW_PUBLISH_MS * 1000UL) {
+        broker.stats.slowPublishes++;
+        penalize(broker, MQTT_SCORE_SLOW_PUBLISH);
+    }
+    return ok;
+}
+
+bool MqttHandler::publish(const char* topic, const char* payload, bool retain) {
+    LOG_D(LOG_TAG_MQTT, "[MQTT] Publishing. Topic: %s, Payload: %s\n", topic, payload);
+    return publishAll(topic, (const uint8_t*)payload, strlen(payload), retain);
+}
+
+bool MqttHandler::publish(const char* topic, const uint8_t* payload, size_t length, bool retain) {
+    LOG_D(LOG_TAG_MQTT, "[MQTT] Publishing. Topic: %s, Payload: %u bytes\n", topic, (unsigned)length);
+    return publishAll(topic, payload, length, retain);
+}
+
+bool MqttHandler::publishAll(const char* topic, const uint8_t* payload, size_t length, bool retain) {
+    bool sent = false;
+    bool targeted = false;
+    for (uint8_t i = 0; i < _brokerCount; i++) {
+        if (isPublishTarget(i)) {
+            targeted = true;
+            sent = publishTo(i, topic, payload, length, retain) || sent;
+        }
+    }
+    if (!targeted) {
+        DEBUG_PRINTLN("[MQTT] Cannot publish, not connected.");
+    }
+    return sent;
+}
+
+// Uses the last known link state; this also runs on the web server task
+void MqttHandler::toJson(JsonObject obj) const {
+    obj["mode"] = MQTT_FANOUT_ENABLED ? "fanout" : "failover";
+    if (!MQTT_FANOUT_ENABLED) {
+        obj["active"] = _active;
+    }
+    obj["failovers"] = _failovers;
+    obj["last_failover_ms"] = _lastFailoverMs;
+    JsonArray brokers = obj.createNestedArray("brokers");
+    for (uint8_t i = 0; i < _brokerCount; i++) {
+        const Broker& broker = _brokers[i];
+        JsonObject entry = brokers.createNestedObject();
+        entry["server"] = broker.server.c_str();
+        entry["port"] = broker.port;
+        entry["connected"] = broker.wasConnected;
+        entry["score"] = broker.score;
+        entry["connects"] = broker.stats.connects;
+        entry["connect_failures"] = broker.stats.connectFailures;
+        entry["disconnects"] = broker.stats.disconnects;
+        entry["publishes"] = broker.stats.publishes;
+        entry["publish_failures"] = broker.stats.publishFailures;
+        entry["slow_publishes"] = broker.stats.slowPublishes;
+        if (broker.stats.publishes > 0) {
+            entry["avg_publish_us"] = (uint32_t)(broker.stats.publishUsTotal / broker.stats.publishes);
+        }
+        entry["max_publish_us"] = broker.stats.publishUsMax;
+#if MQTT_TLS_ENABLED
+        broker.net.toJson(entry.createNestedObject("tls"));
+#endif
+    }
+}
@@ -1,32 +1,156 @@
 #pragma once
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <PubSubClient.h>
 #include <WiFi.h>
 #include <functional>
+#include "EventEncoder.h"
+#include "TlsClient.h"
+#include "TcpProbe.h"
+
+// Largest packet in either direction (diagnostics, labels, command batches, OTA requests)
+#ifndef MQTT_BUFFER_SIZE
+#if MQTT_TLS_ENABLED
+#define MQTT_BUFFER_SIZE 3584 // Diagnostics also carry per-broker TLS stats
+#else
+#define MQTT_BUFFER_SIZE 3072
+#endif
+#endif
+
+// Configured broker plus backups
+#ifndef MQTT_MAX_BROKERS
+#define MQTT_MAX_BROKERS 3
+#endif
+
+// 0: one broker at a time, the healthiest, preferring the configured one.
+// 1: stay connected to every broker and publish to all of them.
+#ifndef MQTT_FANOUT_ENABLED
+#define MQTT_FANOUT_ENABLED 0
+#endif
+
+// While on a backup, how often a higher-priority broker is tried again, in ms
+#ifndef MQTT_FAILBACK_INTERVAL
+#define MQTT_FAILBACK_INTERVAL 60000
+#endif
+
+// A publish taking longer than this counts against the broker's health, in ms
+#ifndef MQTT_SLOW_PUBLISH_MS
+#define MQTT_SLOW_PUBLISH_MS 100
+#endif
+
+// Health score: 100 is healthy. Failures take points off; every broker
+// earns some back each MQTT_SCORE_RECOVERY_INTERVAL, so none is written off.
+#define MQTT_SCORE_MAX 100
+#define MQTT_SCORE_CONNECT_FAILED 30
+#define MQTT_SCORE_CONNECTION_LOST 20
+#define MQTT_SCORE_PUBLISH_FAILED 10
+#define MQTT_SCORE_SLOW_PUBLISH 2
+#define MQTT_SCORE_RECOVERY 10
+#define MQTT_SCORE_RECOVERY_INTERVAL 30000
 
 // Define the function signature for the message callback
 using MqttCallback = std::function<void(char*, byte*, unsigned int)>;
+// Called each time a broker becomes a publish target
+using MqttConnectCallback = std::function<void()>;
+
+struct MqttBrokerStats {
+    uint32_t connects;
+    uint32_t connectFailures;
+    uint32_t disconnects;       // Connections lost after they were up
+    uint32_t publishes;
+    uint32_t publishFailures;
+    uint32_t slowPublishes;
+    uint64_t publishUsTotal;
+    uint32_t publishUsMax;
+};
 
 class MqttHandler {
 public:
     MqttHandler();
     void setup(const char* server, int port, const char* user, const char* password, const String& commandTopic, MqttCallback callback);
+    // Backups as "host[:port],host[:port]", same credentials as the primary
+    void addBackupBrokers(const char* list);
     void loop();
-    bool publish(const char* topic, const char* payload);
+    void addSubscription(const String& topic);
+    void setConnectCallback(MqttConnectCallback callback) { _connectCallback = callback; }
+    // To the active broker, or to every connected one with fan-out. True if
+    // at least one broker took it.
+    bool publish(const char* topic, const char* payload, bool retain = true);
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retain = true);
     bool isConnected();
     const char* getConnectionStatus();
 
+    // Per-broker access, so each broker can drain its own queue
+    uint8_t getBrokerCount() const { return _brokerCount; }
+    // Connected, and the active broker unless fanning out
+    bool isPublishTarget(uint8_t broker);
+    bool publishTo(uint8_t broker, const char* topic, const uint8_t* payload, size_t length, bool retain);
+
+    // Encoding used for paradox/events/<n>, announced in paradox/__status__
+    PayloadEncoding getPayloadEncoding() const { return _payloadEncoding; }
+    void setPayloadEncoding(PayloadEncoding encoding);
+
+    void toJson(JsonObject obj) const;
+
 private:
-    WiFiClient _wifiClient;
-    PubSubClient _mqttClient;
-    String _server;
-    int _port;
+    struct Broker {
+#if MQTT_TLS_ENABLED
+        TlsClient net;
+#else
+        WiFiClient net;
+        TcpProbe probe;             // Checked before each connect, see connect()
+#endif
+        PubSubClient client;
+        String server;
+        int port = 0;
+        int score = MQTT_SCORE_MAX;
+        bool wasConnected = false;  // As of the last loop(); safe to read from other tasks
+        unsigned long lastAttempt = 0;
+        MqttBrokerStats stats = {};
+        Broker() : client(net) {}
+    };
+
+    Broker _brokers[MQTT_MAX_BROKERS];
+    uint8_t _brokerCount = 0;
+    int8_t _active = -1;            // Failover: broker in use, -1 while none is
+    int8_t _pending = -1;           // Failover: broker whose TLS handshake or TCP probe is in flight
+    MqttCallback _callback;
     String _user;
     String _password;
     String _commandTopic;
+    static const int MAX_EXTRA_SUBSCRIPTIONS = 8;
+    String _extraTopics[MAX_EXTRA_SUBSCRIPTIONS];
+    int _extraTopicCount = 0;
     unsigned long _lastReconnectAttempt = 0;
-    bool _statusMessageSent = false;
+    bool _reconnectNow = false;
+    unsigned long _lastFailback = 0;
+    unsigned long _lastRecovery = 0;
+    PayloadEncoding _payloadEncoding = MQTT_PAYLOAD_ENCODING;
+    MqttConnectCallback _connectCallback;
+
+    // Failover timing: from losing the active broker to the next one connecting
+    unsigned long _lostAt = 0;
+    int8_t _lostBroker = -1;
+    uint32_t _failovers = 0;
+    uint32_t _lastFailoverMs = 0;
+
+    // A connect takes several loop() calls: the TLS handshake, or without TLS
+    // a TCP probe, runs in its own task and connect() reports WAITING until
+    // it is done
+    enum class ConnectStep : uint8_t { DONE, WAITING, FAILED };
 
-    void reconnect();
-};
\ No newline at end of file
+    void addBroker(const char* server, int port);
+    ConnectStep connect(uint8_t index);
+    bool isHandshaking(const Broker& broker) const;
+    void attempt(uint8_t index);
+    void promote(uint8_t index);
+    void checkConnections();
+    void serviceFailover();
+    void serviceFanout();
+    int8_t pickBroker(uint8_t count) const;
+    void onConnected(uint8_t index);
+    void penalize(Broker& broker, int points);
+    void publishStatus(uint8_t index);
+    bool publishAll(const char* topic, const uint8_t* payload, size_t length, bool retain);
+};
@@ -0,0 +1,82 @@
+#include "MulticastPublisher.h"
+#include "Config.h"
+#include "Log.h"
+#include <mbedtls/md.h>
+
+void MulticastPublisher::setup(const char* group, uint16_t port, const char* key) {
+    if (!_group.fromString(group)) {
+        DEBUG_PRINTF("[Multicast] Invalid group address %s\n", group);
+        return;
+    }
+    _port = port;
+    _key = key;
+    memset(&_batch, 0, sizeof(_batch));
+    _started = true;
+    DEBUG_PRINTF("[Multicast] Publishing events to %s:%u\n", group, port);
+}
+
+void MulticastPublisher::add(const ParadoxEvent& event) {
+    if (!_started) {
+        return;
+    }
+    // A datagram only carries consecutive sequence numbers
+    if (_batch.header.count > 0 && event.sequence != _batch.header.sequence + _batch.header.count) {
+        flush();
+    }
+    if (_batch.header.count == 0) {
+        _batch.header.sequence = event.sequence;
+        _batchStart = millis();
+    }
+    MulticastEvent& slot = _batch.events[_batch.header.count++];
+    slot.timestamp = event.timestamp;
+    slot.event = event.event;
+    slot.subEvent = event.subEvent;
+    slot.partition = event.partition;
+    slot.panel = event.panel;
+    if (_batch.header.count == MULTICAST_BATCH_MAX) {
+        flush();
+    }
+}
+
+uint32_t MulticastPublisher::service() {
+    if (_batch.header.count == 0) {
+        return UINT32_MAX;
+    }
+    unsigned long waited = millis() - _batchStart;
+    if (waited >= MULTICAST_BATCH_WINDOW) {
+        flush();
+        return UINT32_MAX;
+    }
+    return MULTICAST_BATCH_WINDOW - waited;
+}
+
+void MulticastPublisher::flush() {
+    uint8_t count = _batch.header.count;
+    _batch.header.magic = MULTICAST_MAGIC;
+    _batch.header.version = MULTICAST_VERSION;
+    _batch.header.sentAt = millis();
+
+    uint8_t digest[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                    (const unsigned char*)_key, strlen(_key),
+                    (const unsigned char*)&_batch, offsetof(MulticastDatagram, tag), digest);
+    memcpy(_batch.tag, digest, sizeof(_batch.tag));
+
+    // Best effort: a datagram that cannot be sent is dropped, never retried
+    if (_udp.beginPacket(_group, _port) && _udp.write((const uint8_t*)&_batch, sizeof(_batch)) == sizeof(_batch) &&
+        _udp.endPacket()) {
+        _datagrams++;
+        _events += count;
+    } else {
+        _sendFailures++;
+        LOG_D(LOG_TAG_NET, "[Multicast] Dropped datagram at sequence %u\n", _batch.header.sequence);
+    }
+    memset(&_batch, 0, sizeof(_batch));
+}
+
+void MulticastPublisher::toJson(JsonObject obj) {
+    obj["datagrams"] = _datagrams;
+    obj["events"] = _events;
+    obj["events_per_datagram"] = _datagrams ? (float)_events / _datagrams : 0.0f;
+    obj["send_failures"] = _sendFailures;
+}
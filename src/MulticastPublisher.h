@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include <ArduinoJson.h>
+#include "ParadoxEvents.h"
+
+// LAN fan-out of decoded events for consumers that cannot wait on the broker.
+// Off unless MULTICAST_ENABLED is set, which also requires MULTICAST_KEY.
+#ifndef MULTICAST_ENABLED
+#define MULTICAST_ENABLED 0
+#endif
+
+#ifndef MULTICAST_GROUP
+#define MULTICAST_GROUP "239.255.80.1"
+#endif
+
+#ifndef MULTICAST_PORT
+#define MULTICAST_PORT 5580
+#endif
+
+// Events arriving within this long of the first one share a datagram
+#ifndef MULTICAST_BATCH_WINDOW
+#define MULTICAST_BATCH_WINDOW 5
+#endif
+
+#define MULTICAST_MAGIC 0x5850 // "PX"
+#define MULTICAST_VERSION 1
+#define MULTICAST_BATCH_MAX 8
+#define MULTICAST_TAG_SIZE 16  // Truncated HMAC-SHA256
+
+#if MULTICAST_ENABLED && !defined(MULTICAST_KEY)
+#error "MULTICAST_ENABLED needs MULTICAST_KEY, the shared HMAC key"
+#endif
+
+// Wire format, little-endian. Every datagram is the full 92 bytes; slots past
+// count are zero. Events in a datagram have consecutive journal sequence
+// numbers starting at the header's, so a gap between datagrams is a loss.
+struct __attribute__((packed)) MulticastHeader {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t count;
+    uint32_t sequence;  // Journal sequence of the first event
+    uint32_t sentAt;    // millis() when the datagram was sent
+};
+
+struct __attribute__((packed)) MulticastEvent {
+    uint32_t timestamp; // millis() when the frame was decoded
+    uint8_t event;
+    uint8_t subEvent;
+    uint8_t partition;
+    uint8_t panel;
+};
+
+struct __attribute__((packed)) MulticastDatagram {
+    MulticastHeader header;
+    MulticastEvent events[MULTICAST_BATCH_MAX];
+    uint8_t tag[MULTICAST_TAG_SIZE]; // HMAC-SHA256 of everything above
+};
+static_assert(sizeof(MulticastDatagram) == 92, "MulticastDatagram is a wire format");
+
+class MulticastPublisher {
+public:
+    // Call once the network is up; events added before then are not sent
+    void setup(const char* group, uint16_t port, const char* key);
+
+    // Queues a journaled event for the current batch, sending the batch
+    // straight away when it is full or the sequence is not contiguous
+    void add(const ParadoxEvent& event);
+
+    // Sends a batch whose window has closed. Returns ms until the open batch
+    // is due, so the caller can bound its sleep.
+    uint32_t service();
+
+    void toJson(JsonObject obj);
+
+private:
+    WiFiUDP _udp;
+    IPAddress _group;
+    uint16_t _port = 0;
+    const char* _key = nullptr;
+    bool _started = false;
+
+    MulticastDatagram _batch;
+    unsigned long _batchStart = 0;
+
+    uint32_t _datagrams = 0;
+    uint32_t _events = 0;
+    uint32_t _sendFailures = 0;
+
+    void flush();
+};
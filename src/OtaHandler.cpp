@@ -2,13 +2,50 @@
 #include "Config.h"
 #include "LedHandler.h" // Include the full header here
 #include <ArduinoOTA.h>
+#include <HTTPClient.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/pk.h>
+
+#define OTA_TASK_STACK_SIZE 8192
+#define OTA_TASK_PRIORITY 1
+#define OTA_CHUNK_SIZE 1024
+#define OTA_STREAM_TIMEOUT 10000
+
+// The core marks a new image valid before setup() unless told otherwise;
+// returning true leaves that decision to checkSelfTest().
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+
+static bool parseHex(const char* hex, uint8_t* out, size_t maxLen, size_t& len) {
+    size_t digits = strlen(hex);
+    if (digits % 2 != 0 || digits / 2 > maxLen) {
+        return false;
+    }
+    for (size_t i = 0; i < digits / 2; i++) {
+        char byteStr[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
+        char* end;
+        out[i] = (uint8_t)strtoul(byteStr, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    len = digits / 2;
+    return true;
+}
 
 void OtaHandler::setup(const char* hostname, LedHandler* ledHandler) {
+    _ledHandler = ledHandler;
+#if OTA_PUSH_ENABLED
     ArduinoOTA.setHostname(hostname);
     // ArduinoOTA.setPassword("your_password"); // Optional password protection
 
-    ArduinoOTA.onStart([this, ledHandler]() {
+    ArduinoOTA.onStart([this]() {
         _otaInProgress = true; // Set flag
+        _throttleStart = millis();
+        _throttleBytes = 0;
         String type;
         if (ArduinoOTA.getCommand() == U_FLASH) {
             type = "sketch";
@@ -16,8 +53,8 @@ void OtaHandler::setup(const char* hostname, LedHandler* ledHandler) {
             type = "filesystem";
         }
         DEBUG_PRINTLN("[OTA] Start updating " + type);
-        if (ledHandler) {
-            ledHandler->setMode(LedMode::BLINK_FAST);
+        if (_ledHandler) {
+            _ledHandler->setMode(LedMode::BLINK_FAST);
         }
     });
 
@@ -26,8 +63,10 @@ void OtaHandler::setup(const char* hostname, LedHandler* ledHandler) {
         DEBUG_PRINTLN("\n[OTA] End");
     });
 
-    ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+    // Called after each chunk is written to flash, inside the OTA task
+    ArduinoOTA.onProgress([this](unsigned int progress, unsigned int total) {
         DEBUG_PRINTF("[OTA] Progress: %u%%\r", (progress / (total / 100)));
+        throttle(progress - _throttleBytes);
     });
 
     ArduinoOTA.onError([this](ota_error_t error) {
@@ -41,15 +80,194 @@ void OtaHandler::setup(const char* hostname, LedHandler* ledHandler) {
     });
 
     ArduinoOTA.begin();
+#else
+    DEBUG_PRINTLN("[OTA] Push updates disabled; signed images are pulled over MQTT.");
+#endif
     DEBUG_PRINTLN("[OTA] Handler ready.");
     DEBUG_PRINTF("[OTA] Hostname: %s\n", hostname);
+
+    // Pin to the core that does not run loop(), so flash writes never stall serial ingest
+    xTaskCreatePinnedToCore(taskMain, "ota", OTA_TASK_STACK_SIZE, this, OTA_TASK_PRIORITY, &_task, 0);
 }
 
-void OtaHandler::loop() {
-    ArduinoOTA.handle();
+void OtaHandler::taskMain(void* arg) {
+    OtaHandler* self = static_cast<OtaHandler*>(arg);
+    for (;;) {
+#if OTA_PUSH_ENABLED
+        ArduinoOTA.handle();
+#endif
+        if (self->_pullRequested) {
+            self->runPull();
+            self->_pullRequested = false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
 }
 
 bool OtaHandler::isOtaInProgress() const {
     return _otaInProgress;
 }
 
+// Sleeps just long enough to keep the average write rate under OTA_MAX_WRITE_RATE
+void OtaHandler::throttle(size_t bytesWritten) {
+    _throttleBytes += bytesWritten;
+    unsigned long elapsed = millis() - _throttleStart;
+    unsigned long budget = (unsigned long)((uint64_t)_throttleBytes * 1000 / OTA_MAX_WRITE_RATE);
+    vTaskDelay(pdMS_TO_TICKS(budget > elapsed ? budget - elapsed : 1));
+}
+
+bool OtaHandler::requestPull(const char* url, const char* sha256Hex, const char* signatureHex) {
+    if (!_task || _pullRequested || _otaInProgress) {
+        DEBUG_PRINTLN("[OTA] Pull rejected: OTA not ready or already running.");
+        return false;
+    }
+    if (!url || strlen(url) >= sizeof(_pullUrl)) {
+        DEBUG_PRINTLN("[OTA] Pull rejected: missing or oversized URL.");
+        return false;
+    }
+    size_t hashLen = 0;
+    if (!sha256Hex || !parseHex(sha256Hex, _pullSha256, sizeof(_pullSha256), hashLen) || hashLen != sizeof(_pullSha256)) {
+        DEBUG_PRINTLN("[OTA] Pull rejected: sha256 must be 64 hex digits.");
+        return false;
+    }
+    _pullSignatureLen = 0;
+    if (signatureHex && !parseHex(signatureHex, _pullSignature, sizeof(_pullSignature), _pullSignatureLen)) {
+        DEBUG_PRINTLN("[OTA] Pull rejected: malformed signature.");
+        return false;
+    }
+#ifdef OTA_SIGNING_PUBLIC_KEY
+    if (_pullSignatureLen == 0) {
+        DEBUG_PRINTLN("[OTA] Pull rejected: signature required.");
+        return false;
+    }
+#endif
+    strlcpy(_pullUrl, url, sizeof(_pullUrl));
+    _pullRequested = true;
+    DEBUG_PRINTF("[OTA] Pull queued from %s\n", _pullUrl);
+    return true;
+}
+
+// Streams the image into the inactive slot, hashing as it goes. The slot is
+// only made bootable once the hash (and signature, if configured) check out.
+void OtaHandler::runPull() {
+    HTTPClient http;
+    http.begin(_pullUrl);
+    int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        DEBUG_PRINTF("[OTA] Pull failed: HTTP %d\n", code);
+        http.end();
+        return;
+    }
+
+    int total = http.getSize();
+    if (!Update.begin(total > 0 ? (size_t)total : UPDATE_SIZE_UNKNOWN)) {
+        DEBUG_PRINTF("[OTA] Pull failed: %s\n", Update.errorString());
+        http.end();
+        return;
+    }
+
+    _otaInProgress = true;
+    _throttleStart = millis();
+    _throttleBytes = 0;
+    if (_ledHandler) {
+        _ledHandler->setMode(LedMode::BLINK_FAST);
+    }
+    DEBUG_PRINTF("[OTA] Pulling %d bytes\n", total);
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    WiFiClient* stream = http.getStreamPtr();
+    uint8_t chunk[OTA_CHUNK_SIZE];
+    size_t received = 0;
+    unsigned long lastData = millis();
+    bool ok = true;
+    while (http.connected() && (total < 0 || received < (size_t)total)) {
+        size_t available = stream->available();
+        if (available == 0) {
+            if (millis() - lastData > OTA_STREAM_TIMEOUT) {
+                DEBUG_PRINTLN("[OTA] Pull failed: stream timed out.");
+                ok = false;
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+        size_t n = stream->readBytes(chunk, min(available, sizeof(chunk)));
+        mbedtls_sha256_update(&sha, chunk, n);
+        if (Update.write(chunk, n) != n) {
+            DEBUG_PRINTF("[OTA] Pull failed: %s\n", Update.errorString());
+            ok = false;
+            break;
+        }
+        received += n;
+        lastData = millis();
+        throttle(n);
+    }
+    http.end();
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+
+    if (ok && total > 0 && received != (size_t)total) {
+        DEBUG_PRINTF("[OTA] Pull failed: got %u of %d bytes\n", (unsigned)received, total);
+        ok = false;
+    }
+    if (ok && memcmp(digest, _pullSha256, sizeof(digest)) != 0) {
+        DEBUG_PRINTLN("[OTA] Pull failed: SHA-256 mismatch.");
+        ok = false;
+    }
+#ifdef OTA_SIGNING_PUBLIC_KEY
+    if (ok) {
+        mbedtls_pk_context pk;
+        mbedtls_pk_init(&pk);
+        const char* key = OTA_SIGNING_PUBLIC_KEY;
+        ok = mbedtls_pk_parse_public_key(&pk, (const unsigned char*)key, strlen(key) + 1) == 0 &&
+             mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, digest, sizeof(digest), _pullSignature, _pullSignatureLen) == 0;
+        mbedtls_pk_free(&pk);
+        if (!ok) {
+            DEBUG_PRINTLN("[OTA] Pull failed: signature rejected.");
+        }
+    }
+#endif
+
+    if (!ok) {
+        Update.abort();
+        _otaInProgress = false;
+        return;
+    }
+    if (!Update.end(true)) {
+        DEBUG_PRINTF("[OTA] Pull failed: %s\n", Update.errorString());
+        _otaInProgress = false;
+        return;
+    }
+    DEBUG_PRINTLN("[OTA] Pull verified. Rebooting into new image.");
+    vTaskDelay(pdMS_TO_TICKS(200));
+    ESP.restart();
+}
+
+void OtaHandler::beginSelfTest() {
+    esp_ota_img_states_t state;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    _selfTestPending = esp_ota_get_state_partition(running, &state) == ESP_OK &&
+                       state == ESP_OTA_IMG_PENDING_VERIFY;
+    if (_selfTestPending) {
+        DEBUG_PRINTLN("[OTA] New image booted. Waiting for self-test.");
+    }
+}
+
+void OtaHandler::checkSelfTest(bool panelFrameDecoded, bool mqttConnected) {
+    if (!_selfTestPending) {
+        return;
+    }
+    if (panelFrameDecoded && mqttConnected) {
+        _selfTestPending = false;
+        esp_ota_mark_app_valid_cancel_rollback();
+        DEBUG_PRINTLN("[OTA] Self-test passed. Image marked valid.");
+    } else if (millis() > OTA_SELF_TEST_TIMEOUT) {
+        DEBUG_PRINTF("[OTA] Self-test failed (panel=%d, mqtt=%d). Rolling back.\n", panelFrameDecoded, mqttConnected);
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+}
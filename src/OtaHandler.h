@@ -4,13 +4,64 @@
 // Forward declare LedHandler to avoid circular dependency
 class LedHandler;
 
+// Cap on flash write throughput so serial ingest and MQTT keep their share of CPU
+#ifndef OTA_MAX_WRITE_RATE
+#define OTA_MAX_WRITE_RATE (64 * 1024) // bytes per second
+#endif
+
+// How long a freshly flashed image has to pass its self-test before rollback
+#ifndef OTA_SELF_TEST_TIMEOUT
+#define OTA_SELF_TEST_TIMEOUT 300000
+#endif
+
+// Optional PEM public key (ECDSA or RSA). When defined, pulled images must
+// carry a valid signature over their SHA-256.
+// #define OTA_SIGNING_PUBLIC_KEY "-----BEGIN PUBLIC KEY-----\n...\n-----END PUBLIC KEY-----\n"
+
+// ArduinoOTA push updates are not signed, so they are turned off whenever a
+// signing key is built in; otherwise anyone on the LAN could bypass it
+#ifdef OTA_SIGNING_PUBLIC_KEY
+#define OTA_PUSH_ENABLED 0
+#else
+#define OTA_PUSH_ENABLED 1
+#endif
+
 class OtaHandler {
 public:
+    // Starts the OTA task. ArduinoOTA (push, unless signing is on) and pulled
+    // updates both run in that task, so the main loop keeps servicing the
+    // panel during an update.
     void setup(const char* hostname, LedHandler* ledHandler);
-    void loop();
     bool isOtaInProgress() const;
 
+    // Queues a pull update from a local HTTP server. sha256Hex is required;
+    // signatureHex (DER, hex encoded) is required when a signing key is built in.
+    bool requestPull(const char* url, const char* sha256Hex, const char* signatureHex);
+
+    // Checks whether this boot is the first run of a freshly flashed image
+    void beginSelfTest();
+    // Call periodically after boot. Marks a freshly flashed image valid once
+    // the panel and MQTT are both working, or rolls back after the timeout.
+    void checkSelfTest(bool panelFrameDecoded, bool mqttConnected);
+    bool isSelfTestPending() const { return _selfTestPending; }
+
 private:
-    bool _otaInProgress = false;
-};
+    volatile bool _otaInProgress = false;
+    bool _selfTestPending = false;
+    LedHandler* _ledHandler = nullptr;
+    TaskHandle_t _task = nullptr;
+
+    // Pending pull request, handed from the MQTT handler to the OTA task
+    volatile bool _pullRequested = false;
+    char _pullUrl[128];
+    uint8_t _pullSha256[32];
+    uint8_t _pullSignature[128];
+    size_t _pullSignatureLen = 0;
 
+    unsigned long _throttleStart = 0;
+    size_t _throttleBytes = 0;
+
+    static void taskMain(void* arg);
+    void runPull();
+    void throttle(size_t bytesWritten);
+};
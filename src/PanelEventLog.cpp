@@ -0,0 +1,143 @@
+#include "PanelEventLog.h"
+#include "Config.h"
+#include <Preferences.h>
+
+static uint32_t readUint32BE(const uint8_t* in) {
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+void PanelEventLog::load() {
+    char key[12];
+    snprintf(key, sizeof(key), "marker%u", _panelId);
+    Preferences prefs;
+    prefs.begin("eventlog", true);
+    _markerValid = prefs.isKey(key);
+    _marker = prefs.getUInt(key, 0);
+    prefs.end();
+    if (_markerValid) {
+        DEBUG_PRINTF("[EventLog%u] Last seen panel log entry %u.\n", _panelId, _marker);
+    }
+}
+
+void PanelEventLog::saveMarker(uint32_t marker) {
+    if (_markerValid && marker == _marker) {
+        return;
+    }
+    char key[12];
+    snprintf(key, sizeof(key), "marker%u", _panelId);
+    Preferences prefs;
+    prefs.begin("eventlog", false);
+    prefs.putUInt(key, marker);
+    prefs.end();
+    _marker = marker;
+    _markerValid = true;
+}
+
+bool PanelEventLog::begin(const uint8_t* header) {
+    _stats.runs++;
+    _stats.lastEvents = 0;
+    _count = readUint32BE(header);
+    _size = ((uint16_t)header[4] << 8) | header[5];
+    _liveAtBegin = _liveSinceSync;
+    _liveSinceSync = 0;
+    _from = 1;
+    _to = 0;
+    _emitted = 0;
+    _active = true;
+
+    if (_size == 0 || _size % 2 != 0 || _size > EVENT_LOG_MAX_SIZE) {
+        DEBUG_PRINTF("[EventLog%u] Unusable log header (size %u). Check PARADOX_EVENT_LOG_ADDRESS.\n", _panelId, _size);
+        _active = false;
+        return false;
+    }
+    if (!_markerValid) {
+        // Nothing to compare with, and replaying the whole log would be noise
+        DEBUG_PRINTF("[EventLog%u] First read of the panel log. Following from entry %u.\n", _panelId, _count);
+        return true;
+    }
+    if (_count < _marker) {
+        DEBUG_PRINTF("[EventLog%u] Panel log restarted at %u (was %u).\n", _panelId, _count, _marker);
+        return true;
+    }
+
+    // Events that arrived live since the marker was saved came before the
+    // session dropped, so they are the oldest entries after it
+    uint32_t seen = min<uint32_t>(_liveAtBegin, _count - _marker);
+    _stats.skipped += seen;
+    _from = _marker + seen + 1;
+    _to = _count;
+    if (_to >= _from && _to - _from >= _size) {
+        uint32_t lost = _to - _from + 1 - _size;
+        _stats.lost += lost;
+        _from += lost;
+        DEBUG_PRINTF("[EventLog%u] %u entries were overwritten before they could be read.\n", _panelId, lost);
+    }
+    // Blocks start at odd entry numbers, on an even ring slot
+    _nextBlock = _from - ((_from - 1) & 1);
+    if (_to >= _from) {
+        DEBUG_PRINTF("[EventLog%u] Catching up on entries %u..%u.\n", _panelId, _from, _to);
+    }
+    return true;
+}
+
+bool PanelEventLog::nextBlock(uint16_t& address, uint32_t& firstEntry) {
+    if (!hasNextBlock()) {
+        return false;
+    }
+    firstEntry = _nextBlock;
+    address = PARADOX_EVENT_LOG_ADDRESS + EVENT_LOG_BLOCK_SIZE + ((_nextBlock - 1) % _size) * EVENT_LOG_ENTRY_SIZE;
+    _nextBlock += 2;
+    return true;
+}
+
+void PanelEventLog::deliver(uint32_t firstEntry, const uint8_t* block, const EventLogEntryCallback& emit) {
+    for (uint8_t i = 0; i < EVENT_LOG_BLOCK_SIZE / EVENT_LOG_ENTRY_SIZE; i++) {
+        uint32_t entry = firstEntry + i;
+        if (entry >= _from && entry <= _to) {
+            emit(block + i * EVENT_LOG_ENTRY_SIZE);
+            _emitted = entry;
+            _stats.events++;
+            _stats.lastEvents++;
+        }
+    }
+}
+
+void PanelEventLog::finish(unsigned long elapsedMs) {
+    if (!_active) {
+        return;
+    }
+    _active = false;
+    _stats.lastMs = elapsedMs;
+    _syncedAt = millis();
+    saveMarker(_count);
+    if (_stats.lastEvents > 0) {
+        DEBUG_PRINTF("[EventLog%u] Caught up on %u events in %lu ms.\n", _panelId, _stats.lastEvents, elapsedMs);
+    }
+}
+
+// Keeps what was emitted; the rest is read on the next pass
+void PanelEventLog::abort() {
+    if (!_active) {
+        return;
+    }
+    _active = false;
+    if (_emitted > 0) {
+        saveMarker(_emitted);
+    } else {
+        // Still right after the unchanged marker
+        _liveSinceSync = min<uint32_t>((uint32_t)_liveSinceSync + _liveAtBegin, UINT16_MAX);
+    }
+}
+
+void PanelEventLog::toJson(JsonObject obj) const {
+    obj["marker"] = _marker;
+    obj["runs"] = _stats.runs;
+    obj["events"] = _stats.events;
+    obj["skipped"] = _stats.skipped;
+    obj["lost"] = _stats.lost;
+    obj["last_events"] = _stats.lastEvents;
+    obj["last_ms"] = _stats.lastMs;
+    if (_stats.lastMs > 0 && _stats.lastEvents > 0) {
+        obj["last_events_per_sec"] = _stats.lastEvents * 1000.0f / _stats.lastMs;
+    }
+}
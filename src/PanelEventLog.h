@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+
+// Read events the panel logged while the bridge was away. Off by default:
+// the log's location differs between panel models, so set
+// PARADOX_EVENT_LOG_ADDRESS for yours before turning it on.
+#ifndef PARADOX_CATCHUP_ENABLED
+#define PARADOX_CATCHUP_ENABLED 0
+#endif
+
+// Header block of the panel's event log; entries follow it
+#ifndef PARADOX_EVENT_LOG_ADDRESS
+#define PARADOX_EVENT_LOG_ADDRESS 0x0800
+#endif
+
+// While logged in, how often the last-seen marker is brought up to date
+// after live events, in ms. Bounds the duplicates a power cut can cause.
+#ifndef PARADOX_EVENT_LOG_SYNC
+#define PARADOX_EVENT_LOG_SYNC 60000
+#endif
+
+// Header: total entries ever written (4, big-endian), ring size (2, big-endian).
+// Entries are 8 bytes: year, month, day, hour, minute, event, sub-event,
+// partition. Entry n (1-based) is in ring slot (n - 1) % size, and reads
+// return two entries.
+#define EVENT_LOG_BLOCK_SIZE 16
+#define EVENT_LOG_ENTRY_SIZE 8
+#define EVENT_LOG_MAX_SIZE 1024
+
+struct CatchupStats {
+    uint32_t runs;        // Header reads, including plain marker syncs
+    uint32_t events;      // Historical events emitted
+    uint32_t skipped;     // Entries already seen live
+    uint32_t lost;        // Overwritten in the panel before they were read
+    uint32_t lastEvents;
+    uint32_t lastMs;
+};
+
+// Called with an 8-byte entry, oldest first
+using EventLogEntryCallback = std::function<void(const uint8_t* entry)>;
+
+// Plans and tracks one pass over the panel's event log. The marker is the
+// number of the newest entry the bridge has handled; it is kept in NVS.
+class PanelEventLog {
+public:
+    explicit PanelEventLog(uint8_t panelId) : _panelId(panelId) {}
+
+    void load();
+    // A live event frame arrived; the entry it was logged as needs no replay
+    void noteLive() { if (_liveSinceSync < UINT16_MAX) _liveSinceSync++; }
+    // Live events since the last sync, and the sync interval has passed
+    bool syncDue() const { return _liveSinceSync > 0 && millis() - _syncedAt >= PARADOX_EVENT_LOG_SYNC; }
+
+    // Plans the pass from the header block. False if the header is unusable,
+    // in which case there is nothing to read.
+    bool begin(const uint8_t* header);
+    // Next block to read. False once every planned block has been handed out.
+    bool nextBlock(uint16_t& address, uint32_t& firstEntry);
+    bool hasNextBlock() const { return _active && _from <= _to && _nextBlock <= _to; }
+    // Hands the entries of a block that fall in the planned range to emit
+    void deliver(uint32_t firstEntry, const uint8_t* block, const EventLogEntryCallback& emit);
+    // Ends the pass; the marker moves to what was read
+    void finish(unsigned long elapsedMs);
+    void abort();
+
+    const CatchupStats& getStats() const { return _stats; }
+    void toJson(JsonObject obj) const;
+
+private:
+    uint8_t _panelId;
+    uint32_t _marker = 0;
+    bool _markerValid = false;  // False until the first header after install
+    uint16_t _liveSinceSync = 0;
+    unsigned long _syncedAt = 0;
+
+    // Current pass
+    uint32_t _count = 0;        // Header's entry count
+    uint16_t _size = 0;
+    uint16_t _liveAtBegin = 0;
+    uint32_t _from = 0;         // Entries to emit, inclusive
+    uint32_t _to = 0;
+    uint32_t _nextBlock = 0;    // First entry of the next block to read
+    uint32_t _emitted = 0;      // Newest entry emitted this pass
+    bool _active = false;       // Between begin() and finish() or abort()
+
+    CatchupStats _stats = {};
+
+    void saveMarker(uint32_t marker);
+};
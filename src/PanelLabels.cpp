@@ -0,0 +1,204 @@
+#include "PanelLabels.h"
+#include "Config.h"
+#include "Storage.h"
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+
+uint16_t PanelLabels::addressOf(uint8_t index) {
+    if (index < LABEL_ZONES) {
+        return LABEL_ZONE_ADDRESS + index * LABEL_SIZE;
+    }
+    index -= LABEL_ZONES;
+    if (index < LABEL_PARTITIONS) {
+        return LABEL_PARTITION_ADDRESS + index * LABEL_SIZE;
+    }
+    return LABEL_USER_ADDRESS + (index - LABEL_PARTITIONS) * LABEL_SIZE;
+}
+
+int PanelLabels::indexOf(uint16_t address) {
+    struct Range { uint16_t start; uint8_t count; uint8_t first; };
+    static const Range ranges[] = {
+        {LABEL_ZONE_ADDRESS, LABEL_ZONES, 0},
+        {LABEL_PARTITION_ADDRESS, LABEL_PARTITIONS, LABEL_ZONES},
+        {LABEL_USER_ADDRESS, LABEL_USERS, LABEL_ZONES + LABEL_PARTITIONS},
+    };
+    for (const Range& range : ranges) {
+        if (address >= range.start && address < range.start + range.count * LABEL_SIZE &&
+            (address - range.start) % LABEL_SIZE == 0) {
+            return range.first + (address - range.start) / LABEL_SIZE;
+        }
+    }
+    return -1;
+}
+
+static const char* getSourceName(LabelSource source) {
+    switch (source) {
+        case LabelSource::CACHE: return "cache";
+        case LabelSource::PANEL: return "panel";
+        default:                 return "none";
+    }
+}
+
+void PanelLabels::filePath(char* path, size_t size) const {
+    snprintf(path, size, "/labels%u.bin", _panelId);
+}
+
+bool PanelLabels::load() {
+    char path[24];
+    filePath(path, sizeof(path));
+    if (!mountStorage() || !LittleFS.exists(path)) {
+        DEBUG_PRINTF("[Labels%u] No cached labels.\n", _panelId);
+        return false;
+    }
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
+    }
+    LabelFileHeader header;
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == LABELS_FILE_MAGIC && header.version == LABELS_FILE_VERSION &&
+              header.panel == _panelId && header.count == LABEL_COUNT &&
+              file.read((uint8_t*)_raw, sizeof(_raw)) == sizeof(_raw) &&
+              esp_rom_crc32_le(0, (const uint8_t*)_raw, sizeof(_raw)) == header.crc;
+    file.close();
+    if (!ok) {
+        DEBUG_PRINTF("[Labels%u] Cached labels are damaged or from another layout. Reading the panel.\n", _panelId);
+        return false;
+    }
+    activate();
+    _crc = header.crc;
+    _source = LabelSource::CACHE;
+    DEBUG_PRINTF("[Labels%u] Loaded %u labels from cache.\n", _panelId, LABEL_COUNT);
+    return true;
+}
+
+void PanelLabels::store(uint8_t index, const uint8_t* data) {
+    if (index < LABEL_COUNT) {
+        memcpy(_raw[index], data, LABEL_SIZE);
+    }
+}
+
+void PanelLabels::finishDownload(unsigned long elapsedMs) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)_raw, sizeof(_raw));
+    activate();
+    // An unchanged re-read costs no flash write
+    if (_source == LabelSource::NONE || crc != _crc) {
+        save(crc);
+    }
+    _crc = crc;
+    _source = LabelSource::PANEL;
+    _stale = false;
+    _downloadMs = elapsedMs;
+    _downloads++;
+}
+
+// Builds the text copies: trailing padding trimmed, and anything that would
+// need escaping in JSON replaced, so labels can be pasted into payloads as-is
+void PanelLabels::activate() {
+    for (uint8_t i = 0; i < LABEL_COUNT; i++) {
+        char* text = _text[i];
+        for (uint8_t c = 0; c < LABEL_SIZE; c++) {
+            uint8_t ch = _raw[i][c];
+            text[c] = (ch < 0x20 || ch > 0x7E || ch == '"' || ch == '\\') ? ' ' : ch;
+        }
+        int len = LABEL_SIZE;
+        while (len > 0 && text[len - 1] == ' ') {
+            len--;
+        }
+        text[len] = '\0';
+    }
+}
+
+void PanelLabels::save(uint32_t crc) {
+    char path[24];
+    filePath(path, sizeof(path));
+    File file = LittleFS.open(path, "w");
+    if (!file) {
+        DEBUG_PRINTF("[Labels%u] Failed to write label cache.\n", _panelId);
+        return;
+    }
+    LabelFileHeader header = {LABELS_FILE_MAGIC, LABELS_FILE_VERSION, _panelId, LABEL_COUNT, crc};
+    file.write((const uint8_t*)&header, sizeof(header));
+    file.write((const uint8_t*)_raw, sizeof(_raw));
+    file.close();
+}
+
+const char* PanelLabels::get(LabelKind kind, uint8_t number) const {
+    if (_source == LabelSource::NONE || number == 0) {
+        return nullptr;
+    }
+    uint8_t index = number - 1;
+    switch (kind) {
+        case LabelKind::ZONE:
+            if (number > LABEL_ZONES) return nullptr;
+            break;
+        case LabelKind::PARTITION:
+            if (number > LABEL_PARTITIONS) return nullptr;
+            index += LABEL_ZONES;
+            break;
+        case LabelKind::USER:
+            if (number > LABEL_USERS) return nullptr;
+            index += LABEL_ZONES + LABEL_PARTITIONS;
+            break;
+    }
+    return _text[index][0] ? _text[index] : nullptr;
+}
+
+const char* PanelLabels::forEvent(const ParadoxEvent& event) const {
+    switch (event.event) {
+        case 0:  // Zone OK
+        case 1:  // Zone open
+        case 36: // Zone in alarm
+        case 37: // Fire alarm
+        case 38: // Zone alarm restore
+        case 39: // Fire alarm restore
+        case 49: // Low battery on zone
+        case 50: // Low battery on zone restore
+            return get(LabelKind::ZONE, event.subEvent);
+        case 2:  // Partition status; the polled state carries partition 0
+        case 6:
+            return get(LabelKind::PARTITION, event.partition ? event.partition : 1);
+        case 29: // Arming with user
+        case 31: // Disarming with user
+            return get(LabelKind::USER, event.subEvent);
+        default:
+            return nullptr;
+    }
+}
+
+size_t PanelLabels::formatJson(char* out, size_t size) const {
+    static const struct { const char* key; LabelKind kind; uint8_t count; } sections[] = {
+        {"zones", LabelKind::ZONE, LABEL_ZONES},
+        {"partitions", LabelKind::PARTITION, LABEL_PARTITIONS},
+        {"users", LabelKind::USER, LABEL_USERS},
+    };
+    size_t len = snprintf(out, size, "{\"source\":\"%s\"", getSourceName(_source));
+    for (const auto& section : sections) {
+        if (len < size) {
+            len += snprintf(out + len, size - len, ",\"%s\":{", section.key);
+        }
+        bool first = true;
+        for (uint8_t number = 1; number <= section.count && len < size; number++) {
+            const char* label = get(section.kind, number);
+            if (label) {
+                len += snprintf(out + len, size - len, "%s\"%u\":\"%s\"", first ? "" : ",", number, label);
+                first = false;
+            }
+        }
+        if (len < size) {
+            len += snprintf(out + len, size - len, "}");
+        }
+    }
+    if (len < size) {
+        len += snprintf(out + len, size - len, "}");
+    }
+    return len < size ? len : 0;
+}
+
+void PanelLabels::toJson(JsonObject obj) const {
+    obj["source"] = getSourceName(_source);
+    obj["download_ms"] = _downloadMs;
+    obj["downloads"] = _downloads;
+    obj["failures"] = _failures;
+    obj["read_retries"] = _retries;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "ParadoxEvents.h"
+
+// Read zone, partition and user labels from the panel and cache them
+#ifndef LABELS_ENABLED
+#define LABELS_ENABLED 1
+#endif
+
+#define LABELS_FILE_MAGIC 0x4C425850 // "PXBL"
+#define LABELS_FILE_VERSION 1
+
+// Panel EEPROM layout: consecutive space-padded 16-byte labels
+#define LABEL_SIZE 16
+#define LABEL_ZONES 32
+#define LABEL_PARTITIONS 2
+#define LABEL_USERS 48
+#define LABEL_ZONE_ADDRESS 0x010
+#define LABEL_PARTITION_ADDRESS 0x310
+#define LABEL_USER_ADDRESS 0x330
+#define LABEL_COUNT (LABEL_ZONES + LABEL_PARTITIONS + LABEL_USERS)
+
+enum class LabelKind : uint8_t { ZONE, PARTITION, USER };
+
+enum class LabelSource : uint8_t {
+    NONE,  // Not read yet
+    CACHE, // Loaded from flash at boot
+    PANEL  // Downloaded from the panel this boot
+};
+
+// File layout, little-endian: this header, then LABEL_COUNT raw labels in
+// download order. crc covers the labels.
+struct __attribute__((packed)) LabelFileHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t panel;
+    uint16_t count;
+    uint32_t crc;
+};
+
+// Labels for one panel. The handler downloads them block by block; they are
+// only used once the whole set has arrived.
+class PanelLabels {
+public:
+    explicit PanelLabels(uint8_t panelId) : _panelId(panelId) {}
+
+    // Loads the cached labels. False if there is no cache or it is damaged.
+    bool load();
+
+    // EEPROM address of label block index, 0 <= index < LABEL_COUNT
+    static uint16_t addressOf(uint8_t index);
+    // Block index for an address, or -1 if it is not a label
+    static int indexOf(uint16_t address);
+
+    // Keeps a downloaded block until the download completes
+    void store(uint8_t index, const uint8_t* data);
+    // Activates the downloaded set and writes the cache if it changed
+    void finishDownload(unsigned long elapsedMs);
+    void downloadFailed() { _failures++; }
+    void noteRetry() { _retries++; }
+
+    // Panel config may have changed; the labels are read again
+    void markStale() { _stale = true; }
+    bool needsDownload() const { return _source == LabelSource::NONE || _stale; }
+    LabelSource getSource() const { return _source; }
+
+    // Label by 1-based number, nullptr if unknown or blank
+    const char* get(LabelKind kind, uint8_t number) const;
+    // Label of the zone, partition or user an event refers to
+    const char* forEvent(const ParadoxEvent& event) const;
+
+    // {"source":..,"zones":{"1":"Front door"},"partitions":{..},"users":{..}}
+    // Returns 0 if size is too small.
+    size_t formatJson(char* out, size_t size) const;
+    void toJson(JsonObject obj) const;
+
+private:
+    uint8_t _panelId;
+    uint8_t _raw[LABEL_COUNT][LABEL_SIZE];        // As read; the cache file body
+    char _text[LABEL_COUNT][LABEL_SIZE + 1] = {}; // Trimmed, JSON-safe copies in use
+    uint32_t _crc = 0;                            // Of the labels in use
+    LabelSource _source = LabelSource::NONE;
+    bool _stale = false;
+
+    uint32_t _downloadMs = 0;
+    uint32_t _downloads = 0;
+    uint32_t _failures = 0;
+    uint32_t _retries = 0;
+
+    void activate();
+    void save(uint32_t crc);
+    void filePath(char* path, size_t size) const;
+};
@@ -1,90 +1,126 @@
 #include "ParadoxEvents.h"
 
-String getEventDescription(int event, int sub_event) {
-    String description = "";
+size_t getEventDescription(int event, int sub_event, char* out, size_t size) {
+    if (size > 0) {
+        out[0] = '\0';
+    }
+    const char* prefix;
+    const char* name = nullptr; // nullptr prints the sub-event number after the prefix
     switch (event) {
-        case 0: description = "Zone OK: " + String(sub_event); break;
-        case 1: description = "Zone open: " + String(sub_event); break;
+        case 0: prefix = "Zone OK: "; break;
+        case 1: prefix = "Zone open: "; break;
         case 2: {
-            description = "Partition status: ";
+            prefix = "Partition status: ";
             switch (sub_event) {
-                case 2: description += "Silent alarm"; break;
-                case 3: description += "Buzzer alarm"; break;
-                case 4: description += "Steady alarm"; break;
-                case 5: description += "Pulsed alarm"; break;
-                case 6: description += "Strobe"; break;
-                case 7: description += "Alarm stopped"; break;
-                case 8: description += "Squawk ON"; break;
-                case 9: description += "Squawk OFF"; break;
-                case 10: description += "Ground start"; break;
-                case 11: description += "Disarm partition"; break;
-                case 12: description += "Arm partition"; break;
-                case 13: description += "Entry delay started"; break;
-                case 14: description += "Exit delay started"; break;
-                case 15: description += "Pre-alarm delay"; break;
-                case 16: description += "Report confirmation"; break;
-                default: description = ""; break;
+                case 2: name = "Silent alarm"; break;
+                case 3: name = "Buzzer alarm"; break;
+                case 4: name = "Steady alarm"; break;
+                case 5: name = "Pulsed alarm"; break;
+                case 6: name = "Strobe"; break;
+                case 7: name = "Alarm stopped"; break;
+                case 8: name = "Squawk ON"; break;
+                case 9: name = "Squawk OFF"; break;
+                case 10: name = "Ground start"; break;
+                case 11: name = "Disarm partition"; break;
+                case 12: name = "Arm partition"; break;
+                case 13: name = "Entry delay started"; break;
+                case 14: name = "Exit delay started"; break;
+                case 15: name = "Pre-alarm delay"; break;
+                case 16: name = "Report confirmation"; break;
+                default: return 0;
             }
             break;
         }
         case 3: {
-            description = "Bell status: ";
+            prefix = "Bell status: ";
             switch (sub_event) {
-                case 0: description += "Bell OFF"; break;
-                case 1: description += "Bell ON"; break;
-                case 2: description += "Bell squawk arm"; break;
-                case 3: description += "Bell squawk disarm"; break;
-                default: description = ""; break;
+                case 0: name = "Bell OFF"; break;
+                case 1: name = "Bell ON"; break;
+                case 2: name = "Bell squawk arm"; break;
+                case 3: name = "Bell squawk disarm"; break;
+                default: return 0;
             }
             break;
         }
         case 6: {
-            description = "Non-reportable event: ";
+            prefix = "Non-reportable event: ";
             switch (sub_event) {
-                case 3: description += "Arm in Stay mode"; break;
-                case 4: description += "Arm in Sleep mode"; break;
-                case 5: description += "Arm in Force mode"; break;
-                default: description = ""; break;
+                case 3: name = "Arm in Stay mode"; break;
+                case 4: name = "Arm in Sleep mode"; break;
+                case 5: name = "Arm in Force mode"; break;
+                default: return 0;
             }
             break;
         }
-        case 29: description = "Arming with user: " + String(sub_event); break;
+        case 29: prefix = "Arming with user: "; break;
         case 30: {
-            description = "Special arming: ";
+            prefix = "Special arming: ";
             switch (sub_event) {
-                case 0: description += "Auto-arming"; break;
-                case 4: description += "Quick arming"; break;
-                default: description = ""; break;
+                case 0: name = "Auto-arming"; break;
+                case 4: name = "Quick arming"; break;
+                default: return 0;
             }
             break;
         }
-        case 31: description = "Disarming with user: " + String(sub_event); break;
+        case 31: prefix = "Disarming with user: "; break;
         case 34: {
-            description = "Special disarming: ";
+            prefix = "Special disarming: ";
             switch (sub_event) {
-                case 5: description += "Disarm with keyswitch"; break;
-                default: description = ""; break;
+                case 5: name = "Disarm with keyswitch"; break;
+                default: return 0;
             }
             break;
         }
-        case 36: description = "Zone in alarm: " + String(sub_event); break;
-        case 37: description = "Fire alarm: " + String(sub_event); break;
-        case 38: description = "Zone alarm restore: " + String(sub_event); break;
-        case 39: description = "Fire alarm restore: " + String(sub_event); break;
-        case 44: description = "New trouble"; break;
-        case 45: description = "Trouble restored"; break;
+        case 36: prefix = "Zone in alarm: "; break;
+        case 37: prefix = "Fire alarm: "; break;
+        case 38: prefix = "Zone alarm restore: "; break;
+        case 39: prefix = "Fire alarm restore: "; break;
+        case 44: prefix = "New trouble"; name = ""; break;
+        case 45: prefix = "Trouble restored"; name = ""; break;
         case 48: {
-            description = "Special: ";
+            prefix = "Special: ";
             switch (sub_event) {
-                case 2: description += "Software log on"; break;
-                case 3: description += "Software log off"; break;
-                default: description = ""; break;
+                case 2: name = "Software log on"; break;
+                case 3: name = "Software log off"; break;
+                default: return 0;
             }
             break;
         }
-        case 49: description = "Low battery on zone: " + String(sub_event); break;
-        case 50: description = "Low battery on zone restore: " + String(sub_event); break;
-        default: description = ""; break;
+        case 49: prefix = "Low battery on zone: "; break;
+        case 50: prefix = "Low battery on zone restore: "; break;
+        default: return 0;
+    }
+    int len = name ? snprintf(out, size, "%s%s", prefix, name) : snprintf(out, size, "%s%d", prefix, sub_event);
+    return len > 0 && (size_t)len < size ? len : 0;
+}
+
+const char* getPartitionStateName(uint8_t subEvent) {
+    switch (subEvent) {
+        case 3:  return "armed_stay";
+        case 4:  return "armed_sleep";
+        case 6:  return "triggered";
+        case 11: return "disarmed";
+        case 12: return "armed_away";
+        default: return "unknown";
+    }
+}
+
+AlarmChange getAlarmChange(uint8_t event, uint8_t subEvent) {
+    if (event == 36 || event == 37) {
+        return AlarmChange::RAISED; // Zone or fire alarm
+    }
+    if (event != 2) {
+        return AlarmChange::NONE;
+    }
+    switch (subEvent) {
+        case 2:  // Silent alarm
+        case 5:  // Pulsed alarm
+        case 6:  // Strobe
+            return AlarmChange::RAISED;
+        case 7:  // Alarm stopped
+        case 11: // Disarmed
+            return AlarmChange::CLEARED;
+        default:
+            return AlarmChange::NONE;
     }
-    return description;
 }
@@ -2,4 +2,28 @@
 
 #include <Arduino.h>
 
-String getEventDescription(int event, int sub_event);
+// A decoded panel event as handed from ParadoxHandler to the publishers
+struct ParadoxEvent {
+    uint8_t event;
+    uint8_t subEvent;
+    uint8_t partition;
+    uint8_t panel;      // Id of the ParadoxHandler that decoded it
+    uint32_t timestamp; // millis() when the frame was decoded
+    uint32_t sequence;  // Assigned by the publisher, 0 until then
+    bool historical;    // Read back from the panel's event log, not seen live
+};
+
+#define EVENT_DESCRIPTION_SIZE 48
+
+// Writes a readable description of an event to out without touching the heap.
+// Returns its length, or 0 (and an empty string) for events without one.
+size_t getEventDescription(int event, int sub_event, char* out, size_t size);
+
+// Arm state for a partition sub-event as ParadoxHandler reports it (event 2)
+const char* getPartitionStateName(uint8_t subEvent);
+
+enum class AlarmChange : uint8_t { NONE, RAISED, CLEARED };
+
+// Whether a live event starts or ends an alarm. ParadoxHandler reuses 2/3 and
+// 2/4 for Armed Stay and Armed Sleep, so those are not alarms here.
+AlarmChange getAlarmChange(uint8_t event, uint8_t subEvent);
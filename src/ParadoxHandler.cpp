@@ -1,117 +1,424 @@
 #include "ParadoxHandler.h"
 #include "Config.h"
+#include "Log.h"
+
+// Panel needs a moment between the disconnect and a fresh login
+#define LOGIN_DISCONNECT_SETTLE 250
+#define LOGIN_INIT_TIMEOUT 1000
+#define LOGIN_PASSWORD_TIMEOUT 2000
+// Give the panel a moment to settle after login before the first command
+#define LOGIN_SETTLE_TIME 250
+// Max time to wait for the reply to a command before sending the next one
+#define COMMAND_REPLY_TIMEOUT 500
+#define COMMAND_GAP 100
+#define KEEP_ALIVE_INTERVAL 1800000
+// A memory block is asked for this many times before the job is abandoned
+#define MEMORY_READ_TRIES 3
+// Wait after a failed label download or catch-up before trying again
+#define READ_RETRY_INTERVAL 300000
+// Partition whose arm state the status page and the cached state describe,
+// numbered as in event frames
+#define STATE_PARTITION 1
+
+const char* getCommandStatusName(CommandStatus status) {
+    switch (status) {
+        case CommandStatus::ACCEPTED: return "accepted";
+        case CommandStatus::ACKED:    return "acked";
+        case CommandStatus::FAILED:   return "failed";
+        case CommandStatus::TIMEOUT:  return "timeout";
+        case CommandStatus::CACHED:   return "cached";
+        default:                      return "unknown";
+    }
+}
 
-ParadoxHandler::ParadoxHandler(HardwareSerial& serial) : _serial(serial) {}
+ParadoxHandler::ParadoxHandler(HardwareSerial& serial, uint8_t panelId, int8_t rxPin, int8_t txPin)
+    : _serial(serial), _panelId(panelId), _rxPin(rxPin), _txPin(txPin), _topicPrefix(MQTT_TOPIC_PREFIX),
+      _labels(panelId), _eventLog(panelId) {
+    _password[0] = '\0';
+    _inFlight.id[0] = '\0';
+    _labelRequestId[0] = '\0';
+}
 
 void ParadoxHandler::setup(ParadoxEventCallback callback) {
     _eventCallback = callback;
-    DEBUG_PRINTF("[Paradox] Initializing serial port with RX: %d, TX: %d\n", PARADOX_RX_PIN, PARADOX_TX_PIN);
-    _serial.begin(PARADOX_BAUD_RATE, SERIAL_8N1, PARADOX_RX_PIN, PARADOX_TX_PIN);
+    DEBUG_PRINTF("[Paradox%u] Initializing serial port with RX: %d, TX: %d\n", _panelId, _rxPin, _txPin);
+    _serial.setRxBufferSize(PARADOX_UART_RX_BUFFER); // Must precede begin()
+    _serial.begin(PARADOX_BAUD_RATE, SERIAL_8N1, _rxPin, _txPin);
+    // Raise an RX event per frame's worth of bytes or at the end of a burst,
+    // and wake the task that called setup() instead of having it poll
+    _serial.setRxFIFOFull(37);
+    _serial.setRxTimeout(PARADOX_UART_RX_TIMEOUT);
+    _wakeTask = xTaskGetCurrentTaskHandle();
+    _serial.onReceive([this]() { xTaskNotifyGive(_wakeTask); });
+    _serial.onReceiveError([this](hardwareSerial_error_t error) { onUartError(error); });
     _lastActivityTime = millis();
-    DEBUG_PRINTLN("[Paradox] Handler initialized.");
+#if LABELS_ENABLED
+    // A cache hit means the labels are not read from the panel this boot
+    _labels.load();
+#endif
+#if PARADOX_CATCHUP_ENABLED
+    // Events logged while the bridge was down are read after the first login
+    _eventLog.load();
+    _logPending = true;
+#endif
+    DEBUG_PRINTF("[Paradox%u] Handler initialized. Topics under %s/\n", _panelId, _topicPrefix.c_str());
 }
 
 void ParadoxHandler::loop() {
-    if (_serial.available() >= 37) {
-        _lastActivityTime = millis(); // Reset timer on any incoming data
-        
-        for (int i = 0; i < 37; i++) {
-            _buffer[i] = _serial.read();
+    if (readFrame()) {
+        handleFrame();
+    }
+
+    serviceLogin();
+    serviceQueue();
+    serviceReads();
+
+    // Keep-alive polling
+    if (millis() - _lastPollTime > KEEP_ALIVE_INTERVAL) {
+        DEBUG_PRINTF("[Paradox%u] Polling for zone and partition status.\n", _panelId);
+        requestZoneStatus(CommandRequest(nullptr, nullptr, true));
+        requestPartitionStatus(CommandRequest(nullptr, nullptr, true));
+        _lastPollTime = millis();
+    }
+}
+
+// Feeds buffered bytes to the decoder until one valid frame is complete
+bool ParadoxHandler::readFrame() {
+    uint32_t resyncs = _decoder.getResyncs();
+    _decoder.setRepliesExpected(_awaitingReply || isLoggingIn() || readsInFlight());
+    bool complete = false;
+    while (!complete && _serial.available() > 0) {
+        complete = _decoder.push(_serial.read());
+    }
+    if (_decoder.getResyncs() != resyncs) {
+        DEBUG_PRINTF("[Paradox%u] Bad checksum or start byte. Resyncing.\n", _panelId);
+    }
+    if (!complete) {
+        return false;
+    }
+    memcpy(_buffer, _decoder.frame(), PARADOX_FRAME_SIZE);
+    _lastActivityTime = millis(); // Reset timer on any incoming data
+    _linkDown = false;
+    return true;
+}
+
+// Runs in the UART event task; counters are only written here
+void ParadoxHandler::onUartError(hardwareSerial_error_t error) {
+    switch (error) {
+        case UART_FIFO_OVF_ERROR:    _uartStats.fifoOverflows++; break;
+        case UART_BUFFER_FULL_ERROR: _uartStats.bufferFull++; break;
+        case UART_FRAME_ERROR:       _uartStats.framingErrors++; break;
+        case UART_PARITY_ERROR:      _uartStats.parityErrors++; break;
+        case UART_BREAK_ERROR:       _uartStats.breaks++; break;
+        default: break;
+    }
+}
+
+void ParadoxHandler::logUartStats() const {
+    DEBUG_PRINTF("[Paradox%u] UART errors: fifo_ovf=%u buffer_full=%u framing=%u parity=%u break=%u\n", _panelId,
+                 _uartStats.fifoOverflows, _uartStats.bufferFull, _uartStats.framingErrors,
+                 _uartStats.parityErrors, _uartStats.breaks);
+}
+
+void ParadoxHandler::handleFrame() {
+    byte startByte = _buffer[0];
+
+    // Event messages are processed in every state, including mid-login
+    if ((startByte & 0xF0) == 0xE0) {
+        LOG_D(LOG_TAG_PANEL, "[Paradox%u] Received event message.\n", _panelId);
+        processBuffer();
+        return;
+    }
+
+    // Replies to the session being torn down, or anything but 0x10 while the
+    // password is being checked, are not meaningful
+    if (_loginState == LoginState::DISCONNECT_SENT ||
+        (_loginState == LoginState::PASSWORD_SENT && startByte != 0x10)) {
+        return;
+    }
+
+    if (_loginState == LoginState::INIT_SENT) {
+        // Step 2: Send password, echoing the session bytes from the panel's reply
+        byte data[37] = {0};
+        data[0] = 0x00;
+        memcpy(&data[4], &_buffer[4], 6);
+        data[13] = 0x55;
+
+        // Convert password to bytes
+        size_t passLen = strlen(_password);
+        char digits[3] = {0};
+        if (passLen >= 4) {
+            memcpy(digits, &_password[0], 2);
+            data[14] = strtoul(digits, NULL, 16);
+            memcpy(digits, &_password[2], 2);
+            data[15] = strtoul(digits, NULL, 16);
+        }
+        if (passLen == 6) {
+            memcpy(digits, &_password[4], 2);
+            data[16] = strtoul(digits, NULL, 16);
         }
 
-        byte startByte = _buffer[0];
-
-        // Check for all known valid message start bytes from the panel
-        if ((startByte & 0xF0) == 0xE0) { // Event message
-            DEBUG_PRINTLN("[Paradox] Received event message.");
-            processBuffer();
-        } else if (startByte == 0x10) { // Login success
-            _panelConnected = true;
-            DEBUG_PRINTLN("[Paradox] Login successful.");
-        } else if (startByte == 0x41) { // Acknowledge for Arm
-            DEBUG_PRINTF("[Paradox] Received command acknowledgement: 0x%02X\n", startByte);
-        } else if (startByte == 0x51) { // Response for Status Request
-            if (_buffer[3] == 0x01) {
-                processPartitionStatus();
-            } else {
-                processZoneStatus();
-            }
-        } else if (startByte == 0x70) { // Disconnect message from the panel
-            _panelConnected = false;
-            DEBUG_PRINTLN("[Paradox] Received disconnect message from panel (0x70).");
+        data[33] = 0x05;
+        sendCommand(data);
+        setLoginState(LoginState::PASSWORD_SENT);
+        return;
+    }
+
+    // Memory reads and commands are never in flight together, so while reads
+    // are out a 0x5X reply is a memory block
+    if ((startByte & 0xF0) == 0x50 && readsInFlight()) {
+        processMemoryBlock();
+        return;
+    }
+
+    // Replies carry the command's high nibble: 0x40 -> 0x41, 0x50 -> 0x51
+    if (_awaitingReply) {
+        if ((startByte & 0xF0) == (_inFlight.data[0] & 0xF0)) {
+            completeInFlight(CommandStatus::ACKED);
+        } else if (startByte == 0x70) {
+            completeInFlight(CommandStatus::FAILED);
+        }
+    }
+
+    // Check for all known valid message start bytes from the panel
+    if (startByte == 0x10) { // Login success
+        if (_loginState != LoginState::CONNECTED) {
+            setLoginState(LoginState::CONNECTED);
+            _nextSendTime = millis() + LOGIN_SETTLE_TIME;
+#if PARADOX_CATCHUP_ENABLED
+            _logPending = true;
+#endif
+        }
+        DEBUG_PRINTF("[Paradox%u] Login successful.\n", _panelId);
+    } else if (startByte == 0x41) { // Acknowledge for Arm
+        DEBUG_PRINTF("[Paradox%u] Received command acknowledgement: 0x%02X\n", _panelId, startByte);
+    } else if (startByte == 0x51) { // Response for Status Request
+        if (_buffer[3] == 0x01) {
+            processPartitionStatus();
         } else {
-            // Invalid start byte, likely out of sync
-            DEBUG_PRINTF("[Paradox] Invalid start byte: 0x%02X. Flushing buffer to resync.\n", startByte);
-            flushSerialBuffer();
+            processZoneStatus();
         }
+    } else if (startByte == 0x70) { // Disconnect message from the panel
+        setLoginState(LoginState::IDLE);
+        DEBUG_PRINTF("[Paradox%u] Received disconnect message from panel (0x70).\n", _panelId);
+    } else {
+        // Checksum was good, so this is a message type we do not handle
+        DEBUG_PRINTF("[Paradox%u] Ignoring message 0x%02X.\n", _panelId, startByte);
     }
+}
 
-    // Keep-alive polling
-    if (millis() - _lastPollTime > 1800000) {
-        DEBUG_PRINTLN("[Paradox] Polling for zone and partition status.");
-        requestZoneStatus();
-        delay(500); // Add a small delay between requests to not flood the panel
-        requestPartitionStatus();
-        _lastPollTime = millis();
+void ParadoxHandler::serviceLogin() {
+    unsigned long elapsed = millis() - _stateTime;
+
+    switch (_loginState) {
+        case LoginState::IDLE:
+            // Queued commands and memory reads need a session
+            if (_queueCount > 0) {
+                DEBUG_PRINTF("[Paradox%u] Not logged in. Logging in to send queued commands.\n", _panelId);
+                startLogin();
+            } else if (_readJob != ReadJob::NONE) {
+                DEBUG_PRINTF("[Paradox%u] Not logged in. Logging in to read panel memory.\n", _panelId);
+                startLogin();
+            }
+            break;
+        case LoginState::DISCONNECT_SENT:
+            if (elapsed >= LOGIN_DISCONNECT_SETTLE) {
+                // Clear any stale data from the serial buffer before we begin
+                flushSerialBuffer();
+
+                // Step 1: Initiate login
+                byte data[37] = {0};
+                data[0] = 0x5F;
+                data[1] = 0x20;
+                data[33] = 0x05;
+                sendCommand(data);
+                setLoginState(LoginState::INIT_SENT);
+            }
+            break;
+        case LoginState::INIT_SENT:
+            if (elapsed >= LOGIN_INIT_TIMEOUT) {
+                DEBUG_PRINTF("[Paradox%u] Login failed: No response to login initiation.\n", _panelId);
+                _linkDown = true;
+                clearQueue();
+                setLoginState(LoginState::IDLE);
+            }
+            break;
+        case LoginState::PASSWORD_SENT:
+            if (elapsed >= LOGIN_PASSWORD_TIMEOUT) {
+                DEBUG_PRINTF("[Paradox%u] Login failed: No confirmation received after sending password.\n", _panelId);
+                clearQueue();
+                setLoginState(LoginState::IDLE);
+            }
+            break;
+        case LoginState::CONNECTED:
+            break;
+    }
+}
+
+void ParadoxHandler::serviceQueue() {
+    unsigned long now = millis();
+    if (_awaitingReply) {
+        if ((long)(now - _replyDeadline) < 0) {
+            return;
+        }
+        DEBUG_PRINTF("[Paradox%u] No reply to %s.\n", _panelId, getCommandName(_inFlight.data[0]));
+        completeInFlight(CommandStatus::TIMEOUT);
+    }
+
+    if (_loginState != LoginState::CONNECTED || _queueCount == 0 || readsInFlight()) {
+        return;
+    }
+    if ((long)(now - _nextSendTime) < 0) {
+        return;
+    }
+
+    _inFlight = _queue[_queueHead];
+    _queueHead = (_queueHead + 1) % PARADOX_COMMAND_QUEUE_SIZE;
+    _queueCount--;
+    sendCommand(_inFlight.data);
+    _awaitingReply = true;
+    _replyDeadline = now + COMMAND_REPLY_TIMEOUT;
+    _nextSendTime = now + COMMAND_GAP;
+}
+
+void ParadoxHandler::startLogin() {
+    DEBUG_PRINTF("[Paradox%u] Starting login procedure.\n", _panelId);
+
+    // Ensure we start with a clean session
+    byte data[37] = {0};
+    data[0] = 0x70;
+    data[2] = 0x05;
+    data[33] = 0x01;
+    sendCommand(data);
+    setLoginState(LoginState::DISCONNECT_SENT);
+}
+
+void ParadoxHandler::setLoginState(LoginState state) {
+    _loginState = state;
+    _stateTime = millis();
+}
+
+bool ParadoxHandler::isLoggingIn() const {
+    return _loginState == LoginState::DISCONNECT_SENT ||
+           _loginState == LoginState::INIT_SENT ||
+           _loginState == LoginState::PASSWORD_SENT;
+}
+
+bool ParadoxHandler::enqueueCommand(const byte* commandData, const CommandRequest& request) {
+    if (_queueCount >= PARADOX_COMMAND_QUEUE_SIZE) {
+        DEBUG_PRINTF("[Paradox%u] Command queue full. Dropping %s.\n", _panelId, getCommandName(commandData[0]));
+        reportResult(request.id, request.name, millis(), CommandStatus::FAILED);
+        return false;
     }
+    uint8_t tail = (_queueHead + _queueCount) % PARADOX_COMMAND_QUEUE_SIZE;
+    QueuedCommand& command = _queue[tail];
+    memcpy(command.data, commandData, 37);
+    strlcpy(command.id, request.id ? request.id : "", sizeof(command.id));
+    command.name = request.name;
+    command.acceptedAt = millis();
+    _queueCount++;
+    reportResult(command.id, command.name, command.acceptedAt, CommandStatus::ACCEPTED);
+    return true;
+}
+
+void ParadoxHandler::clearQueue() {
+    if (_queueCount > 0) {
+        DEBUG_PRINTF("[Paradox%u] Dropping %u queued command(s).\n", _panelId, _queueCount);
+    }
+    while (_queueCount > 0) {
+        QueuedCommand& command = _queue[_queueHead];
+        reportResult(command.id, command.name, command.acceptedAt, CommandStatus::FAILED);
+        _queueHead = (_queueHead + 1) % PARADOX_COMMAND_QUEUE_SIZE;
+        _queueCount--;
+    }
+    _queueHead = 0;
+    if (_awaitingReply) {
+        completeInFlight(CommandStatus::FAILED);
+    }
+    if (_readJob != ReadJob::NONE) {
+        abortReadJob();
+    }
+}
+
+void ParadoxHandler::completeInFlight(CommandStatus status) {
+    _awaitingReply = false;
+    reportResult(_inFlight.id, _inFlight.name, _inFlight.acceptedAt, status);
+}
+
+void ParadoxHandler::reportResult(const char* id, const char* name, unsigned long acceptedAt, CommandStatus status) {
+    if (!_resultCallback || id == nullptr || id[0] == '\0') {
+        return;
+    }
+    CommandResult result = {_panelId, id, name ? name : "", status, (uint32_t)(millis() - acceptedAt)};
+    _resultCallback(result);
+}
+
+void ParadoxHandler::rejectCommand(const CommandRequest& request) {
+    reportResult(request.id, request.name, millis(), CommandStatus::FAILED);
 }
 
 void ParadoxHandler::flushSerialBuffer() {
-    DEBUG_PRINTLN("[Paradox] Flushing serial buffer.");
+    DEBUG_PRINTF("[Paradox%u] Flushing serial buffer.\n", _panelId);
     while (_serial.available() > 0) {
         _serial.read();
     }
+    _decoder.reset();
 }
 
 void ParadoxHandler::processBuffer() {
     byte event = _buffer[7];
     byte sub_event = _buffer[8];
     byte partition = _buffer[9];
+    updateState(event, sub_event, partition);
+    _eventLog.noteLive();
+
+    // Installer or maintenance leaving programming mode may have renamed things
+    if (event == 48 && (sub_event == 5 || sub_event == 7)) {
+        _labels.markStale();
+    }
 
-    if (event == 48 && sub_event == 3 && !_isLoggingIn) {
-        _panelConnected = false;
-        DEBUG_PRINTLN("[Paradox] Panel logged off.");
-    } else if (event == 48 && sub_event == 2) {
-        _panelConnected = true;
-        DEBUG_PRINTLN("[Paradox] Panel logged on.");
+    if (event == 48 && sub_event == 3 && !isLoggingIn()) {
+        setLoginState(LoginState::IDLE);
+        DEBUG_PRINTF("[Paradox%u] Panel logged off.\n", _panelId);
+    } else if (event == 48 && sub_event == 2 && !isLoggingIn()) {
+        setLoginState(LoginState::CONNECTED);
+        DEBUG_PRINTF("[Paradox%u] Panel logged on.\n", _panelId);
     }
 
     switch (event) {
         case 2: // Partition status
             switch (sub_event) {
                 case 11: // Disarmed
-                    _eventCallback("2", "11");
+                    emitEvent(2, 11, partition);
                     break;
                 case 12: // Armed Away
-                    _eventCallback("2", "12");
+                    emitEvent(2, 12, partition);
                     break;
                 case 13: // Entry Delay
-                    _eventCallback("2", "13");
+                    emitEvent(2, 13, partition);
                     break;
                 case 14: // Exit Delay
-                    _eventCallback("2", "14");
+                    emitEvent(2, 14, partition);
                     break;
             }
             break;
         case 6: // Non-reportable events
             switch (sub_event) {
                 case 3: // Armed Stay
-                    _eventCallback("2", "3");
+                    emitEvent(2, 3, partition);
                     break;
                 case 4: // Armed Sleep
-                    _eventCallback("2", "4");
+                    emitEvent(2, 4, partition);
                     break;
             }
             break;
     }
 
-    if (_eventCallback) {
-        _eventCallback(String(event), String(sub_event));
-    }
+    emitEvent(event, sub_event, partition);
 }
 
 void ParadoxHandler::processPartitionStatus() {
-    DEBUG_PRINTLN("[Paradox] Processing partition status response.");
+    LOG_D(LOG_TAG_PANEL, "[Paradox%u] Processing partition status response.\n", _panelId);
 
     // Partition 1 Status (byte 17)
     bool p1_alarm = bitRead(_buffer[17], 4);
@@ -119,34 +426,115 @@ void ParadoxHandler::processPartitionStatus() {
     bool p1_sleep = bitRead(_buffer[17], 1);
     bool p1_arm = bitRead(_buffer[17], 0);
 
+    PanelState next = _state;
     if (p1_alarm) {
-        _eventCallback("2", "6"); // Using a generic "triggered" sub-event
+        next.partitionSubEvent = 6; // Using a generic "triggered" sub-event
     } else if (p1_arm) {
-        _eventCallback("2", "12"); // Armed Away
+        next.partitionSubEvent = 12; // Armed Away
     } else if (p1_stay) {
-        _eventCallback("2", "3"); // Armed Stay
+        next.partitionSubEvent = 3; // Armed Stay
     } else if (p1_sleep) {
-        _eventCallback("2", "4"); // Armed Sleep
+        next.partitionSubEvent = 4; // Armed Sleep
     } else {
-        _eventCallback("2", "11"); // Disarmed
+        next.partitionSubEvent = 11; // Disarmed
     }
+    next.partitionValid = true;
+    next.partitionReadAt = millis();
+    commitState(next);
+    emitPartitionState();
+}
+
+void ParadoxHandler::emitPartitionState() {
+    emitEvent(2, _state.partitionSubEvent);
 }
 
 void ParadoxHandler::processZoneStatus() {
-    DEBUG_PRINTLN("[Paradox] Processing zone status response.");
+    LOG_D(LOG_TAG_PANEL, "[Paradox%u] Processing zone status response.\n", _panelId);
 
     // Zone status (bytes 19-22 for zones 1-32)
+    PanelState next = _state;
+    next.openZones = 0;
     for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 8; j++) {
-            int zone = (i * 8) + j + 1;
-            bool isOpen = bitRead(_buffer[19 + i], j);
-            _eventCallback(isOpen ? "1" : "0", String(zone));
-        }
+        next.openZones |= (uint32_t)_buffer[19 + i] << (i * 8);
     }
 
     // Bell status (byte 4, bit 0)
-    bool bellOn = bitRead(_buffer[4], 0);
-    _eventCallback("3", bellOn ? "1" : "0");
+    next.bellOn = bitRead(_buffer[4], 0);
+    next.zonesValid = true;
+    next.zonesReadAt = millis();
+    commitState(next);
+    emitZoneState();
+}
+
+void ParadoxHandler::emitZoneState() {
+    for (int zone = 1; zone <= 32; zone++) {
+        bool isOpen = bitRead(_state.openZones, zone - 1);
+        emitEvent(isOpen ? 1 : 0, zone);
+    }
+    emitEvent(3, _state.bellOn ? 1 : 0);
+}
+
+// Keeps the cached state in step with live events between status reads.
+// Events that leave the arm state unclear drop the partition cache instead.
+// The cached arm state is partition 1's, as read by processPartitionStatus(),
+// so arm state events for other partitions leave it alone.
+void ParadoxHandler::updateState(uint8_t event, uint8_t subEvent, uint8_t partition) {
+    PanelState next = _state;
+    switch (event) {
+        case 0: // Zone OK
+        case 1: // Zone open
+            if (subEvent >= 1 && subEvent <= 32) {
+                bitWrite(next.openZones, subEvent - 1, event == 1);
+            }
+            break;
+        case 2: // Partition status
+            if (partition != STATE_PARTITION) {
+                break;
+            }
+            if (subEvent == 11 || subEvent == 12) {
+                next.partitionSubEvent = subEvent;
+            } else if (subEvent != 13 && subEvent != 14) {
+                next.partitionValid = false;
+            }
+            break;
+        case 3: // Bell status
+            if (subEvent <= 1) {
+                next.bellOn = subEvent == 1;
+            }
+            break;
+        case 6: // Armed stay or sleep
+            if (partition == STATE_PARTITION && (subEvent == 3 || subEvent == 4)) {
+                next.partitionSubEvent = subEvent;
+            }
+            break;
+    }
+    commitState(next);
+}
+
+// Publishes a new state, bumping the generation only when something a reader
+// can see has changed, so pollers can tell a re-read from a change
+void ParadoxHandler::commitState(PanelState next) {
+    portENTER_CRITICAL(&_stateMux);
+    if (next.openZones != _state.openZones || next.bellOn != _state.bellOn ||
+        next.partitionSubEvent != _state.partitionSubEvent ||
+        next.zonesValid != _state.zonesValid || next.partitionValid != _state.partitionValid) {
+        next.generation = _state.generation + 1;
+    }
+    _state = next;
+    portEXIT_CRITICAL(&_stateMux);
+}
+
+PanelState ParadoxHandler::getState() const {
+    portENTER_CRITICAL(&_stateMux);
+    PanelState state = _state;
+    portEXIT_CRITICAL(&_stateMux);
+    return state;
+}
+
+void ParadoxHandler::emitEvent(uint8_t event, uint8_t subEvent, uint8_t partition, bool historical) {
+    if (!_eventCallback) return;
+    ParadoxEvent ev = {event, subEvent, partition, _panelId, (uint32_t)millis(), 0, historical};
+    _eventCallback(ev);
 }
 
 byte ParadoxHandler::calculateChecksum(const byte* data) {
@@ -161,7 +549,7 @@ const char* ParadoxHandler::getCommandName(byte command) {
     switch (command) {
         case 0x00: return "Login-Pass";
         case 0x40: return "Arm/Disarm";
-        case 0x50: return "StatusReq";
+        case 0x50: return "StatusReq"; // Also memory reads for labels and the event log
         case 0x5F: return "Login-Init";
         case 0x70: return "Disconnect";
         default:   return "Unknown";
@@ -170,24 +558,23 @@ const char* ParadoxHandler::getCommandName(byte command) {
 
 void ParadoxHandler::sendCommand(byte* commandData) {
     commandData[36] = calculateChecksum(commandData);
-    DEBUG_PRINTF("[Paradox] Sending command: %s\n", getCommandName(commandData[0]));
-    // for (int i = 0; i < 37; i++) {
-    //     DEBUG_PRINTF("%02X ", commandData[i]);
-    // }
-    // DEBUG_PRINTLN("");
+    LOG_D(LOG_TAG_PANEL, "[Paradox%u] Sending command: %s\n", _panelId, getCommandName(commandData[0]));
     _serial.write(commandData, 37);
     _serial.flush();
     _lastActivityTime = millis(); // Reset keep-alive timer
 }
 
-void ParadoxHandler::disconnect() {
+void ParadoxHandler::disconnect(const CommandRequest& request) {
     byte data[37] = {0};
     data[0] = 0x70;
     data[2] = 0x05;
     data[33] = 0x01;
     sendCommand(data);
-    _panelConnected = false;
-    DEBUG_PRINTLN("[Paradox] Sent disconnect command.");
+    clearQueue();
+    setLoginState(LoginState::IDLE);
+    DEBUG_PRINTF("[Paradox%u] Sent disconnect command.\n", _panelId);
+    // The panel does not answer a disconnect, so sending it is the final result
+    reportResult(request.id, request.name, millis(), CommandStatus::ACCEPTED);
 }
 
 void ParadoxHandler::setPassword(const char* password) {
@@ -195,169 +582,314 @@ void ParadoxHandler::setPassword(const char* password) {
     _password[sizeof(_password) - 1] = '\0';
 }
 
-bool ParadoxHandler::login() {
-    _isLoggingIn = true;
-    DEBUG_PRINTLN("[Paradox] Starting login procedure.");
+bool ParadoxHandler::arm(uint8_t partition, uint8_t arm_mode, const CommandRequest& request) {
+    byte data[37] = {0};
+    data[0] = 0x40;
+    data[2] = arm_mode; // 0x0A for Arm, 0x0B for Stay, 0x0C for Sleep
+    data[3] = partition;
+    data[33] = 0x05;
+    return enqueueCommand(data, request);
+}
 
-    // Ensure we start with a clean session
-    disconnect();
-    delay(250); // Give the panel a moment to process the disconnect
+bool ParadoxHandler::disarm(uint8_t partition, uint8_t disarm_mode, const CommandRequest& request) {
+    byte data[37] = {0};
+    data[0] = 0x40;
+    data[2] = disarm_mode;
+    data[3] = partition;
+    data[33] = 0x01;
+    return enqueueCommand(data, request);
+}
 
-    // Clear any stale data from the serial buffer before we begin
-    flushSerialBuffer();
+// Replays fresh cached state instead of queueing a panel read. Returns false
+// on a miss, in which case the caller queues the read.
+bool ParadoxHandler::answerFromCache(bool valid, unsigned long readAt, const CommandRequest& request) {
+    if (request.force || !valid || millis() - readAt >= _stateMaxAge) {
+        _cacheStats.misses++;
+        return false;
+    }
+    _cacheStats.hits++;
+    reportResult(request.id, request.name, millis(), CommandStatus::CACHED);
+    return true;
+}
 
+// Status type 1 is the partition status, so this shares its cache
+bool ParadoxHandler::requestStatus(const CommandRequest& request) {
+    if (answerFromCache(_state.partitionValid, _state.partitionReadAt, request)) {
+        emitPartitionState();
+        return true;
+    }
     byte data[37] = {0};
-    unsigned long startTime;
+    data[0] = 0x50;
+    data[1] = 0x00;
+    data[2] = 0x80;
+    data[3] = 0x01; // Status type 1
+    data[33] = 0x05;
+    return enqueueCommand(data, request);
+}
 
-    // Step 1: Initiate login
-    data[0] = 0x5F;
-    data[1] = 0x20;
+bool ParadoxHandler::requestPartitionStatus(const CommandRequest& request) {
+    if (answerFromCache(_state.partitionValid, _state.partitionReadAt, request)) {
+        emitPartitionState();
+        return true;
+    }
+    byte data[37] = {0};
+    data[0] = 0x50;
+    data[1] = 0x00;
+    data[2] = 0x80;
+    data[3] = 0x01; // Status type 1 for partitions
     data[33] = 0x05;
-    sendCommand(data);
+    return enqueueCommand(data, request);
+}
 
-    // Wait for the panel's response to the initiation command
-    startTime = millis();
-    while (millis() - startTime < 1000) { // 1-second timeout
-        if (_serial.available() >= 37) {
-            for (int i = 0; i < 37; i++) {
-                _buffer[i] = _serial.read();
-            }
-            goto step2; // Response received, proceed to next step
-        }
-        delay(50);
+bool ParadoxHandler::requestZoneStatus(const CommandRequest& request) {
+    if (answerFromCache(_state.zonesValid, _state.zonesReadAt, request)) {
+        emitZoneState();
+        return true;
     }
-    DEBUG_PRINTLN("[Paradox] Login failed: No response to login initiation.");
-    _isLoggingIn = false;
+    byte data[37] = {0};
+    data[0] = 0x50;
+    data[1] = 0x00;
+    data[2] = 0x80;
+    data[3] = 0x00; // Status type 0 for zones
+    data[33] = 0x01;
+    return enqueueCommand(data, request);
+}
+
+bool ParadoxHandler::refreshLabels(const CommandRequest& request) {
+#if LABELS_ENABLED
+    if (_readJob == ReadJob::LABELS) {
+        reportResult(request.id, request.name, millis(), CommandStatus::FAILED);
+        return false;
+    }
+    // Starts as soon as any catch-up in progress is done
+    _labels.markStale();
+    _labelRetryAt = millis();
+    strlcpy(_labelRequestId, request.id ? request.id : "", sizeof(_labelRequestId));
+    reportResult(_labelRequestId, "refresh-labels", millis(), CommandStatus::ACCEPTED);
+    return true;
+#else
+    rejectCommand(request);
     return false;
+#endif
+}
 
-step2:
-    // Step 2: Send password
-    memset(data, 0, sizeof(data));
-    data[0] = 0x00;
-    memcpy(&data[4], &_buffer[4], 6); // Copy bytes from panel response
-    data[13] = 0x55;
+// =================================================================
+// Memory Reads
+// =================================================================
 
-    // Convert password to bytes
-    String passStr = String(_password);
-    if (passStr.length() >= 4) {
-        data[14] = strtoul(passStr.substring(0, 2).c_str(), NULL, 16);
-        data[15] = strtoul(passStr.substring(2, 4).c_str(), NULL, 16);
+void ParadoxHandler::serviceReads() {
+    unsigned long now = millis();
+    if (_readJob == ReadJob::NONE) {
+#if PARADOX_CATCHUP_ENABLED
+        if ((_logPending || (isPanelConnected() && _eventLog.syncDue())) && (long)(now - _logRetryAt) >= 0) {
+            startReadJob(ReadJob::EVENT_LOG);
+            return;
+        }
+#endif
+#if LABELS_ENABLED
+        if (_labels.needsDownload() && (long)(now - _labelRetryAt) >= 0) {
+            startReadJob(ReadJob::LABELS);
+        }
+#endif
+        return;
     }
-    if (passStr.length() == 6) {
-        data[16] = strtoul(passStr.substring(4, 6).c_str(), NULL, 16);
+    if (_loginState != LoginState::CONNECTED) {
+        // Reads lost with the session are sent again after the next login
+        for (uint8_t i = 0; i < _readCount; i++) {
+            _reads[(_readHead + i) % PARADOX_READ_WINDOW].sent = false;
+        }
+        return;
     }
 
-    data[33] = 0x05;
-    sendCommand(data);
-
-    // Wait for the final login confirmation (0x10)
-    startTime = millis();
-    while (millis() - startTime < 2000) { // 2-second timeout
-        if (_serial.available() >= 37) {
-            for (int i = 0; i < 37; i++) {
-                _buffer[i] = _serial.read();
+    for (uint8_t i = 0; i < _readCount; i++) {
+        MemoryRead& read = _reads[(_readHead + i) % PARADOX_READ_WINDOW];
+        if (read.sent && !read.received && now - read.sentAt >= COMMAND_REPLY_TIMEOUT) {
+            if (++read.tries >= MEMORY_READ_TRIES) {
+                DEBUG_PRINTF("[Paradox%u] No reply to memory read at 0x%04X.\n", _panelId, read.address);
+                abortReadJob();
+                return;
             }
-            if (_buffer[0] == 0x10) {
-                _panelConnected = true;
-                _isLoggingIn = false;
-                // Do not print "Login successful" here, let the main loop handle it
-                return true;
+            if (_readJob == ReadJob::LABELS) {
+                _labels.noteRetry();
             }
+            read.sent = false;
         }
-        delay(50);
     }
 
-    DEBUG_PRINTLN("[Paradox] Login failed: No confirmation received after sending password.");
-    _isLoggingIn = false;
-    return false;
-}
+    if (_readCount == 0 && isReadJobDone()) {
+        finishReadJob();
+        return;
+    }
 
-void ParadoxHandler::arm(uint8_t partition, uint8_t arm_mode) {
-    if (!_panelConnected) {
-        DEBUG_PRINTLN("[Paradox] Not logged in. Attempting to log in before arming.");
-        if (!login()) {
-            DEBUG_PRINTLN("[Paradox] Re-login failed. Cannot arm.");
-            return;
+    // Queued commands go first; the window refills once they are answered
+    if (_awaitingReply || _queueCount > 0 || (long)(now - _nextSendTime) < 0) {
+        return;
+    }
+    while (_readCount < PARADOX_READ_WINDOW) {
+        MemoryRead& read = _reads[(_readHead + _readCount) % PARADOX_READ_WINDOW];
+        if (!nextRead(read)) {
+            break;
+        }
+        read.tries = 0;
+        read.sent = false;
+        read.received = false;
+        _readCount++;
+    }
+    // One frame per call, like the command queue, so the loop is never held
+    // for more than a frame's transmit time
+    for (uint8_t i = 0; i < _readCount; i++) {
+        MemoryRead& read = _reads[(_readHead + i) % PARADOX_READ_WINDOW];
+        if (!read.sent && !read.received) {
+            sendRead(read);
+            break;
         }
-        delay(250); // Give panel a moment to settle after login
     }
-    byte data[37] = {0};
-    data[0] = 0x40;
-    data[2] = arm_mode; // 0x0A for Arm, 0x0B for Stay, 0x0C for Sleep
-    data[3] = partition;
-    data[33] = 0x05;
-    sendCommand(data);
 }
 
-void ParadoxHandler::disarm(uint8_t partition, uint8_t disarm_mode) {
-    if (!_panelConnected) {
-        DEBUG_PRINTLN("[Paradox] Not logged in. Attempting to log in before disarming.");
-        if (!login()) {
-            DEBUG_PRINTLN("[Paradox] Re-login failed. Cannot disarm.");
-            return;
-        }
-        delay(250); // Give panel a moment to settle after login
+void ParadoxHandler::startReadJob(ReadJob job) {
+    _readJob = job;
+    _readHead = 0;
+    _readCount = 0;
+    _readStartedAt = millis();
+    if (job == ReadJob::LABELS) {
+        _labelNext = 0;
+        DEBUG_PRINTF("[Paradox%u] Reading %u labels from the panel.\n", _panelId, LABEL_COUNT);
+    } else {
+        _logPending = false;
+        _logHeaderRequested = false;
+        _logHeaderRead = false;
     }
-    byte data[37] = {0};
-    data[0] = 0x40;
-    data[2] = disarm_mode;
-    data[3] = partition;
-    data[33] = 0x01;
-    sendCommand(data);
 }
 
+// Fills in the next block of the job. False when there is nothing to ask
+// for yet: the job is done, waiting on the log header, or held by the gate.
+bool ParadoxHandler::nextRead(MemoryRead& read) {
+    if (_readJob == ReadJob::LABELS) {
+        if (_labelNext >= LABEL_COUNT) {
+            return false;
+        }
+        read.item = _labelNext;
+        read.address = PanelLabels::addressOf(_labelNext++);
+        return true;
+    }
+    if (!_logHeaderRequested) {
+        _logHeaderRequested = true;
+        read.item = 0;
+        read.address = PARADOX_EVENT_LOG_ADDRESS;
+        return true;
+    }
+    if (!_logHeaderRead || (_catchupGate && !_catchupGate())) {
+        return false;
+    }
+    return _eventLog.nextBlock(read.address, read.item);
+}
 
+bool ParadoxHandler::isReadJobDone() const {
+    if (_readJob == ReadJob::LABELS) {
+        return _labelNext >= LABEL_COUNT;
+    }
+    return _logHeaderRead && !_eventLog.hasNextBlock();
+}
 
-void ParadoxHandler::requestStatus() {
-    if (!_panelConnected) {
-        DEBUG_PRINTLN("[Paradox] Not logged in. Attempting to log in before requesting status.");
-        if (!login()) {
-            DEBUG_PRINTLN("[Paradox] Re-login failed. Cannot request status.");
-            return;
-        }
-        delay(250); // Give panel a moment to settle after login
+void ParadoxHandler::deliverRead(const MemoryRead& read) {
+    if (_readJob == ReadJob::LABELS) {
+        _labels.store(read.item, read.data);
+    } else if (!_logHeaderRead) {
+        _logHeaderRead = true;
+        _eventLog.begin(read.data);
+    } else {
+        _eventLog.deliver(read.item, read.data, [this](const uint8_t* entry) { emitHistorical(entry); });
     }
+}
+
+// Memory read: byte 2 clear selects EEPROM rather than the RAM status pages,
+// bytes 4-5 hold the address. The reply echoes the address and carries 16
+// bytes from it in bytes 6-21.
+void ParadoxHandler::sendRead(MemoryRead& read) {
     byte data[37] = {0};
     data[0] = 0x50;
     data[1] = 0x00;
-    data[2] = 0x80;
-    data[3] = 0x01; // Status type 1
+    data[2] = 0x00;
+    data[4] = read.address >> 8;
+    data[5] = read.address & 0xFF;
     data[33] = 0x05;
     sendCommand(data);
+    read.sent = true;
+    read.sentAt = millis();
 }
 
-void ParadoxHandler::requestPartitionStatus() {
-    if (!_panelConnected) {
-        DEBUG_PRINTLN("[Paradox] Not logged in. Cannot request partition status.");
-        if (!login()) {
-            DEBUG_PRINTLN("[Paradox] Re-login failed. Cannot request partition status.");
-            return;
+void ParadoxHandler::processMemoryBlock() {
+    uint16_t address = ((uint16_t)_buffer[4] << 8) | _buffer[5];
+    bool matched = false;
+    for (uint8_t i = 0; i < _readCount && !matched; i++) {
+        MemoryRead& read = _reads[(_readHead + i) % PARADOX_READ_WINDOW];
+        if (read.sent && !read.received && read.address == address) {
+            memcpy(read.data, &_buffer[6], sizeof(read.data));
+            read.received = true;
+            matched = true;
         }
-        delay(250); // Give panel a moment to settle after login
     }
-    byte data[37] = {0};
-    data[0] = 0x50;
-    data[1] = 0x00;
-    data[2] = 0x80;
-    data[3] = 0x01; // Status type 1 for partitions
-    data[33] = 0x05;
-    sendCommand(data);
+    if (!matched) {
+        // A late answer to a read that was already sent again
+        LOG_D(LOG_TAG_PANEL, "[Paradox%u] Ignoring unexpected memory block 0x%04X.\n", _panelId, address);
+        return;
+    }
+    // Replies may come back in any order, but are used in the order asked
+    while (_readCount > 0 && _reads[_readHead].received) {
+        deliverRead(_reads[_readHead]);
+        _readHead = (_readHead + 1) % PARADOX_READ_WINDOW;
+        _readCount--;
+    }
 }
 
-void ParadoxHandler::requestZoneStatus() {
-    if (!_panelConnected) {
-        DEBUG_PRINTLN("[Paradox] Not logged in. Cannot request zone status.");
-        if (!login()) {
-            DEBUG_PRINTLN("[Paradox] Re-login failed. Cannot request zone status.");
-            return;
+void ParadoxHandler::finishReadJob() {
+    unsigned long elapsed = millis() - _readStartedAt;
+    ReadJob job = _readJob;
+    _readJob = ReadJob::NONE;
+    if (job == ReadJob::LABELS) {
+        _labels.finishDownload(elapsed);
+        DEBUG_PRINTF("[Paradox%u] Read %u labels in %lu ms.\n", _panelId, LABEL_COUNT, elapsed);
+        reportResult(_labelRequestId, "refresh-labels", _readStartedAt, CommandStatus::ACKED);
+        _labelRequestId[0] = '\0';
+        if (_labelsCallback) {
+            _labelsCallback(_panelId);
         }
-        delay(250); // Give panel a moment to settle after login
+    } else {
+        _eventLog.finish(elapsed);
     }
-    byte data[37] = {0};
-    data[0] = 0x50;
-    data[1] = 0x00;
-    data[2] = 0x80;
-    data[3] = 0x00; // Status type 0 for zones
-    data[33] = 0x01;
-    sendCommand(data);
-}
\ No newline at end of file
+}
+
+// Cached labels, if any, stay in use until a later download succeeds.
+// Catch-up keeps the events already emitted and resumes after them.
+void ParadoxHandler::abortReadJob() {
+    ReadJob job = _readJob;
+    _readJob = ReadJob::NONE;
+    _readCount = 0;
+    if (job == ReadJob::LABELS) {
+        _labelRetryAt = millis() + READ_RETRY_INTERVAL;
+        _labels.downloadFailed();
+        DEBUG_PRINTF("[Paradox%u] Label download failed. Retrying in %u s.\n", _panelId, READ_RETRY_INTERVAL / 1000);
+        reportResult(_labelRequestId, "refresh-labels", _readStartedAt, CommandStatus::FAILED);
+        _labelRequestId[0] = '\0';
+    } else {
+        _eventLog.abort();
+        _logPending = true;
+        _logRetryAt = millis() + READ_RETRY_INTERVAL;
+        DEBUG_PRINTF("[Paradox%u] Event log catch-up interrupted. Retrying in %u s.\n", _panelId, READ_RETRY_INTERVAL / 1000);
+    }
+}
+
+bool ParadoxHandler::readsInFlight() const {
+    for (uint8_t i = 0; i < _readCount; i++) {
+        const MemoryRead& read = _reads[(_readHead + i) % PARADOX_READ_WINDOW];
+        if (read.sent && !read.received) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Historical events skip the cached state: they describe the past
+void ParadoxHandler::emitHistorical(const uint8_t* entry) {
+    emitEvent(entry[5], entry[6], entry[7], true);
+}
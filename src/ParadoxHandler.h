@@ -2,45 +2,273 @@
 
 #include <Arduino.h>
 #include <functional>
+#include "ParadoxEvents.h"
+#include "FrameDecoder.h"
+#include "PanelLabels.h"
+#include "PanelEventLog.h"
+
+// Commands waiting for the panel link, per panel
+#ifndef PARADOX_COMMAND_QUEUE_SIZE
+#define PARADOX_COMMAND_QUEUE_SIZE 8
+#endif
+
+// Longest request id echoed back in command results, including the terminator
+#ifndef PARADOX_COMMAND_ID_SIZE
+#define PARADOX_COMMAND_ID_SIZE 24
+#endif
+
+// RX ring for the panel UART, large enough to ride out WiFi stalls
+#ifndef PARADOX_UART_RX_BUFFER
+#define PARADOX_UART_RX_BUFFER 1024
+#endif
+
+// Idle-line gap, in symbol times, that ends a burst and wakes the loop
+#ifndef PARADOX_UART_RX_TIMEOUT
+#define PARADOX_UART_RX_TIMEOUT 3
+#endif
+
+// Status commands are answered from the cached panel state when it was read
+// from the panel less than this long ago
+#ifndef PARADOX_STATE_MAX_AGE
+#define PARADOX_STATE_MAX_AGE 10000
+#endif
+
+// Memory reads kept in flight at once for labels and event log catch-up
+#ifndef PARADOX_READ_WINDOW
+#define PARADOX_READ_WINDOW 4
+#endif
 
 // Define the function signature for the event callback
-using ParadoxEventCallback = std::function<void(const String&, const String&)>;
+using ParadoxEventCallback = std::function<void(const ParadoxEvent&)>;
+
+enum class CommandStatus : uint8_t {
+    ACCEPTED, // Queued for the panel
+    ACKED,    // Panel replied to the command
+    FAILED,   // Queue full, login failed or session dropped
+    TIMEOUT,  // Sent, but the panel did not reply in time
+    CACHED    // Answered from cached state without asking the panel
+};
 
-class ParadoxHandler;
+// Optional caller context for a command. Results are only reported for
+// commands that carry an id. force makes status commands read the panel
+// even when the cached state is fresh.
+struct CommandRequest {
+    const char* id;
+    const char* name;
+    bool force;
+    CommandRequest(const char* id = nullptr, const char* name = nullptr, bool force = false)
+        : id(id), name(name), force(force) {}
+};
 
-extern ParadoxHandler paradoxHandler;
+struct StateCacheStats {
+    uint32_t hits;   // Status commands answered from cache, i.e. panel round-trips saved
+    uint32_t misses; // Status commands that went to the panel
+};
+
+// Snapshot of the cached panel model
+struct PanelState {
+    uint32_t generation;        // Bumped whenever the state below changes
+    uint32_t openZones;         // Bit n set while zone n + 1 is open
+    bool bellOn;
+    uint8_t partitionSubEvent;  // As emitted for event 2: 3, 4, 6, 11 or 12
+    bool zonesValid;
+    bool partitionValid;
+    unsigned long zonesReadAt;
+    unsigned long partitionReadAt;
+};
+
+struct CommandResult {
+    uint8_t panel;
+    const char* id;
+    const char* command;
+    CommandStatus status;
+    uint32_t latencyMs; // Since the command was accepted
+};
+
+// Error counts reported by the UART driver
+struct UartStats {
+    uint32_t fifoOverflows;
+    uint32_t bufferFull;
+    uint32_t framingErrors;
+    uint32_t parityErrors;
+    uint32_t breaks;
+};
+
+using CommandResultCallback = std::function<void(const CommandResult&)>;
+// Called with the panel id once a label download completes
+using LabelsCallback = std::function<void(uint8_t panel)>;
+// Asked before each event log read; false holds catch-up until consumers
+// can take more historical events
+using CatchupGate = std::function<bool()>;
+
+const char* getCommandStatusName(CommandStatus status);
 
 class ParadoxHandler {
 public:
-    explicit ParadoxHandler(HardwareSerial& serial);
+    ParadoxHandler(HardwareSerial& serial, uint8_t panelId, int8_t rxPin, int8_t txPin);
     void setup(ParadoxEventCallback callback);
+    void setResultCallback(CommandResultCallback callback) { _resultCallback = callback; }
+    void setLabelsCallback(LabelsCallback callback) { _labelsCallback = callback; }
+    void setCatchupGate(CatchupGate gate) { _catchupGate = gate; }
+
+    // Services one frame, one login step and one queued command per call, so
+    // several handlers can be looped round-robin without starving each other
     void loop();
 
-    // Public methods for controlling the panel
+    uint8_t getPanelId() const { return _panelId; }
+    void setTopicPrefix(const String& prefix) { _topicPrefix = prefix; }
+    const String& getTopicPrefix() const { return _topicPrefix; }
+    bool isPanelConnected() const { return _loginState == LoginState::CONNECTED; }
+    // True after a login attempt got no answer, until the panel is heard from again
+    bool isLinkDown() const { return _linkDown; }
+    // Frames with a valid checksum read from the panel since boot
+    uint32_t getFrameCount() const { return _decoder.getFramesDecoded(); }
+    const FrameDecoder& getDecoder() const { return _decoder; }
+    const UartStats& getUartStats() const { return _uartStats; }
+    const StateCacheStats& getStateCacheStats() const { return _cacheStats; }
+    void setStateMaxAge(uint32_t maxAgeMs) { _stateMaxAge = maxAgeMs; }
+    // Consistent copy of the cached state, safe to call from other tasks
+    PanelState getState() const;
+    uint32_t getStateGeneration() const { return _state.generation; }
+    const PanelLabels& getLabels() const { return _labels; }
+    const PanelEventLog& getEventLog() const { return _eventLog; }
+    void logUartStats() const;
+    // True when no complete frame is buffered and nothing is waiting to be sent
+    bool isIdle() { return _decoder.size() + _serial.available() < PARADOX_FRAME_SIZE && _queueCount == 0; }
+
+    // Public methods for controlling the panel. Commands are queued and sent
+    // once the panel is logged in; login is started automatically.
     void setPassword(const char* password);
-    bool login();
-    void arm(uint8_t partition, uint8_t arm_mode);
-    void disarm(uint8_t partition, uint8_t disarm_mode);
-    void requestStatus();
-    void requestZoneStatus();
-    void requestPartitionStatus();
-    void disconnect();
+    bool arm(uint8_t partition, uint8_t arm_mode, const CommandRequest& request = CommandRequest());
+    bool disarm(uint8_t partition, uint8_t disarm_mode, const CommandRequest& request = CommandRequest());
+    bool requestStatus(const CommandRequest& request = CommandRequest());
+    bool requestZoneStatus(const CommandRequest& request = CommandRequest());
+    bool requestPartitionStatus(const CommandRequest& request = CommandRequest());
+    void disconnect(const CommandRequest& request = CommandRequest());
+    // Reads the labels from the panel again, replacing the cached ones
+    bool refreshLabels(const CommandRequest& request = CommandRequest());
+
+    // Reports a command that was rejected before reaching the queue
+    void rejectCommand(const CommandRequest& request);
 
 private:
+    enum class LoginState : uint8_t {
+        IDLE,              // Not logged in
+        DISCONNECT_SENT,   // Waiting for the panel to drop the old session
+        INIT_SENT,         // Waiting for the reply to 0x5F
+        PASSWORD_SENT,     // Waiting for 0x10
+        CONNECTED
+    };
+
+    enum class ReadJob : uint8_t { NONE, LABELS, EVENT_LOG };
+
+    struct MemoryRead {
+        uint16_t address;
+        uint32_t item;        // Label index, or first log entry of the block
+        uint8_t tries;
+        bool sent;            // False until sent on the current session
+        bool received;
+        unsigned long sentAt;
+        uint8_t data[16];
+    };
+
+    struct QueuedCommand {
+        byte data[37];
+        char id[PARADOX_COMMAND_ID_SIZE];
+        const char* name;
+        unsigned long acceptedAt;
+    };
+
     HardwareSerial& _serial;
+    uint8_t _panelId;
+    int8_t _rxPin;
+    int8_t _txPin;
+    String _topicPrefix;
     ParadoxEventCallback _eventCallback;
-    byte _buffer[37];
-    bool _panelConnected = false;
-    bool _isLoggingIn = false;
+    CommandResultCallback _resultCallback;
+    LabelsCallback _labelsCallback;
+    CatchupGate _catchupGate;
+    byte _buffer[PARADOX_FRAME_SIZE];
+    LoginState _loginState = LoginState::IDLE;
     char _password[7];
     unsigned long _lastActivityTime = 0;
     unsigned long _lastPollTime = 0;
+    unsigned long _stateTime = 0;   // When the current login step started
+    unsigned long _nextSendTime = 0;
+    unsigned long _replyDeadline = 0;
+    bool _awaitingReply = false;
+    bool _linkDown = false;
+    FrameDecoder _decoder;
+    UartStats _uartStats = {};
+    TaskHandle_t _wakeTask = nullptr; // Notified when the UART has data
+    QueuedCommand _inFlight;
+
+    // Panel state from the last status reads, kept current by live events.
+    // Only the loop task writes it, always through commitState().
+    PanelState _state = {};
+    mutable portMUX_TYPE _stateMux = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t _stateMaxAge = PARADOX_STATE_MAX_AGE;
+    StateCacheStats _cacheStats = {};
+
+    QueuedCommand _queue[PARADOX_COMMAND_QUEUE_SIZE];
+    uint8_t _queueHead = 0;
+    uint8_t _queueCount = 0;
+
+    // Memory reads for one job at a time. Reads are pipelined, up to
+    // PARADOX_READ_WINDOW at a time, and only while no command is queued or
+    // waiting for its reply. Blocks are handed on in the order they were asked for.
+    ReadJob _readJob = ReadJob::NONE;
+    MemoryRead _reads[PARADOX_READ_WINDOW];  // Ring, oldest at _readHead
+    uint8_t _readHead = 0;
+    uint8_t _readCount = 0;
+    unsigned long _readStartedAt = 0;
+
+    PanelLabels _labels;
+    uint8_t _labelNext = 0;       // Next label block to ask for
+    unsigned long _labelRetryAt = 0;
+    char _labelRequestId[PARADOX_COMMAND_ID_SIZE];
+
+    PanelEventLog _eventLog;
+    bool _logPending = false;     // Catch up after the next login
+    bool _logHeaderRequested = false;
+    bool _logHeaderRead = false;
+    unsigned long _logRetryAt = 0;
+
+    bool readFrame();
+    void onUartError(hardwareSerial_error_t error);
+    void handleFrame();
+    void serviceLogin();
+    void serviceQueue();
+    void serviceReads();
+    void startReadJob(ReadJob job);
+    bool nextRead(MemoryRead& read);
+    bool isReadJobDone() const;
+    void deliverRead(const MemoryRead& read);
+    void sendRead(MemoryRead& read);
+    void processMemoryBlock();
+    void finishReadJob();
+    void abortReadJob();
+    bool readsInFlight() const;
+    void emitHistorical(const uint8_t* entry);
+    void startLogin();
+    void setLoginState(LoginState state);
+    bool isLoggingIn() const;
+    bool enqueueCommand(const byte* commandData, const CommandRequest& request);
+    void clearQueue();
+    void completeInFlight(CommandStatus status);
+    void reportResult(const char* id, const char* name, unsigned long acceptedAt, CommandStatus status);
 
     void processBuffer();
     void processZoneStatus();
     void processPartitionStatus();
+    void emitZoneState();
+    void emitPartitionState();
+    void updateState(uint8_t event, uint8_t subEvent, uint8_t partition);
+    void commitState(PanelState next);
+    bool answerFromCache(bool valid, unsigned long readAt, const CommandRequest& request);
+    void emitEvent(uint8_t event, uint8_t subEvent, uint8_t partition = 0, bool historical = false);
     void sendCommand(byte* commandData);
     byte calculateChecksum(const byte* data);
     const char* getCommandName(byte command);
     void flushSerialBuffer();
-};
\ No newline at end of file
+};
@@ -0,0 +1,64 @@
+#include "PipelineMetrics.h"
+#include <algorithm>
+
+void PipelineMetrics::record(uint32_t latencyMs, uint32_t publishMicros) {
+    portENTER_CRITICAL(&_mux);
+    _latencyMs[_next] = latencyMs;
+    _publishMicros[_next] = publishMicros;
+    _next = (_next + 1) % PIPELINE_LATENCY_SAMPLES;
+    if (_samples < PIPELINE_LATENCY_SAMPLES) {
+        _samples++;
+    }
+    _published++;
+    portEXIT_CRITICAL(&_mux);
+}
+
+void PipelineMetrics::recordFailure() {
+    portENTER_CRITICAL(&_mux);
+    _failures++;
+    portEXIT_CRITICAL(&_mux);
+}
+
+void PipelineMetrics::sampleRate() {
+    unsigned long now = millis();
+    portENTER_CRITICAL(&_mux);
+    if (_rateTime != 0 && now != _rateTime) {
+        _eventsPerSec = (_published - _rateCount) * 1000.0f / (now - _rateTime);
+    }
+    _rateCount = _published;
+    _rateTime = now;
+    portEXIT_CRITICAL(&_mux);
+}
+
+// Sorts in place; callers pass a copy
+void PipelineMetrics::addPercentiles(JsonObject obj, uint32_t* values, uint16_t count) {
+    if (count == 0) {
+        return;
+    }
+    std::sort(values, values + count);
+    obj["p50"] = values[count * 50 / 100];
+    obj["p90"] = values[count * 90 / 100];
+    obj["p99"] = values[count * 99 / 100];
+    obj["max"] = values[count - 1];
+}
+
+void PipelineMetrics::toJson(JsonObject obj) {
+    uint32_t latency[PIPELINE_LATENCY_SAMPLES];
+    uint32_t publish[PIPELINE_LATENCY_SAMPLES];
+
+    portENTER_CRITICAL(&_mux);
+    uint16_t count = _samples;
+    memcpy(latency, _latencyMs, count * sizeof(uint32_t));
+    memcpy(publish, _publishMicros, count * sizeof(uint32_t));
+    uint32_t published = _published;
+    uint32_t failures = _failures;
+    float eventsPerSec = _eventsPerSec;
+    portEXIT_CRITICAL(&_mux);
+
+    obj["published"] = published;
+    obj["failures"] = failures;
+    obj["events_per_sec"] = eventsPerSec;
+    obj["samples"] = count;
+    addPercentiles(obj.createNestedObject("latency_ms"), latency, count);
+    addPercentiles(obj.createNestedObject("publish_us"), publish, count);
+}
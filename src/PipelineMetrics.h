@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Recent publishes kept for percentile estimates
+#ifndef PIPELINE_LATENCY_SAMPLES
+#define PIPELINE_LATENCY_SAMPLES 128
+#endif
+
+// Throughput and latency of the panel-to-MQTT path, measured on the device.
+// record() runs on the loop task; toJson() may be called from the web server.
+class PipelineMetrics {
+public:
+    // latencyMs: from frame decode to broker write. publishMicros: time spent
+    // describing, encoding and writing the event.
+    void record(uint32_t latencyMs, uint32_t publishMicros);
+    void recordFailure();
+
+    // Call at a fixed interval to refresh the events/s figure
+    void sampleRate();
+
+    void toJson(JsonObject obj);
+    uint32_t getPublished() const { return _published; }
+
+private:
+    uint32_t _latencyMs[PIPELINE_LATENCY_SAMPLES];
+    uint32_t _publishMicros[PIPELINE_LATENCY_SAMPLES];
+    uint16_t _next = 0;
+    uint16_t _samples = 0;
+    uint32_t _published = 0;
+    uint32_t _failures = 0;
+
+    uint32_t _rateCount = 0; // _published at the last sampleRate()
+    unsigned long _rateTime = 0;
+    float _eventsPerSec = 0;
+
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+    static void addPercentiles(JsonObject obj, uint32_t* values, uint16_t count);
+};
@@ -0,0 +1,140 @@
+#include "RuleEngine.h"
+#include "Config.h"
+#include "Storage.h"
+#include <LittleFS.h>
+#include <driver/gpio.h>
+
+void RuleEngine::reservePin(uint8_t pin) {
+    if (pin < 64) {
+        _reservedPins |= 1ULL << pin;
+    }
+}
+
+bool RuleEngine::isUsablePin(uint8_t pin) const {
+    return pin < 64 && GPIO_IS_VALID_OUTPUT_GPIO(pin) && !(_reservedPins & (1ULL << pin));
+}
+
+bool RuleEngine::load() {
+    if (!mountStorage() || !LittleFS.exists(RULES_FILE)) {
+        DEBUG_PRINTLN("[Rules] No rules file. Rule engine idle.");
+        return false;
+    }
+    File file = LittleFS.open(RULES_FILE, "r");
+    if (!file) {
+        return false;
+    }
+    uint8_t data[sizeof(RuleFileHeader) + RULES_MAX * sizeof(RuleRecord)];
+    size_t length = file.read(data, sizeof(data));
+    file.close();
+    return loadFromBuffer(data, length);
+}
+
+bool RuleEngine::loadFromBuffer(const uint8_t* data, size_t length) {
+    RuleFileHeader header;
+    if (length < sizeof(header)) {
+        DEBUG_PRINTLN("[Rules] Rules image too short.");
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != RULES_FILE_MAGIC || header.version != RULES_FILE_VERSION) {
+        DEBUG_PRINTLN("[Rules] Rules image has a bad magic or version.");
+        return false;
+    }
+    if (header.count > RULES_MAX || length != sizeof(header) + header.count * sizeof(RuleRecord)) {
+        DEBUG_PRINTF("[Rules] Rules image size does not match %u rules (max %u).\n", header.count, RULES_MAX);
+        return false;
+    }
+    const uint8_t* records = data + sizeof(header);
+    // Refuse the whole image so a bad upload cannot leave half a rule set running
+    for (uint8_t i = 0; i < header.count; i++) {
+        RuleRecord rule;
+        memcpy(&rule, records + i * sizeof(RuleRecord), sizeof(rule));
+        if (rule.action == RuleAction::GPIO && !isUsablePin(rule.arg0)) {
+            DEBUG_PRINTF("[Rules] Rule %u drives GPIO%u, which is not a free output pin.\n", i, rule.arg0);
+            return false;
+        }
+    }
+
+    // Counting sort by event number builds the dispatch table in one pass
+    uint8_t perEvent[256] = {0};
+    for (uint8_t i = 0; i < header.count; i++) {
+        perEvent[records[i * sizeof(RuleRecord)]]++;
+    }
+    _firstRule[0] = 0;
+    for (int e = 0; e < 256; e++) {
+        _firstRule[e + 1] = _firstRule[e] + perEvent[e];
+    }
+    uint8_t next[256];
+    memcpy(next, _firstRule, sizeof(next));
+    for (uint8_t i = 0; i < header.count; i++) {
+        uint8_t slot = next[records[i * sizeof(RuleRecord)]]++;
+        memcpy(&_rules[slot], records + i * sizeof(RuleRecord), sizeof(RuleRecord));
+        _ruleIndex[slot] = i;
+    }
+    memset(_state, 0, sizeof(_state));
+    _ruleCount = header.count;
+
+    for (uint8_t slot = 0; slot < _ruleCount; slot++) {
+        if (_rules[slot].action == RuleAction::GPIO) {
+            pinMode(_rules[slot].arg0, OUTPUT);
+        }
+    }
+    DEBUG_PRINTF("[Rules] Loaded %u rules.\n", _ruleCount);
+    return true;
+}
+
+bool RuleEngine::matches(const RuleRecord& rule, const ParadoxEvent& event) const {
+    return event.subEvent >= rule.subEventMin && event.subEvent <= rule.subEventMax &&
+           (rule.partition == 0 || rule.partition == event.partition) &&
+           (rule.panel == 0 || rule.panel == event.panel);
+}
+
+// Returns true when this match reaches the rule's threshold
+bool RuleEngine::countMatch(uint8_t slot) {
+    const RuleRecord& rule = _rules[slot];
+    RuleState& state = _state[slot];
+    if (rule.threshold <= 1) {
+        return true;
+    }
+    unsigned long now = millis();
+    if (state.count == 0 || (rule.windowSec > 0 && now - state.windowStart > rule.windowSec * 1000UL)) {
+        state.count = 0;
+        state.windowStart = now;
+    }
+    if (++state.count < rule.threshold) {
+        return false;
+    }
+    state.count = 0;
+    return true;
+}
+
+void RuleEngine::evaluate(const ParadoxEvent& event) {
+    for (uint8_t slot = _firstRule[event.event]; slot < _firstRule[event.event + 1]; slot++) {
+        if (matches(_rules[slot], event) && countMatch(slot)) {
+            fire(slot, event);
+        }
+    }
+}
+
+void RuleEngine::fire(uint8_t slot, const ParadoxEvent& event) {
+    const RuleRecord& rule = _rules[slot];
+    DEBUG_PRINTF("[Rules] Rule %u fired on event %u/%u.\n", _ruleIndex[slot], event.event, event.subEvent);
+    if (rule.action == RuleAction::GPIO) {
+        digitalWrite(rule.arg0, rule.arg1 ? HIGH : LOW);
+        // Never store 0, which means no pulse is running
+        _state[slot].pulseEnd = rule.durationMs > 0 ? (millis() + rule.durationMs) | 1 : 0;
+    } else if (rule.action != RuleAction::NONE && _actionCallback) {
+        _actionCallback(_ruleIndex[slot], rule, event);
+    }
+}
+
+void RuleEngine::service() {
+    unsigned long now = millis();
+    for (uint8_t slot = 0; slot < _ruleCount; slot++) {
+        RuleState& state = _state[slot];
+        if (state.pulseEnd != 0 && (long)(now - state.pulseEnd) >= 0) {
+            digitalWrite(_rules[slot].arg0, _rules[slot].arg1 ? LOW : HIGH);
+            state.pulseEnd = 0;
+        }
+    }
+}
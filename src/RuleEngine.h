@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include "ParadoxEvents.h"
+
+#define RULES_FILE "/rules.bin"
+#define RULES_FILE_MAGIC 0x4C555250 // "PRUL"
+#define RULES_FILE_VERSION 1
+
+#ifndef RULES_MAX
+#define RULES_MAX 32
+#endif
+
+// Pins no rule may drive: GPIO1/3 are the console UART, GPIO6-11 the SPI flash
+#ifndef RULES_RESERVED_PINS
+#define RULES_RESERVED_PINS 0x0FCAULL
+#endif
+
+enum class RuleAction : uint8_t {
+    NONE,
+    GPIO,    // arg0 = pin, arg1 = level, durationMs = pulse length (0 latches)
+    ARM,     // arg0 = partition, arg1 = arm mode (0 = away)
+    DISARM,  // arg0 = partition
+    PUBLISH  // Priority MQTT publish to <prefix>/rules/<index>
+};
+
+// One compiled rule, stored as-is in the rules file (little-endian, 16 bytes)
+struct __attribute__((packed)) RuleRecord {
+    uint8_t event;
+    uint8_t subEventMin;
+    uint8_t subEventMax;
+    uint8_t partition;  // 0 = any
+    uint8_t panel;      // 0 = any
+    uint8_t threshold;  // Matches needed within windowSec to fire; 0 or 1 = every match
+    uint16_t windowSec; // 0 = count without a time limit
+    RuleAction action;
+    uint8_t arg0;
+    uint8_t arg1;
+    uint8_t reserved0;
+    uint16_t durationMs;
+    uint16_t reserved1;
+};
+static_assert(sizeof(RuleRecord) == 16, "RuleRecord is a file format");
+
+struct __attribute__((packed)) RuleFileHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t count;
+    uint16_t reserved;
+};
+
+// Panel and MQTT actions are handed back to the caller; GPIO is driven here
+using RuleActionCallback = std::function<void(uint8_t index, const RuleRecord& rule, const ParadoxEvent& event)>;
+
+// Evaluates compiled rules against decoded panel events without a round trip
+// through the broker. Rules are bucketed by event number at load time, so an
+// event only visits the rules that can match it.
+class RuleEngine {
+public:
+    void setActionCallback(RuleActionCallback callback) { _actionCallback = callback; }
+    // Keeps GPIO rules off a pin the firmware drives itself. Call before load().
+    void reservePin(uint8_t pin);
+
+    // Loads RULES_FILE from LittleFS. A missing file leaves no rules active.
+    bool load();
+    // Validates and activates a rules image, e.g. one received over MQTT
+    bool loadFromBuffer(const uint8_t* data, size_t length);
+
+    void evaluate(const ParadoxEvent& event);
+    // Ends GPIO pulses whose time is up; call periodically
+    void service();
+
+    uint8_t getRuleCount() const { return _ruleCount; }
+
+private:
+    struct RuleState {
+        uint8_t count;
+        unsigned long windowStart;
+        unsigned long pulseEnd; // 0 = no pulse running
+    };
+
+    RuleRecord _rules[RULES_MAX];       // Sorted by event
+    RuleState _state[RULES_MAX];
+    uint8_t _ruleIndex[RULES_MAX];      // Position of each sorted rule in the file
+    uint8_t _firstRule[257];            // Rules for event e are [_firstRule[e], _firstRule[e + 1])
+    uint8_t _ruleCount = 0;
+    RuleActionCallback _actionCallback;
+    uint64_t _reservedPins = RULES_RESERVED_PINS;
+
+    bool isUsablePin(uint8_t pin) const;
+    bool matches(const RuleRecord& rule, const ParadoxEvent& event) const;
+    bool countMatch(uint8_t slot);
+    void fire(uint8_t slot, const ParadoxEvent& event);
+};
@@ -0,0 +1,15 @@
+#include "Storage.h"
+#include "Config.h"
+#include <LittleFS.h>
+
+static bool s_mounted = false;
+
+bool mountStorage() {
+    if (!s_mounted) {
+        s_mounted = LittleFS.begin(false);
+        if (!s_mounted) {
+            DEBUG_PRINTLN("[FS] Failed to mount file system.");
+        }
+    }
+    return s_mounted;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// LittleFS holds the config, rules, labels, zone history and TLS bundle.
+// Mounted on first use and never formatted here, so a failed mount cannot
+// wipe what is stored; only the configuration portal formats a blank flash.
+bool mountStorage();
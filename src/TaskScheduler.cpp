@@ -0,0 +1,114 @@
+#include "TaskScheduler.h"
+#include "Config.h"
+
+TaskScheduler::TaskScheduler() {
+    for (int i = 0; i < SCHEDULER_WHEEL_SLOTS; i++) {
+        _slots[i] = -1;
+    }
+    _currentTick = millis() / SCHEDULER_TICK_MS;
+}
+
+int TaskScheduler::addTask(const char* name, uint32_t intervalMs, ScheduledCallback callback, uint32_t delayMs) {
+    // Reuse the slot of a finished one-shot task before growing the table
+    int id = -1;
+    for (int i = 0; i < _taskCount; i++) {
+        if (!_tasks[i].active) {
+            id = i;
+            break;
+        }
+    }
+    if (id < 0) {
+        if (_taskCount >= SCHEDULER_MAX_TASKS) {
+            DEBUG_PRINTF("[Scheduler] Task table full, dropping %s\n", name);
+            return -1;
+        }
+        id = _taskCount++;
+    }
+
+    Task& task = _tasks[id];
+    task.callback = callback;
+    task.stats = {name, intervalMs, 0, 0, 0};
+    task.active = true;
+    insert(id, intervalMs > 0 && delayMs == 0 ? intervalMs : delayMs);
+    return id;
+}
+
+void TaskScheduler::insert(int id, uint32_t delayMs) {
+    // Round up so a task never runs early
+    uint32_t ticks = (delayMs + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    uint32_t slot = (_currentTick + ticks) % SCHEDULER_WHEEL_SLOTS;
+    _tasks[id].rounds = (ticks - 1) / SCHEDULER_WHEEL_SLOTS;
+    _tasks[id].next = _slots[slot];
+    _slots[slot] = id;
+}
+
+uint32_t TaskScheduler::run() {
+    uint32_t nowTick = millis() / SCHEDULER_TICK_MS;
+
+    // After a long stall only one revolution needs visiting; every slot is then covered
+    if (nowTick - _currentTick > SCHEDULER_WHEEL_SLOTS) {
+        _currentTick = nowTick - SCHEDULER_WHEEL_SLOTS;
+    }
+    while (_currentTick != nowTick) {
+        _currentTick++;
+        runSlot(_currentTick);
+    }
+
+    // Time to the next occupied slot
+    for (uint32_t i = 1; i <= SCHEDULER_WHEEL_SLOTS; i++) {
+        if (_slots[(_currentTick + i) % SCHEDULER_WHEEL_SLOTS] >= 0) {
+            return i * SCHEDULER_TICK_MS - (millis() % SCHEDULER_TICK_MS);
+        }
+    }
+    return SCHEDULER_WHEEL_SLOTS * SCHEDULER_TICK_MS;
+}
+
+void TaskScheduler::runSlot(uint32_t tick) {
+    uint32_t slot = tick % SCHEDULER_WHEEL_SLOTS;
+
+    // Detach the list first: tasks rescheduled below may land in this slot again
+    int8_t id = _slots[slot];
+    _slots[slot] = -1;
+
+    while (id >= 0) {
+        Task& task = _tasks[id];
+        int8_t next = task.next;
+
+        if (task.rounds > 0) {
+            task.rounds--;
+            task.next = _slots[slot];
+            _slots[slot] = id;
+        } else {
+            unsigned long start = micros();
+            task.callback();
+            uint32_t elapsed = micros() - start;
+
+            task.stats.runCount++;
+            task.stats.totalMicros += elapsed;
+            if (elapsed > task.stats.maxMicros) {
+                task.stats.maxMicros = elapsed;
+            }
+
+            if (task.stats.intervalMs > 0) {
+                insert(id, task.stats.intervalMs);
+            } else {
+                task.active = false;
+                task.callback = nullptr;
+            }
+        }
+        id = next;
+    }
+}
+
+void TaskScheduler::logStats() const {
+    for (int i = 0; i < _taskCount; i++) {
+        const ScheduledTaskStats& stats = _tasks[i].stats;
+        if (!_tasks[i].active) continue;
+        DEBUG_PRINTF("[Scheduler] %-12s every %5u ms: %u runs, avg %u us, max %u us\n",
+                     stats.name, stats.intervalMs, stats.runCount,
+                     stats.runCount ? stats.totalMicros / stats.runCount : 0, stats.maxMicros);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 16
+#endif
+
+// Wheel resolution and size. Tasks further out than one revolution
+// (TICK_MS * SLOTS) wait extra rounds in their slot.
+#define SCHEDULER_TICK_MS 10
+#define SCHEDULER_WHEEL_SLOTS 64
+
+using ScheduledCallback = std::function<void()>;
+
+struct ScheduledTaskStats {
+    const char* name;
+    uint32_t intervalMs;
+    uint32_t runCount;
+    uint32_t totalMicros;
+    uint32_t maxMicros;
+};
+
+// Cooperative scheduler for housekeeping that does not need to run on every
+// loop() spin. Tasks are kept on a hashed timer wheel, so run() only touches
+// the slots for ticks that elapsed since the last call.
+class TaskScheduler {
+public:
+    TaskScheduler();
+
+    // intervalMs == 0 schedules a one-shot task that runs after delayMs.
+    // Returns the task id, or -1 if the table is full.
+    int addTask(const char* name, uint32_t intervalMs, ScheduledCallback callback, uint32_t delayMs = 0);
+
+    // Runs due tasks. Returns the milliseconds until the next task is due.
+    uint32_t run();
+
+    int getTaskCount() const { return _taskCount; }
+    const ScheduledTaskStats& getStats(int id) const { return _tasks[id].stats; }
+    void logStats() const;
+
+private:
+    struct Task {
+        ScheduledCallback callback;
+        ScheduledTaskStats stats;
+        uint32_t rounds;  // Full wheel revolutions left before the task is due
+        int8_t next;      // Next task in the same slot, -1 = end of list
+        bool active;
+    };
+
+    Task _tasks[SCHEDULER_MAX_TASKS];
+    int8_t _slots[SCHEDULER_WHEEL_SLOTS]; // Head of each slot's task list
+    int _taskCount = 0;
+    uint32_t _currentTick;
+
+    void insert(int id, uint32_t delayMs);
+    void runSlot(uint32_t tick);
+};
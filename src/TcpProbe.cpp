@@ -0,0 +1,31 @@
+#include "TcpProbe.h"
+#include <WiFi.h>
+
+bool TcpProbe::start(const char* host, uint16_t port) {
+    if (_state != State::IDLE) {
+        return false;
+    }
+    strlcpy(_host, host, sizeof(_host));
+    _port = port;
+    _state = State::RUNNING;
+    if (xTaskCreatePinnedToCore(taskMain, "probe", TCP_PROBE_STACK_SIZE, this, TCP_PROBE_PRIORITY, nullptr, 0) != pdPASS) {
+        _state = State::IDLE;
+        return false;
+    }
+    return true;
+}
+
+void TcpProbe::taskMain(void* arg) {
+    TcpProbe* self = static_cast<TcpProbe*>(arg);
+    WiFiClient client;
+    bool reachable = client.connect(self->_host, self->_port, TCP_PROBE_TIMEOUT);
+    client.stop();
+    self->_state = reachable ? State::REACHABLE : State::UNREACHABLE;
+    vTaskDelete(nullptr);
+}
+
+void TcpProbe::reset() {
+    if (_state != State::RUNNING) {
+        _state = State::IDLE;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Longest wait for DNS plus the TCP connect, in ms
+#ifndef TCP_PROBE_TIMEOUT
+#define TCP_PROBE_TIMEOUT 5000
+#endif
+
+#ifndef TCP_PROBE_STACK_SIZE
+#define TCP_PROBE_STACK_SIZE 3072
+#endif
+#ifndef TCP_PROBE_PRIORITY
+#define TCP_PROBE_PRIORITY 1
+#endif
+
+// Checks that a broker accepts TCP connections without blocking the loop.
+// DNS and the connect run in a short-lived task on the core that does not
+// run loop(); the loop polls getState() and only connects for real once
+// the broker is known to answer.
+class TcpProbe {
+public:
+    enum class State : uint8_t {
+        IDLE,
+        RUNNING,    // Task running
+        REACHABLE,
+        UNREACHABLE
+    };
+
+    bool start(const char* host, uint16_t port);
+    State getState() const { return _state; }
+    // Back to IDLE once the result has been read; ignored while RUNNING
+    void reset();
+
+private:
+    volatile State _state = State::IDLE;
+    char _host[64];
+    uint16_t _port = 0;
+
+    static void taskMain(void* arg);
+};
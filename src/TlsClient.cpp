@@ -0,0 +1,530 @@
+#include "TlsClient.h"
+#include "Config.h"
+#include "Storage.h"
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <lwip/sockets.h>
+#include <memory>
+
+// Trust material shared by every connection; read-only once loaded
+static mbedtls_x509_crt s_ca;
+static mbedtls_x509_crt s_clientCert;
+static mbedtls_pk_context s_clientKey;
+static bool s_credentialsLoaded = false;
+static bool s_haveClientCert = false;
+
+using BundleEntryCallback = std::function<bool(TlsBundleEntry type, const uint8_t* der, size_t length)>;
+
+// Walks the entries of a bundle whose header has been checked
+static bool forEachEntry(const uint8_t* data, size_t length, const BundleEntryCallback& callback) {
+    const TlsBundleHeader* header = (const TlsBundleHeader*)data;
+    size_t offset = sizeof(TlsBundleHeader);
+    for (uint8_t i = 0; i < header->count; i++) {
+        if (offset + 3 > length) {
+            return false;
+        }
+        TlsBundleEntry type = (TlsBundleEntry)data[offset];
+        size_t size = data[offset + 1] | (data[offset + 2] << 8);
+        offset += 3;
+        if (offset + size > length || !callback(type, data + offset, size)) {
+            return false;
+        }
+        offset += size;
+    }
+    return offset == length;
+}
+
+bool TlsClient::validateBundle(const uint8_t* data, size_t length) {
+    if (length < sizeof(TlsBundleHeader) || length > TLS_BUNDLE_MAX_SIZE) {
+        return false;
+    }
+    const TlsBundleHeader* header = (const TlsBundleHeader*)data;
+    if (header->magic != TLS_BUNDLE_MAGIC || header->version != TLS_BUNDLE_VERSION ||
+        esp_rom_crc32_le(0, data + sizeof(TlsBundleHeader), length - sizeof(TlsBundleHeader)) != header->crc) {
+        return false;
+    }
+    uint8_t cas = 0, certs = 0, keys = 0;
+    bool ok = forEachEntry(data, length, [&](TlsBundleEntry type, const uint8_t*, size_t) {
+        switch (type) {
+            case TlsBundleEntry::CA:          cas++; return true;
+            case TlsBundleEntry::CLIENT_CERT: certs++; return true;
+            case TlsBundleEntry::CLIENT_KEY:  keys++; return true;
+            default:                          return false;
+        }
+    });
+    return ok && cas > 0 && certs <= 1 && certs == keys;
+}
+
+bool TlsClient::loadCredentials() {
+    if (s_credentialsLoaded) {
+        return true;
+    }
+    if (!mountStorage()) {
+        return false;
+    }
+    File file = LittleFS.open(TLS_BUNDLE_PATH, "r");
+    if (!file) {
+        DEBUG_PRINTLN("[TLS] No credentials bundle at " TLS_BUNDLE_PATH ".");
+        return false;
+    }
+    size_t length = file.size();
+    if (length > TLS_BUNDLE_MAX_SIZE) {
+        file.close();
+        DEBUG_PRINTLN("[TLS] Credentials bundle is too large.");
+        return false;
+    }
+    std::unique_ptr<uint8_t[]> data(new uint8_t[length]);
+    bool read = file.read(data.get(), length) == length;
+    file.close();
+    if (!read || !validateBundle(data.get(), length)) {
+        DEBUG_PRINTLN("[TLS] Credentials bundle is damaged.");
+        return false;
+    }
+
+    mbedtls_x509_crt_init(&s_ca);
+    mbedtls_x509_crt_init(&s_clientCert);
+    mbedtls_pk_init(&s_clientKey);
+    int error = 0;
+    forEachEntry(data.get(), length, [&error](TlsBundleEntry type, const uint8_t* der, size_t size) {
+        switch (type) {
+            case TlsBundleEntry::CA:
+                error = mbedtls_x509_crt_parse_der(&s_ca, der, size);
+                break;
+            case TlsBundleEntry::CLIENT_CERT:
+                error = mbedtls_x509_crt_parse_der(&s_clientCert, der, size);
+                s_haveClientCert = true;
+                break;
+            case TlsBundleEntry::CLIENT_KEY:
+                error = mbedtls_pk_parse_key(&s_clientKey, der, size, nullptr, 0);
+                break;
+        }
+        return error == 0;
+    });
+    if (error != 0) {
+        DEBUG_PRINTF("[TLS] Failed to parse credentials: -0x%04X\n", -error);
+        mbedtls_x509_crt_free(&s_ca);
+        mbedtls_x509_crt_free(&s_clientCert);
+        mbedtls_pk_free(&s_clientKey);
+        s_haveClientCert = false;
+        return false;
+    }
+    s_credentialsLoaded = true;
+    DEBUG_PRINTF("[TLS] Loaded credentials (%u bytes%s).\n", (unsigned)length, s_haveClientCert ? ", client certificate" : "");
+    return true;
+}
+
+// Written beside the old bundle and renamed over it, so a failed write
+// leaves the previous credentials in place
+bool TlsClient::storeBundle(const uint8_t* data, size_t length) {
+    static const char* tempPath = TLS_BUNDLE_PATH ".tmp";
+    if (!validateBundle(data, length) || !mountStorage()) {
+        return false;
+    }
+    File file = LittleFS.open(tempPath, "w");
+    if (!file) {
+        return false;
+    }
+    bool written = file.write(data, length) == length;
+    file.close();
+    if (!written || (LittleFS.exists(TLS_BUNDLE_PATH) && !LittleFS.remove(TLS_BUNDLE_PATH)) ||
+        !LittleFS.rename(tempPath, TLS_BUNDLE_PATH)) {
+        LittleFS.remove(tempPath);
+        return false;
+    }
+    DEBUG_PRINTF("[TLS] Stored new credentials bundle (%u bytes).\n", (unsigned)length);
+    return true;
+}
+
+TlsClient::TlsClient() {
+    mbedtls_ssl_session_init(&_session);
+}
+
+TlsClient::~TlsClient() {
+    stop();
+    mbedtls_ssl_session_free(&_session);
+}
+
+bool TlsClient::startConnect(const char* host, uint16_t port) {
+    if (_state != State::IDLE || !s_credentialsLoaded) {
+        return false;
+    }
+    strlcpy(_host, host, sizeof(_host));
+    _port = port;
+    _abandoned = false;
+    _closed = false;
+    _peeked = -1;
+    _unflushed = 0;
+    _state = State::CONNECTING;
+    // Pin to the core that does not run loop(), so the handshake's big-number
+    // maths never holds up serial ingest
+    if (xTaskCreatePinnedToCore(taskMain, "tls", TLS_TASK_STACK_SIZE, this, TLS_TASK_PRIORITY, nullptr, 0) != pdPASS) {
+        _state = State::IDLE;
+        return false;
+    }
+    return true;
+}
+
+void TlsClient::taskMain(void* arg) {
+    static_cast<TlsClient*>(arg)->runHandshake();
+    vTaskDelete(nullptr);
+}
+
+void TlsClient::runHandshake() {
+    if (!_sessionLoaded) {
+        loadSession();
+    }
+    unsigned long start = millis();
+    bool resumed = false;
+    int ret = handshake(resumed);
+    uint32_t elapsed = millis() - start;
+
+    if (ret == 0) {
+        rememberSession();
+        _stats.lastMs = elapsed;
+        _stats.lastResumed = resumed;
+        if (resumed) {
+            _stats.resumedHandshakes++;
+            _stats.resumedMsTotal += elapsed;
+        } else {
+            _stats.fullHandshakes++;
+            _stats.fullMsTotal += elapsed;
+        }
+        // From here on the loop reads and writes, and must never block on a read
+        mbedtls_net_set_nonblock(&_net);
+        mbedtls_ssl_set_bio(&_ssl, &_net, mbedtls_net_send, mbedtls_net_recv, nullptr);
+        DEBUG_PRINTF("[TLS] %s handshake with %s in %u ms.\n", resumed ? "Resumed" : "Full", _host, elapsed);
+    } else {
+        _stats.failures++;
+        _stats.lastError = ret;
+        freeContexts();
+        DEBUG_PRINTF("[TLS] Handshake with %s failed: -0x%04X\n", _host, -ret);
+    }
+
+    portENTER_CRITICAL(&_mux);
+    bool abandoned = _abandoned;
+    if (!abandoned) {
+        _state = ret == 0 ? State::READY : State::FAILED;
+    }
+    portEXIT_CRITICAL(&_mux);
+    if (abandoned) {
+        freeContexts();
+        _state = State::IDLE;
+    }
+}
+
+// Runs in the handshake task. Returns 0 or an mbedtls error code.
+int TlsClient::handshake(bool& resumed) {
+    int ret;
+    if (!_drbgSeeded) {
+        mbedtls_entropy_init(&_entropy);
+        mbedtls_ctr_drbg_init(&_drbg);
+        ret = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy, (const unsigned char*)HOSTNAME, strlen(HOSTNAME));
+        if (ret != 0) {
+            return ret;
+        }
+        _drbgSeeded = true;
+    }
+
+    mbedtls_net_init(&_net);
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_config_init(&_conf);
+    _contextsReady = true;
+
+    char port[6];
+    snprintf(port, sizeof(port), "%u", _port);
+    if ((ret = mbedtls_net_connect(&_net, _host, port, MBEDTLS_NET_PROTO_TCP)) != 0 ||
+        (ret = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&_conf, &s_ca, nullptr);
+    mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+    mbedtls_ssl_conf_read_timeout(&_conf, TLS_HANDSHAKE_TIMEOUT);
+    mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    if (s_haveClientCert && (ret = mbedtls_ssl_conf_own_cert(&_conf, &s_clientCert, &s_clientKey)) != 0) {
+        return ret;
+    }
+    if ((ret = mbedtls_ssl_setup(&_ssl, &_conf)) != 0 || (ret = mbedtls_ssl_set_hostname(&_ssl, _host)) != 0) {
+        return ret;
+    }
+    mbedtls_ssl_set_bio(&_ssl, &_net, mbedtls_net_send, nullptr, mbedtls_net_recv_timeout);
+
+    // A session ID or ticket from the last connection lets the server skip
+    // the certificate exchange and key agreement
+    bool offered = _haveSession && mbedtls_ssl_set_session(&_ssl, &_session) == 0;
+
+    // Only a full handshake verifies the server's certificate, so the verify
+    // callback firing tells a full handshake from a resumed one
+    bool verified = false;
+    mbedtls_ssl_conf_verify(&_conf, onVerify, &verified);
+    while ((ret = mbedtls_ssl_handshake(&_ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return ret;
+        }
+    }
+    resumed = offered && !verified;
+    return 0;
+}
+
+// Leaves mbedtls's own verdict in flags untouched
+int TlsClient::onVerify(void* arg, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    *static_cast<bool*>(arg) = true;
+    return 0;
+}
+
+void TlsClient::rememberSession() {
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_session_init(&_session);
+    _haveSession = mbedtls_ssl_get_session(&_ssl, &_session) == 0;
+#if TLS_SESSION_NVS
+    if (_haveSession) {
+        saveSession();
+    }
+#endif
+}
+
+// NVS blob: host length (1), host, then the session as mbedtls saves it.
+// A session is only offered back to the host that issued it.
+void TlsClient::loadSession() {
+    _sessionLoaded = true;
+#if TLS_SESSION_NVS
+    char key[8];
+    snprintf(key, sizeof(key), "sess%u", _slot);
+    Preferences prefs;
+    prefs.begin("tls", true);
+    size_t length = prefs.isKey(key) ? prefs.getBytesLength(key) : 0;
+    if (length < 2 || length > TLS_SESSION_MAX_SIZE) {
+        prefs.end();
+        return;
+    }
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[length]);
+    prefs.getBytes(key, blob.get(), length);
+    prefs.end();
+
+    size_t hostLength = blob[0];
+    if (1 + hostLength >= length || hostLength != strlen(_host) || memcmp(blob.get() + 1, _host, hostLength) != 0) {
+        return;
+    }
+    if (mbedtls_ssl_session_load(&_session, blob.get() + 1 + hostLength, length - 1 - hostLength) != 0) {
+        mbedtls_ssl_session_free(&_session);
+        mbedtls_ssl_session_init(&_session);
+        return;
+    }
+    _haveSession = true;
+    _sessionCrc = esp_rom_crc32_le(0, blob.get(), length);
+    DEBUG_PRINTF("[TLS] Loaded saved session for %s.\n", _host);
+#endif
+}
+
+// Written only when the session changed, so a resumption that keeps the
+// same ticket costs no flash write
+void TlsClient::saveSession() {
+    size_t hostLength = strlen(_host);
+    size_t sessionLength = 0;
+    mbedtls_ssl_session_save(&_session, nullptr, 0, &sessionLength);
+    size_t length = 1 + hostLength + sessionLength;
+    if (sessionLength == 0 || length > TLS_SESSION_MAX_SIZE) {
+        return;
+    }
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[length]);
+    blob[0] = hostLength;
+    memcpy(blob.get() + 1, _host, hostLength);
+    if (mbedtls_ssl_session_save(&_session, blob.get() + 1 + hostLength, sessionLength, &sessionLength) != 0) {
+        return;
+    }
+    uint32_t crc = esp_rom_crc32_le(0, blob.get(), length);
+    if (crc == _sessionCrc) {
+        return;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "sess%u", _slot);
+    Preferences prefs;
+    prefs.begin("tls", false);
+    prefs.putBytes(key, blob.get(), length);
+    prefs.end();
+    _sessionCrc = crc;
+}
+
+void TlsClient::freeContexts() {
+    if (!_contextsReady) {
+        return;
+    }
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_net_free(&_net);
+    _contextsReady = false;
+}
+
+// Never blocks: the connection is only usable once the handshake task is done
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+    return connected();
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+    return connected();
+}
+
+uint8_t TlsClient::connected() {
+    if (_state != State::READY || _closed) {
+        return 0;
+    }
+    if (_peeked >= 0 || mbedtls_ssl_get_bytes_avail(&_ssl) > 0) {
+        return 1;
+    }
+    uint8_t probe;
+    int ret = recv(_net.fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (ret > 0 || (ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR))) {
+        return 1;
+    }
+    _closed = true;
+    return 0;
+}
+
+int TlsClient::available() {
+    if (_state != State::READY || _closed) {
+        return 0;
+    }
+    flushPending();
+    int pending = mbedtls_ssl_get_bytes_avail(&_ssl);
+    if (pending == 0) {
+        // Decrypts the next record, if one has arrived
+        int ret = mbedtls_ssl_read(&_ssl, nullptr, 0);
+        if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            _closed = true;
+            return 0;
+        }
+        pending = mbedtls_ssl_get_bytes_avail(&_ssl);
+    }
+    return pending + (_peeked >= 0 ? 1 : 0);
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+    if (_state != State::READY || size == 0) {
+        return -1;
+    }
+    size_t count = 0;
+    if (_peeked >= 0) {
+        buf[count++] = _peeked;
+        _peeked = -1;
+    }
+    if (count == size || _closed) {
+        return count > 0 ? (int)count : -1;
+    }
+    int ret = mbedtls_ssl_read(&_ssl, buf + count, size - count);
+    if (ret > 0) {
+        return count + ret;
+    }
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        // Close notify, end of stream or a broken record
+        _closed = true;
+    }
+    return count > 0 ? (int)count : -1;
+}
+
+int TlsClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int TlsClient::peek() {
+    if (_peeked < 0) {
+        uint8_t b;
+        if (read(&b, 1) == 1) {
+            _peeked = b;
+        }
+    }
+    return _peeked;
+}
+
+size_t TlsClient::write(uint8_t b) {
+    return write(&b, 1);
+}
+
+// Never waits for the socket. A record mbedtls could not send in full stays
+// in its buffer and counts as written; until it has gone out, writes return
+// 0 and PubSubClient's caller tries again on a later loop. MQTT_BUFFER_SIZE
+// is below the record size, so a packet is never split across records.
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+    if (_state != State::READY || _closed || !flushPending()) {
+        return 0;
+    }
+    size_t sent = 0;
+    while (sent < size) {
+        size_t chunk = size - sent;
+        int ret = mbedtls_ssl_write(&_ssl, buf + sent, chunk);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+            int maxPayload = mbedtls_ssl_get_max_out_record_payload(&_ssl);
+            if (maxPayload > 0 && chunk > (size_t)maxPayload) {
+                chunk = maxPayload;
+            }
+            _unflushed = chunk;
+            sent += chunk;
+        } else {
+            _closed = true;
+        }
+        break;
+    }
+    return sent;
+}
+
+// True once no record is left half sent. While one is, mbedtls_ssl_write()
+// only flushes it and does not read the buffer, so any pointer will do.
+bool TlsClient::flushPending() {
+    if (_unflushed == 0) {
+        return true;
+    }
+    static const uint8_t unused = 0;
+    int ret = mbedtls_ssl_write(&_ssl, &unused, _unflushed);
+    if (ret > 0) {
+        _unflushed = 0;
+        return true;
+    }
+    if (ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) {
+        _closed = true;
+    }
+    return false;
+}
+
+void TlsClient::stop() {
+    portENTER_CRITICAL(&_mux);
+    bool handshaking = _state == State::CONNECTING;
+    if (handshaking) {
+        _abandoned = true;
+    }
+    portEXIT_CRITICAL(&_mux);
+    if (handshaking) {
+        return;
+    }
+    if (_state == State::READY && !_closed) {
+        mbedtls_ssl_close_notify(&_ssl);
+    }
+    freeContexts();
+    _peeked = -1;
+    _unflushed = 0;
+    _closed = false;
+    _state = State::IDLE;
+}
+
+void TlsClient::toJson(JsonObject obj) const {
+    obj["full"] = _stats.fullHandshakes;
+    obj["resumed"] = _stats.resumedHandshakes;
+    obj["failures"] = _stats.failures;
+    if (_stats.fullHandshakes > 0) {
+        obj["avg_full_ms"] = _stats.fullMsTotal / _stats.fullHandshakes;
+    }
+    if (_stats.resumedHandshakes > 0) {
+        obj["avg_resumed_ms"] = _stats.resumedMsTotal / _stats.resumedHandshakes;
+    }
+    obj["last_ms"] = _stats.lastMs;
+    obj["last_resumed"] = _stats.lastResumed;
+    obj["session"] = _haveSession;
+    if (_stats.lastError != 0) {
+        obj["last_error"] = _stats.lastError;
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+#include <ArduinoJson.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/pk.h>
+
+// TLS to every broker. Needs a credentials bundle on LittleFS, see below.
+#ifndef MQTT_TLS_ENABLED
+#define MQTT_TLS_ENABLED 0
+#endif
+
+// Handshakes run in a short-lived task on the core that does not run loop()
+#ifndef TLS_TASK_STACK_SIZE
+#define TLS_TASK_STACK_SIZE 8192
+#endif
+#ifndef TLS_TASK_PRIORITY
+#define TLS_TASK_PRIORITY 1
+#endif
+
+// Longest wait for a handshake record, in ms
+#ifndef TLS_HANDSHAKE_TIMEOUT
+#define TLS_HANDSHAKE_TIMEOUT 10000
+#endif
+
+// Keep resumable sessions in NVS so a reboot also skips the full handshake.
+// The session holds the master secret; without flash encryption, anyone
+// with the board can read it.
+#ifndef TLS_SESSION_NVS
+#define TLS_SESSION_NVS 1
+#endif
+#define TLS_SESSION_MAX_SIZE 2048
+
+// Credentials bundle, little-endian: this header, then entries of type (1),
+// length (2) and DER bytes. crc covers the entries.
+#define TLS_BUNDLE_PATH "/tls.bin"
+#define TLS_BUNDLE_MAGIC 0x53545850 // "PXTS"
+#define TLS_BUNDLE_VERSION 1
+#define TLS_BUNDLE_MAX_SIZE 8192
+
+struct __attribute__((packed)) TlsBundleHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t count;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+enum class TlsBundleEntry : uint8_t {
+    CA = 1,          // Trusted CA certificate; at least one is required
+    CLIENT_CERT = 2, // Optional client certificate...
+    CLIENT_KEY = 3   // ...and its private key, unencrypted
+};
+
+struct TlsStats {
+    uint32_t fullHandshakes;
+    uint32_t resumedHandshakes;
+    uint32_t failures;
+    uint32_t fullMsTotal;
+    uint32_t resumedMsTotal;
+    uint32_t lastMs;
+    bool lastResumed;
+    int lastError;          // mbedtls error code of the last failure
+};
+
+// Client for PubSubClient over mbedtls. connect() never blocks: the TCP
+// connect and handshake are started with startConnect() and run in their
+// own task. Once getState() is READY, connected() is true, so PubSubClient
+// goes straight to the MQTT CONNECT.
+class TlsClient : public Client {
+public:
+    enum class State : uint8_t {
+        IDLE,
+        CONNECTING, // Handshake task running; the contexts belong to it
+        READY,
+        FAILED      // Until stop()
+    };
+
+    TlsClient();
+    ~TlsClient();
+
+    // Loads the CA and optional client credentials shared by every
+    // connection. False if the bundle is missing or damaged.
+    static bool loadCredentials();
+    // Checks a bundle before it is stored
+    static bool validateBundle(const uint8_t* data, size_t length);
+    // Replaces the stored bundle. Connections in use keep the loaded
+    // credentials; the new ones take effect from the next restart.
+    static bool storeBundle(const uint8_t* data, size_t length);
+
+    // Slot for the NVS session copy, one per broker
+    void setSessionSlot(uint8_t slot) { _slot = slot; }
+    bool startConnect(const char* host, uint16_t port);
+    State getState() const { return _state; }
+    bool hasSession() const { return _haveSession; }
+    const TlsStats& getStats() const { return _stats; }
+    void toJson(JsonObject obj) const;
+
+    // Client
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+private:
+    volatile State _state = State::IDLE;
+    volatile bool _abandoned = false;  // stop() during a handshake; the task cleans up
+    char _host[64];
+    uint16_t _port = 0;
+    uint8_t _slot = 0;
+    int _peeked = -1;
+    size_t _unflushed = 0;             // Length of the record mbedtls still holds, see write()
+    bool _closed = false;              // Peer closed or the link broke; connected() is false
+    bool _contextsReady = false;
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+    mbedtls_net_context _net;
+    mbedtls_ssl_context _ssl;
+    mbedtls_ssl_config _conf;
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _drbg;
+    bool _drbgSeeded = false;
+
+    // Last session the server gave us, offered again on the next connect
+    mbedtls_ssl_session _session;
+    bool _haveSession = false;
+    bool _sessionLoaded = false;    // NVS copy read, or found missing
+    uint32_t _sessionCrc = 0;       // Of the copy in NVS
+
+    TlsStats _stats = {};
+
+    static void taskMain(void* arg);
+    void runHandshake();
+    int handshake(bool& resumed);
+    static int onVerify(void* arg, mbedtls_x509_crt* crt, int depth, uint32_t* flags);
+    bool flushPending();
+    void rememberSession();
+    void loadSession();
+    void saveSession();
+    void freeContexts();
+};
@@ -1,72 +1,549 @@
 #include "WebUi.h"
 #include "Config.h" // Include for DEBUG_PRINTLN
 #include "Logger.h"
+#include "ZoneHistory.h"
+#include "TlsClient.h"
 #include <ESPAsyncWebServer.h>
+#include <memory>
+#include <stdarg.h>
 
 AsyncWebServer server(80);
 
-WebUi::WebUi() {}
+// What one /api response reports. Taken once, so every chunk of the body is
+// rendered from the same state; held open until then for long-polls.
+struct ApiSnapshot {
+    WebUi::ApiView view;
+    bool ready;
+    uint32_t bootId;
+    uint32_t since;
+    unsigned long startedAt;
+    uint32_t generation;
+    uint8_t panelCount;
+    uint8_t panelIds[WEBUI_MAX_PANELS];
+    PanelState panels[WEBUI_MAX_PANELS];
+    uint8_t* longPolls; // Released when the response is destroyed
 
-void WebUi::setup() {
-    server.on("/logs", HTTP_GET, [](AsyncWebServerRequest *request){
-        if (!request->authenticate(CONFIG_PORTAL_SSID, CONFIG_PORTAL_PASSWORD)) {
-            // Manually send the 401 Unauthorized response
-            AsyncWebServerResponse *response = request->beginResponse(401);
-            response->addHeader("WWW-Authenticate", "Basic realm=\"ESP32 Logs\"");
-            request->send(response);
-            return;
+    ~ApiSnapshot() {
+        if (longPolls) {
+            (*longPolls)--;
         }
+    }
+};
 
-        AsyncWebServerResponse *response = request->beginChunkedResponse("text/html", [](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
-            static const char* header = "<!DOCTYPE html><html><head><title>ESP32 Logs</title><meta http-equiv=\"refresh\" content=\"5\"></head><body><h1>ESP32 Logs</h1><pre>";
-            static const char* footer = "</pre></body></html>";
-            static int log_index = -1; // -1 for header, 0 to count-1 for logs, count for footer
+static void appendf(char* out, size_t size, size_t& len, const char* format, ...) {
+    if (len >= size) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out + len, size - len, format, args);
+    va_end(args);
+    len = n < 0 ? size : len + n;
+}
 
-            if (index == 0) {
-                log_index = -1; // Reset for a new request
+// Returns the body length, or 0 if it does not fit in size
+static size_t renderApi(const ApiSnapshot& snapshot, char* out, size_t size) {
+    size_t len = 0;
+    appendf(out, size, len, "{\"boot\":\"%08lx\",\"generation\":%lu,\"panels\":[",
+            (unsigned long)snapshot.bootId, (unsigned long)snapshot.generation);
+    for (uint8_t i = 0; i < snapshot.panelCount; i++) {
+        const PanelState& state = snapshot.panels[i];
+        appendf(out, size, len, "%s{\"panel\":%u", i ? "," : "", snapshot.panelIds[i]);
+        if (snapshot.view != WebUi::ApiView::PARTITIONS) {
+            appendf(out, size, len, ",\"zones\":{\"valid\":%s,\"bell\":%s,\"open\":[",
+                    state.zonesValid ? "true" : "false", state.bellOn ? "true" : "false");
+            bool first = true;
+            for (int zone = 1; zone <= 32; zone++) {
+                if (bitRead(state.openZones, zone - 1)) {
+                    appendf(out, size, len, "%s%d", first ? "" : ",", zone);
+                    first = false;
+                }
             }
+            appendf(out, size, len, "]}");
+        }
+        if (snapshot.view != WebUi::ApiView::ZONES) {
+            appendf(out, size, len, ",\"partition\":{\"valid\":%s,\"state\":\"%s\"}",
+                    state.partitionValid ? "true" : "false", getPartitionStateName(state.partitionSubEvent));
+        }
+        appendf(out, size, len, "}");
+    }
+    appendf(out, size, len, "]}");
+    return len < size ? len : 0;
+}
 
-            if (log_index == -1) {
-                size_t len = strlen(header);
-                if (len > maxLen) return 0; // Should not happen
-                memcpy(buffer, header, len);
-                log_index++;
-                return len;
+// A response body made of small pieces, each rendered only when the server
+// has room for it. A piece that does not fit is carried to the next call.
+class PieceStream {
+public:
+    virtual ~PieceStream() {}
+
+    size_t fill(uint8_t* buffer, size_t maxLen) {
+        size_t used = 0;
+        while (used < maxLen) {
+            if (_carrySent == _carryLen) {
+                _carryLen = nextPiece(_carry, sizeof(_carry));
+                _carrySent = 0;
+                if (_carryLen == 0) {
+                    break;
+                }
             }
+            size_t n = min(maxLen - used, _carryLen - _carrySent);
+            memcpy(buffer + used, _carry + _carrySent, n);
+            used += n;
+            _carrySent += n;
+        }
+        return used;
+    }
+
+protected:
+    // Renders the next piece into out; 0 ends the body
+    virtual size_t nextPiece(char* out, size_t size) = 0;
 
-            const Logger& logger = Logger::getInstance();
-            const String* log_lines = logger.getLogLines();
-            int current_line = logger.getCurrentLine();
-            bool buffer_full = logger.isBufferFull();
-            int count = buffer_full ? Logger::LOG_BUFFER_SIZE : current_line;
+private:
+    char _carry[API_PIECE_SIZE];
+    size_t _carryLen = 0;
+    size_t _carrySent = 0;
+};
 
-            if (log_index < count) {
-                int line_to_send_index = current_line - 1 - log_index;
-                if (line_to_send_index < 0) {
-                    line_to_send_index += Logger::LOG_BUFFER_SIZE;
+class HistoryStream : public PieceStream {
+public:
+    HistoryStream(ZoneHistory& history, const HistoryQuery& query) : _history(history), _query(query) {}
+
+protected:
+    size_t nextPiece(char* out, size_t size) override {
+        switch (_phase) {
+            case 0:
+                _phase = 1;
+                return snprintf(out, size, "{\"records\":[");
+            case 1:
+                // Keeps reading through stretches with no matches until a record or the end
+                while (_batchPos == _batchCount && !_query.done) {
+                    _batchCount = _history.read(_query, _batch, sizeof(_batch) / sizeof(_batch[0]));
+                    _batchPos = 0;
+                }
+                if (_batchPos < _batchCount) {
+                    size_t len = _first ? 0 : 1;
+                    out[0] = ',';
+                    len += ZoneHistory::formatRecord(_batch[_batchPos++], out + len, size - len);
+                    _first = false;
+                    return len;
                 }
-                String line = log_lines[line_to_send_index] + "\n";
-                size_t len = line.length();
-                if (len > maxLen) len = maxLen; // Truncate if necessary
-                memcpy(buffer, line.c_str(), len);
-                log_index++;
-                return len;
+                _phase = 2;
+                return snprintf(out, size, "]}");
+            default:
+                return 0;
+        }
+    }
+
+private:
+    ZoneHistory& _history;
+    HistoryQuery _query;
+    HistoryRecord _batch[8];
+    uint8_t _batchCount = 0;
+    uint8_t _batchPos = 0;
+    uint8_t _phase = 0;
+    bool _first = true;
+};
+
+class HistoryStatsStream : public PieceStream {
+public:
+    HistoryStatsStream(ZoneHistory& history, const uint8_t* panels, uint8_t panelCount, uint8_t channel)
+        : _history(history), _panelCount(panelCount), _channel(channel == 0xFF ? 0 : channel), _only(channel != 0xFF) {
+        memcpy(_panels, panels, panelCount);
+    }
+
+protected:
+    size_t nextPiece(char* out, size_t size) override {
+        if (_phase == 0) {
+            _phase = 1;
+            return snprintf(out, size, "{\"day_start\":%lu,\"stats\":[", (unsigned long)_history.getDayStart());
+        }
+        while (_phase == 1 && _panel < _panelCount) {
+            uint8_t channel = _channel;
+            uint8_t panel = _panels[_panel];
+            if (_only || ++_channel == HISTORY_CHANNELS) {
+                _channel = _only ? _channel : 0;
+                _panel++;
+            }
+            ChannelStats stats;
+            // Zones that never changed are left out of the full listing
+            if (!_history.getStats(panel, channel, stats) ||
+                (!_only && stats.changes == 0 && stats.state == HISTORY_STATE_UNKNOWN)) {
+                continue;
             }
+            size_t len = _first ? 0 : 1;
+            out[0] = ',';
+            len += ZoneHistory::formatStats(panel, channel, stats, out + len, size - len);
+            _first = false;
+            return len;
+        }
+        if (_phase == 1) {
+            _phase = 2;
+            return snprintf(out, size, "]}");
+        }
+        return 0;
+    }
+
+private:
+    ZoneHistory& _history;
+    uint8_t _panels[WEBUI_MAX_PANELS];
+    uint8_t _panelCount;
+    uint8_t _panel = 0;
+    uint8_t _channel;
+    bool _only;
+    uint8_t _phase = 0;
+    bool _first = true;
+};
 
-            if (log_index == count) {
-                size_t len = strlen(footer);
-                if (len > maxLen) return 0; // Should not happen
-                memcpy(buffer, footer, len);
-                log_index++;
-                return len;
+// The /logs page, newest line first. Lines written over while the page is
+// streaming end it early rather than being sent garbled.
+class LogStream : public PieceStream {
+protected:
+    size_t nextPiece(char* out, size_t size) override {
+        switch (_phase) {
+            case 0:
+                _phase = 1;
+                _cursor = Logger::getInstance().getEnd();
+                return snprintf(out, size, "<!DOCTYPE html><html><head><title>ESP32 Logs</title><meta http-equiv=\"refresh\" content=\"5\"></head><body><h1>ESP32 Logs</h1><pre>");
+            case 1: {
+                size_t len = Logger::getInstance().readLineBefore(_cursor, out, size);
+                if (len > 0) {
+                    out[len - 1] = '\n'; // A line cut to fit still ends its own row
+                    return len;
+                }
+                _phase = 2;
+                return snprintf(out, size, "</pre></body></html>");
             }
+            default:
+                return 0;
+        }
+    }
+
+private:
+    uint8_t _phase = 0;
+    uint32_t _cursor = 0;
+};
+
+// Generations start again at every boot; the id keeps old ETags from matching
+WebUi::WebUi() : _bootId(esp_random()) {}
+
+bool WebUi::addPanel(ParadoxHandler& panel) {
+    if (_panelCount >= WEBUI_MAX_PANELS) {
+        DEBUG_PRINTF("[WebUI] Panel %u not exposed: API limited to %d panels\n", panel.getPanelId(), WEBUI_MAX_PANELS);
+        return false;
+    }
+    _panels[_panelCount++] = &panel;
+    return true;
+}
+
+// Every panel's generation only grows, so their sum changes whenever any of them does
+uint32_t WebUi::getGeneration() const {
+    uint32_t generation = 0;
+    for (uint8_t i = 0; i < _panelCount; i++) {
+        generation += _panels[i]->getStateGeneration();
+    }
+    return generation;
+}
+
+// Plain requests carry the boot id and generation as their ETag and get 304
+// while both are unchanged. ?since=[<boot>-]<generation> holds the request until the state moves on
+// or API_LONG_POLL_TIMEOUT passes; the body always carries the generation.
+void WebUi::handleApi(AsyncWebServerRequest* request, ApiView view) {
+    if (!request->authenticate(CONFIG_PORTAL_SSID, CONFIG_PORTAL_PASSWORD)) {
+        return request->requestAuthentication();
+    }
+
+    uint32_t generation = getGeneration();
+    char etag[API_ETAG_SIZE];
+    formatApiEtag(_bootId, generation, etag, sizeof(etag));
+
+    const char* sinceText = request->hasParam("since") ? request->getParam("since")->value().c_str() : nullptr;
+    const char* ifNoneMatch = request->hasHeader("If-None-Match") ? request->getHeader("If-None-Match")->value().c_str() : nullptr;
+    ApiReply reply = decideApiReply(_bootId, generation, ifNoneMatch, sinceText, _longPolls);
+    if (reply == ApiReply::NOT_MODIFIED) {
+        AsyncWebServerResponse* response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        request->send(response);
+        return;
+    }
+    if (reply == ApiReply::BUSY) {
+        request->send(503);
+        return;
+    }
+    bool longPoll = reply == ApiReply::WAIT;
+    uint32_t since = 0;
+    if (longPoll) {
+        parseApiSince(sinceText, _bootId, since);
+    }
+
+    std::shared_ptr<ApiSnapshot> snapshot(new ApiSnapshot());
+    snapshot->view = view;
+    snapshot->bootId = _bootId;
+    snapshot->since = since;
+    snapshot->startedAt = millis();
+    auto capture = [this](ApiSnapshot& target) {
+        target.panelCount = _panelCount;
+        target.generation = 0;
+        for (uint8_t i = 0; i < _panelCount; i++) {
+            target.panelIds[i] = _panels[i]->getPanelId();
+            target.panels[i] = _panels[i]->getState();
+            target.generation += target.panels[i].generation;
+        }
+        target.ready = true;
+    };
+    if (longPoll) {
+        _longPolls++;
+        snapshot->longPolls = &_longPolls;
+    } else {
+        capture(*snapshot);
+    }
 
-            return 0; // End of stream
+    // Polled by the server until it returns data; nothing is buffered beyond the snapshot
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+        [this, snapshot, capture](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            if (!snapshot->ready) {
+                if (apiLongPollWaiting(getGeneration(), snapshot->since, millis() - snapshot->startedAt)) {
+                    return RESPONSE_TRY_AGAIN;
+                }
+                capture(*snapshot);
+            }
+            char text[API_RESPONSE_BUFFER];
+            size_t len = renderApi(*snapshot, text, sizeof(text));
+            if (index >= len) {
+                return 0;
+            }
+            size_t n = min(maxLen, len - index);
+            memcpy(buffer, text + index, n);
+            return n;
         });
+    if (!longPoll) {
+        response->addHeader("ETag", etag);
+    }
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+// ?panel=<id> and ?zone=<1-32> or ?partition=1 narrow the result; records
+// also take ?from= and ?to= in Unix seconds
+void WebUi::handleHistory(AsyncWebServerRequest* request, bool stats) {
+    if (!request->authenticate(CONFIG_PORTAL_SSID, CONFIG_PORTAL_PASSWORD)) {
+        return request->requestAuthentication();
+    }
+    if (!_history) {
+        request->send(404);
+        return;
+    }
+
+    HistoryQuery query;
+    if (request->hasParam("panel")) {
+        query.panel = strtoul(request->getParam("panel")->value().c_str(), nullptr, 10);
+    }
+    if (request->hasParam("zone")) {
+        unsigned long zone = strtoul(request->getParam("zone")->value().c_str(), nullptr, 10);
+        if (zone < 1 || zone > 32) {
+            request->send(400, "text/plain", "zone must be 1-32");
+            return;
+        }
+        query.channel = zone - 1;
+    } else if (request->hasParam("partition")) {
+        if (strtoul(request->getParam("partition")->value().c_str(), nullptr, 10) != HISTORY_PARTITION) {
+            request->send(400, "text/plain", "only partition 1 has history");
+            return;
+        }
+        query.channel = HISTORY_PARTITION_CHANNEL;
+    }
+    if (request->hasParam("from")) {
+        query.from = strtoul(request->getParam("from")->value().c_str(), nullptr, 10);
+    }
+    if (request->hasParam("to")) {
+        query.to = strtoul(request->getParam("to")->value().c_str(), nullptr, 10);
+    }
+
+    std::shared_ptr<PieceStream> stream;
+    if (stats) {
+        uint8_t panels[WEBUI_MAX_PANELS];
+        uint8_t panelCount = 0;
+        for (uint8_t i = 0; i < _panelCount; i++) {
+            uint8_t id = _panels[i]->getPanelId();
+            if (query.panel == 0 || query.panel == id) {
+                panels[panelCount++] = id;
+            }
+        }
+        stream.reset(new HistoryStatsStream(*_history, panels, panelCount, query.channel));
+    } else {
+        stream.reset(new HistoryStream(*_history, query));
+    }
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+        [stream](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            return stream->fill(buffer, maxLen);
+        });
+    request->send(response);
+}
+
+// Held by a /metrics response; gives the slot back when the response is destroyed
+struct WebUi::MetricsTicket {
+    WebUi* owner;
+
+    ~MetricsTicket() {
+        owner->releaseMetrics();
+    }
+};
+
+// The body is rendered by serviceMetrics() on the loop, where the state it
+// reports is owned, and streamed straight out of the pool block
+void WebUi::handleMetrics(AsyncWebServerRequest* request) {
+    if (!request->authenticate(CONFIG_PORTAL_SSID, CONFIG_PORTAL_PASSWORD)) {
+        return request->requestAuthentication();
+    }
+    if (!_metricsRenderer) {
+        request->send(404);
+        return;
+    }
+
+    void* block = nullptr;
+    portENTER_CRITICAL(&_metricsMux);
+    if (_metricsState == MetricsState::IDLE) {
+        block = _metricsPool->allocate();
+        if (block) {
+            _metricsBlock = block;
+            _metricsText = nullptr;
+            _metricsLength = 0;
+            _metricsState = MetricsState::REQUESTED;
+        }
+    }
+    portEXIT_CRITICAL(&_metricsMux);
+    if (!block) {
+        request->send(503);
+        return;
+    }
+
+    std::shared_ptr<MetricsTicket> ticket(new MetricsTicket{this});
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+        [this, ticket](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            if (_metricsState != MetricsState::READY) {
+                return RESPONSE_TRY_AGAIN;
+            }
+            // Text and length are fixed once READY; a failed render streams nothing
+            if (index >= _metricsLength) {
+                return 0;
+            }
+            size_t n = min(maxLen, _metricsLength - index);
+            memcpy(buffer, _metricsText + index, n);
+            return n;
+        });
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+// A response dropped before the loop has rendered it leaves the block to the loop
+void WebUi::releaseMetrics() {
+    portENTER_CRITICAL(&_metricsMux);
+    if (_metricsState == MetricsState::READY) {
+        _metricsPool->deallocate(_metricsBlock);
+        _metricsBlock = nullptr;
+        _metricsState = MetricsState::IDLE;
+    } else if (_metricsState == MetricsState::REQUESTED) {
+        _metricsState = MetricsState::ABANDONED;
+    }
+    portEXIT_CRITICAL(&_metricsMux);
+}
+
+void WebUi::serviceMetrics() {
+    if (_metricsState != MetricsState::REQUESTED && _metricsState != MetricsState::ABANDONED) {
+        return;
+    }
+    const char* text = nullptr;
+    if (_metricsState == MetricsState::REQUESTED) {
+        BumpArena arena(_metricsBlock, _metricsPool->getBlockSize());
+        text = _metricsRenderer(arena);
+    }
+    portENTER_CRITICAL(&_metricsMux);
+    if (_metricsState == MetricsState::REQUESTED) {
+        _metricsText = text;
+        _metricsLength = text ? strlen(text) : 0;
+        _metricsState = MetricsState::READY;
+    } else {
+        _metricsPool->deallocate(_metricsBlock);
+        _metricsBlock = nullptr;
+        _metricsState = MetricsState::IDLE;
+    }
+    portEXIT_CRITICAL(&_metricsMux);
+}
+
+void WebUi::setup() {
+    server.on("/logs", HTTP_GET, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(CONFIG_PORTAL_SSID, CONFIG_PORTAL_PASSWORD)) {
+            // Manually send the 401 Unauthorized response
+            AsyncWebServerResponse *response = request->beginResponse(401);
+            response->addHeader("WWW-Authenticate", "Basic realm=\"ESP32 Logs\"");
+            request->send(response);
+            return;
+        }
+
+        std::shared_ptr<LogStream> stream(new LogStream());
+        AsyncWebServerResponse *response = request->beginChunkedResponse("text/html",
+            [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return stream->fill(buffer, maxLen);
+            });
 
         request->send(response);
     });
 
+    server.on("/metrics", HTTP_GET, [this](AsyncWebServerRequest *request){
+        handleMetrics(request);
+    });
+
+    // /api/history would also match /api/history/stats, so the longer path goes first
+    server.on("/api/history/stats", HTTP_GET, [this](AsyncWebServerRequest *request){
+        handleHistory(request, true);
+    });
+    server.on("/api/history", HTTP_GET, [this](AsyncWebServerRequest *request){
+        handleHistory(request, false);
+    });
+    server.on("/api/state", HTTP_GET, [this](AsyncWebServerRequest *request){
+        handleApi(request, ApiView::STATE);
+    });
+    server.on("/api/zones", HTTP_GET, [this](AsyncWebServerRequest *request){
+        handleApi(request, ApiView::ZONES);
+    });
+    server.on("/api/partitions", HTTP_GET, [this](AsyncWebServerRequest *request){
+        handleApi(request, ApiView::PARTITIONS);
+    });
+
+#if MQTT_TLS_ENABLED
+    // Credentials bundle from tools/tls_bundle.py, used from the next restart.
+    // The body is collected into _tempObject, which the server frees.
+    server.on("/api/tls", HTTP_PUT, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(CONFIG_PORTAL_SSID, CONFIG_PORTAL_PASSWORD)) {
+            return request->requestAuthentication();
+        }
+        size_t length = request->contentLength();
+        if (length > TLS_BUNDLE_MAX_SIZE) {
+            request->send(413);
+            return;
+        }
+        if (!request->_tempObject || !TlsClient::validateBundle((const uint8_t*)request->_tempObject, length)) {
+            request->send(400, "text/plain", "Invalid bundle");
+            return;
+        }
+        if (!TlsClient::storeBundle((const uint8_t*)request->_tempObject, length)) {
+            request->send(500, "text/plain", "Could not store bundle");
+            return;
+        }
+        request->send(200, "text/plain", "Stored; restart to apply");
+    }, nullptr, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+        if (index == 0) {
+            if (total > TLS_BUNDLE_MAX_SIZE || !request->authenticate(CONFIG_PORTAL_SSID, CONFIG_PORTAL_PASSWORD)) {
+                return;
+            }
+            request->_tempObject = malloc(total);
+        }
+        if (request->_tempObject && index + len <= total) {
+            memcpy((uint8_t*)request->_tempObject + index, data, len);
+        }
+    });
+#endif
+
     server.begin();
-    DEBUG_PRINTLN("[WebUI] Web server started. Access logs at /logs");
+    DEBUG_PRINTLN("[WebUI] Web server started. Access logs at /logs, metrics at /metrics, state at /api");
 }
@@ -1,12 +1,73 @@
 #pragma once
 
 #include <Arduino.h>
+#include <functional>
+#include "ParadoxHandler.h"
+#include "MemoryPool.h"
+#include "ApiReply.h"
+
+// Panels the state API can report on
+#ifndef WEBUI_MAX_PANELS
+#define WEBUI_MAX_PANELS 2
+#endif
+
+// Stack buffer each /api response is rendered into; sized for WEBUI_MAX_PANELS
+#ifndef API_RESPONSE_BUFFER
+#define API_RESPONSE_BUFFER 1024
+#endif
+
+// Largest single piece of a streamed /api body, e.g. one history stats entry
+#ifndef API_PIECE_SIZE
+#define API_PIECE_SIZE 200
+#endif
+
+// Renders the /metrics body into the arena and returns it, or nullptr if it
+// does not fit. Called from serviceMetrics(), so it may read loop-owned state.
+using MetricsRenderer = std::function<const char*(BumpArena&)>;
+
+class AsyncWebServerRequest;
+class ZoneHistory;
 
 class WebUi {
 public:
+    enum class ApiView : uint8_t { STATE, ZONES, PARTITIONS };
+
     WebUi();
     void setup();
+    // /metrics bodies are rendered into a block taken from pool
+    void setMetricsRenderer(MetricsRenderer renderer, FixedBlockPool& pool) {
+        _metricsRenderer = renderer;
+        _metricsPool = &pool;
+    }
+    // Renders a pending /metrics request; call from the main loop
+    void serviceMetrics();
+    // Exposes a panel's cached state under /api
+    bool addPanel(ParadoxHandler& panel);
+    // Serves /api/history and /api/history/stats from this store
+    void setHistory(ZoneHistory* history) { _history = history; }
 
 private:
     // Web server is managed internally
+    enum class MetricsState : uint8_t { IDLE, REQUESTED, READY, ABANDONED };
+    struct MetricsTicket;
+
+    MetricsRenderer _metricsRenderer;
+    FixedBlockPool* _metricsPool = nullptr;
+    // One /metrics request at a time; the slot is shared with the loop under _metricsMux
+    volatile MetricsState _metricsState = MetricsState::IDLE;
+    void* _metricsBlock = nullptr;
+    const char* _metricsText = nullptr;
+    size_t _metricsLength = 0;
+    portMUX_TYPE _metricsMux = portMUX_INITIALIZER_UNLOCKED;
+    ParadoxHandler* _panels[WEBUI_MAX_PANELS] = {};
+    uint8_t _panelCount = 0;
+    uint8_t _longPolls = 0; // Only touched on the web server task
+    uint32_t _bootId;
+    ZoneHistory* _history = nullptr;
+
+    uint32_t getGeneration() const;
+    void handleApi(AsyncWebServerRequest* request, ApiView view);
+    void handleHistory(AsyncWebServerRequest* request, bool stats);
+    void handleMetrics(AsyncWebServerRequest* request);
+    void releaseMetrics();
 };
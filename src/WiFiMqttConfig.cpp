@@ -1,7 +1,11 @@
 #include "WiFiMqttConfig.h"
 #include "Config.h"
+#include "Storage.h"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
+
+#define CACHED_CONFIG_MAGIC 0xC0F1
 
 // Global instance pointer for the callback
 WiFiMqttConfig* instance = nullptr;
@@ -15,8 +19,7 @@ void saveConfigCallbackGlobal() {
 // Private method to load configuration from LittleFS
 bool WiFiMqttConfig::loadConfiguration() {
     DEBUG_PRINTLN("[FS] Attempting to load configuration...");
-    if (!LittleFS.begin(true)) { // Format on fail
-        DEBUG_PRINTLN("[FS] Failed to mount file system.");
+    if (!mountStorage()) {
         return false;
     }
 
@@ -45,10 +48,11 @@ bool WiFiMqttConfig::loadConfiguration() {
     strlcpy(_mqttPort, doc["port"] | "1883", sizeof(_mqttPort));
     strlcpy(_mqttUser, doc["user"] | "", sizeof(_mqttUser));
     strlcpy(_mqttPassword, doc["password"] | "", sizeof(_mqttPassword));
+    strlcpy(_mqttBackups, doc["backups"] | "", sizeof(_mqttBackups));
 
     // Second, for security, remove the password from the JSON object before logging it
     doc.as<JsonObject>().remove("password");
-    char sanitized_buf[256];
+    char sanitized_buf[384];
     serializeJson(doc, sanitized_buf);
     DEBUG_PRINTLN("[FS] --- SANITIZED CONFIG FILE CONTENT ---");
     DEBUG_PRINTLN(sanitized_buf);
@@ -62,16 +66,18 @@ bool WiFiMqttConfig::loadConfiguration() {
 // Private method to save configuration to LittleFS
 void WiFiMqttConfig::saveConfiguration() {
     DEBUG_PRINTLN("[FS] Saving configuration...");
+    // The one place that formats: a new device's flash is blank until now
     if (!LittleFS.begin(true)) { // Format on fail
         DEBUG_PRINTLN("[FS] Failed to mount file system for saving.");
         return;
     }
 
-    StaticJsonDocument<256> doc;
+    StaticJsonDocument<384> doc;
     doc["server"] = _custom_mqtt_server.getValue();
     doc["port"] = _custom_mqtt_port.getValue();
     doc["user"] = _custom_mqtt_user.getValue();
     doc["password"] = _custom_mqtt_password.getValue();
+    doc["backups"] = _custom_mqtt_backups.getValue();
 
     File configFile = LittleFS.open("/config.json", "w");
     if (!configFile) {
@@ -90,12 +96,14 @@ WiFiMqttConfig::WiFiMqttConfig() :
     _custom_mqtt_server("server", "MQTT Server", _mqttServer, 64),
     _custom_mqtt_port("port", "MQTT Port", _mqttPort, 6, "1883"),
     _custom_mqtt_user("user", "MQTT User", _mqttUser, 32),
-    _custom_mqtt_password("password", "MQTT Password", _mqttPassword, 64)
+    _custom_mqtt_password("password", "MQTT Password", _mqttPassword, 64),
+    _custom_mqtt_backups("backups", "Backup MQTT Brokers (host:port, comma-separated)", _mqttBackups, 96)
 {
     _mqttServer[0] = '\0';
     _mqttPort[0] = '\0';
     _mqttUser[0] = '\0';
     _mqttPassword[0] = '\0';
+    _mqttBackups[0] = '\0';
     instance = this;
 }
 
@@ -106,11 +114,13 @@ void WiFiMqttConfig::setup() {
     _custom_mqtt_port.setValue(_mqttPort, 6);
     _custom_mqtt_user.setValue(_mqttUser, 32);
     _custom_mqtt_password.setValue(_mqttPassword, 64);
+    _custom_mqtt_backups.setValue(_mqttBackups, 96);
 
     _wm.addParameter(&_custom_mqtt_server);
     _wm.addParameter(&_custom_mqtt_port);
     _wm.addParameter(&_custom_mqtt_user);
     _wm.addParameter(&_custom_mqtt_password);
+    _wm.addParameter(&_custom_mqtt_backups);
     _wm.setSaveConfigCallback(saveConfigCallbackGlobal);
     _wm.setConnectTimeout(30);
     _wm.setConfigPortalTimeout(1);
@@ -120,6 +130,10 @@ void WiFiMqttConfig::setup() {
     if (strlen(_mqttServer) > 0) {
         _isConfigured = true;
         DEBUG_PRINTLN("[WiFi] Configuration is valid.");
+        // Next boot can skip LittleFS and the blocking connect
+        if (WiFi.isConnected()) {
+            saveCachedConfig();
+        }
     } else {
         _isConfigured = false;
         DEBUG_PRINTLN("[WiFi] Configuration is incomplete.");
@@ -144,7 +158,90 @@ void WiFiMqttConfig::saveConfigCallback() {
 const char* WiFiMqttConfig::getMqttServer() const { return _mqttServer; }
 const char* WiFiMqttConfig::getMqttUser() const { return _mqttUser; }
 const char* WiFiMqttConfig::getMqttPassword() const { return _mqttPassword; }
+const char* WiFiMqttConfig::getMqttBackups() const { return _mqttBackups; }
 int WiFiMqttConfig::getMqttPort() const {
     int port = atoi(_mqttPort);
     return (port == 0) ? MQTT_DEFAULT_PORT : port;
 }
+
+bool WiFiMqttConfig::loadCachedConfig(CachedConfig& cache) {
+    Preferences prefs;
+    if (!prefs.begin("wificfg", true)) {
+        return false;
+    }
+    size_t len = prefs.getBytes("cfg", &cache, sizeof(cache));
+    prefs.end();
+    return len == sizeof(cache) && cache.magic == CACHED_CONFIG_MAGIC && cache.size == sizeof(cache);
+}
+
+void WiFiMqttConfig::saveCachedConfig() {
+    memset(&_cache, 0, sizeof(_cache));
+    _cache.magic = CACHED_CONFIG_MAGIC;
+    _cache.size = sizeof(_cache);
+    strlcpy(_cache.mqttServer, _mqttServer, sizeof(_cache.mqttServer));
+    strlcpy(_cache.mqttPort, _mqttPort, sizeof(_cache.mqttPort));
+    strlcpy(_cache.mqttUser, _mqttUser, sizeof(_cache.mqttUser));
+    strlcpy(_cache.mqttPassword, _mqttPassword, sizeof(_cache.mqttPassword));
+    strlcpy(_cache.mqttBackups, _mqttBackups, sizeof(_cache.mqttBackups));
+    strlcpy(_cache.ssid, WiFi.SSID().c_str(), sizeof(_cache.ssid));
+    strlcpy(_cache.psk, WiFi.psk().c_str(), sizeof(_cache.psk));
+    memcpy(_cache.bssid, WiFi.BSSID(), sizeof(_cache.bssid));
+    _cache.channel = WiFi.channel();
+
+    Preferences prefs;
+    prefs.begin("wificfg", false);
+    prefs.putBytes("cfg", &_cache, sizeof(_cache));
+    prefs.end();
+    DEBUG_PRINTF("[WiFi] Cached config for fast boot (channel %d).\n", _cache.channel);
+}
+
+void WiFiMqttConfig::clearCachedConfig() {
+    Preferences prefs;
+    prefs.begin("wificfg", false);
+    prefs.clear();
+    prefs.end();
+}
+
+bool WiFiMqttConfig::beginFast() {
+    if (!loadCachedConfig(_cache) || strlen(_cache.mqttServer) == 0 || strlen(_cache.ssid) == 0) {
+        DEBUG_PRINTLN("[WiFi] No fast boot cache, using full setup.");
+        return false;
+    }
+
+    strlcpy(_mqttServer, _cache.mqttServer, sizeof(_mqttServer));
+    strlcpy(_mqttPort, _cache.mqttPort, sizeof(_mqttPort));
+    strlcpy(_mqttUser, _cache.mqttUser, sizeof(_mqttUser));
+    strlcpy(_mqttPassword, _cache.mqttPassword, sizeof(_mqttPassword));
+    strlcpy(_mqttBackups, _cache.mqttBackups, sizeof(_mqttBackups));
+    _isConfigured = true;
+    _fastBoot = true;
+
+    // Known channel and BSSID skip the scan, which is most of the association time
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(_cache.ssid, _cache.psk, _cache.channel, _cache.bssid);
+    _associateStart = millis();
+    DEBUG_PRINTF("[WiFi] Fast boot: associating with %s on channel %d.\n", _cache.ssid, _cache.channel);
+    return true;
+}
+
+void WiFiMqttConfig::loop() {
+    if (!_fastBoot) {
+        return;
+    }
+
+    bool connected = WiFi.isConnected();
+    if (connected && !_wasConnected) {
+        DEBUG_PRINTF("[WiFi] Connected after %lu ms.\n", millis() - _associateStart);
+        // Refresh the cache if we roamed to a different AP
+        if (_cache.channel != WiFi.channel() || memcmp(_cache.bssid, WiFi.BSSID(), sizeof(_cache.bssid)) != 0) {
+            saveCachedConfig();
+        }
+    } else if (!connected && !_scanFallback && millis() - _associateStart > FAST_BOOT_BSSID_TIMEOUT) {
+        // The cached AP may be gone; let the driver scan for any AP with this SSID
+        DEBUG_PRINTLN("[WiFi] Cached AP not reachable, scanning.");
+        _scanFallback = true;
+        WiFi.disconnect();
+        WiFi.begin(_cache.ssid, _cache.psk);
+    }
+    _wasConnected = connected;
+}
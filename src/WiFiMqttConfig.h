@@ -4,6 +4,16 @@
 #include <WiFiManager.h>
 #include "LedHandler.h" // Include for the reset method
 
+// Boot from the NVS config cache and associate in the background
+#ifndef FAST_BOOT_ENABLED
+#define FAST_BOOT_ENABLED 1
+#endif
+
+// How long to try the cached BSSID/channel before falling back to a full scan
+#ifndef FAST_BOOT_BSSID_TIMEOUT
+#define FAST_BOOT_BSSID_TIMEOUT 5000
+#endif
+
 class WiFiMqttConfig {
 public:
     WiFiMqttConfig();
@@ -11,22 +21,56 @@ public:
     void startPortal();
     bool isConfigured() const { return _isConfigured; }
 
+    // Fast boot: loads the packed NVS copy of the config and starts WiFi
+    // association without blocking. Returns false if there is no valid cache,
+    // in which case setup() must be used.
+    bool beginFast();
+    // Drives the background association started by beginFast()
+    void loop();
+    bool isFastBoot() const { return _fastBoot; }
+    void clearCachedConfig();
+
     // Getters for saved values
     const char* getMqttServer() const;
     int getMqttPort() const;
     const char* getMqttUser() const;
     const char* getMqttPassword() const;
+    // Backup brokers, "host[:port],host[:port]"; empty for none
+    const char* getMqttBackups() const;
     void saveConfigCallback();
 
 
 private:
+    // Packed copy of the config and last good AP, stored as one NVS blob
+    struct CachedConfig {
+        uint16_t magic;
+        uint16_t size;
+        char mqttServer[64];
+        char mqttPort[6];
+        char mqttUser[32];
+        char mqttPassword[64];
+        char mqttBackups[96];
+        char ssid[33];
+        char psk[65];
+        uint8_t bssid[6];
+        int32_t channel;
+    };
+
     bool loadConfiguration();
     void saveConfiguration();
+    bool loadCachedConfig(CachedConfig& cache);
+    void saveCachedConfig();
+    bool _fastBoot = false;
+    bool _scanFallback = false;
+    bool _wasConnected = false;
+    unsigned long _associateStart = 0;
+    CachedConfig _cache;
     bool _isConfigured = false;
     char _mqttServer[64];
     char _mqttPort[6];
     char _mqttUser[32];
     char _mqttPassword[64];
+    char _mqttBackups[96];
 
     // WiFiManager and parameters are now class members
     WiFiManager _wm;
@@ -34,4 +78,5 @@ private:
     WiFiManagerParameter _custom_mqtt_port;
     WiFiManagerParameter _custom_mqtt_user;
     WiFiManagerParameter _custom_mqtt_password;
+    WiFiManagerParameter _custom_mqtt_backups;
 };
@@ -0,0 +1,579 @@
+#include "ZoneHistory.h"
+#include "Config.h"
+#include "Storage.h"
+#include <LittleFS.h>
+#include <time.h>
+
+// Earliest time taken as a real clock rather than seconds since boot
+#define HISTORY_MIN_VALID_TIME 1600000000UL
+#define HISTORY_FLAG_UNDATED 0x80
+#define HISTORY_FLAG_PANEL2 0x40
+#define HISTORY_CHANNEL_MASK 0x3F
+#define HISTORY_MAX_RECORD_BYTES 7 // Flags, up to a 5-byte delta, state
+
+struct __attribute__((packed)) StatsFileHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t panels;
+    uint8_t channels;
+    uint8_t reserved;
+    uint32_t day;
+};
+
+// Flags byte, zigzag varint seconds since the previous dated record (absent
+// when undated), state byte
+static size_t encodeRecord(const HistoryRecord& record, uint32_t& previous, uint8_t* out) {
+    size_t len = 0;
+    out[len++] = (record.channel & HISTORY_CHANNEL_MASK) | (record.panel == 2 ? HISTORY_FLAG_PANEL2 : 0) |
+                 (record.time ? 0 : HISTORY_FLAG_UNDATED);
+    if (record.time) {
+        int32_t delta = (int32_t)(record.time - previous);
+        uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        while (zigzag >= 0x80) {
+            out[len++] = (zigzag & 0x7F) | 0x80;
+            zigzag >>= 7;
+        }
+        out[len++] = zigzag;
+        previous = record.time;
+    }
+    out[len++] = record.state;
+    return len;
+}
+
+static bool decodeRecord(File& file, uint32_t& previous, HistoryRecord& record) {
+    int flags = file.read();
+    if (flags < 0) {
+        return false;
+    }
+    record.time = 0;
+    if (!(flags & HISTORY_FLAG_UNDATED)) {
+        uint32_t zigzag = 0;
+        for (int shift = 0;; shift += 7) {
+            int b = file.read();
+            if (b < 0 || shift > 28) {
+                return false;
+            }
+            zigzag |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        previous += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+        record.time = previous;
+    }
+    int state = file.read();
+    if (state < 0) {
+        return false;
+    }
+    record.panel = (flags & HISTORY_FLAG_PANEL2) ? 2 : 1;
+    record.channel = flags & HISTORY_CHANNEL_MASK;
+    record.state = state;
+    return true;
+}
+
+uint32_t ZoneHistory::clockNow() {
+    time_t now = time(nullptr);
+    return now >= (time_t)HISTORY_MIN_VALID_TIME ? (uint32_t)now : 0;
+}
+
+// Open zones, and partitions that are armed or in alarm
+bool ZoneHistory::isActive(uint8_t channel, uint8_t state) {
+    if (channel == HISTORY_PARTITION_CHANNEL) {
+        return state != 11 && state != HISTORY_STATE_UNKNOWN;
+    }
+    return state == 1;
+}
+
+void ZoneHistory::segmentPath(uint16_t id, char* path, size_t size) {
+    snprintf(path, size, HISTORY_DIR "/%u.seg", id);
+}
+
+void ZoneHistory::setup() {
+    _lock = xSemaphoreCreateMutex();
+    memset(_stats, 0, sizeof(_stats));
+    memset(_changedAt, 0, sizeof(_changedAt));
+    memset(_activeRemainderMs, 0, sizeof(_activeRemainderMs));
+    if (!mountStorage()) {
+        DEBUG_PRINTLN("[History] LittleFS unavailable. History is kept in RAM only.");
+    } else {
+        if (!LittleFS.exists(HISTORY_DIR)) {
+            LittleFS.mkdir(HISTORY_DIR);
+        }
+        loadSegments();
+        loadStats();
+    }
+    for (auto& panel : _stats) {
+        for (ChannelStats& channel : panel) {
+            channel.state = HISTORY_STATE_UNKNOWN; // The panel may have changed while we were off
+        }
+    }
+    DEBUG_PRINTF("[History] %u segment(s), next record %u\n", _segmentCount, _nextIndex);
+}
+
+void ZoneHistory::loadSegments() {
+    File dir = LittleFS.open(HISTORY_DIR);
+    if (!dir || !dir.isDirectory()) {
+        return;
+    }
+    // Segments beyond HISTORY_MAX_SEGMENTS, e.g. after lowering it, are deleted once listed
+    uint16_t stale[8];
+    uint8_t staleCount = 0;
+    for (File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+        const char* name = strrchr(file.name(), '/');
+        name = name ? name + 1 : file.name();
+        char* end;
+        uint16_t id = strtoul(name, &end, 10);
+        SegmentHeader header;
+        if (strcmp(end, ".seg") != 0 || file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+            header.magic != HISTORY_SEGMENT_MAGIC || header.version != HISTORY_FILE_VERSION) {
+            continue;
+        }
+        Segment segment = {id, header.count, header.firstIndex, header.startTime, header.endTime,
+                           (uint32_t)sizeof(header) + header.length};
+
+        // Keep the table ordered by first record, dropping the oldest when full
+        uint8_t pos = _segmentCount;
+        while (pos > 0 && _segments[pos - 1].firstIndex > segment.firstIndex) {
+            pos--;
+        }
+        if (_segmentCount == HISTORY_MAX_SEGMENTS) {
+            if (staleCount < sizeof(stale) / sizeof(stale[0])) {
+                stale[staleCount++] = pos == 0 ? id : _segments[0].id;
+            }
+            if (pos == 0) {
+                continue;
+            }
+            memmove(&_segments[0], &_segments[1], (pos - 1) * sizeof(Segment));
+            pos--;
+        } else {
+            memmove(&_segments[pos + 1], &_segments[pos], (_segmentCount - pos) * sizeof(Segment));
+            _segmentCount++;
+        }
+        _segments[pos] = segment;
+    }
+    dir.close();
+    for (uint8_t i = 0; i < staleCount; i++) {
+        char path[32];
+        segmentPath(stale[i], path, sizeof(path));
+        LittleFS.remove(path);
+    }
+    if (_segmentCount > 0) {
+        const Segment& last = _segments[_segmentCount - 1];
+        _nextIndex = last.firstIndex + last.count;
+    }
+}
+
+void ZoneHistory::loadStats() {
+    File file = LittleFS.open(HISTORY_STATS_FILE, "r");
+    if (!file) {
+        return;
+    }
+    StatsFileHeader header;
+    if (file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == HISTORY_STATS_MAGIC &&
+        header.version == HISTORY_FILE_VERSION && header.panels == HISTORY_PANELS &&
+        header.channels == HISTORY_CHANNELS && file.read((uint8_t*)_stats, sizeof(_stats)) == sizeof(_stats)) {
+        _statsDay = header.day;
+    } else {
+        memset(_stats, 0, sizeof(_stats));
+    }
+    file.close();
+}
+
+void ZoneHistory::saveStats() {
+    File file = LittleFS.open(HISTORY_STATS_FILE, "w");
+    if (!file) {
+        return;
+    }
+    StatsFileHeader header = {HISTORY_STATS_MAGIC, HISTORY_FILE_VERSION, HISTORY_PANELS, HISTORY_CHANNELS, 0, _statsDay};
+    file.write((const uint8_t*)&header, sizeof(header));
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    file.write((const uint8_t*)_stats, sizeof(_stats));
+    xSemaphoreGive(_lock);
+    file.close();
+}
+
+void ZoneHistory::record(const ParadoxEvent& event) {
+    if (event.panel < 1 || event.panel > HISTORY_PANELS) {
+        return;
+    }
+    uint8_t channel;
+    uint8_t state;
+    if ((event.event == 0 || event.event == 1) && event.subEvent >= 1 && event.subEvent <= 32) {
+        channel = event.subEvent - 1;
+        state = event.event;
+    } else if (event.event == 2 && event.partition == HISTORY_PARTITION &&
+               (event.subEvent == 3 || event.subEvent == 4 || event.subEvent == 6 ||
+                event.subEvent == 11 || event.subEvent == 12)) {
+        channel = HISTORY_PARTITION_CHANNEL;
+        state = event.subEvent;
+    } else {
+        return;
+    }
+
+    // Status replies repeat the whole zone map; only changes are history
+    uint8_t previous = _stats[event.panel - 1][channel].state;
+    if (previous == state) {
+        return;
+    }
+    if (_pendingCount >= HISTORY_RAM_ENTRIES) {
+        flush();
+    }
+
+    uint32_t now = clockNow();
+    rollDay(now);
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    applyChange(event.panel, channel, state, now);
+    // The first sighting of a closed zone or disarmed partition after boot
+    // is a baseline, not a change
+    if (previous != HISTORY_STATE_UNKNOWN || isActive(channel, state)) {
+        if (_pendingCount >= HISTORY_RAM_ENTRIES) {
+            // Flash is not taking writes; lose the oldest rather than the newest
+            memmove(&_pending[0], &_pending[1], (HISTORY_RAM_ENTRIES - 1) * sizeof(Pending));
+            _pendingCount--;
+            _dropped++;
+        }
+        if (_pendingCount == 0) {
+            _oldestPendingAt = millis();
+        }
+        _pending[_pendingCount++] = {{now, event.panel, channel, state}, (uint32_t)(millis() / 1000)};
+        _nextIndex++;
+        _undatedPending = _undatedPending || now == 0;
+    }
+    xSemaphoreGive(_lock);
+}
+
+// Called with the lock held
+void ZoneHistory::applyChange(uint8_t panel, uint8_t channel, uint8_t state, uint32_t now) {
+    ChannelStats& stats = _stats[panel - 1][channel];
+    unsigned long& changedAt = _changedAt[panel - 1][channel];
+    unsigned long nowMs = millis();
+    if (isActive(channel, stats.state)) {
+        uint16_t& remainder = _activeRemainderMs[panel - 1][channel];
+        unsigned long spellMs = nowMs - changedAt + remainder;
+        stats.activeSeconds += spellMs / 1000;
+        remainder = spellMs % 1000;
+    }
+    if (channel == HISTORY_PARTITION_CHANNEL ? stats.state != HISTORY_STATE_UNKNOWN : state == 1) {
+        stats.changes++;
+        stats.changesToday++;
+    }
+    stats.state = state;
+    stats.lastChange = now;
+    changedAt = nowMs;
+}
+
+void ZoneHistory::rollDay(uint32_t now) {
+    if (now == 0) {
+        return;
+    }
+    uint32_t day = (now + HISTORY_UTC_OFFSET) / 86400;
+    if (day == _statsDay) {
+        return;
+    }
+    // Changes before the clock was first set count towards the day it turns out to be
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (_statsDay != 0) {
+        for (auto& panel : _stats) {
+            for (ChannelStats& channel : panel) {
+                channel.changesToday = 0;
+            }
+        }
+    }
+    _statsDay = day;
+    xSemaphoreGive(_lock);
+}
+
+// Dates changes recorded before the clock was first set this boot
+void ZoneHistory::dateUndated(uint32_t now) {
+    uint32_t uptime = millis() / 1000;
+    unsigned long nowMs = millis();
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (uint16_t i = 0; i < _pendingCount; i++) {
+        if (_pending[i].record.time == 0) {
+            _pending[i].record.time = now - (uptime - _pending[i].uptime);
+        }
+    }
+    for (uint8_t panel = 0; panel < HISTORY_PANELS; panel++) {
+        for (uint8_t channel = 0; channel < HISTORY_CHANNELS; channel++) {
+            ChannelStats& stats = _stats[panel][channel];
+            if (stats.lastChange == 0 && stats.state != HISTORY_STATE_UNKNOWN) {
+                stats.lastChange = now - (nowMs - _changedAt[panel][channel]) / 1000;
+            }
+        }
+    }
+    _undatedPending = false;
+    xSemaphoreGive(_lock);
+}
+
+void ZoneHistory::service() {
+    uint32_t now = clockNow();
+    rollDay(now);
+    if (now && _undatedPending) {
+        dateUndated(now);
+    }
+    if (_pendingCount >= HISTORY_RAM_ENTRIES * 3 / 4 ||
+        (_pendingCount > 0 && millis() - _oldestPendingAt >= HISTORY_FLUSH_INTERVAL)) {
+        flush();
+    }
+}
+
+// Appends everything buffered to the newest segment, starting new segments
+// (and deleting the oldest) as they fill
+void ZoneHistory::flush() {
+    if (_pendingCount == 0) {
+        return;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    uint32_t pendingStart = _nextIndex - _pendingCount;
+    uint16_t written = 0;
+    while (written < _pendingCount) {
+        if (_segmentCount == 0 || _segments[_segmentCount - 1].count >= HISTORY_SEGMENT_ENTRIES ||
+            _segments[_segmentCount - 1].firstIndex + _segments[_segmentCount - 1].count != pendingStart + written) {
+            if (!startSegment(_pending[written].record, pendingStart + written)) {
+                break;
+            }
+        }
+        Segment& segment = _segments[_segmentCount - 1];
+        uint16_t count = min((uint16_t)(_pendingCount - written), (uint16_t)(HISTORY_SEGMENT_ENTRIES - segment.count));
+        if (!appendToSegment(segment, &_pending[written], count)) {
+            break;
+        }
+        written += count;
+    }
+    if (written < _pendingCount) {
+        _flushFailures++;
+        DEBUG_PRINTF("[History] Flush stopped after %u of %u records.\n", written, _pendingCount);
+    }
+    memmove(&_pending[0], &_pending[written], (_pendingCount - written) * sizeof(Pending));
+    _pendingCount -= written;
+    _oldestPendingAt = millis();
+    _flushes++;
+    xSemaphoreGive(_lock);
+    saveStats();
+}
+
+// Called with the lock held
+bool ZoneHistory::startSegment(const HistoryRecord& first, uint32_t firstIndex) {
+    if (_segmentCount == HISTORY_MAX_SEGMENTS) {
+        char path[32];
+        segmentPath(_segments[0].id, path, sizeof(path));
+        LittleFS.remove(path);
+        memmove(&_segments[0], &_segments[1], (HISTORY_MAX_SEGMENTS - 1) * sizeof(Segment));
+        _segmentCount--;
+    }
+    uint16_t id = _segmentCount > 0 ? _segments[_segmentCount - 1].id + 1 : 1;
+    char path[32];
+    segmentPath(id, path, sizeof(path));
+    File file = LittleFS.open(path, "w");
+    SegmentHeader header = {HISTORY_SEGMENT_MAGIC, HISTORY_FILE_VERSION, 0, 0, firstIndex, first.time, first.time, 0};
+    if (!file || file.write((const uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+        DEBUG_PRINTF("[History] Could not create %s\n", path);
+        return false;
+    }
+    file.close();
+    _segments[_segmentCount++] = {id, 0, firstIndex, first.time, first.time, (uint32_t)sizeof(header)};
+    return true;
+}
+
+// Called with the lock held. The header is rewritten last and records its
+// data length, so a write cut short leaves the previous records readable.
+bool ZoneHistory::appendToSegment(Segment& segment, const Pending* records, uint16_t count) {
+    char path[32];
+    segmentPath(segment.id, path, sizeof(path));
+    File file = LittleFS.open(path, "r+");
+    if (!file || !file.seek(segment.size)) {
+        return false;
+    }
+    uint8_t buffer[128];
+    size_t used = 0;
+    size_t total = 0;
+    uint32_t previous = segment.endTime;
+    bool ok = true;
+    for (uint16_t i = 0; i < count && ok; i++) {
+        used += encodeRecord(records[i].record, previous, buffer + used);
+        if (used > sizeof(buffer) - HISTORY_MAX_RECORD_BYTES || i == count - 1) {
+            ok = file.write(buffer, used) == used;
+            total += used;
+            used = 0;
+        }
+    }
+    SegmentHeader header = {HISTORY_SEGMENT_MAGIC, HISTORY_FILE_VERSION, 0, (uint16_t)(segment.count + count),
+                            segment.firstIndex, segment.startTime, previous,
+                            (uint32_t)(segment.size + total - sizeof(SegmentHeader))};
+    ok = ok && file.seek(0) && file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    file.close();
+    if (!ok) {
+        return false;
+    }
+    segment.count += count;
+    segment.endTime = previous;
+    segment.size += total;
+    return true;
+}
+
+bool ZoneHistory::matches(const HistoryQuery& query, const HistoryRecord& record) const {
+    if (query.panel && record.panel != query.panel) return false;
+    if (query.channel != 0xFF && record.channel != query.channel) return false;
+    // Undated records only show up in queries from the beginning of time
+    if (record.time == 0) return query.from == 0;
+    return record.time >= query.from && record.time <= query.to;
+}
+
+size_t ZoneHistory::read(HistoryQuery& query, HistoryRecord* out, size_t max) {
+    size_t count = 0;
+    uint16_t budget = HISTORY_READ_BUDGET;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    uint32_t pendingStart = _nextIndex - _pendingCount;
+    while (count < max && budget > 0) {
+        if (query.next >= _nextIndex) {
+            query.done = true;
+            break;
+        }
+        if (query.next >= pendingStart) {
+            const HistoryRecord& record = _pending[query.next - pendingStart].record;
+            query.next++;
+            budget--;
+            if (matches(query, record)) {
+                out[count++] = record;
+            }
+            continue;
+        }
+
+        // The segment holding next, or the first after it if next was deleted
+        const Segment* segment = nullptr;
+        for (uint8_t i = 0; i < _segmentCount && !segment; i++) {
+            if (query.next < _segments[i].firstIndex + _segments[i].count) {
+                segment = &_segments[i];
+            }
+        }
+        if (!segment) {
+            query.next = pendingStart;
+            continue;
+        }
+        if (query.next < segment->firstIndex) {
+            query.next = segment->firstIndex;
+        }
+        bool before = query.from > 0 && segment->endTime < query.from;
+        bool after = segment->startTime != 0 && segment->startTime > query.to;
+        if (before || after) {
+            query.next = segment->firstIndex + segment->count;
+            continue;
+        }
+        count += readSegment(*segment, query, out + count, max - count, budget);
+    }
+    xSemaphoreGive(_lock);
+    return count;
+}
+
+// Called with the lock held
+size_t ZoneHistory::readSegment(const Segment& segment, HistoryQuery& query, HistoryRecord* out, size_t max,
+                                uint16_t& budget) {
+    uint32_t end = segment.firstIndex + segment.count;
+    char path[32];
+    segmentPath(segment.id, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        query.next = end;
+        return 0;
+    }
+
+    // Resume where the last call stopped instead of decoding from the start
+    uint32_t index = segment.firstIndex;
+    uint32_t previous = segment.startTime;
+    if (query.segmentId == segment.id && query.segmentOffset > 0 && query.segmentIndex <= query.next) {
+        index = query.segmentIndex;
+        previous = query.segmentTime;
+        file.seek(query.segmentOffset);
+    } else {
+        file.seek(sizeof(SegmentHeader));
+    }
+
+    size_t count = 0;
+    while (index < end && count < max && budget > 0) {
+        HistoryRecord record;
+        if (!decodeRecord(file, previous, record)) {
+            DEBUG_PRINTF("[History] Segment %u is truncated.\n", segment.id);
+            index = end;
+            break;
+        }
+        budget--;
+        if (index >= query.next) {
+            query.next = index + 1;
+            if (matches(query, record)) {
+                out[count++] = record;
+            }
+        }
+        index++;
+    }
+    if (index >= end) {
+        query.next = end;
+    }
+    query.segmentId = segment.id;
+    query.segmentIndex = index;
+    query.segmentOffset = file.position();
+    query.segmentTime = previous;
+    file.close();
+    return count;
+}
+
+bool ZoneHistory::getStats(uint8_t panel, uint8_t channel, ChannelStats& stats) {
+    if (panel < 1 || panel > HISTORY_PANELS || channel >= HISTORY_CHANNELS) {
+        return false;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    stats = _stats[panel - 1][channel];
+    if (isActive(channel, stats.state)) {
+        stats.activeSeconds += (millis() - _changedAt[panel - 1][channel]) / 1000;
+    }
+    xSemaphoreGive(_lock);
+    return true;
+}
+
+size_t ZoneHistory::formatRecord(const HistoryRecord& record, char* out, size_t size) {
+    uint8_t zone = record.channel == HISTORY_PARTITION_CHANNEL ? 0 : record.channel + 1;
+    int len = snprintf(out, size, "[%lu,%u,%u,%u]", (unsigned long)record.time, record.panel, zone, record.state);
+    return len > 0 && (size_t)len < size ? len : 0;
+}
+
+size_t ZoneHistory::formatStats(uint8_t panel, uint8_t channel, const ChannelStats& stats, char* out, size_t size) {
+    int len;
+    if (channel == HISTORY_PARTITION_CHANNEL) {
+        len = snprintf(out, size,
+                       "{\"panel\":%u,\"partition\":%u,\"changes\":%lu,\"changes_today\":%lu,"
+                       "\"armed_seconds\":%lu,\"last_change\":%lu,\"state\":\"%s\"}",
+                       panel, HISTORY_PARTITION, (unsigned long)stats.changes, (unsigned long)stats.changesToday,
+                       (unsigned long)stats.activeSeconds, (unsigned long)stats.lastChange,
+                       getPartitionStateName(stats.state));
+    } else {
+        len = snprintf(out, size,
+                       "{\"panel\":%u,\"zone\":%u,\"opens\":%lu,\"opens_today\":%lu,"
+                       "\"open_seconds\":%lu,\"last_change\":%lu,\"open\":%s}",
+                       panel, channel + 1, (unsigned long)stats.changes, (unsigned long)stats.changesToday,
+                       (unsigned long)stats.activeSeconds, (unsigned long)stats.lastChange,
+                       stats.state == HISTORY_STATE_UNKNOWN ? "null" : (stats.state == 1 ? "true" : "false"));
+    }
+    return len > 0 && (size_t)len < size ? len : 0;
+}
+
+uint32_t ZoneHistory::getDayStart() const {
+    return _statsDay ? _statsDay * 86400 - HISTORY_UTC_OFFSET : 0;
+}
+
+void ZoneHistory::toJson(JsonObject obj) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    uint32_t stored = 0;
+    uint32_t bytes = 0;
+    for (uint8_t i = 0; i < _segmentCount; i++) {
+        stored += _segments[i].count;
+        bytes += _segments[i].size;
+    }
+    obj["segments"] = _segmentCount;
+    obj["records_stored"] = stored;
+    obj["bytes_stored"] = bytes;
+    obj["records_pending"] = _pendingCount;
+    obj["oldest"] = _segmentCount > 0 ? _segments[0].startTime : 0;
+    xSemaphoreGive(_lock);
+    obj["flushes"] = _flushes;
+    obj["flush_failures"] = _flushFailures;
+    obj["dropped"] = _dropped;
+}
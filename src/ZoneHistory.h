@@ -0,0 +1,174 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <freertos/semphr.h>
+#include "ParadoxEvents.h"
+
+#define HISTORY_DIR "/history"
+#define HISTORY_STATS_FILE "/history/stats.bin"
+#define HISTORY_SEGMENT_MAGIC 0x53494850 // "PHIS"
+#define HISTORY_STATS_MAGIC 0x54534850   // "PHST"
+#define HISTORY_FILE_VERSION 1
+
+// Panels with history; a record has one bit for the panel
+#ifndef HISTORY_PANELS
+#define HISTORY_PANELS 2
+#endif
+static_assert(HISTORY_PANELS <= 2, "History records have one bit for the panel");
+
+// Changes buffered in RAM until they are appended to flash
+#ifndef HISTORY_RAM_ENTRIES
+#define HISTORY_RAM_ENTRIES 128
+#endif
+
+// Longest a change waits in RAM before it is written, in ms
+#ifndef HISTORY_FLUSH_INTERVAL
+#define HISTORY_FLUSH_INTERVAL 900000
+#endif
+
+// Records per segment file, and segment files kept; the oldest is deleted
+#ifndef HISTORY_SEGMENT_ENTRIES
+#define HISTORY_SEGMENT_ENTRIES 1024
+#endif
+#ifndef HISTORY_MAX_SEGMENTS
+#define HISTORY_MAX_SEGMENTS 32
+#endif
+
+// Records examined per read() call, so a long scan never holds up the loop
+#ifndef HISTORY_READ_BUDGET
+#define HISTORY_READ_BUDGET 256
+#endif
+
+// Offset from UTC, in seconds, of the day boundary for the "today" counters
+#ifndef HISTORY_UTC_OFFSET
+#define HISTORY_UTC_OFFSET 0
+#endif
+
+#define HISTORY_PARTITION_CHANNEL 32 // Channels 0-31 are zones 1-32
+#define HISTORY_PARTITION 1 // The partition channel follows this partition (numbered from 1)
+#define HISTORY_CHANNELS 33
+#define HISTORY_STATE_UNKNOWN 0xFF
+
+struct HistoryRecord {
+    uint32_t time;   // Unix seconds, 0 if the clock was not set
+    uint8_t panel;
+    uint8_t channel;
+    uint8_t state;   // Zones: 1 open, 0 closed. Partition: event 2 sub-event
+};
+
+struct ChannelStats {
+    uint32_t changes;        // Zones: times opened. Partition: arm state changes
+    uint32_t changesToday;
+    uint32_t activeSeconds;  // Time open, or armed/in alarm for the partition
+    uint32_t lastChange;     // Unix seconds, 0 = never or unknown
+    uint8_t state;           // HISTORY_STATE_UNKNOWN until first seen after boot
+};
+
+// A range query and its read position. Pass the same query to read() until
+// done is set; nothing else needs to be kept between calls.
+struct HistoryQuery {
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX;
+    uint8_t panel = 0;       // 0 = any
+    uint8_t channel = 0xFF;  // 0xFF = any
+    bool done = false;
+
+    uint32_t next = 0;          // Index of the next record to examine
+    uint16_t segmentId = 0;     // Decode position within that segment's file
+    uint32_t segmentIndex = 0;
+    uint32_t segmentOffset = 0;
+    uint32_t segmentTime = 0;
+};
+
+// Per-zone and partition change history. Changes are buffered in RAM and
+// appended to delta-encoded segment files on LittleFS. Each segment notes the
+// time span it covers, so range queries skip whole files. Aggregates are kept
+// as changes arrive.
+class ZoneHistory {
+public:
+    void setup();
+
+    // Stores the event if it moves a zone or partition to a new state
+    void record(const ParadoxEvent& event);
+
+    // Flushes buffered changes that are numerous or old enough, and resets
+    // the day counters at midnight. Call periodically from the loop.
+    void service();
+
+    // Copies up to max matching records into out, oldest first. Safe from
+    // any task. Returns 0 without setting done when the scan budget ran out.
+    size_t read(HistoryQuery& query, HistoryRecord* out, size_t max);
+
+    // Stats including the current open spell. False for an unknown channel.
+    bool getStats(uint8_t panel, uint8_t channel, ChannelStats& stats);
+    // Unix time the "today" counters started, 0 before the clock is set
+    uint32_t getDayStart() const;
+
+    void toJson(JsonObject obj);
+
+    // JSON text shared by the web and MQTT endpoints. Records are
+    // [time,panel,zone,state] with zone 0 for the partition. Both return 0
+    // if size is too small.
+    static size_t formatRecord(const HistoryRecord& record, char* out, size_t size);
+    static size_t formatStats(uint8_t panel, uint8_t channel, const ChannelStats& stats, char* out, size_t size);
+
+private:
+    struct __attribute__((packed)) SegmentHeader {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t reserved;
+        uint16_t count;
+        uint32_t firstIndex;
+        uint32_t startTime;  // Base for the first delta
+        uint32_t endTime;    // Last known record time
+        uint32_t length;     // Bytes of records after the header
+    };
+
+    struct Segment {
+        uint16_t id;
+        uint16_t count;
+        uint32_t firstIndex;
+        uint32_t startTime;
+        uint32_t endTime;
+        uint32_t size;       // Header plus records, where appends go
+    };
+
+    struct Pending {
+        HistoryRecord record;
+        uint32_t uptime;     // Seconds since boot, to date it once the clock is set
+    };
+
+    SemaphoreHandle_t _lock = nullptr;
+    Segment _segments[HISTORY_MAX_SEGMENTS];  // Oldest first
+    uint8_t _segmentCount = 0;
+    Pending _pending[HISTORY_RAM_ENTRIES];
+    uint16_t _pendingCount = 0;
+    unsigned long _oldestPendingAt = 0;
+    uint32_t _nextIndex = 0;                  // Index the next record gets
+    bool _undatedPending = false;
+
+    ChannelStats _stats[HISTORY_PANELS][HISTORY_CHANNELS];
+    unsigned long _changedAt[HISTORY_PANELS][HISTORY_CHANNELS]; // millis() of the last change this boot
+    uint16_t _activeRemainderMs[HISTORY_PANELS][HISTORY_CHANNELS]; // Carried so short spells add up
+    uint32_t _statsDay = 0;
+
+    uint32_t _flushes = 0;
+    uint32_t _flushFailures = 0;
+    uint32_t _dropped = 0;
+
+    static uint32_t clockNow();
+    static bool isActive(uint8_t channel, uint8_t state);
+    void applyChange(uint8_t panel, uint8_t channel, uint8_t state, uint32_t now);
+    void rollDay(uint32_t now);
+    void dateUndated(uint32_t now);
+    void flush();
+    bool appendToSegment(Segment& segment, const Pending* records, uint16_t count);
+    bool startSegment(const HistoryRecord& first, uint32_t firstIndex);
+    void loadSegments();
+    void loadStats();
+    void saveStats();
+    size_t readSegment(const Segment& segment, HistoryQuery& query, HistoryRecord* out, size_t max, uint16_t& budget);
+    bool matches(const HistoryQuery& query, const HistoryRecord& record) const;
+    static void segmentPath(uint16_t id, char* path, size_t size);
+};
@@ -17,6 +17,7 @@
 
 #include <Arduino.h>
 #include "Config.h"
+#include "Log.h"
 #include "LedHandler.h"
 #include "WiFiMqttConfig.h"
 #include "MqttHandler.h"
@@ -24,10 +25,63 @@
 #include "ParadoxHandler.h"
 #include "WebUi.h"
 #include "ParadoxEvents.h"
+#include "EventEncoder.h"
+#include "EventJournal.h"
+#include "CommandDispatcher.h"
+#include "TaskScheduler.h"
+#include "PipelineMetrics.h"
+#include "MemoryMonitor.h"
+#include "MemoryPool.h"
+#include "RuleEngine.h"
+#include "MulticastPublisher.h"
+#include "ZoneHistory.h"
+#include "Storage.h"
 #include <ArduinoJson.h>
 #include <WiFiManager.h>
 #include <LittleFS.h>
 
+// Second panel on UART1. GPIO 9/10 (the UART1 defaults) are wired to flash.
+#ifndef PARADOX_PANEL_COUNT
+#define PARADOX_PANEL_COUNT 1
+#endif
+#ifndef PARADOX2_SERIAL
+#define PARADOX2_SERIAL Serial1
+#endif
+#ifndef PARADOX2_RX_PIN
+#define PARADOX2_RX_PIN 25
+#endif
+#ifndef PARADOX2_TX_PIN
+#define PARADOX2_TX_PIN 26
+#endif
+
+#define FACTORY_RESET_HOLD_TIME 5000 // 5 seconds
+#define DIAGNOSTICS_INTERVAL 60000
+// Scratch blocks for building diagnostics from the loop and the web server at once
+#if MQTT_TLS_ENABLED
+#define DIAGNOSTICS_JSON_CAPACITY 3584
+#define REQUEST_BLOCK_SIZE 6144
+#else
+#define DIAGNOSTICS_JSON_CAPACITY 3072
+#define REQUEST_BLOCK_SIZE 5120
+#endif
+#define REQUEST_BLOCK_COUNT 2
+// Longest the loop sleeps when idle; bounds added latency for serial and MQTT
+#ifndef LOOP_IDLE_SLEEP_MAX
+#define LOOP_IDLE_SLEEP_MAX 10
+#endif
+// Time source for history timestamps; the panel clock is not read
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+// Records per message and most records per request for paradox/history
+#define HISTORY_MQTT_PAGE 32
+#define HISTORY_MQTT_STATS_PAGE 8
+#define HISTORY_MQTT_LIMIT 256
+#define HISTORY_MQTT_PAYLOAD 1536
+// Most journaled events sent to one broker per pass, so one broker's
+// backlog never holds up the others for long
+#define MQTT_PUBLISH_BURST 16
+
 // =================================================================
 // Global Objects
 // =================================================================
@@ -36,66 +90,625 @@ LedHandler ledHandler(LED_PIN);
 WiFiMqttConfig wifiConfig;
 MqttHandler mqttHandler;
 OtaHandler otaHandler;
-ParadoxHandler paradoxHandler(PARADOX_SERIAL);
+ParadoxHandler panel1(PARADOX_SERIAL, 1, PARADOX_RX_PIN, PARADOX_TX_PIN);
+#if PARADOX_PANEL_COUNT > 1
+ParadoxHandler panel2(PARADOX2_SERIAL, 2, PARADOX2_RX_PIN, PARADOX2_TX_PIN);
+ParadoxHandler* paradoxHandlers[] = {&panel1, &panel2};
+#else
+ParadoxHandler* paradoxHandlers[] = {&panel1};
+#endif
 WebUi webUi;
+EventJournal eventJournal;
+CommandDispatcher commandDispatcher(mqttHandler);
+TaskScheduler scheduler;
+PipelineMetrics pipelineMetrics;
+MemoryMonitor memoryMonitor;
+StaticBlockPool<REQUEST_BLOCK_SIZE, REQUEST_BLOCK_COUNT> requestPool;
+RuleEngine ruleEngine;
+MulticastPublisher multicastPublisher;
+ZoneHistory zoneHistory;
+
+// Last journaled event that reached a broker. Events decoded while MQTT is
+// down stay in the journal and are published in order once it connects.
+uint32_t publishedSequence = 0;
+#if MQTT_FANOUT_ENABLED
+// With fan-out each broker drains the journal on its own; a broker that
+// falls more than the ring behind skips ahead and counts the rest as dropped
+uint32_t brokerSequence[MQTT_MAX_BROKERS];
+uint32_t brokerDropped[MQTT_MAX_BROKERS];
+#endif
+
+// Milliseconds after reset at which each bring-up milestone was reached, 0 = not yet
+struct BootTimings {
+    unsigned long firstFrame;
+    unsigned long wifiConnected;
+    unsigned long mqttConnected;
+    unsigned long firstPublish;
+};
+BootTimings bootTimings = {0, 0, 0, 0};
+bool networkServicesStarted = false;
+bool alarmActive = false;
 
 // =================================================================
 // Callback Functions
 // =================================================================
 
-void onParadoxEvent(const String& event, const String& payload) {
-    String description = getEventDescription(event.toInt(), payload.toInt());
-    if (description.length() > 0) {
-        DEBUG_PRINTF("[Paradox] Event: %s\n", description.c_str());
+ParadoxHandler* findPanel(uint8_t panelId) {
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        if (handler->getPanelId() == panelId) return handler;
+    }
+    return nullptr;
+}
+
+// To one broker, or to every broker in use when broker is -1
+bool publishEvent(const ParadoxEvent& event, const char* subtopic, bool retain, int8_t broker = -1) {
+    ParadoxHandler* panel = findPanel(event.panel);
+    char topic[48];
+    snprintf(topic, sizeof(topic), "%s/%s/%u", panel ? panel->getTopicPrefix().c_str() : MQTT_TOPIC_PREFIX,
+             subtopic, event.event);
+
+    uint8_t payload[EVENT_PAYLOAD_MAX_SIZE];
+    const char* label = panel ? panel->getLabels().forEvent(event) : nullptr;
+    size_t length = encodeEvent(mqttHandler.getPayloadEncoding(), event, payload, sizeof(payload), label);
+    if (length == 0) {
+        return false;
+    }
+    return broker < 0 ? mqttHandler.publish(topic, payload, length, retain)
+                      : mqttHandler.publishTo(broker, topic, payload, length, retain);
+}
+
+void reportBootTimings() {
+    DEBUG_PRINTF("[System] Boot (%s): first frame %lu ms, WiFi %lu ms, MQTT %lu ms, first publish %lu ms\n",
+                 wifiConfig.isFastBoot() ? "fast" : "full", bootTimings.firstFrame, bootTimings.wifiConnected,
+                 bootTimings.mqttConnected, bootTimings.firstPublish);
+
+    StaticJsonDocument<192> doc;
+    doc["fast_boot"] = wifiConfig.isFastBoot();
+    doc["first_frame_ms"] = bootTimings.firstFrame;
+    doc["wifi_ms"] = bootTimings.wifiConnected;
+    doc["mqtt_ms"] = bootTimings.mqttConnected;
+    doc["first_publish_ms"] = bootTimings.firstPublish;
+    char payload[192];
+    serializeJson(doc, payload);
+    mqttHandler.publish(MQTT_TOPIC_PREFIX "/__boot__", payload);
+}
+
+// Pipeline, memory and per-panel link figures, shared by MQTT and /metrics
+void buildDiagnostics(JsonObject obj) {
+    JsonObject pipeline = obj.createNestedObject("pipeline");
+    pipelineMetrics.toJson(pipeline);
+    uint32_t published = pipelineMetrics.getPublished();
+    if (published > 0) {
+        pipeline["allocs_per_event"] = (float)MemoryMonitor::getAllocations(AllocTag::EVENTS).count / published;
+    }
+
+    JsonObject memory = obj.createNestedObject("memory");
+    memoryMonitor.toJson(memory);
+    requestPool.toJson(memory.createNestedObject("pools").createNestedObject("request"));
+
+    LogStats logStats = getLogStats();
+    JsonObject log = obj.createNestedObject("log");
+    log["queued"] = logStats.queued;
+    log["dropped"] = logStats.dropped;
+    log["enqueue_us_avg"] = logStats.queued + logStats.dropped > 0 ? logStats.enqueueMicrosTotal / (logStats.queued + logStats.dropped) : 0;
+    log["enqueue_us_max"] = logStats.enqueueMicrosMax;
+
+#if MULTICAST_ENABLED
+    multicastPublisher.toJson(obj.createNestedObject("multicast"));
+#endif
+    zoneHistory.toJson(obj.createNestedObject("history"));
+
+    JsonArray panels = obj.createNestedArray("panels");
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        const FrameDecoder& decoder = handler->getDecoder();
+        const UartStats& uart = handler->getUartStats();
+        JsonObject panel = panels.createNestedObject();
+        panel["panel"] = handler->getPanelId();
+        panel["frames"] = decoder.getFramesDecoded();
+        panel["resyncs"] = decoder.getResyncs();
+        panel["bytes_discarded"] = decoder.getBytesDiscarded();
+        panel["uart_fifo_overflows"] = uart.fifoOverflows;
+        panel["uart_buffer_full"] = uart.bufferFull;
+        panel["uart_framing_errors"] = uart.framingErrors;
+        const StateCacheStats& cache = handler->getStateCacheStats();
+        panel["state_cache_hits"] = cache.hits;
+        panel["state_cache_misses"] = cache.misses;
+        if (cache.hits + cache.misses > 0) {
+            panel["state_cache_hit_rate"] = (float)cache.hits / (cache.hits + cache.misses);
+        }
+#if LABELS_ENABLED
+        handler->getLabels().toJson(panel.createNestedObject("labels"));
+#endif
+#if PARADOX_CATCHUP_ENABLED
+        handler->getEventLog().toJson(panel.createNestedObject("catchup"));
+#endif
+    }
+
+    JsonObject mqtt = obj.createNestedObject("mqtt");
+    mqttHandler.toJson(mqtt);
+#if MQTT_FANOUT_ENABLED
+    JsonArray brokers = mqtt["brokers"];
+    for (uint8_t i = 0; i < mqttHandler.getBrokerCount(); i++) {
+        brokers[i]["backlog"] = eventJournal.getLastSequence() - brokerSequence[i];
+        brokers[i]["dropped"] = brokerDropped[i];
+    }
+#endif
+}
+
+// Builds the diagnostics JSON and its text inside one request block.
+// Returns nullptr if the block is too small.
+const char* renderDiagnostics(BumpArena& arena) {
+    BasicJsonDocument<ArenaJsonAllocator> doc(DIAGNOSTICS_JSON_CAPACITY, ArenaJsonAllocator(arena));
+    if (doc.capacity() == 0) {
+        return nullptr;
+    }
+    buildDiagnostics(doc.to<JsonObject>());
+    size_t size = measureJson(doc) + 1;
+    char* text = static_cast<char*>(arena.allocate(size, 1));
+    if (text) {
+        serializeJson(doc, text, size);
+    }
+    requestPool.recordUsage(arena.getUsed());
+    return text;
+}
+
+void publishDiagnostics() {
+    void* block = requestPool.allocate();
+    if (!block) {
+        DEBUG_PRINTLN("[System] Request pool exhausted. Skipping diagnostics.");
+        return;
+    }
+    BumpArena arena(block, REQUEST_BLOCK_SIZE);
+    const char* payload = renderDiagnostics(arena);
+    if (payload) {
+        mqttHandler.publish(MQTT_TOPIC_PREFIX "/diagnostics", payload, false);
+    }
+    requestPool.deallocate(block);
+}
+
+// Publishes journaled events a broker has not had yet, oldest first, at most
+// MQTT_PUBLISH_BURST per broker per call. Returns true if anything was published.
+bool publishPendingEvents() {
+    uint32_t last = eventJournal.getLastSequence();
+    bool published = false;
+    for (uint8_t broker = 0; broker < mqttHandler.getBrokerCount(); broker++) {
+        if (!mqttHandler.isPublishTarget(broker)) continue;
+#if MQTT_FANOUT_ENABLED
+        uint32_t& cursor = brokerSequence[broker];
+        uint32_t oldest = eventJournal.getOldestSequence();
+        if (cursor + 1 < oldest) {
+            brokerDropped[broker] += oldest - cursor - 1;
+            cursor = oldest - 1;
+        }
+#else
+        // One queue, handed on to whichever broker is active
+        uint32_t& cursor = publishedSequence;
+#endif
+        if (cursor == last) continue;
+
+        bool failed = false;
+        uint32_t to = min(last, cursor + MQTT_PUBLISH_BURST);
+        eventJournal.replay(cursor + 1, to, [&](const ParadoxEvent& event) {
+            // Stop at the first failure so events stay in order
+            if (failed) return;
+            uint32_t start = micros();
+            // Historical events are not retained, so they never mask the current state
+            if (publishEvent(event, event.historical ? "catchup/events" : "events", !event.historical, broker)) {
+                // Latency is measured to the first broker that has the event
+                if (event.sequence > publishedSequence) {
+                    pipelineMetrics.record(millis() - event.timestamp, micros() - start);
+                    publishedSequence = event.sequence;
+                }
+                cursor = event.sequence;
+                published = true;
+            } else {
+                pipelineMetrics.recordFailure();
+                failed = true;
+            }
+        });
+    }
+
+    if (published && bootTimings.firstPublish == 0) {
+        bootTimings.firstPublish = millis();
+        reportBootTimings();
+    }
+    return published;
+}
+
+void onParadoxEvent(const ParadoxEvent& event) {
+    AllocScope allocScope(AllocTag::EVENTS);
+    if (bootTimings.firstFrame == 0) {
+        bootTimings.firstFrame = millis();
+    }
+
+    char description[EVENT_DESCRIPTION_SIZE];
+    if (getEventDescription(event.event, event.subEvent, description, sizeof(description)) > 0) {
+        DEBUG_PRINTF("[Paradox] %sEvent: %s\n", event.historical ? "Historical " : "", description);
     } else {
-        DEBUG_PRINTF("[Paradox] Event: %s, Payload: %s\n", event.c_str(), payload.c_str());
+        DEBUG_PRINTF("[Paradox] %sEvent: %u, Payload: %u\n", event.historical ? "Historical " : "", event.event, event.subEvent);
+    }
+
+    // Events from the panel's log are only published; acting on them or
+    // counting them as current state would replay the past
+    if (event.historical) {
+        ParadoxEvent outbound = event;
+        eventJournal.record(outbound);
+        publishPendingEvents();
+        return;
     }
 
-    String topic = String(MQTT_TOPIC_PREFIX) + "/events/" + event;
-    String jsonPayload = "{\"value\":\"" + payload + "\"}";
-    if (mqttHandler.publish(topic.c_str(), jsonPayload.c_str())) {
+    AlarmChange alarmChange = getAlarmChange(event.event, event.subEvent);
+    if (alarmChange != AlarmChange::NONE) {
+        alarmActive = alarmChange == AlarmChange::RAISED;
+    }
+
+    ParadoxEvent outbound = event;
+    eventJournal.record(outbound);
+    // Local rules react before the event goes anywhere near the network
+    ruleEngine.evaluate(outbound);
+    // Brokerless LAN consumers; a no-op until the network is up
+    multicastPublisher.add(outbound);
+    zoneHistory.record(outbound);
+
+    if (publishPendingEvents()) {
         ledHandler.setMode(LedMode::FLICKER);
     }
 }
 
-void onMqttMessage(char* topic, byte* payload, unsigned int length) {
-    String topicStr(topic);
-    payload[length] = '\0'; // Null-terminate the payload
+// Publishes <panel prefix>/labels, retained, for consumers that name zones,
+// partitions and users
+void publishLabels(uint8_t panelId) {
+    ParadoxHandler* panel = findPanel(panelId);
+    if (!panel || panel->getLabels().getSource() == LabelSource::NONE || !mqttHandler.isConnected()) {
+        return;
+    }
+    void* block = requestPool.allocate();
+    if (!block) {
+        DEBUG_PRINTLN("[System] Request pool exhausted. Skipping labels.");
+        return;
+    }
+    char topic[48];
+    snprintf(topic, sizeof(topic), "%s/labels", panel->getTopicPrefix().c_str());
+    if (panel->getLabels().formatJson((char*)block, REQUEST_BLOCK_SIZE) > 0) {
+        mqttHandler.publish(topic, (const char*)block, true);
+    }
+    requestPool.deallocate(block);
+}
 
-    DEBUG_PRINTF("[MQTT] Message received. Topic: %s, Payload: %s\n", topic, (char*)payload);
-    ledHandler.setMode(LedMode::FLICKER);
+// Panel commands and priority publishes requested by a local rule
+void onRuleAction(uint8_t index, const RuleRecord& rule, const ParadoxEvent& event) {
+    ParadoxHandler* panel = findPanel(event.panel);
+    if (!panel) return;
+
+    if (rule.action == RuleAction::ARM) {
+        panel->arm(rule.arg0, rule.arg1 ? rule.arg1 : 0x04, CommandRequest(nullptr, "rule"));
+    } else if (rule.action == RuleAction::DISARM) {
+        panel->disarm(rule.arg0, 0x05, CommandRequest(nullptr, "rule"));
+    } else if (rule.action == RuleAction::PUBLISH) {
+        char topic[48];
+        snprintf(topic, sizeof(topic), "%s/rules/%u", panel->getTopicPrefix().c_str(), index);
+        StaticJsonDocument<128> doc;
+        doc["rule"] = index;
+        doc["event"] = event.event;
+        doc["sub_event"] = event.subEvent;
+        doc["partition"] = event.partition;
+        doc["seq"] = event.sequence;
+        char payload[128];
+        serializeJson(doc, payload);
+        mqttHandler.publish(topic, payload, false);
+    }
+}
 
-    if (topicStr == String(MQTT_TOPIC_PREFIX) + "/commands") {
-        StaticJsonDocument<256> doc;
-        DeserializationError error = deserializeJson(doc, payload, length);
+// Replaces the active rules with a binary rules image and stores it for the next boot
+void handleRulesUpload(char* payload, size_t length) {
+    if (!ruleEngine.loadFromBuffer((const uint8_t*)payload, length)) {
+        DEBUG_PRINTLN("[Rules] Rejected uploaded rules.");
+        return;
+    }
+    File file = LittleFS.open(RULES_FILE, "w");
+    if (!file) {
+        DEBUG_PRINTLN("[Rules] Failed to save rules file.");
+        return;
+    }
+    file.write((const uint8_t*)payload, length);
+    file.close();
+}
+
+// Republishes a range of journaled events so consumers can repair sequence gaps.
+// Request: {"from":<seq>,"to":<seq>} on paradox/replay
+void handleReplayRequest(char* payload, size_t length) {
+    StaticJsonDocument<128> doc;
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error) {
+        DEBUG_PRINTF("[MQTT] Replay request parse failed: %s\n", error.c_str());
+        return;
+    }
 
-        if (error) {
-            DEBUG_PRINTF("[MQTT] deserializeJson() failed: %s\n", error.c_str());
+    uint32_t from = doc["from"] | 0UL;
+    uint32_t to = doc["to"] | eventJournal.getLastSequence();
+    DEBUG_PRINTF("[Journal] Replaying events %u..%u\n", from, to);
+
+    size_t sent = eventJournal.replay(from, to, [](const ParadoxEvent& event) {
+        publishEvent(event, "replay/events", false);
+    });
+
+    StaticJsonDocument<128> result;
+    result["from"] = from;
+    result["to"] = to;
+    result["sent"] = sent;
+    result["oldest"] = eventJournal.getOldestSequence();
+    result["last"] = eventJournal.getLastSequence();
+    char buffer[128];
+    serializeJson(result, buffer);
+    mqttHandler.publish(MQTT_TOPIC_PREFIX "/replay/result", buffer, false);
+}
+
+// Opens a paradox/history/result page: {"id":..,"<key>":[
+static size_t beginHistoryPage(char* buffer, const char* id, const char* key) {
+    if (id) {
+        return snprintf(buffer, HISTORY_MQTT_PAYLOAD, "{\"id\":\"%.32s\",\"%s\":[", id, key);
+    }
+    return snprintf(buffer, HISTORY_MQTT_PAYLOAD, "{\"%s\":[", key);
+}
+
+static void publishHistoryPage(char* buffer, size_t len, bool more, bool truncated) {
+    snprintf(buffer + len, HISTORY_MQTT_PAYLOAD - len, "],\"more\":%s,\"truncated\":%s}",
+             more ? "true" : "false", truncated ? "true" : "false");
+    mqttHandler.publish(MQTT_TOPIC_PREFIX "/history/result", buffer, false);
+}
+
+// Publishes stored zone and partition changes in pages of HISTORY_MQTT_PAGE.
+// Request on paradox/history: {"id":"x","panel":1,"zone":3,"from":<unix>,"to":<unix>,"limit":100}
+// "partition":1 instead of "zone" selects arm state changes; "stats":true
+// returns counters instead of records.
+void handleHistoryRequest(char* payload, size_t length) {
+    StaticJsonDocument<256> doc;
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error) {
+        DEBUG_PRINTF("[MQTT] History request parse failed: %s\n", error.c_str());
+        return;
+    }
+
+    HistoryQuery query;
+    query.panel = doc["panel"] | 0;
+    if (doc.containsKey("zone")) {
+        uint8_t zone = doc["zone"] | 0;
+        if (zone < 1 || zone > 32) {
+            DEBUG_PRINTF("[History] Rejected request for zone %u\n", zone);
             return;
         }
+        query.channel = zone - 1;
+    } else if (doc.containsKey("partition")) {
+        uint8_t partition = doc["partition"] | 0;
+        if (partition != HISTORY_PARTITION) {
+            DEBUG_PRINTF("[History] Rejected request for partition %u\n", partition);
+            return;
+        }
+        query.channel = HISTORY_PARTITION_CHANNEL;
+    }
+    query.from = doc["from"] | 0UL;
+    query.to = doc["to"] | (unsigned long)UINT32_MAX;
+    uint16_t limit = min<uint16_t>(doc["limit"] | HISTORY_MQTT_LIMIT, HISTORY_MQTT_LIMIT);
+    const char* id = doc["id"];
+
+    void* block = requestPool.allocate();
+    if (!block) {
+        DEBUG_PRINTLN("[System] Request pool exhausted. Skipping history request.");
+        return;
+    }
+    char* buffer = (char*)block;
+    static_assert(HISTORY_MQTT_PAYLOAD <= REQUEST_BLOCK_SIZE, "History page must fit a request block");
+
+    if (doc["stats"] | false) {
+        size_t len = beginHistoryPage(buffer, id, "stats");
+        uint8_t inPage = 0;
+        for (ParadoxHandler* handler : paradoxHandlers) {
+            uint8_t panel = handler->getPanelId();
+            if (query.panel != 0 && query.panel != panel) continue;
+            for (uint8_t channel = 0; channel < HISTORY_CHANNELS; channel++) {
+                if (query.channel != 0xFF && query.channel != channel) continue;
+                ChannelStats stats;
+                if (!zoneHistory.getStats(panel, channel, stats) ||
+                    (query.channel == 0xFF && stats.changes == 0 && stats.state == HISTORY_STATE_UNKNOWN)) {
+                    continue;
+                }
+                if (inPage == HISTORY_MQTT_STATS_PAGE) {
+                    publishHistoryPage(buffer, len, true, false);
+                    len = beginHistoryPage(buffer, id, "stats");
+                    inPage = 0;
+                }
+                if (inPage > 0) buffer[len++] = ',';
+                len += ZoneHistory::formatStats(panel, channel, stats, buffer + len, HISTORY_MQTT_PAYLOAD - len);
+                inPage++;
+            }
+        }
+        publishHistoryPage(buffer, len, false, false);
+        requestPool.deallocate(block);
+        return;
+    }
 
-        if (doc.containsKey("password")) {
-            const char* password = doc["password"];
-            paradoxHandler.setPassword(password);
-            DEBUG_PRINTLN("[MQTT] Password updated from payload.");
+    HistoryRecord records[HISTORY_MQTT_PAGE];
+    uint16_t sent = 0;
+    size_t len = beginHistoryPage(buffer, id, "records");
+    uint8_t inPage = 0;
+    while (!query.done && sent < limit) {
+        size_t count = zoneHistory.read(query, records, min<size_t>(HISTORY_MQTT_PAGE - inPage, limit - sent));
+        for (size_t i = 0; i < count; i++) {
+            if (inPage > 0) buffer[len++] = ',';
+            len += ZoneHistory::formatRecord(records[i], buffer + len, HISTORY_MQTT_PAYLOAD - len);
+            inPage++;
+        }
+        sent += count;
+        if (inPage == HISTORY_MQTT_PAGE && !query.done) {
+            publishHistoryPage(buffer, len, true, false);
+            len = beginHistoryPage(buffer, id, "records");
+            inPage = 0;
         }
+    }
+    // Hitting the limit with records left over is reported, not silently cut
+    publishHistoryPage(buffer, len, false, !query.done);
+    requestPool.deallocate(block);
+}
+
+// {"url":"http://host/firmware.bin","sha256":"<hex>","signature":"<DER hex>"}
+void handleOtaRequest(char* payload, size_t length) {
+    StaticJsonDocument<512> doc;
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error) {
+        DEBUG_PRINTF("[MQTT] OTA request parse failed: %s\n", error.c_str());
+        return;
+    }
+    otaHandler.requestPull(doc["url"], doc["sha256"], doc["signature"]);
+}
 
-        uint8_t partition = doc.containsKey("partition") ? doc["partition"].as<uint8_t>() : 0;
+void onMqttMessage(char* topic, byte* payload, unsigned int length) {
+    // PubSubClient's payload is not null-terminated, so print it with an explicit length
+    LOG_D(LOG_TAG_MQTT, "[MQTT] Message received. Topic: %s, Payload: %.*s\n", topic, (int)length, (char*)payload);
+    ledHandler.setMode(LedMode::FLICKER);
 
-        if (doc.containsKey("command")) {
-            String command = doc["command"].as<String>();
-            DEBUG_PRINTF("[MQTT] Processing command: %s\n", command.c_str());
+    if (!commandDispatcher.dispatch(topic, payload, length)) {
+        DEBUG_PRINTF("[MQTT] No handler for topic %s\n", topic);
+    }
+}
 
-            if (command.equalsIgnoreCase("arm")) paradoxHandler.arm(partition, 0x04);
+// Publishes {"id","command","status","latency_ms"} for commands sent with an id
+void onCommandResult(const CommandResult& result) {
+    ParadoxHandler* panel = findPanel(result.panel);
+    char topic[48];
+    snprintf(topic, sizeof(topic), "%s/commands/result", panel ? panel->getTopicPrefix().c_str() : MQTT_TOPIC_PREFIX);
+
+    StaticJsonDocument<192> doc;
+    doc["id"] = result.id;
+    doc["command"] = result.command;
+    doc["status"] = getCommandStatusName(result.status);
+    doc["latency_ms"] = result.latencyMs;
+    char payload[192];
+    serializeJson(doc, payload);
+    mqttHandler.publish(topic, payload, false);
+}
 
-            else if (command.equalsIgnoreCase("disarm")) paradoxHandler.disarm(partition, 0x05);
-            else if (command.equalsIgnoreCase("stay")) paradoxHandler.arm(partition, 0x01);
-            else if (command.equalsIgnoreCase("sleep")) paradoxHandler.arm(partition, 0x03);
-            else if (command.equalsIgnoreCase("status")) paradoxHandler.requestStatus();
-            else if (command.equalsIgnoreCase("status-getzones")) paradoxHandler.requestZoneStatus();
-            else if (command.equalsIgnoreCase("status-getarmstatus")) paradoxHandler.requestPartitionStatus();
-            else if (command.equalsIgnoreCase("disconnect")) paradoxHandler.disconnect();
+void onMqttConnected() {
+    if (bootTimings.mqttConnected == 0) {
+        bootTimings.mqttConnected = millis();
+    }
+    publishPendingEvents();
+
+    // Request a full status update now that we are connected
+    DEBUG_PRINTLN("[MQTT] Requesting initial zone and partition status.");
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        handler->requestZoneStatus();
+        handler->requestPartitionStatus();
+        publishLabels(handler->getPanelId());
+    }
+}
+
+// =================================================================
+// Housekeeping Tasks
+// =================================================================
+
+// OTA and the web UI need a network interface, so they start on first connect
+void startNetworkServices() {
+    bootTimings.wifiConnected = millis();
+    otaHandler.setup(HOSTNAME, &ledHandler);
+#if MULTICAST_ENABLED
+    multicastPublisher.setup(MULTICAST_GROUP, MULTICAST_PORT, MULTICAST_KEY);
+#endif
+    // History times are UTC; records taken before the first sync are dated afterwards
+    configTime(0, 0, NTP_SERVER);
+    // Rendered by the "metrics" task on the loop into a request pool block
+    webUi.setMetricsRenderer(renderDiagnostics, requestPool);
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        webUi.addPanel(*handler);
+    }
+    webUi.setHistory(&zoneHistory);
+    webUi.setup();
+    networkServicesStarted = true;
+}
+
+bool resetInProgress = false;
+bool factoryResetPending = false;
+unsigned long buttonPressStartTime = 0;
+
+void factoryReset() {
+    DEBUG_PRINTLN("[System] Factory reset triggered! Erasing config and rebooting.");
+    factoryResetPending = true;
+    if (mountStorage()) {
+        LittleFS.remove("/config.json");
+    }
+    wifiConfig.clearCachedConfig();
+    WiFiManager wm;
+    wm.resetSettings();
+    // Let the log line reach the console before rebooting
+    scheduler.addTask("restart", 0, []() { ESP.restart(); }, 200);
+}
+
+void checkFactoryResetButton() {
+    if (factoryResetPending) return;
+
+    if (digitalRead(FACTORY_RESET_PIN) == LOW) {
+        if (!resetInProgress) {
+            resetInProgress = true;
+            buttonPressStartTime = millis();
+            DEBUG_PRINTLN("[System] Factory reset button held. Keep holding for 5 seconds...");
         }
+    } else {
+        if (resetInProgress) {
+            resetInProgress = false;
+            DEBUG_PRINTLN("[System] Factory reset cancelled.");
+        }
+    }
+
+    if (resetInProgress && (millis() - buttonPressStartTime > FACTORY_RESET_HOLD_TIME)) {
+        factoryReset();
+    }
+}
+
+// Highest priority first
+void updateLedMode() {
+    if (otaHandler.isOtaInProgress()) {
+        return;
+    }
+
+    bool panelLinkDown = false;
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        panelLinkDown = panelLinkDown || handler->isLinkDown();
+    }
+
+    LedStatus status;
+    status.resetInProgress = resetInProgress;
+    status.alarmActive = alarmActive;
+    status.panelLinkDown = panelLinkDown;
+    status.wifiConnected = WiFi.isConnected();
+    status.journalBacklog = publishedSequence != eventJournal.getLastSequence();
+    status.mqttConnected = mqttHandler.isConnected();
+    ledHandler.setMode(selectLedMode(status));
+}
+
+// A new image is kept only once it has decoded a panel frame and reached MQTT
+void checkOtaSelfTest() {
+    bool panelFrameDecoded = false;
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        panelFrameDecoded = panelFrameDecoded || handler->getFrameCount() > 0;
+    }
+    otaHandler.checkSelfTest(panelFrameDecoded, mqttHandler.isConnected());
+}
+
+void checkConnectivity() {
+    wifiConfig.loop();
+
+    if (!networkServicesStarted && WiFi.isConnected()) {
+        startNetworkServices();
+    }
+
+    static bool lastWifiConnected = false;
+    static const char* lastMqttStatus = "";
+    bool wifiConnected = WiFi.status() == WL_CONNECTED;
+    const char* mqttStatus = mqttHandler.getConnectionStatus();
+
+    if (wifiConnected != lastWifiConnected || strcmp(mqttStatus, lastMqttStatus) != 0) {
+        DEBUG_PRINTF("[System] WiFi: %s, MQTT: %s\n", wifiConnected ? "Connected" : "Disconnected", mqttStatus);
+        lastWifiConnected = wifiConnected;
+        lastMqttStatus = mqttStatus;
     }
 }
 
@@ -106,12 +719,60 @@ void onMqttMessage(char* topic, byte* payload, unsigned int length) {
 void setup() {
     Serial.begin(115200);
     while (!Serial && millis() < 1000);
+    setupLog();
     DEBUG_PRINTLN("\n[System] Booting up Paradox MQTT Bridge v2.4...");
 
+    memoryMonitor.setup();
     pinMode(FACTORY_RESET_PIN, INPUT_PULLUP);
 
     ledHandler.setup();
-    wifiConfig.setup();
+    otaHandler.beginSelfTest();
+    eventJournal.setup();
+    publishedSequence = eventJournal.getLastSequence();
+#if MQTT_FANOUT_ENABLED
+    for (uint32_t& sequence : brokerSequence) {
+        sequence = publishedSequence;
+    }
+#endif
+
+#if PARADOX_PANEL_COUNT > 1
+    // Each panel gets its own namespace: paradox/<panel-id>/...
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        handler->setTopicPrefix(String(MQTT_TOPIC_PREFIX) + "/" + String(handler->getPanelId()));
+    }
+#endif
+
+    // Panel links come up before the network so nothing decoded during
+    // WiFi/MQTT bring-up is lost; events wait in the journal until publish
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        handler->setup(onParadoxEvent);
+        handler->setResultCallback(onCommandResult);
+        handler->setLabelsCallback(publishLabels);
+        // Catch-up waits for the broker and never outruns the journal ring
+        handler->setCatchupGate([]() {
+            return mqttHandler.isConnected() && eventJournal.getLastSequence() - publishedSequence < JOURNAL_RING_SIZE / 2;
+        });
+        handler->setPassword(PARADOX_DEFAULT_PASSWORD);
+    }
+
+    // LittleFS is read once the panel UARTs are up: frames arriving while it
+    // mounts wait in the RX ring, and the loop only handles them after the
+    // rules and history below are loaded
+    zoneHistory.setup();
+    ruleEngine.setActionCallback(onRuleAction);
+    ruleEngine.reservePin(LED_PIN);
+    ruleEngine.reservePin(FACTORY_RESET_PIN);
+    ruleEngine.reservePin(PARADOX_RX_PIN);
+    ruleEngine.reservePin(PARADOX_TX_PIN);
+#if PARADOX_PANEL_COUNT > 1
+    ruleEngine.reservePin(PARADOX2_RX_PIN);
+    ruleEngine.reservePin(PARADOX2_TX_PIN);
+#endif
+    ruleEngine.load();
+
+    if (!FAST_BOOT_ENABLED || !wifiConfig.beginFast()) {
+        wifiConfig.setup();
+    }
 
     if (!wifiConfig.isConfigured()) {
         DEBUG_PRINTLN("[System] Configuration is incomplete. Starting configuration portal.");
@@ -126,77 +787,72 @@ void setup() {
         wifiConfig.getMqttPort(),
         wifiConfig.getMqttUser(),
         wifiConfig.getMqttPassword(),
-        String(MQTT_TOPIC_PREFIX) + "/commands",
+        panel1.getTopicPrefix() + "/commands",
         onMqttMessage
     );
-
-    otaHandler.setup(HOSTNAME, &ledHandler);
-    paradoxHandler.setup(onParadoxEvent);
-    webUi.setup();
-
-    paradoxHandler.setPassword(PARADOX_DEFAULT_PASSWORD);
+    mqttHandler.addBackupBrokers(wifiConfig.getMqttBackups());
+#if MQTT_TLS_ENABLED
+    if (!TlsClient::loadCredentials()) {
+        DEBUG_PRINTLN("[MQTT] TLS is enabled but no usable credentials; upload a bundle to /api/tls.");
+    }
+#endif
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        if (handler != &panel1) {
+            mqttHandler.addSubscription(handler->getTopicPrefix() + "/commands");
+        }
+        commandDispatcher.addPanel(*handler);
+    }
+    mqttHandler.addSubscription(String(MQTT_TOPIC_PREFIX) + "/replay");
+    commandDispatcher.addRoute(String(MQTT_TOPIC_PREFIX) + "/replay", handleReplayRequest);
+    mqttHandler.addSubscription(String(MQTT_TOPIC_PREFIX) + "/ota");
+    commandDispatcher.addRoute(String(MQTT_TOPIC_PREFIX) + "/ota", handleOtaRequest);
+    mqttHandler.addSubscription(String(MQTT_TOPIC_PREFIX) + "/rules");
+    commandDispatcher.addRoute(String(MQTT_TOPIC_PREFIX) + "/rules", handleRulesUpload);
+    mqttHandler.addSubscription(String(MQTT_TOPIC_PREFIX) + "/history");
+    commandDispatcher.addRoute(String(MQTT_TOPIC_PREFIX) + "/history", handleHistoryRequest);
+    mqttHandler.setConnectCallback(onMqttConnected);
+
+    scheduler.addTask("reset-btn", 50, checkFactoryResetButton);
+    scheduler.addTask("led-mode", 100, updateLedMode);
+    scheduler.addTask("network", 250, checkConnectivity);
+    scheduler.addTask("sched-stats", 600000, []() { scheduler.logStats(); });
+    scheduler.addTask("uart-stats", 600000, []() {
+        for (ParadoxHandler* handler : paradoxHandlers) {
+            handler->logUartStats();
+        }
+    });
+    scheduler.addTask("ota-selftest", 1000, checkOtaSelfTest);
+    scheduler.addTask("pipeline-rate", 10000, []() { pipelineMetrics.sampleRate(); });
+    scheduler.addTask("rules", 20, []() { ruleEngine.service(); });
+    scheduler.addTask("memory", 10000, []() { memoryMonitor.sample(); });
+    scheduler.addTask("history", 1000, []() { zoneHistory.service(); });
+    scheduler.addTask("diagnostics", DIAGNOSTICS_INTERVAL, publishDiagnostics);
+    scheduler.addTask("metrics", 50, []() { webUi.serviceMetrics(); });
+    // Drains what a burst limit or a failed publish left in the journal
+    scheduler.addTask("publish", 50, []() { publishPendingEvents(); });
 
     DEBUG_PRINTLN("[System] Setup complete. Running normally.");
 }
 
 void loop() {
-    ledHandler.loop();
-    otaHandler.loop();
-
-    // Factory Reset Logic
-    static unsigned long buttonPressStartTime = 0;
-    static bool resetInProgress = false;
-    const int factoryResetHoldTime = 5000; // 5 seconds
-
-    if (digitalRead(FACTORY_RESET_PIN) == LOW) {
-        if (!resetInProgress) {
-            resetInProgress = true;
-            buttonPressStartTime = millis();
-            DEBUG_PRINTLN("[System] Factory reset button held. Keep holding for 5 seconds...");
-        }
-    } else {
-        if (resetInProgress) {
-            resetInProgress = false;
-            DEBUG_PRINTLN("[System] Factory reset cancelled.");
-        }
+    // OTA runs in its own task, so the panel keeps being serviced during updates
+    bool idle = true;
+    {
+        AllocScope allocScope(AllocTag::MQTT);
+        mqttHandler.loop();
     }
-
-    if (resetInProgress && (millis() - buttonPressStartTime > factoryResetHoldTime)) {
-        DEBUG_PRINTLN("[System] Factory reset triggered! Erasing config and rebooting.");
-        if (LittleFS.begin()) {
-            LittleFS.remove("/config.json");
-        }
-        WiFiManager wm;
-        wm.resetSettings();
-        delay(200);
-        ESP.restart();
+    // Round-robin: each handler does a bounded amount of work per call
+    for (ParadoxHandler* handler : paradoxHandlers) {
+        AllocScope allocScope(AllocTag::PANEL);
+        handler->loop();
+        idle = idle && handler->isIdle();
     }
 
-    if (!otaHandler.isOtaInProgress()) {
-        mqttHandler.loop();
-        paradoxHandler.loop();
-
-        if (resetInProgress) {
-            ledHandler.setMode(LedMode::BLINK_FAST);
-        } else if (WiFi.isConnected()) {
-            if (mqttHandler.isConnected()) {
-                ledHandler.setMode(LedMode::ON);
-            } else {
-                ledHandler.setMode(LedMode::BLINK_SLOW);
-            }
-        } else {
-            ledHandler.setMode(LedMode::BLINK_FAST);
-        }
-
-        static String lastWifiStatus = "";
-        static String lastMqttStatus = "";
-        String currentWifiStatus = WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected";
-        String currentMqttStatus = mqttHandler.getConnectionStatus();
+    uint32_t nextTaskMs = min(scheduler.run(), multicastPublisher.service());
 
-        if (currentWifiStatus != lastWifiStatus || currentMqttStatus != lastMqttStatus) {
-            DEBUG_PRINTF("[System] WiFi: %s, MQTT: %s\n", currentWifiStatus.c_str(), currentMqttStatus.c_str());
-            lastWifiStatus = currentWifiStatus;
-            lastMqttStatus = currentMqttStatus;
-        }
+    // Nothing buffered and no housekeeping due: yield the CPU instead of spinning
+    if (idle) {
+        // Panel UART RX events cut the sleep short
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(min(nextTaskMs, (uint32_t)LOOP_IDLE_SLEEP_MAX)));
     }
-}
\ No newline at end of file
+}
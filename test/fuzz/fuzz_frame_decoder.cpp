@@ -0,0 +1,65 @@
+// libFuzzer target for FrameDecoder. Each input is fed as a raw panel stream,
+// once with replies expected and once without, checking that every frame
+// handed out has a good checksum and that no byte is lost or counted twice.
+//
+//   clang++ -std=gnu++11 -g -O1 -fsanitize=fuzzer,address,undefined -Isrc
+//       test/fuzz/fuzz_frame_decoder.cpp src/FrameDecoder.cpp -o fuzz_frame_decoder
+//   ./fuzz_frame_decoder test/fuzz/corpus/frame_decoder
+//
+// Without clang, -DFUZZ_STANDALONE builds a driver that replays the files
+// given on the command line, e.g. the seed corpus, under g++ sanitizers.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "FrameDecoder.h"
+
+static void check(const uint8_t* data, size_t size, bool repliesExpected) {
+    FrameDecoder decoder;
+    decoder.setRepliesExpected(repliesExpected);
+    for (size_t i = 0; i < size; i++) {
+        if (decoder.push(data[i])) {
+            const uint8_t* frame = decoder.frame();
+            uint8_t sum = 0;
+            for (int j = 0; j < PARADOX_FRAME_SIZE - 1; j++) {
+                sum += frame[j];
+            }
+            if (sum != frame[PARADOX_FRAME_SIZE - 1]) abort();
+            if (!repliesExpected && (frame[0] & 0xF0) != 0xE0 && frame[0] != 0x70) abort();
+        }
+        if (decoder.size() >= PARADOX_FRAME_SIZE) abort();
+        if ((size_t)decoder.getFramesDecoded() * PARADOX_FRAME_SIZE + decoder.getBytesDiscarded() +
+                decoder.size() != i + 1) {
+            abort();
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    check(data, size, false);
+    check(data, size, true);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include <stdio.h>
+#include <vector>
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        FILE* file = fopen(argv[i], "rb");
+        if (!file) {
+            perror(argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> data;
+        int c;
+        while ((c = fgetc(file)) != EOF) {
+            data.push_back(c);
+        }
+        fclose(file);
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+        printf("%s: %zu bytes ok\n", argv[i], data.size());
+    }
+    return 0;
+}
+#endif
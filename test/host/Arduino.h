@@ -0,0 +1,78 @@
+#pragma once
+// Just enough of the Arduino core to build bridge sources on the host. Time
+// is a fake clock the tests move with hostAdvanceTime() in esp_timer.h.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "WString.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+
+using std::min;
+using std::max;
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+
+inline uint64_t& hostNowUs() {
+    static uint64_t now = 0;
+    return now;
+}
+
+inline unsigned long millis() { return (unsigned long)(hostNowUs() / 1000); }
+inline unsigned long micros() { return (unsigned long)hostNowUs(); }
+
+// Last level written to each pin, and how many writes each has seen
+inline uint8_t* hostPinLevels() {
+    static uint8_t levels[64];
+    return levels;
+}
+inline uint32_t* hostPinWrites() {
+    static uint32_t writes[64];
+    return writes;
+}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+    hostPinLevels()[pin] = level;
+    hostPinWrites()[pin]++;
+}
+inline int digitalRead(uint8_t pin) { return hostPinLevels()[pin]; }
+
+// RTC memory is ordinary memory on the host
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#define IRAM_ATTR
+
+// Heap figures ESP reports; tests set them to whatever they need
+struct HostHeap {
+    uint32_t free;
+    uint32_t minFree;
+    uint32_t largestBlock;
+    uint32_t size;
+};
+
+inline HostHeap& hostHeap() {
+    static HostHeap heap = {200000, 180000, 110000, 320000};
+    return heap;
+}
+
+struct EspClass {
+    uint32_t getFreeHeap() { return hostHeap().free; }
+    uint32_t getMinFreeHeap() { return hostHeap().minFree; }
+    uint32_t getMaxAllocHeap() { return hostHeap().largestBlock; }
+    uint32_t getHeapSize() { return hostHeap().size; }
+    void restart() { abort(); }
+};
+static EspClass ESP __attribute__((unused));
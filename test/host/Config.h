@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in for the user's Config.h: logging compiled out
+#define DEBUG_PRINT(...) do {} while (0)
+#define DEBUG_PRINTLN(...) do {} while (0)
+#define DEBUG_PRINTF(...) do {} while (0)
@@ -0,0 +1,18 @@
+#pragma once
+// A file system that never mounts, so sources that fall back to defaults
+// without flash build and run on the host
+#include <Arduino.h>
+
+class File {
+public:
+    explicit operator bool() const { return false; }
+    size_t read(uint8_t*, size_t) { return 0; }
+    void close() {}
+};
+
+struct HostLittleFS {
+    bool begin(bool = false) { return false; }
+    bool exists(const char*) { return false; }
+    File open(const char*, const char* = "r") { return File(); }
+};
+static HostLittleFS LittleFS __attribute__((unused));
@@ -0,0 +1,82 @@
+#pragma once
+// NVS kept in memory for the life of the test binary. Holds integers only,
+// which is all the sources built on the host store.
+#include "Arduino.h"
+
+#define HOST_PREFERENCES_MAX 32
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        snprintf(_namespace, sizeof(_namespace), "%s", name);
+        _readOnly = readOnly;
+        return true;
+    }
+    void end() {}
+
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) {
+        Entry* entry = find(key, false);
+        return entry ? entry->value : defaultValue;
+    }
+    size_t putUInt(const char* key, uint32_t value) {
+        Entry* entry = _readOnly ? nullptr : find(key, true);
+        if (!entry) {
+            return 0;
+        }
+        entry->value = value;
+        writes()++;
+        return sizeof(value);
+    }
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return getUInt(key, defaultValue); }
+    size_t putUChar(const char* key, uint8_t value) { return putUInt(key, value) ? 1 : 0; }
+    bool isKey(const char* key) { return find(key, false) != nullptr; }
+    bool remove(const char* key) {
+        Entry* entry = _readOnly ? nullptr : find(key, false);
+        if (entry) {
+            entry->used = false;
+        }
+        return entry != nullptr;
+    }
+
+    // Writes since the program started, for tests that bound flash wear
+    static uint32_t& writes() {
+        static uint32_t count = 0;
+        return count;
+    }
+
+private:
+    struct Entry {
+        bool used;
+        char name[48];
+        uint32_t value;
+    };
+
+    char _namespace[16] = "";
+    bool _readOnly = true;
+
+    static Entry* entries() {
+        static Entry table[HOST_PREFERENCES_MAX];
+        return table;
+    }
+
+    Entry* find(const char* key, bool create) {
+        char name[48];
+        snprintf(name, sizeof(name), "%s/%s", _namespace, key);
+        Entry* table = entries();
+        Entry* freeEntry = nullptr;
+        for (size_t i = 0; i < HOST_PREFERENCES_MAX; i++) {
+            if (table[i].used && strcmp(table[i].name, name) == 0) {
+                return &table[i];
+            }
+            if (!table[i].used && !freeEntry) {
+                freeEntry = &table[i];
+            }
+        }
+        if (!create || !freeEntry) {
+            return nullptr;
+        }
+        freeEntry->used = true;
+        snprintf(freeEntry->name, sizeof(freeEntry->name), "%s", name);
+        return freeEntry;
+    }
+};
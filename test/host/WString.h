@@ -0,0 +1,110 @@
+#pragma once
+// Heap-backed String with the parts of the Arduino API the bridge uses. Grows
+// through new[] like the real one reallocs, so benchmarks that count
+// operator new see the same allocations per operation.
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+class String {
+public:
+    String(const char* text = "") { assign(text ? text : "", text ? strlen(text) : 0); }
+    String(const String& other) { assign(other._buffer, other._length); }
+    explicit String(char c) { assign(&c, 1); }
+    explicit String(int value) { assignf("%d", value); }
+    explicit String(unsigned int value) { assignf("%u", value); }
+    explicit String(long value) { assignf("%ld", value); }
+    explicit String(unsigned long value) { assignf("%lu", value); }
+    explicit String(float value, unsigned char decimals = 2) { assignf("%.*f", decimals, (double)value); }
+    explicit String(double value, unsigned char decimals = 2) { assignf("%.*f", decimals, value); }
+    ~String() { delete[] _buffer; }
+
+    String& operator=(const String& other) {
+        if (this != &other) {
+            _length = 0;
+            append(other._buffer, other._length);
+        }
+        return *this;
+    }
+    String& operator=(const char* text) {
+        _length = 0;
+        return concat(text);
+    }
+
+    String& concat(const char* text) { return append(text, strlen(text)); }
+    String& concat(const String& other) { return append(other._buffer, other._length); }
+    String& concat(char c) { return append(&c, 1); }
+    String& operator+=(const char* text) { return concat(text); }
+    String& operator+=(const String& other) { return concat(other); }
+    String& operator+=(char c) { return concat(c); }
+
+    const char* c_str() const { return _buffer; }
+    size_t length() const { return _length; }
+    bool reserve(size_t size) {
+        grow(size);
+        return true;
+    }
+    char operator[](size_t index) const { return index < _length ? _buffer[index] : 0; }
+    bool operator==(const char* text) const { return strcmp(_buffer, text) == 0; }
+    bool operator==(const String& other) const { return strcmp(_buffer, other._buffer) == 0; }
+
+private:
+    char* _buffer = nullptr;
+    size_t _length = 0;
+    size_t _capacity = 0;
+
+    void assign(const char* text, size_t length) {
+        _length = 0;
+        append(text, length);
+    }
+    template <typename T>
+    void assignf(const char* format, T value) {
+        char text[32];
+        assign(text, snprintf(text, sizeof(text), format, value));
+    }
+    void assignf(const char* format, int decimals, double value) {
+        char text[48];
+        assign(text, snprintf(text, sizeof(text), format, decimals, value));
+    }
+    void grow(size_t size) {
+        if (_buffer && size <= _capacity) {
+            return;
+        }
+        char* buffer = new char[size + 1];
+        if (_buffer) {
+            memcpy(buffer, _buffer, _length + 1);
+            delete[] _buffer;
+        } else {
+            buffer[0] = '\0';
+        }
+        _buffer = buffer;
+        _capacity = size;
+    }
+    String& append(const char* text, size_t length) {
+        if (_buffer && text >= _buffer && text < _buffer + _capacity + 1) {
+            String copy(text);
+            return append(copy._buffer, length);
+        }
+        grow(_length + length);
+        memmove(_buffer + _length, text, length);
+        _length += length;
+        _buffer[_length] = '\0';
+        return *this;
+    }
+};
+
+inline String operator+(const String& left, const String& right) {
+    String result(left);
+    result += right;
+    return result;
+}
+inline String operator+(const String& left, const char* right) {
+    String result(left);
+    result += right;
+    return result;
+}
+inline String operator+(const char* left, const String& right) {
+    String result(left);
+    result += right;
+    return result;
+}
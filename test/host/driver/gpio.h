@@ -0,0 +1,9 @@
+#pragma once
+// ESP32 pin capabilities as the IDF 4.4 driver reports them
+#include <stdint.h>
+
+#define SOC_GPIO_VALID_GPIO_MASK (0xFFFFFFFFFFULL & ~((1ULL << 24) | (0xFULL << 28)))
+#define SOC_GPIO_VALID_OUTPUT_GPIO_MASK (SOC_GPIO_VALID_GPIO_MASK & ~(0x3FULL << 34)) // 34-39 are input only
+
+#define GPIO_IS_VALID_GPIO(gpio_num) ((gpio_num) < 64 && ((1ULL << (gpio_num)) & SOC_GPIO_VALID_GPIO_MASK) != 0)
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio_num) ((gpio_num) < 64 && ((1ULL << (gpio_num)) & SOC_GPIO_VALID_OUTPUT_GPIO_MASK) != 0)
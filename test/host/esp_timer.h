@@ -0,0 +1,114 @@
+#pragma once
+// One-shot and periodic timers on the fake clock in Arduino.h. Callbacks run
+// from hostAdvanceTime(), in expiry order, as the esp_timer task would.
+#include "Arduino.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    bool armed;
+    uint64_t expiry;
+    uint64_t period; // 0 for one-shot
+};
+typedef struct esp_timer* esp_timer_handle_t;
+
+#define HOST_MAX_TIMERS 16
+
+struct HostTimers {
+    esp_timer timers[HOST_MAX_TIMERS];
+    size_t count;
+};
+
+inline HostTimers& hostTimers() {
+    static HostTimers registry;
+    return registry;
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    HostTimers& registry = hostTimers();
+    if (registry.count >= HOST_MAX_TIMERS) {
+        return ESP_FAIL;
+    }
+    esp_timer* timer = &registry.timers[registry.count++];
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->armed = false;
+    timer->period = 0;
+    *handle = timer;
+    return ESP_OK;
+}
+
+// Like the real one, starting an armed timer fails
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+    if (timer->armed) {
+        return ESP_FAIL;
+    }
+    timer->armed = true;
+    timer->expiry = hostNowUs() + timeoutUs;
+    timer->period = 0;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+    esp_err_t err = esp_timer_start_once(timer, periodUs);
+    timer->period = periodUs;
+    return err;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->armed) {
+        return ESP_FAIL;
+    }
+    timer->armed = false;
+    return ESP_OK;
+}
+
+inline int64_t esp_timer_get_time() {
+    return (int64_t)hostNowUs();
+}
+
+// Forgets every timer, e.g. before the object owning them goes out of scope
+inline void hostResetTimers() {
+    hostTimers().count = 0;
+}
+
+// Moves the clock forward, firing every timer that expires on the way
+inline void hostAdvanceTime(uint64_t us) {
+    uint64_t target = hostNowUs() + us;
+    for (;;) {
+        HostTimers& registry = hostTimers();
+        esp_timer* next = nullptr;
+        for (size_t i = 0; i < registry.count; i++) {
+            esp_timer* timer = &registry.timers[i];
+            if (timer->armed && timer->expiry <= target && (!next || timer->expiry < next->expiry)) {
+                next = timer;
+            }
+        }
+        if (!next) {
+            break;
+        }
+        hostNowUs() = next->expiry;
+        if (next->period) {
+            next->expiry += next->period;
+        } else {
+            next->armed = false;
+        }
+        next->callback(next->arg);
+    }
+    hostNowUs() = target;
+}
@@ -0,0 +1,26 @@
+#pragma once
+// Scheduler types and critical sections for single-threaded host tests.
+// hostCurrentTask() is the task the code under test believes it runs on.
+#include <stdint.h>
+#include <stddef.h>
+
+typedef void* TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define portMAX_DELAY 0xFFFFFFFFUL
+
+// Tests are single threaded, so critical sections have nothing to do
+typedef struct { int owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+
+inline TaskHandle_t& hostCurrentTask() {
+    static TaskHandle_t task = reinterpret_cast<TaskHandle_t>(1);
+    return task;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "FreeRTOS.h"
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return hostCurrentTask(); }
+// No named tasks exist on the host
+inline TaskHandle_t xTaskGetHandle(const char*) { return nullptr; }
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
@@ -0,0 +1,126 @@
+#include <unity.h>
+#include "ApiReply.h"
+
+#define BOOT 0x1a2b3c4dUL
+#define NEXT_BOOT 0x99887766UL
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static ApiReply plain(uint32_t generation, const char* ifNoneMatch) {
+    return decideApiReply(BOOT, generation, ifNoneMatch, nullptr, 0);
+}
+
+void test_etag_is_boot_and_generation() {
+    char etag[API_ETAG_SIZE];
+    formatApiEtag(BOOT, 0, etag, sizeof(etag));
+    TEST_ASSERT_EQUAL_STRING("\"1a2b3c4d-0\"", etag);
+    formatApiEtag(0xFFFFFFFFUL, 4294967295UL, etag, sizeof(etag));
+    TEST_ASSERT_EQUAL_STRING("\"ffffffff-4294967295\"", etag);
+}
+
+void test_unchanged_state_is_not_modified() {
+    TEST_ASSERT_TRUE(plain(42, "\"1a2b3c4d-42\"") == ApiReply::NOT_MODIFIED);
+}
+
+void test_changed_state_is_sent() {
+    TEST_ASSERT_TRUE(plain(43, "\"1a2b3c4d-42\"") == ApiReply::NOW);
+    TEST_ASSERT_TRUE(plain(43, nullptr) == ApiReply::NOW);
+    TEST_ASSERT_TRUE(plain(43, "") == ApiReply::NOW);
+}
+
+// After a restart the generation counts up from 0 again and reaches numbers
+// clients saved before it; their tags must not match the new state
+void test_if_none_match_across_restart() {
+    char before[API_ETAG_SIZE];
+    formatApiEtag(BOOT, 3, before, sizeof(before));
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 3, before, nullptr, 0) == ApiReply::NOT_MODIFIED);
+    TEST_ASSERT_TRUE(decideApiReply(NEXT_BOOT, 3, before, nullptr, 0) == ApiReply::NOW);
+
+    char after[API_ETAG_SIZE];
+    formatApiEtag(NEXT_BOOT, 3, after, sizeof(after));
+    TEST_ASSERT_TRUE(decideApiReply(NEXT_BOOT, 3, after, nullptr, 0) == ApiReply::NOT_MODIFIED);
+    // Tags from before the boot id was added
+    TEST_ASSERT_TRUE(decideApiReply(NEXT_BOOT, 3, "\"3\"", nullptr, 0) == ApiReply::NOW);
+}
+
+// A generation whose digits contain the client's, or the other way round, is a change
+void test_no_partial_matches() {
+    TEST_ASSERT_TRUE(plain(1, "\"1a2b3c4d-11\"") == ApiReply::NOW);
+    TEST_ASSERT_TRUE(plain(11, "\"1a2b3c4d-1\"") == ApiReply::NOW);
+    TEST_ASSERT_TRUE(plain(12, "\"1a2b3c4d-123\"") == ApiReply::NOW);
+    TEST_ASSERT_TRUE(plain(12, "1a2b3c4d-12") == ApiReply::NOW);
+}
+
+void test_etag_lists_weak_tags_and_wildcard() {
+    TEST_ASSERT_TRUE(apiEtagMatches("\"7\", \"8\"", "\"8\""));
+    TEST_ASSERT_TRUE(apiEtagMatches("\"7\",\"8\"", "\"7\""));
+    TEST_ASSERT_TRUE(apiEtagMatches("W/\"8\"", "\"8\""));
+    TEST_ASSERT_TRUE(apiEtagMatches("*", "\"8\""));
+    TEST_ASSERT_FALSE(apiEtagMatches("\"7\", \"9\"", "\"8\""));
+    TEST_ASSERT_FALSE(apiEtagMatches("\"8", "\"8\""));
+    TEST_ASSERT_FALSE(apiEtagMatches(nullptr, "\"8\""));
+}
+
+void test_since_forms() {
+    uint32_t since = 0;
+    TEST_ASSERT_TRUE(parseApiSince("17", BOOT, since));
+    TEST_ASSERT_EQUAL_UINT32(17, since);
+    TEST_ASSERT_TRUE(parseApiSince("1a2b3c4d-18", BOOT, since));
+    TEST_ASSERT_EQUAL_UINT32(18, since);
+    TEST_ASSERT_FALSE(parseApiSince("99887766-18", BOOT, since));
+    TEST_ASSERT_FALSE(parseApiSince("", BOOT, since));
+    TEST_ASSERT_FALSE(parseApiSince("12x", BOOT, since));
+    TEST_ASSERT_FALSE(parseApiSince("1a2b3c4d-", BOOT, since));
+}
+
+// ?since= says what the client has, so it is never answered with 304
+void test_long_poll_ignores_if_none_match() {
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 5, "\"1a2b3c4d-5\"", "5", 0) == ApiReply::WAIT);
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 5, "\"1a2b3c4d-5\"", "4", 0) == ApiReply::NOW);
+}
+
+void test_long_poll_behind_is_answered_now() {
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 9, nullptr, "3", 0) == ApiReply::NOW);
+    // Even when every long-poll slot is taken
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 9, nullptr, "3", API_LONG_POLL_MAX) == ApiReply::NOW);
+    // A client that got ahead, e.g. after a restart reset the generation
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 2, nullptr, "50", 0) == ApiReply::NOW);
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 2, nullptr, "junk", 0) == ApiReply::NOW);
+}
+
+// A generation saved before a restart that the new boot has reached again
+void test_long_poll_across_restart() {
+    TEST_ASSERT_TRUE(decideApiReply(NEXT_BOOT, 4, nullptr, "1a2b3c4d-4", 0) == ApiReply::NOW);
+    TEST_ASSERT_TRUE(decideApiReply(NEXT_BOOT, 4, nullptr, "99887766-4", 0) == ApiReply::WAIT);
+}
+
+void test_long_poll_limit() {
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 9, nullptr, "9", API_LONG_POLL_MAX - 1) == ApiReply::WAIT);
+    TEST_ASSERT_TRUE(decideApiReply(BOOT, 9, nullptr, "9", API_LONG_POLL_MAX) == ApiReply::BUSY);
+}
+
+// A held request returns as soon as the generation moves, or at the timeout
+void test_long_poll_wait() {
+    TEST_ASSERT_TRUE(apiLongPollWaiting(9, 9, 0));
+    TEST_ASSERT_TRUE(apiLongPollWaiting(9, 9, API_LONG_POLL_TIMEOUT - 1));
+    TEST_ASSERT_FALSE(apiLongPollWaiting(9, 9, API_LONG_POLL_TIMEOUT));
+    TEST_ASSERT_FALSE(apiLongPollWaiting(10, 9, 1));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_etag_is_boot_and_generation);
+    RUN_TEST(test_unchanged_state_is_not_modified);
+    RUN_TEST(test_changed_state_is_sent);
+    RUN_TEST(test_if_none_match_across_restart);
+    RUN_TEST(test_no_partial_matches);
+    RUN_TEST(test_etag_lists_weak_tags_and_wildcard);
+    RUN_TEST(test_since_forms);
+    RUN_TEST(test_long_poll_ignores_if_none_match);
+    RUN_TEST(test_long_poll_behind_is_answered_now);
+    RUN_TEST(test_long_poll_across_restart);
+    RUN_TEST(test_long_poll_limit);
+    RUN_TEST(test_long_poll_wait);
+    return UNITY_END();
+}
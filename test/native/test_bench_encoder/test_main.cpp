@@ -0,0 +1,124 @@
+// Cost of turning an event into an MQTT topic and payload, and the bytes it
+// puts on the wire, for the String concatenation the bridge used before and
+// each encodeEvent() encoding. Prints one JSON line per case; compare across
+// commits on the same host.
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <new>
+#include "EventEncoder.h"
+
+#define TOPIC_PREFIX "paradox"
+
+static const int EVENTS = 1000000;
+
+static uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* block = malloc(size ? size : 1);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* block) noexcept { free(block); }
+void operator delete[](void* block) noexcept { free(block); }
+void operator delete(void* block, size_t) noexcept { free(block); }
+void operator delete[](void* block, size_t) noexcept { free(block); }
+
+// Bytes of a QoS 0 PUBLISH: fixed header with its length varint, topic, payload
+static size_t publishPacketSize(size_t topicLength, size_t payloadLength) {
+    size_t remaining = 2 + topicLength + payloadLength;
+    size_t varint = remaining < 128 ? 1 : remaining < 16384 ? 2 : 3;
+    return 1 + varint + remaining;
+}
+
+// A spread of live events: zone, partition and trouble traffic with growing timestamps
+static ParadoxEvent makeEvent(int i) {
+    static const uint8_t EVENTS_SEEN[] = {0, 1, 2, 6, 3, 37, 44, 64};
+    ParadoxEvent event = {};
+    event.event = EVENTS_SEEN[i % sizeof(EVENTS_SEEN)];
+    event.subEvent = (i * 7) % 32;
+    event.partition = 1;
+    event.timestamp = 1000u + (uint32_t)i * 250u;
+    event.sequence = (uint32_t)i + 1;
+    return event;
+}
+
+struct Totals {
+    uint64_t allocs;
+    uint64_t payloadBytes;
+    uint64_t wireBytes;
+    uint32_t failures; // Events that did not encode
+    double seconds;
+};
+
+static void report(const char* name, const Totals& totals) {
+    printf("{\"bench\":\"event_encoder\",\"case\":\"%s\",\"events\":%d,\"ns_per_event\":%.1f,"
+           "\"allocs_per_event\":%.2f,\"payload_bytes\":%.2f,\"wire_bytes\":%.2f}\n",
+           name, EVENTS, totals.seconds * 1e9 / EVENTS, (double)totals.allocs / EVENTS,
+           (double)totals.payloadBytes / EVENTS, (double)totals.wireBytes / EVENTS);
+}
+
+template <typename Encode>
+static Totals measure(Encode encode) {
+    Totals totals = {};
+    uint64_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < EVENTS; i++) {
+        size_t topicLength = 0;
+        size_t payloadLength = encode(makeEvent(i), topicLength);
+        if (payloadLength == 0) {
+            totals.failures++;
+        }
+        totals.payloadBytes += payloadLength;
+        totals.wireBytes += publishPacketSize(topicLength, payloadLength);
+    }
+    totals.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    totals.allocs = allocations - before;
+    return totals;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// What onParadoxEvent did before: event and sub-event as Strings, concatenated
+void test_legacy_string_json() {
+    Totals totals = measure([](const ParadoxEvent& event, size_t& topicLength) -> size_t {
+        String name(event.event);
+        String payload(event.subEvent);
+        String topic = String(TOPIC_PREFIX) + "/events/" + name;
+        String jsonPayload = "{\"value\":\"" + payload + "\"}";
+        topicLength = topic.length();
+        return jsonPayload.length();
+    });
+    report("legacy_string_json", totals);
+    TEST_ASSERT_TRUE(totals.allocs > 0);
+}
+
+static void runEncoding(const char* name, PayloadEncoding encoding, const char* label) {
+    Totals totals = measure([encoding, label](const ParadoxEvent& event, size_t& topicLength) -> size_t {
+        char topic[48];
+        topicLength = snprintf(topic, sizeof(topic), "%s/events/%u", TOPIC_PREFIX, event.event);
+        uint8_t payload[EVENT_PAYLOAD_MAX_SIZE];
+        return encodeEvent(encoding, event, payload, sizeof(payload), label);
+    });
+    report(name, totals);
+    TEST_ASSERT_EQUAL_UINT32(0, totals.failures);
+    TEST_ASSERT_EQUAL_UINT32(0, totals.allocs);
+}
+
+void test_json() { runEncoding("json", PayloadEncoding::JSON, nullptr); }
+void test_json_with_label() { runEncoding("json_label", PayloadEncoding::JSON, "Front door"); }
+void test_binary() { runEncoding("binary", PayloadEncoding::BINARY, nullptr); }
+void test_cbor() { runEncoding("cbor", PayloadEncoding::CBOR, nullptr); }
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_legacy_string_json);
+    RUN_TEST(test_json);
+    RUN_TEST(test_json_with_label);
+    RUN_TEST(test_binary);
+    RUN_TEST(test_cbor);
+    return UNITY_END();
+}
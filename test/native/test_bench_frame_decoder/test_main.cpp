@@ -0,0 +1,68 @@
+// Decoder throughput on a clean stream and on one with line noise between
+// frames. Prints one JSON line per case; compare across commits on the same host.
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "FrameDecoder.h"
+
+static const size_t STREAM_FRAMES = 200000;
+
+static std::vector<uint8_t> buildStream(uint32_t maxNoise) {
+    uint32_t state = 0x9E3779B9;
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    std::vector<uint8_t> stream;
+    uint8_t frame[PARADOX_FRAME_SIZE] = {0xE2, 20, 24, 6, 15, 12, 30};
+    for (size_t n = 0; n < STREAM_FRAMES; n++) {
+        uint32_t noise = maxNoise ? next() % maxNoise : 0;
+        for (uint32_t i = 0; i < noise; i++) {
+            stream.push_back(next());
+        }
+        frame[7] = next() % 51;
+        frame[8] = next();
+        frame[9] = 1;
+        uint8_t sum = 0;
+        for (int i = 0; i < PARADOX_FRAME_SIZE - 1; i++) {
+            sum += frame[i];
+        }
+        frame[PARADOX_FRAME_SIZE - 1] = sum;
+        stream.insert(stream.end(), frame, frame + PARADOX_FRAME_SIZE);
+    }
+    return stream;
+}
+
+static void run(const char* name, uint32_t maxNoise) {
+    std::vector<uint8_t> stream = buildStream(maxNoise);
+    FrameDecoder decoder;
+    uint32_t frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint8_t value : stream) {
+        if (decoder.push(value)) frames++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("{\"bench\":\"frame_decoder\",\"case\":\"%s\",\"bytes\":%zu,\"frames\":%u,"
+           "\"mb_per_sec\":%.1f,\"ns_per_byte\":%.2f,\"resyncs\":%u}\n",
+           name, stream.size(), frames, stream.size() / seconds / 1e6,
+           seconds * 1e9 / stream.size(), decoder.getResyncs());
+    TEST_ASSERT_EQUAL_UINT32(STREAM_FRAMES, frames);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_clean_stream() { run("clean", 0); }
+void test_noisy_stream() { run("noise_0_39", 40); }
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_stream);
+    RUN_TEST(test_noisy_stream);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+// Cost of storing a log line for /logs and of reading the page back, for the
+// String-per-line store the bridge used before and the character ring it uses
+// now. Prints one JSON line per case; compare across commits on the same host.
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <new>
+#include "Logger.h"
+
+static const int LINES = 200000;
+static const int PAGES = 200;
+
+static uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* block = malloc(size ? size : 1);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* block) noexcept { free(block); }
+void operator delete[](void* block) noexcept { free(block); }
+void operator delete(void* block, size_t) noexcept { free(block); }
+void operator delete[](void* block, size_t) noexcept { free(block); }
+
+// The store as it was: one heap String per line, stamp built by concatenation
+class LegacyLogger {
+public:
+    static const int LOG_BUFFER_SIZE = 500;
+
+    void add(unsigned long timestamp, const char* line) {
+        String stamp = "[" + String(timestamp) + "] ";
+        _log_lines[_current_line] = stamp + line;
+        _current_line++;
+        if (_current_line >= LOG_BUFFER_SIZE) {
+            _current_line = 0;
+            _buffer_full = true;
+        }
+    }
+
+    // What /logs did per line, newest first
+    size_t readPage() const {
+        size_t bytes = 0;
+        int count = _buffer_full ? LOG_BUFFER_SIZE : _current_line;
+        for (int i = 0; i < count; i++) {
+            int index = _current_line - 1 - i;
+            if (index < 0) {
+                index += LOG_BUFFER_SIZE;
+            }
+            String line = _log_lines[index] + "\n";
+            bytes += line.length();
+        }
+        return bytes;
+    }
+
+private:
+    String _log_lines[LOG_BUFFER_SIZE];
+    int _current_line = 0;
+    bool _buffer_full = false;
+};
+
+static const char* const SAMPLE_LINES[] = {
+    "[Paradox] Event: Zone open, zone 5, partition 1\n",
+    "[MQTT] Published paradox/events (142 bytes)\n",
+    "[WiFi] RSSI -61 dBm\n",
+    "[Log] 3 lines dropped, queue full.\n",
+    "[Paradox] Status request 2 answered in 38 ms\n",
+};
+static const size_t SAMPLE_COUNT = sizeof(SAMPLE_LINES) / sizeof(SAMPLE_LINES[0]);
+
+static void report(const char* name, const char* op, uint64_t count, double seconds, uint64_t allocs, size_t bytes) {
+    printf("{\"bench\":\"logger\",\"case\":\"%s\",\"op\":\"%s\",\"count\":%llu,\"ns_per_op\":%.1f,"
+           "\"allocs_per_op\":%.2f,\"bytes\":%zu}\n",
+           name, op, (unsigned long long)count, seconds * 1e9 / count, (double)allocs / count, bytes);
+}
+
+template <typename Body>
+static double timed(uint64_t& allocs, Body body) {
+    uint64_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    body();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    allocs = allocations - before;
+    return seconds;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_legacy_string_lines() {
+    LegacyLogger* logger = new LegacyLogger();
+    uint64_t allocs;
+    double seconds = timed(allocs, [logger]() {
+        for (int i = 0; i < LINES; i++) {
+            logger->add(1000000UL + i, SAMPLE_LINES[i % SAMPLE_COUNT]);
+        }
+    });
+    report("legacy_string", "add", LINES, seconds, allocs, 0);
+    TEST_ASSERT_TRUE(allocs > 0);
+
+    size_t bytes = 0;
+    seconds = timed(allocs, [logger, &bytes]() {
+        for (int i = 0; i < PAGES; i++) {
+            bytes = logger->readPage();
+        }
+    });
+    report("legacy_string", "read_page", PAGES, seconds, allocs, bytes);
+    delete logger;
+}
+
+void test_char_ring() {
+    Logger& logger = Logger::getInstance();
+    uint64_t allocs;
+    double seconds = timed(allocs, [&logger]() {
+        for (int i = 0; i < LINES; i++) {
+            logger.add(1000000UL + i, SAMPLE_LINES[i % SAMPLE_COUNT]);
+        }
+    });
+    report("char_ring", "add", LINES, seconds, allocs, 0);
+    TEST_ASSERT_EQUAL_UINT32(0, allocs);
+
+    size_t bytes = 0;
+    seconds = timed(allocs, [&logger, &bytes]() {
+        char line[256];
+        for (int i = 0; i < PAGES; i++) {
+            bytes = 0;
+            uint32_t cursor = logger.getEnd();
+            size_t len;
+            while ((len = logger.readLineBefore(cursor, line, sizeof(line))) > 0) {
+                bytes += len;
+            }
+        }
+    });
+    report("char_ring", "read_page", PAGES, seconds, allocs, bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, allocs);
+    TEST_ASSERT_TRUE(bytes > LOG_HISTORY_SIZE / 2);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_legacy_string_lines);
+    RUN_TEST(test_char_ring);
+    return UNITY_END();
+}
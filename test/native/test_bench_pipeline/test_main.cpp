@@ -0,0 +1,194 @@
+// The panel-to-broker path on the host: serial bytes through FrameDecoder,
+// the description onParadoxEvent logs, EventJournal, encodeEvent() and a
+// PUBLISH packet written into an in-process broker buffer. Prints one JSON
+// line per encoding with events/s, per-event latency percentiles,
+// allocations per event and peak memory; compare across commits on the
+// same host.
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <vector>
+#include <sys/resource.h>
+#include "FrameDecoder.h"
+#include "EventJournal.h"
+#include "EventEncoder.h"
+
+static const size_t EVENTS = 200000;
+
+// Every operator new is counted and sized, so live and peak heap are exact
+// for C++ allocations; malloc from C code is not seen
+static uint64_t allocations = 0;
+static size_t liveBytes = 0;
+static size_t peakBytes = 0;
+
+static const size_t HEADER = 16;
+
+void* operator new(size_t size) {
+    uint8_t* block = static_cast<uint8_t*>(malloc(size + HEADER));
+    if (!block) throw std::bad_alloc();
+    memcpy(block, &size, sizeof(size));
+    allocations++;
+    liveBytes += size;
+    peakBytes = std::max(peakBytes, liveBytes);
+    return block + HEADER;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* pointer) noexcept {
+    if (!pointer) return;
+    uint8_t* block = static_cast<uint8_t*>(pointer) - HEADER;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    liveBytes -= size;
+    free(block);
+}
+void operator delete[](void* pointer) noexcept { operator delete(pointer); }
+void operator delete(void* pointer, size_t) noexcept { operator delete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { operator delete(pointer); }
+
+// Stands in for the broker socket: keeps the last packets written, like a send buffer
+class BrokerSink {
+public:
+    void publish(const char* topic, const uint8_t* payload, size_t length) {
+        size_t topicLength = strlen(topic);
+        size_t remaining = 2 + topicLength + length;
+        uint8_t header[5] = {0x30};
+        size_t headerLength = 1;
+        do {
+            uint8_t digit = remaining % 128;
+            remaining /= 128;
+            header[headerLength++] = digit | (remaining ? 0x80 : 0);
+        } while (remaining);
+        write(header, headerLength);
+        uint8_t topicSize[2] = {(uint8_t)(topicLength >> 8), (uint8_t)topicLength};
+        write(topicSize, 2);
+        write(reinterpret_cast<const uint8_t*>(topic), topicLength);
+        write(payload, length);
+        packets++;
+    }
+
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+
+private:
+    uint8_t _buffer[4096];
+    size_t _used = 0;
+
+    void write(const uint8_t* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            _buffer[_used] = data[i];
+            _used = (_used + 1) % sizeof(_buffer);
+        }
+        bytes += length;
+    }
+};
+
+// Live event frames as the panel sends them, back to back
+static std::vector<uint8_t> buildStream() {
+    static const uint8_t EVENTS_SEEN[] = {0, 1, 2, 6, 3, 37, 44, 64};
+    std::vector<uint8_t> stream;
+    stream.reserve(EVENTS * PARADOX_FRAME_SIZE);
+    uint8_t frame[PARADOX_FRAME_SIZE] = {0xE2, 20, 24, 6, 15, 12, 30};
+    for (size_t n = 0; n < EVENTS; n++) {
+        frame[7] = EVENTS_SEEN[n % sizeof(EVENTS_SEEN)];
+        frame[8] = (n * 7) % 32;
+        frame[9] = 1;
+        uint8_t sum = 0;
+        for (int i = 0; i < PARADOX_FRAME_SIZE - 1; i++) {
+            sum += frame[i];
+        }
+        frame[PARADOX_FRAME_SIZE - 1] = sum;
+        stream.insert(stream.end(), frame, frame + PARADOX_FRAME_SIZE);
+    }
+    return stream;
+}
+
+// Kept across cases like the firmware's globals; the journal carries on its sequence
+static FrameDecoder decoder;
+static EventJournal journal;
+
+static void run(const char* name, PayloadEncoding encoding) {
+    std::vector<uint8_t> stream = buildStream();
+    std::vector<uint32_t> latencyNs;
+    latencyNs.reserve(EVENTS);
+
+    BrokerSink broker;
+    journal.setup();
+    uint32_t cursor = journal.getLastSequence();
+    size_t logBytes = 0;
+
+    uint64_t allocsBefore = allocations;
+    size_t baseBytes = liveBytes;
+    peakBytes = liveBytes;
+    auto start = std::chrono::steady_clock::now();
+    for (uint8_t value : stream) {
+        if (!decoder.push(value)) {
+            continue;
+        }
+        auto decoded = std::chrono::steady_clock::now();
+        const uint8_t* frame = decoder.frame();
+        ParadoxEvent event = {};
+        event.event = frame[7];
+        event.subEvent = frame[8];
+        event.partition = frame[9];
+        event.panel = 1;
+        event.timestamp = millis();
+
+        // onParadoxEvent describes every event for the log before journaling it
+        char description[EVENT_DESCRIPTION_SIZE];
+        getEventDescription(event.event, event.subEvent, description, sizeof(description));
+        char line[128];
+        logBytes += snprintf(line, sizeof(line), "[Paradox] Event: %s\n", description);
+        journal.record(event);
+
+        journal.replay(cursor + 1, journal.getLastSequence(), [&](const ParadoxEvent& pending) {
+            char topic[48];
+            snprintf(topic, sizeof(topic), "paradox/events/%u", pending.event);
+            uint8_t payload[EVENT_PAYLOAD_MAX_SIZE];
+            size_t length = encodeEvent(encoding, pending, payload, sizeof(payload));
+            if (length > 0) {
+                broker.publish(topic, payload, length);
+                cursor = pending.sequence;
+            }
+        });
+        latencyNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - decoded).count());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocs = allocations - allocsBefore;
+    size_t peakHeap = peakBytes - baseBytes;
+
+    std::sort(latencyNs.begin(), latencyNs.end());
+    size_t count = latencyNs.size();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("{\"bench\":\"pipeline\",\"case\":\"%s\",\"events\":%zu,\"events_per_sec\":%.0f,"
+           "\"latency_ns\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u},"
+           "\"allocs_per_event\":%.2f,\"peak_heap_bytes\":%zu,\"peak_rss_kb\":%ld,"
+           "\"wire_bytes_per_event\":%.2f,\"log_bytes_per_event\":%.2f}\n",
+           name, count, count / seconds,
+           latencyNs[count * 50 / 100], latencyNs[count * 90 / 100], latencyNs[count * 99 / 100], latencyNs[count - 1],
+           (double)allocs / count, peakHeap, usage.ru_maxrss,
+           (double)broker.bytes / count, (double)logBytes / count);
+
+    TEST_ASSERT_EQUAL_UINT32(EVENTS, count);
+    TEST_ASSERT_EQUAL_UINT32(EVENTS, broker.packets);
+    // Events are described, journaled and encoded in fixed buffers only
+    TEST_ASSERT_TRUE_MESSAGE(allocs == 0, "event path allocated from the heap");
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_json() { run("json", PayloadEncoding::JSON); }
+void test_binary() { run("binary", PayloadEncoding::BINARY); }
+void test_cbor() { run("cbor", PayloadEncoding::CBOR); }
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_json);
+    RUN_TEST(test_binary);
+    RUN_TEST(test_cbor);
+    return UNITY_END();
+}
@@ -0,0 +1,179 @@
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "FrameDecoder.h"
+
+static FrameDecoder decoder;
+static uint32_t rngState;
+
+// Deterministic, so a failure replays the same stream
+static uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static void seal(uint8_t* frame) {
+    uint8_t sum = 0;
+    for (int i = 0; i < PARADOX_FRAME_SIZE - 1; i++) {
+        sum += frame[i];
+    }
+    frame[PARADOX_FRAME_SIZE - 1] = sum;
+}
+
+// A live event frame as the panel sends it, with noise in the unused bytes
+static void makeEvent(uint8_t* frame, uint8_t event, uint8_t subEvent, uint8_t partition) {
+    frame[0] = 0xE2;
+    frame[1] = 20;
+    frame[2] = nextRandom() % 100;
+    frame[3] = 1 + nextRandom() % 12;
+    frame[4] = 1 + nextRandom() % 31;
+    frame[5] = nextRandom() % 24;
+    frame[6] = nextRandom() % 60;
+    frame[7] = event;
+    frame[8] = subEvent;
+    frame[9] = partition;
+    for (int i = 10; i < PARADOX_FRAME_SIZE - 1; i++) {
+        frame[i] = nextRandom();
+    }
+    seal(frame);
+}
+
+static void makeReply(uint8_t* frame, uint8_t start) {
+    memset(frame, 0, PARADOX_FRAME_SIZE);
+    frame[0] = start;
+    seal(frame);
+}
+
+static int pushAll(const uint8_t* data, size_t len) {
+    int frames = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (decoder.push(data[i])) frames++;
+    }
+    return frames;
+}
+
+void setUp(void) {
+    decoder = FrameDecoder();
+    rngState = 0x2545F491;
+}
+
+void tearDown(void) {}
+
+void test_back_to_back_frames() {
+    uint8_t frame[PARADOX_FRAME_SIZE];
+    for (int i = 0; i < 100; i++) {
+        makeEvent(frame, i % 51, i, 1);
+        for (int j = 0; j < PARADOX_FRAME_SIZE - 1; j++) {
+            TEST_ASSERT_FALSE(decoder.push(frame[j]));
+        }
+        TEST_ASSERT_TRUE(decoder.push(frame[PARADOX_FRAME_SIZE - 1]));
+        TEST_ASSERT_EQUAL_MEMORY(frame, decoder.frame(), PARADOX_FRAME_SIZE);
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, decoder.getFramesDecoded());
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getResyncs());
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getBytesDiscarded());
+}
+
+void test_bad_checksum_resyncs_on_next_frame() {
+    uint8_t bad[PARADOX_FRAME_SIZE];
+    uint8_t good[PARADOX_FRAME_SIZE];
+    makeEvent(bad, 1, 5, 1);
+    bad[20] ^= 0x04;
+    makeEvent(good, 0, 5, 1);
+
+    TEST_ASSERT_EQUAL_INT(0, pushAll(bad, sizeof(bad)));
+    TEST_ASSERT_EQUAL_INT(1, pushAll(good, sizeof(good)));
+    TEST_ASSERT_EQUAL_MEMORY(good, decoder.frame(), PARADOX_FRAME_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getResyncs());
+    TEST_ASSERT_EQUAL_UINT32(PARADOX_FRAME_SIZE, decoder.getBytesDiscarded());
+}
+
+void test_event_with_impossible_date_is_rejected() {
+    uint8_t frame[PARADOX_FRAME_SIZE];
+    makeEvent(frame, 2, 12, 1);
+    frame[3] = 13; // Month
+    seal(frame);
+    TEST_ASSERT_EQUAL_INT(0, pushAll(frame, sizeof(frame)));
+
+    makeEvent(frame, PARADOX_MAX_EVENT_GROUP + 1, 0, 1);
+    TEST_ASSERT_EQUAL_INT(0, pushAll(frame, sizeof(frame)));
+}
+
+void test_replies_only_while_expected() {
+    uint8_t frame[PARADOX_FRAME_SIZE];
+    makeReply(frame, 0x51);
+    TEST_ASSERT_EQUAL_INT(0, pushAll(frame, sizeof(frame)));
+
+    decoder.reset();
+    decoder.setRepliesExpected(true);
+    const uint8_t starts[] = {0x10, 0x41, 0x51, 0x52};
+    for (uint8_t start : starts) {
+        makeReply(frame, start);
+        TEST_ASSERT_EQUAL_INT(1, pushAll(frame, sizeof(frame)));
+        TEST_ASSERT_EQUAL_UINT8(start, decoder.frame()[0]);
+    }
+}
+
+void test_disconnect_accepted_any_time() {
+    uint8_t frame[PARADOX_FRAME_SIZE];
+    makeReply(frame, 0x70);
+    TEST_ASSERT_EQUAL_INT(1, pushAll(frame, sizeof(frame)));
+
+    // Only padding follows the reason code
+    frame[2] = 0x01;
+    frame[10] = 0x33;
+    seal(frame);
+    TEST_ASSERT_EQUAL_INT(0, pushAll(frame, sizeof(frame)));
+}
+
+// 10000 frames, each after 0-39 bytes of line noise: every frame comes out
+// exactly once and the noise never yields a frame of its own
+void test_recovers_every_frame_from_noise() {
+    std::vector<uint8_t> stream;
+    std::vector<std::vector<uint8_t>> sent;
+    for (int n = 0; n < 10000; n++) {
+        uint32_t noise = nextRandom() % 40;
+        for (uint32_t i = 0; i < noise; i++) {
+            stream.push_back(nextRandom());
+        }
+        std::vector<uint8_t> frame(PARADOX_FRAME_SIZE);
+        makeEvent(frame.data(), nextRandom() % 51, nextRandom(), 1 + nextRandom() % 2);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+        sent.push_back(frame);
+    }
+
+    size_t next = 0;
+    uint32_t bogus = 0;
+    for (uint8_t value : stream) {
+        if (!decoder.push(value)) continue;
+        if (next < sent.size() && memcmp(decoder.frame(), sent[next].data(), PARADOX_FRAME_SIZE) == 0) {
+            next++;
+        } else {
+            bogus++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, bogus);
+    TEST_ASSERT_EQUAL_size_t(sent.size(), next);
+}
+
+// Pure noise never decodes while no reply is expected
+void test_noise_alone_yields_nothing() {
+    for (int i = 0; i < 1000000; i++) {
+        TEST_ASSERT_FALSE(decoder.push(nextRandom()));
+    }
+    TEST_ASSERT_LESS_THAN(PARADOX_FRAME_SIZE, decoder.size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_back_to_back_frames);
+    RUN_TEST(test_bad_checksum_resyncs_on_next_frame);
+    RUN_TEST(test_event_with_impossible_date_is_rejected);
+    RUN_TEST(test_replies_only_while_expected);
+    RUN_TEST(test_disconnect_accepted_any_time);
+    RUN_TEST(test_recovers_every_frame_from_noise);
+    RUN_TEST(test_noise_alone_yields_nothing);
+    return UNITY_END();
+}
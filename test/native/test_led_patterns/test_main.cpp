@@ -0,0 +1,144 @@
+#include <unity.h>
+#include "LedHandler.h"
+#include "ParadoxEvents.h"
+
+#define LED_PIN 2
+
+void setUp(void) {
+    hostResetTimers();
+}
+
+void tearDown(void) {}
+
+// Level a pattern drives at t ms after it started, found by walking its steps
+static bool patternLevel(const LedPattern& pattern, unsigned long t) {
+    if (pattern.stepCount == 0) {
+        return pattern.level;
+    }
+    unsigned long period = 0;
+    for (uint8_t i = 0; i < pattern.stepCount; i++) {
+        period += pattern.steps[i];
+    }
+    t %= period;
+    for (uint8_t i = 0; i < pattern.stepCount; i++) {
+        if (t < pattern.steps[i]) {
+            return i % 2 == 0;
+        }
+        t -= pattern.steps[i];
+    }
+    return false;
+}
+
+// The pin at every ms follows the pattern, inverted while a flicker is showing
+static void checkUnderFlickers(LedMode mode, unsigned long interval, unsigned long total) {
+    hostResetTimers();
+    LedHandler led(LED_PIN);
+    led.setup();
+    const LedPattern& pattern = getLedPattern(mode);
+    unsigned long start = millis();
+    led.setMode(mode);
+
+    unsigned long flickerStart = 0;
+    bool flickerShown = false;
+    for (unsigned long t = 0; t < total; t++) {
+        if (t > 0) {
+            hostAdvanceTime(1000);
+        }
+        if (interval && t % interval == 0) {
+            led.setMode(LedMode::FLICKER);
+            if (!flickerShown || t - flickerStart >= FLICKER_DURATION) {
+                flickerStart = t;
+                flickerShown = true;
+            }
+        }
+        bool flickering = flickerShown && t - flickerStart < FLICKER_DURATION;
+        bool expected = patternLevel(pattern, millis() - start) != flickering;
+        if (hostPinLevels()[LED_PIN] != (expected ? HIGH : LOW)) {
+            char message[64];
+            snprintf(message, sizeof(message), "pin wrong at t=%lu ms", t);
+            TEST_FAIL_MESSAGE(message);
+        }
+    }
+}
+
+void test_patterns_keep_their_timing() {
+    checkUnderFlickers(LedMode::BLINK_SLOW, 0, 5000);
+    checkUnderFlickers(LedMode::ALARM, 0, 5000);
+    checkUnderFlickers(LedMode::PANEL_LINK_DOWN, 0, 5000);
+}
+
+// A steady event stream must not hold the pattern at its first step
+void test_pattern_advances_under_steady_flickers() {
+    checkUnderFlickers(LedMode::BLINK_SLOW, 20, 10000);
+    checkUnderFlickers(LedMode::BLINK_FAST, 20, 10000);
+    checkUnderFlickers(LedMode::ALARM, 20, 10000);
+}
+
+void test_single_flicker_inverts_briefly() {
+    checkUnderFlickers(LedMode::ON, 1000, 5000);
+    checkUnderFlickers(LedMode::OFF, 1000, 5000);
+}
+
+void test_mode_change_cancels_flicker() {
+    LedHandler led(LED_PIN);
+    led.setup();
+    led.setMode(LedMode::OFF);
+    led.setMode(LedMode::FLICKER);
+    TEST_ASSERT_EQUAL(HIGH, hostPinLevels()[LED_PIN]);
+    led.setMode(LedMode::ON);
+    TEST_ASSERT_EQUAL(HIGH, hostPinLevels()[LED_PIN]);
+    hostAdvanceTime(FLICKER_DURATION * 2000ULL);
+    TEST_ASSERT_EQUAL(HIGH, hostPinLevels()[LED_PIN]);
+    TEST_ASSERT_TRUE(led.getMode() == LedMode::ON);
+}
+
+// Feeds events through the same alarm tracking onParadoxEvent does and
+// returns the mode a healthy, connected bridge would show
+static LedMode modeAfter(const uint8_t (*events)[2], size_t count) {
+    LedStatus status;
+    status.wifiConnected = true;
+    status.mqttConnected = true;
+    for (size_t i = 0; i < count; i++) {
+        AlarmChange change = getAlarmChange(events[i][0], events[i][1]);
+        if (change != AlarmChange::NONE) {
+            status.alarmActive = change == AlarmChange::RAISED;
+        }
+    }
+    return selectLedMode(status);
+}
+
+// ParadoxHandler reports Armed Stay and Armed Sleep as 2/3 and 2/4
+void test_stay_and_sleep_arm_are_not_alarms() {
+    const uint8_t stay[][2] = {{2, 14}, {2, 3}};
+    const uint8_t sleep[][2] = {{2, 14}, {2, 4}};
+    const uint8_t away[][2] = {{2, 14}, {2, 12}};
+    TEST_ASSERT_TRUE(modeAfter(stay, 2) == LedMode::ON);
+    TEST_ASSERT_TRUE(modeAfter(sleep, 2) == LedMode::ON);
+    TEST_ASSERT_TRUE(modeAfter(away, 2) == LedMode::ON);
+}
+
+void test_alarms_raise_and_clear() {
+    const uint8_t alarms[][2] = {{2, 2}, {2, 5}, {2, 6}, {36, 4}, {37, 1}};
+    for (const uint8_t* alarm : alarms) {
+        const uint8_t raised[][2] = {{2, 3}, {alarm[0], alarm[1]}};
+        TEST_ASSERT_TRUE(modeAfter(raised, 2) == LedMode::ALARM);
+        const uint8_t stopped[][2] = {{alarm[0], alarm[1]}, {2, 7}};
+        TEST_ASSERT_TRUE(modeAfter(stopped, 2) == LedMode::ON);
+        const uint8_t disarmed[][2] = {{alarm[0], alarm[1]}, {2, 4}, {2, 11}};
+        TEST_ASSERT_TRUE(modeAfter(disarmed, 3) == LedMode::ON);
+    }
+    // Arming again while the alarm shows leaves it showing until cleared
+    const uint8_t rearmed[][2] = {{36, 4}, {2, 3}};
+    TEST_ASSERT_TRUE(modeAfter(rearmed, 2) == LedMode::ALARM);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_patterns_keep_their_timing);
+    RUN_TEST(test_pattern_advances_under_steady_flickers);
+    RUN_TEST(test_single_flicker_inverts_briefly);
+    RUN_TEST(test_mode_change_cancels_flicker);
+    RUN_TEST(test_stay_and_sleep_arm_are_not_alarms);
+    RUN_TEST(test_alarms_raise_and_clear);
+    return UNITY_END();
+}
@@ -0,0 +1,99 @@
+#include <unity.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "LogFormat.h"
+
+static LogRecord record;
+static char line[256];
+
+static void capture(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    record.fmt = fmt;
+    captureLogArgs(record, fmt, args);
+    va_end(args);
+    formatLogRecord(record, line, sizeof(line));
+}
+
+// Places text so that its last byte is the last readable one: reading past
+// it faults instead of quietly picking up whatever follows
+static char* atPageEnd(const char* text, size_t length) {
+    static uint8_t* pages = nullptr;
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (!pages) {
+        pages = (uint8_t*)mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        mprotect(pages + page, page, PROT_NONE);
+    }
+    char* start = (char*)pages + page - length;
+    memcpy(start, text, length);
+    return start;
+}
+
+void setUp(void) {
+    memset(&record, 0, sizeof(record));
+    line[0] = '\0';
+}
+
+void tearDown(void) {}
+
+void test_plain_arguments() {
+    capture("[Test] %d %u %ld %s %c %x\n", -5, 7u, 123456L, "text", 'c', 0xBEEF);
+    TEST_ASSERT_EQUAL_STRING("[Test] -5 7 123456 text c beef\n", line);
+    TEST_ASSERT_FALSE(record.truncated);
+}
+
+// MQTT payloads are logged straight from PubSubClient's buffer, which has no terminator
+void test_star_precision_bounds_unterminated_string() {
+    const char payload[] = {'{', '"', 'a', '"', ':', '1', '}'};
+    char* text = atPageEnd(payload, sizeof(payload));
+    capture("[MQTT] %s: %.*s\n", "paradox/cmd", (int)sizeof(payload), text);
+    TEST_ASSERT_EQUAL_STRING("[MQTT] paradox/cmd: {\"a\":1}\n", line);
+    // Topic and terminator, the precision, then the payload and terminator
+    TEST_ASSERT_EQUAL_UINT32(strlen("paradox/cmd") + 1 + sizeof(int) + sizeof(payload) + 1, record.argLength);
+}
+
+void test_shorter_star_precision_cuts_string() {
+    char* text = atPageEnd("abcdef", 6);
+    capture("<%.*s>", 3, text);
+    TEST_ASSERT_EQUAL_STRING("<abc>", line);
+}
+
+void test_width_and_precision_stars() {
+    char* text = atPageEnd("abcdef", 6);
+    capture("<%*.*s>", 5, 2, text);
+    TEST_ASSERT_EQUAL_STRING("<   ab>", line);
+}
+
+// A width star alone gives no bound; the string must be terminated as usual
+void test_width_star_alone() {
+    capture("<%*s>", 4, "ab");
+    TEST_ASSERT_EQUAL_STRING("<  ab>", line);
+}
+
+void test_fixed_precision_bounds_unterminated_string() {
+    char* text = atPageEnd("xyz", 3);
+    capture("<%.3s>", text);
+    TEST_ASSERT_EQUAL_STRING("<xyz>", line);
+}
+
+void test_long_string_is_truncated() {
+    char text[200];
+    memset(text, 'a', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    capture("%s", text);
+    TEST_ASSERT_TRUE(record.truncated);
+    TEST_ASSERT_EQUAL_UINT32(LOG_RECORD_ARG_BYTES, record.argLength);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_plain_arguments);
+    RUN_TEST(test_star_precision_bounds_unterminated_string);
+    RUN_TEST(test_shorter_star_precision_cuts_string);
+    RUN_TEST(test_width_and_precision_stars);
+    RUN_TEST(test_width_star_alone);
+    RUN_TEST(test_fixed_precision_bounds_unterminated_string);
+    RUN_TEST(test_long_string_is_truncated);
+    return UNITY_END();
+}
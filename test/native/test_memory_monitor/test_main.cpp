@@ -0,0 +1,151 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "MemoryMonitor.h"
+
+// The native env wraps malloc, calloc and realloc the same way the device
+// build does, so these calls land in MemoryMonitor's counters. They go
+// through pointers because the compiler assumes the C library versions read
+// no program state, and would move the task switches below past them.
+static void* (*volatile hostMalloc)(size_t) = malloc;
+static void* (*volatile hostCalloc)(size_t, size_t) = calloc;
+static void* (*volatile hostRealloc)(void*, size_t) = realloc;
+
+static TaskHandle_t const LOOP_TASK = reinterpret_cast<TaskHandle_t>(1);
+static TaskHandle_t const WEB_TASK = reinterpret_cast<TaskHandle_t>(2);
+
+static MemoryMonitor monitor;
+static AllocCounter before[(size_t)AllocTag::COUNT];
+
+static void snapshot() {
+    for (size_t i = 0; i < (size_t)AllocTag::COUNT; i++) {
+        before[i] = MemoryMonitor::getAllocations((AllocTag)i);
+    }
+}
+
+static uint32_t countSince(AllocTag tag) {
+    return MemoryMonitor::getAllocations(tag).count - before[(size_t)tag].count;
+}
+
+static uint32_t bytesSince(AllocTag tag) {
+    return MemoryMonitor::getAllocations(tag).bytes - before[(size_t)tag].bytes;
+}
+
+static void allocate(size_t size) {
+    free(hostMalloc(size));
+}
+
+void setUp(void) {
+    hostCurrentTask() = LOOP_TASK;
+    snapshot();
+}
+
+void tearDown(void) {}
+
+void test_before_setup_everything_is_other_tasks() {
+    {
+        AllocScope scope(AllocTag::EVENTS);
+        allocate(3);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, countSince(AllocTag::OTHER_TASKS));
+    TEST_ASSERT_EQUAL_UINT32(0, countSince(AllocTag::EVENTS));
+}
+
+void test_setup_tracks_calling_task() {
+    monitor.setup();
+    allocate(12);
+    TEST_ASSERT_EQUAL_UINT32(1, countSince(AllocTag::UNTAGGED));
+    TEST_ASSERT_EQUAL_UINT32(0, countSince(AllocTag::OTHER_TASKS));
+}
+
+void test_untagged_outside_any_scope() {
+    allocate(24);
+    TEST_ASSERT_EQUAL_UINT32(1, countSince(AllocTag::UNTAGGED));
+    TEST_ASSERT_EQUAL_UINT32(24, bytesSince(AllocTag::UNTAGGED));
+}
+
+void test_scope_tags_loop_allocations() {
+    {
+        AllocScope scope(AllocTag::EVENTS);
+        allocate(32);
+        allocate(16);
+    }
+    allocate(8);
+    TEST_ASSERT_EQUAL_UINT32(2, countSince(AllocTag::EVENTS));
+    TEST_ASSERT_EQUAL_UINT32(48, bytesSince(AllocTag::EVENTS));
+    TEST_ASSERT_EQUAL_UINT32(1, countSince(AllocTag::UNTAGGED));
+}
+
+void test_nested_scopes_restore_outer_tag() {
+    {
+        AllocScope events(AllocTag::EVENTS);
+        allocate(10);
+        {
+            AllocScope mqtt(AllocTag::MQTT);
+            allocate(20);
+            {
+                AllocScope panel(AllocTag::PANEL);
+                allocate(30);
+            }
+            allocate(40);
+        }
+        allocate(50);
+    }
+    allocate(60);
+    TEST_ASSERT_EQUAL_UINT32(60, bytesSince(AllocTag::EVENTS));
+    TEST_ASSERT_EQUAL_UINT32(60, bytesSince(AllocTag::MQTT));
+    TEST_ASSERT_EQUAL_UINT32(30, bytesSince(AllocTag::PANEL));
+    TEST_ASSERT_EQUAL_UINT32(60, bytesSince(AllocTag::UNTAGGED));
+}
+
+// Another task allocating while the loop is inside a scope is not charged to that scope
+void test_other_tasks_never_take_loop_tag() {
+    AllocScope scope(AllocTag::MQTT);
+    hostCurrentTask() = WEB_TASK;
+    allocate(100);
+    hostCurrentTask() = LOOP_TASK;
+    allocate(5);
+    TEST_ASSERT_EQUAL_UINT32(1, countSince(AllocTag::OTHER_TASKS));
+    TEST_ASSERT_EQUAL_UINT32(100, bytesSince(AllocTag::OTHER_TASKS));
+    TEST_ASSERT_EQUAL_UINT32(5, bytesSince(AllocTag::MQTT));
+}
+
+// A scope opened on another task must not change the loop's tag, on entry or exit
+void test_scope_on_other_task_is_inert() {
+    hostCurrentTask() = WEB_TASK;
+    {
+        AllocScope scope(AllocTag::LOGGER);
+        allocate(7);
+        hostCurrentTask() = LOOP_TASK;
+        allocate(9);
+        hostCurrentTask() = WEB_TASK;
+    }
+    hostCurrentTask() = LOOP_TASK;
+    allocate(11);
+    TEST_ASSERT_EQUAL_UINT32(0, countSince(AllocTag::LOGGER));
+    TEST_ASSERT_EQUAL_UINT32(7, bytesSince(AllocTag::OTHER_TASKS));
+    TEST_ASSERT_EQUAL_UINT32(20, bytesSince(AllocTag::UNTAGGED));
+}
+
+void test_calloc_and_realloc_counted() {
+    AllocScope scope(AllocTag::PANEL);
+    free(hostCalloc(4, 25));
+    void* block = hostMalloc(10);
+    block = hostRealloc(block, 50);
+    free(block);
+    TEST_ASSERT_EQUAL_UINT32(3, countSince(AllocTag::PANEL));
+    TEST_ASSERT_EQUAL_UINT32(160, bytesSince(AllocTag::PANEL));
+}
+
+int main() {
+    UNITY_BEGIN();
+    // Runs first: setup() has not picked the loop task yet
+    RUN_TEST(test_before_setup_everything_is_other_tasks);
+    RUN_TEST(test_setup_tracks_calling_task);
+    RUN_TEST(test_untagged_outside_any_scope);
+    RUN_TEST(test_scope_tags_loop_allocations);
+    RUN_TEST(test_nested_scopes_restore_outer_tag);
+    RUN_TEST(test_other_tasks_never_take_loop_tag);
+    RUN_TEST(test_scope_on_other_task_is_inert);
+    RUN_TEST(test_calloc_and_realloc_counted);
+    return UNITY_END();
+}
@@ -0,0 +1,81 @@
+#include <unity.h>
+#include "RuleEngine.h"
+
+#define LED_PIN 2
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// A rules image holding one GPIO rule per pin, all firing on zone 5 opening
+static size_t buildImage(uint8_t* out, const uint8_t* pins, uint8_t count) {
+    RuleFileHeader header = {RULES_FILE_MAGIC, RULES_FILE_VERSION, count, 0};
+    memcpy(out, &header, sizeof(header));
+    for (uint8_t i = 0; i < count; i++) {
+        RuleRecord rule;
+        memset(&rule, 0, sizeof(rule));
+        rule.event = 1;
+        rule.subEventMin = 5;
+        rule.subEventMax = 5;
+        rule.action = RuleAction::GPIO;
+        rule.arg0 = pins[i];
+        rule.arg1 = 1;
+        memcpy(out + sizeof(header) + i * sizeof(rule), &rule, sizeof(rule));
+    }
+    return sizeof(header) + count * sizeof(RuleRecord);
+}
+
+static ParadoxEvent zoneOpened(uint8_t zone) {
+    ParadoxEvent event;
+    memset(&event, 0, sizeof(event));
+    event.panel = 1;
+    event.partition = 1;
+    event.event = 1;
+    event.subEvent = zone;
+    return event;
+}
+
+void test_free_output_pins_load_and_fire(void) {
+    RuleEngine engine;
+    engine.reservePin(LED_PIN);
+    uint8_t image[sizeof(RuleFileHeader) + 2 * sizeof(RuleRecord)];
+    const uint8_t pins[] = {4, 33};
+    TEST_ASSERT_TRUE(engine.loadFromBuffer(image, buildImage(image, pins, 2)));
+    TEST_ASSERT_EQUAL(2, engine.getRuleCount());
+
+    uint32_t writes = hostPinWrites()[33];
+    engine.evaluate(zoneOpened(5));
+    TEST_ASSERT_EQUAL(writes + 1, hostPinWrites()[33]);
+    TEST_ASSERT_EQUAL(HIGH, hostPinLevels()[33]);
+}
+
+// One bad pin refuses the whole set and leaves the running rules alone
+void test_rule_set_with_unusable_pin_is_refused(void) {
+    RuleEngine engine;
+    engine.reservePin(LED_PIN);
+    uint8_t image[sizeof(RuleFileHeader) + 2 * sizeof(RuleRecord)];
+    const uint8_t good[] = {4};
+    TEST_ASSERT_TRUE(engine.loadFromBuffer(image, buildImage(image, good, 1)));
+
+    // Reserved by the firmware, SPI flash, console UART, input only, no such pad
+    const uint8_t bad[] = {LED_PIN, 6, 11, 1, 34, 39, 24, 40, 255};
+    for (uint8_t i = 0; i < sizeof(bad); i++) {
+        const uint8_t pins[] = {5, bad[i]};
+        TEST_ASSERT_FALSE_MESSAGE(engine.loadFromBuffer(image, buildImage(image, pins, 2)), "bad pin accepted");
+    }
+    TEST_ASSERT_EQUAL(1, engine.getRuleCount());
+
+    uint32_t writes[64];
+    memcpy(writes, hostPinWrites(), sizeof(writes));
+    engine.evaluate(zoneOpened(5));
+    TEST_ASSERT_EQUAL(writes[4] + 1, hostPinWrites()[4]);
+    TEST_ASSERT_EQUAL(writes[5], hostPinWrites()[5]);
+    TEST_ASSERT_EQUAL(writes[LED_PIN], hostPinWrites()[LED_PIN]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_free_output_pins_load_and_fire);
+    RUN_TEST(test_rule_set_with_unusable_pin_is_refused);
+    return UNITY_END();
+}
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""Minimal MQTT-over-TLS broker stand-in for testing the bridge's TLS client.
+
+Accepts TLS 1.2 connections, answers CONNECT, SUBSCRIBE and PINGREQ, and
+counts PUBLISHes. For each connection it prints how long the handshake took
+on this side and whether the session was resumed. Both session IDs and
+session tickets are on; --no-tickets leaves only session IDs.
+
+Create a CA and a server certificate for the address the bridge will use
+(needs the openssl command):
+
+    python3 mqtt_tls_standin.py --make-certs certs --host 192.168.1.20
+
+then pack the CA for the bridge and start the stand-in:
+
+    python3 tls_bundle.py --ca certs/ca.pem -o tls.bin
+    python3 mqtt_tls_standin.py --cert certs/server.pem --key certs/server.key
+
+Point the bridge's MQTT server at this host, port 8883. After the first
+connection, restarting the bridge or dropping the link should show
+'resumed'. Restarting the stand-in discards its session cache and ticket
+keys, so the next connection is a full handshake again.
+
+Messages are not routed between clients; this is only for the bridge.
+"""
+
+import argparse
+import ipaddress
+import os
+import socket
+import ssl
+import subprocess
+import threading
+import time
+
+CONNECT = 1
+CONNACK = 2
+PUBLISH = 3
+PUBACK = 4
+SUBSCRIBE = 8
+SUBACK = 9
+PINGREQ = 12
+PINGRESP = 13
+DISCONNECT = 14
+
+stats_lock = threading.Lock()
+stats = {"connections": 0, "resumed": 0, "full": 0, "publishes": 0}
+
+
+def read_exact(conn, n):
+    data = b""
+    while len(data) < n:
+        chunk = conn.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("closed")
+        data += chunk
+    return data
+
+
+def read_packet(conn):
+    """(type, flags, body) of the next MQTT packet."""
+    first = read_exact(conn, 1)[0]
+    length, shift = 0, 0
+    while True:
+        byte = read_exact(conn, 1)[0]
+        length |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            break
+        shift += 7
+    return first >> 4, first & 0x0F, read_exact(conn, length)
+
+
+def packet(kind, body=b"", flags=0):
+    header = bytes([(kind << 4) | flags])
+    length = len(body)
+    while True:
+        byte = length & 0x7F
+        length >>= 7
+        header += bytes([byte | (0x80 if length else 0)])
+        if not length:
+            return header + body
+
+
+def serve_mqtt(conn, name, verbose):
+    publishes = 0
+    while True:
+        kind, flags, body = read_packet(conn)
+        if kind == CONNECT:
+            conn.sendall(packet(CONNACK, b"\x00\x00"))  # Accepted
+        elif kind == SUBSCRIBE:
+            packet_id = body[:2]
+            topics, i = [], 2
+            while i < len(body):
+                size = int.from_bytes(body[i:i + 2], "big")
+                topics.append(body[i + 2:i + 2 + size].decode(errors="replace"))
+                i += 2 + size + 1
+            conn.sendall(packet(SUBACK, packet_id + b"\x00" * len(topics)))
+            if verbose:
+                print(f"{name}: subscribed to {', '.join(topics)}")
+        elif kind == PUBLISH:
+            size = int.from_bytes(body[:2], "big")
+            topic = body[2:2 + size].decode(errors="replace")
+            qos = (flags >> 1) & 3
+            if qos:
+                conn.sendall(packet(PUBACK, body[2 + size:4 + size]))
+            publishes += 1
+            with stats_lock:
+                stats["publishes"] += 1
+            if verbose:
+                print(f"{name}: publish {topic} ({len(body) - 2 - size - (2 if qos else 0)} bytes)")
+        elif kind == PINGREQ:
+            conn.sendall(packet(PINGRESP))
+        elif kind == DISCONNECT:
+            return publishes
+
+
+def handle(raw, address, context, verbose):
+    name = f"{address[0]}:{address[1]}"
+    start = time.monotonic()
+    try:
+        conn = context.wrap_socket(raw, server_side=True)
+    except (ssl.SSLError, OSError) as e:
+        print(f"{name}: handshake failed: {e}")
+        raw.close()
+        return
+    elapsed = (time.monotonic() - start) * 1000
+    resumed = conn.session_reused
+    with stats_lock:
+        stats["connections"] += 1
+        stats["resumed" if resumed else "full"] += 1
+    print(f"{name}: {'resumed' if resumed else 'full'} handshake, {elapsed:.0f} ms, {conn.version()} {conn.cipher()[0]}")
+
+    publishes = 0
+    try:
+        publishes = serve_mqtt(conn, name, verbose)
+    except (ConnectionError, ssl.SSLError, OSError):
+        pass
+    finally:
+        # OpenSSL drops a session from its cache unless close_notify was sent
+        try:
+            conn.unwrap()
+        except (ssl.SSLError, OSError):
+            pass
+        conn.close()
+    print(f"{name}: closed after {publishes} publishes")
+
+
+def make_certs(directory, host):
+    os.makedirs(directory, exist_ok=True)
+    ca_key, ca_cert = os.path.join(directory, "ca.key"), os.path.join(directory, "ca.pem")
+    key, csr, cert = (os.path.join(directory, f) for f in ("server.key", "server.csr", "server.pem"))
+    ext = os.path.join(directory, "server.ext")
+
+    # mbedtls matches the host the bridge connects to against DNS names
+    # only, so an IP address goes in as a DNS name too
+    names = [f"DNS:{host}"]
+    try:
+        ipaddress.ip_address(host)
+        names.append(f"IP:{host}")
+    except ValueError:
+        pass
+    with open(ext, "w") as f:
+        f.write(f"subjectAltName={','.join(names)}\n")
+
+    ec = ["-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1", "-nodes"]
+    run = lambda *args: subprocess.run(["openssl", *args], check=True, capture_output=True)
+    run("req", "-x509", *ec, "-keyout", ca_key, "-out", ca_cert, "-days", "3650", "-subj", "/CN=Paradox bridge test CA")
+    run("req", *ec, "-keyout", key, "-out", csr, "-subj", f"/CN={host}")
+    run("x509", "-req", "-in", csr, "-CA", ca_cert, "-CAkey", ca_key, "-CAcreateserial",
+        "-out", cert, "-days", "825", "-extfile", ext)
+    print(f"Wrote {ca_cert}, {cert} and {key} for {host}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--make-certs", metavar="DIR", help="create a CA and server certificate in DIR, then exit")
+    parser.add_argument("--host", help="name or address the bridge connects to, for --make-certs")
+    parser.add_argument("--cert", help="server certificate (PEM)")
+    parser.add_argument("--key", help="server private key (PEM)")
+    parser.add_argument("--client-ca", help="require client certificates signed by this CA")
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8883)
+    parser.add_argument("--no-tickets", action="store_true", help="resume with session IDs only")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print subscriptions and publishes")
+    args = parser.parse_args()
+
+    if args.make_certs:
+        if not args.host:
+            parser.error("--make-certs needs --host")
+        make_certs(args.make_certs, args.host)
+        return
+    if not args.cert or not args.key:
+        parser.error("--cert and --key are required")
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    # The bridge speaks TLS 1.2, where resumption is visible on the server
+    context.minimum_version = ssl.TLSVersion.TLSv1_2
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    context.load_cert_chain(args.cert, args.key)
+    if args.client_ca:
+        context.load_verify_locations(args.client_ca)
+        context.verify_mode = ssl.CERT_REQUIRED
+    if args.no_tickets:
+        context.options |= ssl.OP_NO_TICKET
+
+    server = socket.create_server((args.bind, args.port))
+    print(f"Listening on {args.bind}:{args.port} (TLS 1.2, session tickets {'off' if args.no_tickets else 'on'})")
+    try:
+        while True:
+            raw, address = server.accept()
+            threading.Thread(target=handle, args=(raw, address, context, args.verbose), daemon=True).start()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.close()
+        with stats_lock:
+            print(f"\n{stats['connections']} connections: {stats['full']} full, {stats['resumed']} resumed; "
+                  f"{stats['publishes']} publishes")
+
+
+if __name__ == "__main__":
+    main()
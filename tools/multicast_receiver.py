@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""Reference receiver for the bridge's UDP multicast event stream.
+
+Joins the group, verifies each datagram's HMAC, drops replays and reports
+gaps in the event sequence. Events are printed one per line:
+
+    python3 multicast_receiver.py --key "$MULTICAST_KEY"
+
+--bench runs a sender and a receiver over loopback instead and reports
+throughput and send-to-verify latency for the receive path:
+
+    python3 multicast_receiver.py --key test --bench --count 100000
+"""
+
+import argparse
+import hashlib
+import hmac
+import socket
+import struct
+import threading
+import time
+
+MAGIC = 0x5850
+VERSION = 1
+BATCH_MAX = 8
+TAG_SIZE = 16
+HEADER = struct.Struct("<HBBII")   # magic, version, count, sequence, sent_at
+EVENT = struct.Struct("<IBBBB")    # timestamp, event, sub_event, partition, panel
+BODY_SIZE = HEADER.size + BATCH_MAX * EVENT.size
+DATAGRAM_SIZE = BODY_SIZE + TAG_SIZE
+
+
+def sign(key, body):
+    return hmac.new(key, body, hashlib.sha256).digest()[:TAG_SIZE]
+
+
+def parse(key, data):
+    """Returns (sequence, sent_at, events) or None if the datagram is not valid."""
+    if len(data) != DATAGRAM_SIZE:
+        return None
+    body, tag = data[:BODY_SIZE], data[BODY_SIZE:]
+    if not hmac.compare_digest(sign(key, body), tag):
+        return None
+    magic, version, count, sequence, sent_at = HEADER.unpack_from(body)
+    if magic != MAGIC or version != VERSION or not 1 <= count <= BATCH_MAX:
+        return None
+    events = [EVENT.unpack_from(body, HEADER.size + i * EVENT.size) for i in range(count)]
+    return sequence, sent_at, events
+
+
+def build(key, sequence, sent_at, events):
+    body = bytearray(BODY_SIZE)
+    HEADER.pack_into(body, 0, MAGIC, VERSION, len(events), sequence, sent_at)
+    for i, event in enumerate(events):
+        EVENT.pack_into(body, HEADER.size + i * EVENT.size, *event)
+    return bytes(body) + sign(key, bytes(body))
+
+
+def open_receiver(group, port, interface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(("", port))
+    membership = socket.inet_aton(group) + socket.inet_aton(interface)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+    return sock
+
+
+class SequenceTracker:
+    """Events carry consecutive journal sequence numbers, so any jump is a loss."""
+
+    def __init__(self):
+        self.next = None
+        self.lost = 0
+        self.replayed = 0
+
+    def accept(self, sequence, count):
+        if self.next is not None and sequence < self.next:
+            # Old or repeated datagram. The journal sequence survives reboots,
+            # so this is never a legitimate restart.
+            self.replayed += 1
+            return False
+        if self.next is not None:
+            self.lost += sequence - self.next
+        self.next = sequence + count
+        return True
+
+
+def receive(args):
+    key = args.key.encode()
+    sock = open_receiver(args.group, args.port, args.interface)
+    tracker = SequenceTracker()
+    rejected = 0
+    print(f"Listening on {args.group}:{args.port}")
+    while True:
+        data, sender = sock.recvfrom(2048)
+        parsed = parse(key, data)
+        if parsed is None:
+            rejected += 1
+            print(f"Rejected datagram from {sender[0]} ({rejected} so far)")
+            continue
+        sequence, sent_at, events = parsed
+        lost = tracker.lost
+        if not tracker.accept(sequence, len(events)):
+            print(f"Ignored replay of sequence {sequence}")
+            continue
+        if tracker.lost != lost:
+            print(f"Lost {tracker.lost - lost} events before sequence {sequence}")
+        for i, (timestamp, event, sub_event, partition, panel) in enumerate(events):
+            print(f"seq={sequence + i} panel={panel} event={event} sub_event={sub_event} "
+                  f"partition={partition} batched_ms={sent_at - timestamp}")
+
+
+def bench(args):
+    key = args.key.encode()
+    group, port = args.group, args.port
+    sock = open_receiver(group, port, "127.0.0.1")
+    sock.settimeout(1.0)
+
+    sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sender.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton("127.0.0.1"))
+    sender.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+
+    datagrams = (args.count + args.batch - 1) // args.batch
+    sent_at = {}
+
+    def send():
+        sequence = 1
+        for _ in range(datagrams):
+            events = [(sequence + i, 1, (sequence + i) % 32 + 1, 1, 1) for i in range(args.batch)]
+            payload = build(key, sequence, 0, events)
+            sent_at[sequence] = time.perf_counter()
+            sender.sendto(payload, (group, port))
+            sequence += args.batch
+            if args.rate:
+                time.sleep(1.0 / args.rate)
+
+    thread = threading.Thread(target=send)
+    tracker = SequenceTracker()
+    latencies = []
+    received = 0
+    start = time.perf_counter()
+    thread.start()
+    while received < datagrams:
+        try:
+            data = sock.recv(2048)
+        except socket.timeout:
+            break
+        parsed = parse(key, data)
+        now = time.perf_counter()
+        if parsed is None:
+            continue
+        sequence, _, events = parsed
+        tracker.accept(sequence, len(events))
+        latencies.append(now - sent_at.get(sequence, now))
+        received += 1
+    elapsed = time.perf_counter() - start
+    thread.join()
+
+    latencies.sort()
+    def percentile(p):
+        return latencies[min(len(latencies) - 1, int(len(latencies) * p))] * 1e6 if latencies else 0.0
+
+    print(f"datagrams: {received}/{datagrams} received, {tracker.lost} events lost")
+    print(f"throughput: {received / elapsed:.0f} datagrams/s, {received * args.batch / elapsed:.0f} events/s")
+    print(f"latency us: p50={percentile(0.5):.0f} p90={percentile(0.9):.0f} "
+          f"p99={percentile(0.99):.0f} max={percentile(1.0):.0f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--key", required=True, help="MULTICAST_KEY the bridge was built with")
+    parser.add_argument("--group", default="239.255.80.1")
+    parser.add_argument("--port", type=int, default=5580)
+    parser.add_argument("--interface", default="0.0.0.0", help="Local address to join the group on")
+    parser.add_argument("--bench", action="store_true", help="Loopback benchmark instead of receiving")
+    parser.add_argument("--count", type=int, default=50000, help="Bench: events to send")
+    parser.add_argument("--batch", type=int, default=1, choices=range(1, BATCH_MAX + 1), help="Bench: events per datagram")
+    parser.add_argument("--rate", type=float, default=0, help="Bench: datagrams/s, 0 = as fast as possible")
+    args = parser.parse_args()
+    if args.bench:
+        bench(args)
+    else:
+        receive(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,484 @@
+#!/usr/bin/env python3
+"""Paradox SP-series panel simulator for load and soak testing the bridge.
+
+Speaks the 37-byte serial protocol as ParadoxHandler expects it: answers
+login init (0x5F) and password (0x00) with 0x10, arm/disarm (0x40) with 0x41
+status requests (0x50) with 0x51 zone or partition pages, and EEPROM reads
+(0x50 with the RAM bit clear) with 16-byte labels or event log blocks.
+Between commands it sends 0xE* event frames, scripted or random, at a set
+rate, and keeps them in an event log ring the bridge can catch up from.
+Optional faults are line noise, corrupted frames, panel disconnects (0x70)
+and slow replies.
+
+Attach it to a USB-serial adapter wired to the bridge's panel UART:
+
+    python3 paradox_simulator.py --device /dev/ttyUSB0 --rate 10
+
+or expose a pseudo-terminal for a host-side consumer:
+
+    python3 paradox_simulator.py --pty --link /tmp/paradox --rate 50
+
+With a bridge built with MULTICAST_ENABLED, --multicast-key counts what the
+bridge actually decoded. --ramp then steps the rate up until events go
+missing, and reports the highest lossless rate:
+
+    python3 paradox_simulator.py --device /dev/ttyUSB0 --multicast-key secret --ramp 5:5:30
+
+For a bridge built with PARADOX_CATCHUP_ENABLED, the script command
+'offline <count>' logs events without sending them and then drops the
+session, so the bridge logs in again and reads them back from the log. The
+bridge reports the catch-up rate in diagnostics (catchup.last_events_per_sec).
+
+At 9600 baud the wire carries at most ~25 frames/s; a pty has no such limit.
+"""
+
+import argparse
+import json
+import os
+import random
+import select
+import socket
+import sys
+import termios
+import threading
+import time
+import tty
+
+import multicast_receiver
+
+FRAME_SIZE = 37
+# EEPROM label blocks as the bridge reads them: (first address, count, name)
+LABEL_RANGES = [(0x010, 32, "zones"), (0x310, 2, "partitions"), (0x330, 48, "users")]
+LABEL_SIZE = 16
+# Event log as the bridge expects it at PARADOX_EVENT_LOG_ADDRESS: a header
+# block (entry count BE32, ring size BE16), then 8-byte entries two per block
+EVENT_LOG_ADDRESS = 0x0800
+EVENT_LOG_ENTRY_SIZE = 8
+BAUD_RATES = {9600: termios.B9600, 19200: termios.B19200, 38400: termios.B38400,
+              57600: termios.B57600, 115200: termios.B115200}
+
+
+def checksum(data):
+    return sum(data[:36]) % 256
+
+
+def frame(start, fields=None):
+    data = bytearray(FRAME_SIZE)
+    data[0] = start
+    for index, value in (fields or {}).items():
+        data[index] = value
+    data[36] = checksum(data)
+    return data
+
+
+class FrameReader:
+    """Sliding-window resync: drop one byte at a time until the checksum holds."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.discarded = 0
+
+    def feed(self, data):
+        self.buffer += data
+        frames = []
+        while len(self.buffer) >= FRAME_SIZE:
+            candidate = self.buffer[:FRAME_SIZE]
+            if checksum(candidate) == candidate[36]:
+                frames.append(bytes(candidate))
+                del self.buffer[:FRAME_SIZE]
+            else:
+                del self.buffer[0]
+                self.discarded += 1
+        return frames
+
+
+class Panel:
+    def __init__(self, args, port):
+        self.args = args
+        self.port = port
+        self.lock = threading.Lock()
+        self.reader = FrameReader()
+        self.rng = random.Random(args.seed)
+        self.logged_in = False
+        self.session = bytes(self.rng.randrange(256) for _ in range(6))
+        self.open_zones = 0
+        self.bell = False
+        self.partition = 11  # Sub-event as the bridge reports it: 11 disarmed, 12 away, 3 stay, 4 sleep
+        self.running = True
+        self.labels = load_labels(args.labels)
+        self.log_entries = bytearray(args.log_size * EVENT_LOG_ENTRY_SIZE)
+        self.log_count = 0
+        self.stats = {"events": 0, "replies": 0, "commands": 0, "noise_bytes": 0,
+                      "corrupted": 0, "disconnects": 0, "slow_replies": 0, "label_reads": 0,
+                      "logged": 0, "log_reads": 0}
+        for _ in range(args.backlog):
+            self.log_event(*self.random_event())
+
+    # --- Output -----------------------------------------------------------
+
+    def write(self, data, corruptible=True):
+        if corruptible and self.rng.random() < self.args.noise:
+            garbage = bytes(self.rng.randrange(256) for _ in range(self.rng.randint(1, 12)))
+            self.stats["noise_bytes"] += len(garbage)
+            data = garbage + data
+        if corruptible and self.rng.random() < self.args.corrupt:
+            data = bytearray(data)
+            data[-self.rng.randint(2, FRAME_SIZE)] ^= 1 << self.rng.randrange(8)
+            self.stats["corrupted"] += 1
+        with self.lock:
+            view = memoryview(bytes(data))
+            while view:
+                written = os.write(self.port, view)
+                view = view[written:]
+
+    def reply(self, data):
+        self.stats["replies"] += 1
+        if self.rng.random() < self.args.slow:
+            self.stats["slow_replies"] += 1
+            threading.Timer(self.args.slow_ms / 1000.0, self.write, (data,)).start()
+        else:
+            self.write(data)
+
+    def send_event(self, event, sub_event, partition=1):
+        now = time.localtime()
+        self.write(frame(0xE2, {1: 20, 2: now.tm_year % 100, 3: now.tm_mon, 4: now.tm_mday,
+                                5: now.tm_hour, 6: now.tm_min,
+                                7: event, 8: sub_event, 9: partition}))
+        self.stats["events"] += 1
+        self.log_event(event, sub_event, partition)
+
+    def log_event(self, event, sub_event, partition=1):
+        """Records an event in the panel's log, whether or not it was sent."""
+        now = time.localtime()
+        slot = self.log_count % self.args.log_size * EVENT_LOG_ENTRY_SIZE
+        self.log_entries[slot:slot + EVENT_LOG_ENTRY_SIZE] = bytes(
+            (now.tm_year % 100, now.tm_mon, now.tm_mday, now.tm_hour, now.tm_min, event, sub_event, partition))
+        self.log_count += 1
+        self.stats["logged"] += 1
+        self.apply_event(event, sub_event)
+
+    def disconnect(self):
+        self.logged_in = False
+        self.stats["disconnects"] += 1
+        self.write(frame(0x70), corruptible=False)
+
+    # --- Panel model ------------------------------------------------------
+
+    def apply_event(self, event, sub_event):
+        if event in (0, 1) and 1 <= sub_event <= 32:
+            bit = 1 << (sub_event - 1)
+            self.open_zones = self.open_zones | bit if event == 1 else self.open_zones & ~bit
+        elif event == 3 and sub_event <= 1:
+            self.bell = sub_event == 1
+        elif event == 2 and sub_event in (11, 12):
+            self.partition = sub_event
+        elif event == 6 and sub_event in (3, 4):
+            self.partition = sub_event
+
+    def zone_page(self):
+        fields = {3: 0x00, 4: 1 if self.bell else 0}
+        for i in range(4):
+            fields[19 + i] = (self.open_zones >> (i * 8)) & 0xFF
+        return frame(0x51, fields)
+
+    def partition_page(self):
+        bits = {12: 0x01, 3: 0x04, 4: 0x02}.get(self.partition, 0)
+        if self.bell:
+            bits |= 0x10  # A ringing bell reads as the partition in alarm
+        return frame(0x51, {3: 0x01, 17: bits})
+
+    def label_block(self, address):
+        fields = {4: address >> 8, 5: address & 0xFF}
+        for start, count, section in LABEL_RANGES:
+            if start <= address < start + count * LABEL_SIZE:
+                number = (address - start) // LABEL_SIZE + 1
+                text = self.labels[section].get(number, "").encode("ascii", "replace")[:LABEL_SIZE]
+                for i, b in enumerate(text.ljust(LABEL_SIZE)):
+                    fields[6 + i] = b
+        return frame(0x52, fields)
+
+    def log_block(self, address):
+        fields = {4: address >> 8, 5: address & 0xFF}
+        if address == EVENT_LOG_ADDRESS:
+            data = self.log_count.to_bytes(4, "big") + self.args.log_size.to_bytes(2, "big")
+        else:
+            offset = address - EVENT_LOG_ADDRESS - LABEL_SIZE
+            data = self.log_entries[offset:offset + LABEL_SIZE]
+        for i, b in enumerate(data):
+            fields[6 + i] = b
+        return frame(0x52, fields)
+
+    def is_log_address(self, address):
+        end = EVENT_LOG_ADDRESS + LABEL_SIZE + len(self.log_entries)
+        return EVENT_LOG_ADDRESS <= address < end and (address - EVENT_LOG_ADDRESS) % LABEL_SIZE == 0
+
+    # --- Input ------------------------------------------------------------
+
+    def handle(self, request):
+        command = request[0]
+        self.stats["commands"] += 1
+        if command == 0x70:
+            self.logged_in = False
+        elif command == 0x5F:
+            self.session = bytes(self.rng.randrange(256) for _ in range(6))
+            self.reply(frame(0x10, {4 + i: b for i, b in enumerate(self.session)}))
+        elif command == 0x00:
+            if request[4:10] != self.session or request[14:17] != self.password_bytes():
+                log("Login rejected: wrong session bytes or password")
+                self.reply(frame(0x70))
+                return
+            self.logged_in = True
+            self.reply(frame(0x10))
+        elif not self.logged_in:
+            log(f"Ignoring 0x{command:02X} outside a session")
+        elif command == 0x40:
+            self.reply(frame(0x41, {3: request[3]}))
+            if request[33] == 0x01:
+                self.send_event(2, 11, request[3])
+            elif request[2] == 0x0B:
+                self.send_event(6, 3, request[3])
+            elif request[2] == 0x0C:
+                self.send_event(6, 4, request[3])
+            else:
+                self.send_event(2, 12, request[3])
+        elif command == 0x50 and not request[2] & 0x80:
+            address = request[4] << 8 | request[5]
+            if self.is_log_address(address):
+                self.stats["log_reads"] += 1
+                self.reply(self.log_block(address))
+            else:
+                self.stats["label_reads"] += 1
+                self.reply(self.label_block(address))
+        elif command == 0x50:
+            self.reply(self.partition_page() if request[3] == 0x01 else self.zone_page())
+        else:
+            log(f"Unhandled command 0x{command:02X}")
+
+    def password_bytes(self):
+        # As ParadoxHandler packs it: two BCD digits per byte, 4 or 6 digits
+        password = self.args.password
+        digits = password[:6] if len(password) == 6 else password[:4] + "00"
+        return bytes(int(digits[i:i + 2], 16) for i in range(0, 6, 2))
+
+    def read_loop(self):
+        while self.running:
+            ready, _, _ = select.select([self.port], [], [], 0.2)
+            if not ready:
+                continue
+            try:
+                data = os.read(self.port, 256)
+            except OSError:
+                # A pty reads EIO while nothing has the other end open
+                time.sleep(0.2)
+                continue
+            for request in self.reader.feed(data):
+                self.handle(request)
+
+    # --- Event sources ----------------------------------------------------
+
+    def random_event(self):
+        roll = self.rng.random()
+        if roll < 0.85:
+            zone = self.rng.randint(1, self.args.zones)
+            return (0 if self.open_zones & (1 << (zone - 1)) else 1), zone
+        if roll < 0.95:
+            return 2, self.rng.choice((13, 14))
+        return 3, 0 if self.bell else 1
+
+    def run_rate(self, rate, duration):
+        """Sends random events at rate/s for duration seconds. Returns events sent."""
+        sent = 0
+        start = time.monotonic()
+        interval = 1.0 / rate
+        next_disconnect = start + self.args.disconnect_every if self.args.disconnect_every else None
+        while self.running and time.monotonic() - start < duration:
+            now = time.monotonic()
+            if next_disconnect and now >= next_disconnect:
+                self.disconnect()
+                next_disconnect = now + self.args.disconnect_every
+            self.send_event(*self.random_event())
+            sent += 1
+            # Pace against the start time so send jitter does not add up
+            delay = start + sent * interval - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        return sent
+
+    def run_script(self, path):
+        """Script lines: <delay_ms> <event> <sub_event> [partition], 'disconnect',
+        'label <zones|partitions|users> <number> <text>' to rename as an installer would,
+        or 'offline <count>' to log random events the bridge misses, then disconnect."""
+        with open(path) as script:
+            for line in script:
+                line = line.split("#", 1)[0].split()
+                if not line or not self.running:
+                    continue
+                if line[0] == "disconnect":
+                    self.disconnect()
+                    continue
+                if line[0] == "label":
+                    # Programming mode entered and left, as the keypad reports it
+                    self.labels[line[1]][int(line[2])] = " ".join(line[3:])
+                    self.send_event(48, 4)
+                    self.send_event(48, 5)
+                    continue
+                if line[0] == "offline":
+                    for _ in range(int(line[1])):
+                        self.log_event(*self.random_event())
+                    self.disconnect()
+                    continue
+                time.sleep(int(line[0]) / 1000.0)
+                partition = int(line[3]) if len(line) > 3 else 1
+                self.send_event(int(line[1]), int(line[2]), partition)
+
+
+def load_labels(path):
+    """Default labels, overridden by a JSON file like {"zones": {"1": "Front door"}}."""
+    labels = {section: {n: f"{section[:-1].title()} {n}" for n in range(1, count + 1)}
+              for _start, count, section in LABEL_RANGES}
+    if path:
+        with open(path) as source:
+            for section, names in json.load(source).items():
+                labels[section].update({int(n): text for n, text in names.items()})
+    return labels
+
+
+class MulticastCounter:
+    """Counts events the bridge re-published on the LAN multicast stream."""
+
+    def __init__(self, args):
+        self.key = args.multicast_key.encode()
+        self.sock = multicast_receiver.open_receiver(args.multicast_group, args.multicast_port, args.interface)
+        self.sock.settimeout(0.2)
+        self.tracker = multicast_receiver.SequenceTracker()
+        self.events = 0
+        self.running = True
+        threading.Thread(target=self.loop, daemon=True).start()
+
+    def loop(self):
+        while self.running:
+            try:
+                data = self.sock.recv(2048)
+            except socket.timeout:
+                continue
+            parsed = multicast_receiver.parse(self.key, data)
+            if parsed and self.tracker.accept(parsed[0], len(parsed[2])):
+                self.events += len(parsed[2])
+
+
+def open_port(args):
+    if args.pty:
+        master, slave = os.openpty()
+        tty.setraw(slave)
+        name = os.ttyname(slave)
+        if args.link:
+            if os.path.islink(args.link):
+                os.unlink(args.link)
+            os.symlink(name, args.link)
+            name = f"{args.link} -> {name}"
+        log(f"Panel on {name}")
+        # Keep our copy of the slave open so reads do not fail between clients
+        return master, slave
+    fd = os.open(args.device, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    attrs[4] = attrs[5] = BAUD_RATES[args.baud]
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    log(f"Panel on {args.device} at {args.baud} baud")
+    return fd, None
+
+
+def log(message):
+    print(time.strftime("%H:%M:%S ") + message, flush=True)
+
+
+def report(panel, counter):
+    stats = " ".join(f"{k}={v}" for k, v in panel.stats.items())
+    line = f"logged_in={int(panel.logged_in)} {stats} rx_discarded={panel.reader.discarded}"
+    if counter:
+        line += f" bridge_events={counter.events} bridge_lost={counter.tracker.lost}"
+    log(line)
+
+
+def ramp(panel, counter, spec):
+    start, step, seconds = (float(x) for x in spec.split(":"))
+    rate = start
+    best = None
+    while panel.running:
+        before = counter.events
+        sent = panel.run_rate(rate, seconds)
+        time.sleep(2.0)  # Let the bridge drain its queues
+        received = counter.events - before
+        log(f"rate={rate:g}/s sent={sent} received={received}")
+        if received < sent:
+            break
+        best = rate
+        rate += step
+    if best is None:
+        log("Events were lost at the starting rate")
+    else:
+        log(f"Highest rate without loss: {best:g} events/s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    where = parser.add_mutually_exclusive_group(required=True)
+    where.add_argument("--device", help="Serial device wired to the bridge's panel UART")
+    where.add_argument("--pty", action="store_true", help="Create a pseudo-terminal instead")
+    parser.add_argument("--link", help="With --pty: symlink to create for the terminal")
+    parser.add_argument("--baud", type=int, default=9600, choices=sorted(BAUD_RATES))
+    parser.add_argument("--password", default="1234", help="Panel code the bridge must log in with")
+    parser.add_argument("--labels", help="JSON file of zone, partition and user labels")
+    parser.add_argument("--log-size", type=int, default=256, help="Entries in the panel's event log ring")
+    parser.add_argument("--backlog", type=int, default=0, help="Events logged before the simulator starts")
+    parser.add_argument("--rate", type=float, default=1.0, help="Random events per second, 0 = none")
+    parser.add_argument("--duration", type=float, default=float("inf"), help="Seconds to run")
+    parser.add_argument("--script", help="Play events from a script instead of random ones")
+    parser.add_argument("--zones", type=int, default=32, help="Zones used by random events")
+    parser.add_argument("--noise", type=float, default=0.0, help="Chance of garbage bytes before a frame")
+    parser.add_argument("--corrupt", type=float, default=0.0, help="Chance of a bit flip in a frame")
+    parser.add_argument("--disconnect-every", type=float, default=0, help="Seconds between panel disconnects")
+    parser.add_argument("--slow", type=float, default=0.0, help="Chance a reply is delayed")
+    parser.add_argument("--slow-ms", type=int, default=800, help="Delay for slow replies")
+    parser.add_argument("--seed", type=int, help="Random seed for a repeatable run")
+    parser.add_argument("--stats-interval", type=float, default=10.0)
+    parser.add_argument("--multicast-key", help="Count events the bridge publishes over multicast")
+    parser.add_argument("--multicast-group", default="239.255.80.1")
+    parser.add_argument("--multicast-port", type=int, default=5580)
+    parser.add_argument("--interface", default="0.0.0.0", help="Local address to join the group on")
+    parser.add_argument("--ramp", metavar="START:STEP:SECONDS", help="Step the rate up until events are lost")
+    args = parser.parse_args()
+    if args.log_size < 2 or args.log_size % 2 or args.log_size > 1024:
+        parser.error("--log-size must be even, between 2 and 1024")
+    if args.ramp and not args.multicast_key:
+        parser.error("--ramp needs --multicast-key to see what the bridge received")
+
+    port, _slave = open_port(args)
+    panel = Panel(args, port)
+    counter = MulticastCounter(args) if args.multicast_key else None
+    threading.Thread(target=panel.read_loop, daemon=True).start()
+
+    def stats_loop():
+        while panel.running:
+            time.sleep(args.stats_interval)
+            report(panel, counter)
+    threading.Thread(target=stats_loop, daemon=True).start()
+
+    try:
+        if args.ramp:
+            ramp(panel, counter, args.ramp)
+        elif args.script:
+            panel.run_script(args.script)
+        elif args.rate > 0:
+            panel.run_rate(args.rate, args.duration)
+        else:
+            time.sleep(args.duration)
+    except KeyboardInterrupt:
+        pass
+    panel.running = False
+    report(panel, counter)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Pack PEM certificates and a key into the bridge's TLS credentials bundle.
+
+The bundle is what TlsClient loads from /tls.bin on LittleFS: a 12-byte
+header (magic "PXTS", version, entry count, CRC-32 of the entries) followed
+by entries of type (1 byte), length (2 bytes, little-endian) and DER bytes.
+DER is about a quarter smaller than PEM and needs no parsing of base64 on
+the bridge.
+
+    python3 tls_bundle.py --ca ca.pem -o tls.bin
+    python3 tls_bundle.py --ca ca.pem --cert bridge.pem --key bridge.key -o tls.bin
+
+Upload it and restart the bridge:
+
+    curl --user ParadoxConfig:paradox123 -T tls.bin http://paradox-mqtt-bridge.local/api/tls
+
+The key must not be encrypted. A PEM file may hold several CA certificates.
+"""
+
+import argparse
+import base64
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = 0x53545850  # "PXTS"
+VERSION = 1
+MAX_SIZE = 8192
+
+ENTRY_CA = 1
+ENTRY_CLIENT_CERT = 2
+ENTRY_CLIENT_KEY = 3
+
+PEM_BLOCK = re.compile(r"-----BEGIN ([A-Z ]+)-----(.*?)-----END \1-----", re.S)
+
+
+def pem_blocks(path):
+    """(label, DER bytes) for each PEM block in the file."""
+    with open(path) as f:
+        text = f.read()
+    blocks = [(label, base64.b64decode("".join(body.split())))
+              for label, body in PEM_BLOCK.findall(text)]
+    if not blocks:
+        sys.exit(f"{path}: no PEM blocks found")
+    return blocks
+
+
+def certificates(path):
+    ders = [der for label, der in pem_blocks(path) if label == "CERTIFICATE"]
+    if not ders:
+        sys.exit(f"{path}: no certificates found")
+    return ders
+
+
+def private_key(path):
+    for label, der in pem_blocks(path):
+        if label == "ENCRYPTED PRIVATE KEY":
+            sys.exit(f"{path}: key is encrypted; decrypt it with openssl pkey first")
+        if label.endswith("PRIVATE KEY"):
+            return der
+    sys.exit(f"{path}: no private key found")
+
+
+def build(cas, cert, key):
+    entries = [(ENTRY_CA, der) for der in cas]
+    if cert:
+        entries.append((ENTRY_CLIENT_CERT, cert))
+        entries.append((ENTRY_CLIENT_KEY, key))
+    body = b"".join(struct.pack("<BH", kind, len(der)) + der for kind, der in entries)
+    header = struct.pack("<IBBHI", MAGIC, VERSION, len(entries), 0, zlib.crc32(body))
+    return header + body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ca", action="append", required=True, help="PEM file of trusted CA certificates (repeatable)")
+    parser.add_argument("--cert", help="PEM client certificate, for brokers that require one")
+    parser.add_argument("--key", help="PEM private key for --cert, unencrypted")
+    parser.add_argument("-o", "--output", required=True, help="bundle file to write")
+    args = parser.parse_args()
+
+    if bool(args.cert) != bool(args.key):
+        parser.error("--cert and --key go together")
+
+    cas = [der for path in args.ca for der in certificates(path)]
+    cert = certificates(args.cert)[0] if args.cert else None
+    key = private_key(args.key) if args.key else None
+    bundle = build(cas, cert, key)
+    if len(bundle) > MAX_SIZE:
+        sys.exit(f"bundle is {len(bundle)} bytes; the bridge accepts at most {MAX_SIZE}")
+
+    with open(args.output, "wb") as f:
+        f.write(bundle)
+    print(f"{args.output}: {len(cas)} CA certificate(s){', client certificate' if cert else ''}, {len(bundle)} bytes")
+
+
+if __name__ == "__main__":
+    main()